@@ -20,8 +20,10 @@
 
 #include "csclient.hh"
 
+using namespace std;
 
 #define INCLUDE_TEST_CODE 0
+#define INCLUDE_BENCHMARK_CODE 0
 
 
 #define check_init() do { if (!_init) return init_err; } while (false);
@@ -98,6 +100,10 @@ ControlSocketClient::configure(unsigned int host_ip, unsigned short port)
     return click_err; /* wrong version */
   }
 
+  _protocol_minor_version = minor;
+  _rbuf.clear();
+  _rpos = 0;
+  _updates.clear();
   _init = true;
   return no_err;
 }
@@ -124,23 +130,98 @@ ControlSocketClient::readline(string &buf)
 #define MAX_LINE_SZ 1024 /* arbitrary... to prevent weirdness */
 
   /*
-   * keep calling read() to get one character at a time, until we get
-   * a line.  not very ``efficient'', but who cares?
+   * buffer the socket's data, so pipelined responses and handler data
+   * arriving together don't cost a read() per character
    */
-  char c = 0;
   buf.resize(0);
-  do {
-    int res = ::read(_fd, (void *) &c, 1);
-    if (res < 0)
-      return sys_err;
-    if (res != 1)
-      return sys_err;
-    buf += c;
+  while (1) {
+    size_t nl = _rbuf.find('\n', _rpos);
+    if (nl != string::npos) {
+      buf.append(_rbuf, _rpos, nl + 1 - _rpos);
+      _rpos = nl + 1;
+      return (buf.size() > MAX_LINE_SZ ? click_err : no_err);
+    }
+    buf.append(_rbuf, _rpos, string::npos);
+    _rbuf.resize(0);
+    _rpos = 0;
     if (buf.size() > MAX_LINE_SZ)
       return click_err;
+
+    char tmp[4096];
+    int res = ::read(_fd, tmp, sizeof(tmp));
+    if (res <= 0)
+      return sys_err;
+    _rbuf.assign(tmp, res);
+  }
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::readbytes(size_t n, string &buf)
+{
+  buf.assign(_rbuf, _rpos, n);
+  _rpos = min(_rpos + n, _rbuf.size());
+  if (_rpos == _rbuf.size()) {
+    _rbuf.resize(0);
+    _rpos = 0;
+  }
+
+  size_t have = buf.size();
+  if (have < n) {
+    buf.resize(n);
+    while (have < n) {
+      int res = ::read(_fd, &buf[have], n - have);
+      if (res <= 0)
+	return sys_err;
+      have += res;
+    }
+  }
+  return no_err;
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::send(const string &cmd)
+{
+  int res = ::write(_fd, cmd.c_str(), cmd.size());
+  if (res < 0)
+    return sys_err;
+  if ((size_t) res != cmd.size())
+    return sys_err;
+  return no_err;
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::read_response(int &code, string *last_line)
+{
+  string line;
+  while (1) {
+    err_t err = readline(line);
+    if (err != no_err)
+      return err;
+
+    /* subscription updates can precede any response */
+    if (line.compare(0, 5, "PUSH ") == 0) {
+      int id, len;
+      if (sscanf(line.c_str() + 5, "%d %d", &id, &len) != 2 || len < 0)
+	return click_err;
+      string data;
+      if ((err = readbytes(len, data)) != no_err)
+	return err;
+      _updates.push_back(make_pair(id, data));
+      continue;
+    }
+
+    if (line.size() < 4)
+      return click_err;
+    if (line[3] != '-')
+      break;
   }
-  while (c != '\n');
 
+  code = get_resp_code(line);
+  if (last_line)
+    *last_line = line;
   return no_err;
 }
 
@@ -175,54 +256,24 @@ ControlSocketClient::read(string el, string handler, string &response)
     handler = el + "." + handler;
   string cmd = "READ " + handler + "\n";
 
-  int res = ::write(_fd, cmd.c_str(), cmd.size());
-  if (res < 0)
-    return sys_err;
-  if ((size_t) res != cmd.size())
-    return sys_err;
-
-  string cmd_resp;
-  string line;
-  do {
-    err_t err = readline(line);
-    if (err != no_err)
-      return err;
-    if (line.size() < 4)
-      return click_err;
-    cmd_resp += line;
-  }
-  while (line[3] == '-');
+  err_t err = send(cmd);
+  if (err != no_err)
+    return err;
 
-  int code = get_resp_code(line);
+  int code;
+  if ((err = read_response(code)) != no_err)
+    return err;
   if (code != CODE_OK && code != CODE_OK_WARN)
     return handle_err_code(code);
 
-  res = readline(line);
-  if (res < 0)
+  string line;
+  if (readline(line) != no_err)
     return click_err;
   int num = get_data_len(line);
   if (num < 0)
     return click_err;
 
-  response.resize(0);
-  if (num == 0)
-    return no_err;
-
-  char *buf = new char[num];
-  int num_read = 0;
-  while (num_read < num) {
-    res = ::read(_fd, buf + num_read, num - num_read);
-    if (res < 0) {
-      delete[] buf;
-      return sys_err;
-    }
-    num_read += res;
-  }
-
-  response.append(buf, num);
-  delete[] buf;
-
-  return no_err;
+  return readbytes(num, response);
 }
 
 
@@ -267,19 +318,10 @@ ControlSocketClient::write(string el, string handler, const char *buf, int bufsz
   if (res != bufsz)
     return sys_err;
 
-  string cmd_resp;
-  string line;
-  do {
-    err_t err = readline(line);
-    if (err != no_err)
-      return err;
-    if (line.size() < 4)
-      return click_err;
-    cmd_resp += line;
-  }
-  while (line[3] == '-');
-
-  int code = get_resp_code(line);
+  int code;
+  err_t err = read_response(code);
+  if (err != no_err)
+    return err;
   if (code != CODE_OK && code != CODE_OK_WARN)
     {
       cout << "CCCC " << code << endl;
@@ -314,6 +356,197 @@ ControlSocketClient::handle_err_code(int code)
 
 
 
+static uint64_t
+get_net64(const char *s)
+{
+  uint64_t x = 0;
+  for (int i = 0; i < 8; i++)
+    x = (x << 8) | (unsigned char) s[i];
+  return x;
+}
+
+
+static uint32_t
+get_net32(const char *s)
+{
+  return ((unsigned char) s[0] << 24) | ((unsigned char) s[1] << 16)
+    | ((unsigned char) s[2] << 8) | (unsigned char) s[3];
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::decode_values(const string &data, vector<handler_value_t> &values)
+{
+  values.clear();
+  const char *s = data.data(), *end = s + data.size();
+  while (s != end) {
+    handler_value_t v;
+    if (end - s < 3)
+      return click_err;
+    size_t nlen = ((unsigned char) s[0] << 8) | (unsigned char) s[1];
+    if ((size_t) (end - s) < 3 + nlen)
+      return click_err;
+    v.name.assign(s + 2, nlen);
+    s += 2 + nlen;
+    v.type = *s++;
+
+    switch (v.type) {
+    case 'u':
+    case 'i':
+    case 'd':
+      if (end - s < 8)
+	return click_err;
+      v.u = get_net64(s);
+      v.i = (int64_t) v.u;
+      memcpy(&v.d, &v.u, 8);
+      if (v.type == 'u')
+	v.d = (double) v.u;
+      else if (v.type == 'i')
+	v.d = (double) v.i;
+      s += 8;
+      break;
+    case 's':
+    case 'e': {
+      if (v.type == 'e') {
+	if (end - s < 2)
+	  return click_err;
+	v.code = ((unsigned char) s[0] << 8) | (unsigned char) s[1];
+	s += 2;
+      }
+      if (end - s < 4)
+	return click_err;
+      uint32_t len = get_net32(s);
+      if ((uint32_t) (end - s - 4) < len)
+	return click_err;
+      v.s.assign(s + 4, len);
+      s += 4 + len;
+      break;
+    }
+    default:
+      return click_err;
+    }
+    values.push_back(v);
+  }
+  return no_err;
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::read_many(const vector<string> &patterns, vector<handler_value_t> &values)
+{
+  check_init();
+  if (_protocol_minor_version < PROTOCOL_MANY_MINOR_VERSION)
+    return click_err;
+
+  string cmd = "READMANYBIN";
+  for (size_t i = 0; i < patterns.size(); i++)
+    cmd += " " + patterns[i];
+  cmd += "\n";
+
+  err_t err = send(cmd);
+  if (err != no_err)
+    return err;
+
+  int code;
+  if ((err = read_response(code)) != no_err)
+    return err;
+  if (code != CODE_OK && code != CODE_OK_WARN)
+    return handle_err_code(code);
+
+  string line, data;
+  if (readline(line) != no_err)
+    return click_err;
+  int num = get_data_len(line);
+  if (num < 0)
+    return click_err;
+  if ((err = readbytes(num, data)) != no_err)
+    return err;
+  return decode_values(data, values);
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::subscribe(const vector<string> &patterns, unsigned interval_msec, int &id)
+{
+  check_init();
+  if (_protocol_minor_version < PROTOCOL_MANY_MINOR_VERSION)
+    return click_err;
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "SUBSCRIBEBIN %u", interval_msec);
+  string cmd = buf;
+  for (size_t i = 0; i < patterns.size(); i++)
+    cmd += " " + patterns[i];
+  cmd += "\n";
+
+  err_t err = send(cmd);
+  if (err != no_err)
+    return err;
+
+  int code;
+  string line;
+  if ((err = read_response(code, &line)) != no_err)
+    return err;
+  if (code != CODE_OK)
+    return handle_err_code(code);
+  if (sscanf(line.c_str(), "%*d Subscription %d", &id) != 1)
+    return click_err;
+  return no_err;
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::unsubscribe(int id)
+{
+  check_init();
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "UNSUBSCRIBE %d\n", id);
+  err_t err = send(buf);
+  if (err != no_err)
+    return err;
+
+  int code;
+  if ((err = read_response(code)) != no_err)
+    return err;
+  if (code != CODE_OK)
+    return handle_err_code(code);
+
+  /* drop updates that were already queued */
+  for (size_t i = 0; i < _updates.size(); )
+    if (_updates[i].first == id)
+      _updates.erase(_updates.begin() + i);
+    else
+      i++;
+  return no_err;
+}
+
+
+ControlSocketClient::err_t
+ControlSocketClient::next_update(int &id, vector<handler_value_t> &values)
+{
+  check_init();
+
+  string data;
+  if (_updates.size()) {
+    id = _updates[0].first;
+    data = _updates[0].second;
+    _updates.erase(_updates.begin());
+  } else {
+    string line;
+    int len;
+    err_t err = readline(line);
+    if (err != no_err)
+      return err;
+    if (sscanf(line.c_str(), "PUSH %d %d", &id, &len) != 2 || len < 0)
+      return click_err;
+    if ((err = readbytes(len, data)) != no_err)
+      return err;
+  }
+  return decode_values(data, values);
+}
+
+
 vector<string>
 ControlSocketClient::split(string s, size_t offset, char terminator)
 {
@@ -415,25 +648,13 @@ ControlSocketClient::check_handler(string el, string h, bool is_write, bool &exi
     h = el + "." + h;
   string cmd = (is_write ? "CHECKWRITE " : "CHECKREAD ") + h + "\n";
 
-  int res = ::write(_fd, cmd.c_str(), cmd.size());
-  if (res < 0)
-    return sys_err;
-  if ((size_t) res != cmd.size())
-    return sys_err;
-
-  string cmd_resp;
-  string line;
-  do {
-    err_t err = readline(line);
-    if (err != no_err)
-      return err;
-    if (line.size() < 4)
-      return click_err;
-    cmd_resp += line;
-  }
-  while (line[3] == '-');
+  err_t err = send(cmd);
+  if (err != no_err)
+    return err;
 
-  int code = get_resp_code(line);
+  int code;
+  if ((err = read_response(code)) != no_err)
+    return err;
   switch (code) {
   case CODE_OK:
   case CODE_OK_WARN:
@@ -643,3 +864,75 @@ main(int argc, char **argv)
   return 0;
 }
 #endif
+
+
+#if INCLUDE_BENCHMARK_CODE
+
+#include <sys/time.h>
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Compare polling a set of handlers one READ at a time with polling them
+ * in one READMANYBIN.
+ * usage: csclient [IP [PORT [PATTERN [ITERATIONS]]]]
+ */
+int
+main(int argc, char **argv)
+{
+  unsigned long ip = inet_addr(argc > 1 ? argv[1] : "127.0.0.1");
+  unsigned short port = (argc > 2 ? atoi(argv[2]) : 7777);
+  string pattern = (argc > 3 ? argv[3] : "*.*.count");
+  int iterations = (argc > 4 ? atoi(argv[4]) : 100);
+
+  ControlSocketClient cs;
+  if (cs.configure(ip, port) != ControlSocketClient::no_err) {
+    cerr << "cannot connect to " << argv[1] << ":" << port << endl;
+    return 1;
+  }
+
+  vector<string> patterns(1, pattern);
+  vector<ControlSocketClient::handler_value_t> values;
+  if (cs.read_many(patterns, values) != ControlSocketClient::no_err) {
+    cerr << "READMANYBIN failed; is the router older than protocol 1.4?" << endl;
+    return 1;
+  }
+  cout << values.size() << " handlers match " << pattern << endl;
+
+  double t0 = now();
+  for (int it = 0; it < iterations; it++)
+    for (size_t i = 0; i < values.size(); i++) {
+      string v;
+      if (cs.read("", values[i].name, v) != ControlSocketClient::no_err) {
+	cerr << "READ " << values[i].name << " failed" << endl;
+	return 1;
+      }
+    }
+  double t1 = now();
+  for (int it = 0; it < iterations; it++)
+    if (cs.read_many(patterns, values) != ControlSocketClient::no_err) {
+      cerr << "READMANYBIN failed" << endl;
+      return 1;
+    }
+  double t2 = now();
+
+  cout << "READ:        " << (t1 - t0) / iterations * 1000 << " ms per poll" << endl;
+  cout << "READMANYBIN: " << (t2 - t1) / iterations * 1000 << " ms per poll" << endl;
+
+  int id;
+  if (cs.subscribe(patterns, 100, id) == ControlSocketClient::no_err
+      && cs.next_update(id, values) == ControlSocketClient::no_err) {
+    cout << "subscription " << id << ": " << values.size() << " values" << endl;
+    for (size_t i = 0; i < values.size() && i < 5; i++)
+      cout << "  " << values[i].name << " = " << values[i].u << endl;
+    cs.unsubscribe(id);
+  }
+  return 0;
+}
+#endif
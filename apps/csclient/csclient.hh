@@ -10,6 +10,10 @@
 #include <assert.h>
 
 #include <unistd.h>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
 
 /*
  * NB: obscure implementation note: this class does not handle EINTR
@@ -20,8 +24,8 @@
 class ControlSocketClient
 {
 public:
-  ControlSocketClient() : _init(false), _fd(0) { }
-  ControlSocketClient(ControlSocketClient &) : _init(false), _fd(0) { }
+  ControlSocketClient() : _init(false), _fd(0), _rpos(0) { }
+  ControlSocketClient(ControlSocketClient &) : _init(false), _fd(0), _rpos(0) { }
 
   enum err_t {
     no_err = 0,
@@ -185,6 +189,47 @@ public:
    */
   err_t write(string el, string handler, const char *buf, int bufsz);
 
+  struct handler_value_t {
+    string name;        /* full handler name, ``ROUTER.ELEMENT.HANDLER'' */
+    char type;          /* 'u', 'i', 'd', 's', or 'e' (error) */
+    uint64_t u;
+    int64_t i;
+    double d;
+    string s;           /* string value, or error message */
+    int code;           /* ControlSocket error code if type == 'e' */
+    handler_value_t() : type('s'), u(0), i(0), d(0), code(CODE_OK) { }
+  };
+
+  /*
+   * Read many handlers in one request (protocol version 1.4 or later).
+   * PATTERNS are handler names, ``ROUTER.ELEMENT.HANDLER'' or
+   * ``ROUTER.HANDLER'', possibly containing shell wildcards.
+   * VALUES is filled with one entry per handler read, existing contents are replaced.
+   * Numeric handler values are decoded by the router.
+   * Returns: no_err, sys_err, init_err, click_err
+   */
+  err_t read_many(const vector<string> &patterns, vector<handler_value_t> &values);
+
+  /*
+   * Ask the router to send the values of the handlers matching PATTERNS
+   * every INTERVAL_MSEC milliseconds.  ID is filled with the subscription ID.
+   * Returns: no_err, sys_err, init_err, click_err
+   */
+  err_t subscribe(const vector<string> &patterns, unsigned interval_msec, int &id);
+
+  /*
+   * Cancel subscription ID.
+   * Returns: no_err, sys_err, init_err, click_err
+   */
+  err_t unsubscribe(int id);
+
+  /*
+   * Wait for the next subscription update.  ID is filled with its
+   * subscription ID and VALUES with the handler values.
+   * Returns: no_err, sys_err, init_err, click_err
+   */
+  err_t next_update(int &id, vector<handler_value_t> &values);
+
   /*
    * sugar, for reading and writing handlers.
    */
@@ -206,6 +251,10 @@ private:
 
   string _name;
 
+  string _rbuf;         /* data received but not yet consumed */
+  size_t _rpos;
+  vector<std::pair<int, string> > _updates;     /* pushed while awaiting a response */
+
   enum {
     CODE_OK = 200,
     CODE_OK_WARN = 220,
@@ -218,12 +267,20 @@ private:
     CODE_NO_ROUTER = 540,
 
     PROTOCOL_MAJOR_VERSION = 1,
-    PROTOCOL_MINOR_VERSION = 0
+    PROTOCOL_MINOR_VERSION = 0,
+    PROTOCOL_MANY_MINOR_VERSION = 4
   };
 
   /* Try to read a '\n'-terminated line (including the '\n') from the
    * socket.  */
   err_t readline(string &buf);
+  /* Read exactly N bytes from the socket. */
+  err_t readbytes(size_t n, string &buf);
+  /* Read a response's message lines, saving any PUSH updates on the way;
+   * sets CODE to the final response code. */
+  err_t read_response(int &code, string *last_line = 0);
+  err_t send(const string &cmd);
+  err_t decode_values(const string &data, vector<handler_value_t> &values);
 
   int get_resp_code(string line);
   int get_data_len(string line);
@@ -17,6 +17,7 @@
 
 #include <click/config.h>
 #include "aggcounter.hh"
+#include "aggrenumber.hh"
 #include <click/handlercall.hh>
 #include <click/args.hh>
 #include <click/error.hh>
@@ -332,6 +333,46 @@ AggregateCounter::reaggregate_counts()
 }
 
 
+// MERGE
+
+void
+AggregateCounter::merge_nodes(const Node *n, const AggregateRenumberMap *map,
+			      int port, uint32_t &unmapped)
+{
+    if (n->count) {
+	uint32_t agg = n->aggregate;
+	if (map && agg && !(agg = map->lookup(port, agg)))
+	    ++unmapped;
+	else if (Node *m = find_node(agg, _frozen)) {
+	    if (!m->count)
+		_num_nonzero++;
+	    m->count += n->count;
+	    _count += n->count;
+	}
+    }
+
+    if (n->child[0]) {
+	merge_nodes(n->child[0], map, port, unmapped);
+	merge_nodes(n->child[1], map, port, unmapped);
+    }
+}
+
+int
+AggregateCounter::merge(const AggregateCounter *ac,
+			const AggregateRenumberMap *map, int port,
+			ErrorHandler *errh)
+{
+    if (ac == this)
+	return errh->error("cannot merge %p{element} into itself", this);
+    uint32_t unmapped = 0;
+    if (ac->_root)
+	merge_nodes(ac->_root, map, port, unmapped);
+    if (unmapped)
+	errh->warning("%u aggregates from %p{element} were never emitted", unmapped, ac);
+    return 0;
+}
+
+
 // HANDLERS
 
 static void
@@ -427,7 +468,7 @@ AggregateCounter::write_file_handler(const String &data, Element *e, void *thunk
 
 enum {
     AC_FROZEN, AC_ACTIVE, AC_BANNER, AC_STOP, AC_REAGGREGATE, AC_CLEAR,
-    AC_AGGREGATE_CALL, AC_COUNT_CALL, AC_NAGG, AC_COUNT
+    AC_AGGREGATE_CALL, AC_COUNT_CALL, AC_NAGG, AC_COUNT, AC_MERGE
 };
 
 String
@@ -514,6 +555,20 @@ AggregateCounter::write_handler(const String &data, Element *e, void *thunk, Err
 	  ac->_call_count = new_count;
 	  return 0;
       }
+      case AC_MERGE: {
+	  AggregateCounter *other;
+	  AggregateRenumberMap *map = 0;
+	  int port = 0;
+	  if (Args(ac, errh).push_back_words(s)
+	      .read_mp("COUNTER", ElementCastArg("AggregateCounter"), other)
+	      .read_p("MERGE", ElementCastArg("AggregateRenumberMap"), map)
+	      .read_p("PORT", port)
+	      .complete() < 0)
+	      return -1;
+	  if (map && (port < 0 || port >= map->nworkers()))
+	      return errh->error("PORT out of range");
+	  return ac->merge(other, map, port, errh);
+      }
       default:
 	return errh->error("internal error");
     }
@@ -543,6 +598,7 @@ AggregateCounter::add_handlers()
     add_write_handler("count_call", write_handler, AC_COUNT_CALL);
     add_read_handler("count", read_handler, AC_COUNT);
     add_read_handler("nagg", read_handler, AC_NAGG);
+    add_write_handler("merge", write_handler, AC_MERGE);
 }
 
 ELEMENT_REQUIRES(userlevel int64)
@@ -163,6 +163,20 @@ Returns or sets the COUNT_CALL setting.
 
 Returns the number of aggregates that have been seen so far.
 
+=h merge write-only
+
+Argument is 'C<COUNTER> [C<MERGE> C<PORT>]'.  Adds every count in the
+AggregateCounter COUNTER to this element's counts, aggregate by aggregate.
+This combines counters that ran in parallel, such as one per TraceSplit
+worker; sums do not depend on how packets were divided.  If MERGE, a
+TraceMerge element with RENUMBER true, is given, then each of COUNTER's
+aggregates is first translated to the number MERGE assigned to that
+aggregate on input PORT.  This lets per-flow counters from different workers
+merge into single-threaded flow numbers.  Aggregates MERGE never emitted are
+left out, with a warning.  The frozen state applies.  AGGREGATE_CALL and
+COUNT_CALL are not triggered.  Write this handler only once COUNTER's thread
+has stopped updating it.
+
 =n
 
 The aggregate identifier is stored in host byte order. Thus, the aggregate ID
@@ -187,7 +201,9 @@ form.
 
 =a
 
-AggregateIP, AggregatePacketCounter, FromIPSummaryDump, FromDump */
+AggregateIP, AggregatePacketCounter, FromIPSummaryDump, FromDump, TraceMerge */
+
+class AggregateRenumberMap;
 
 class AggregateCounter : public Element { public:
 
@@ -211,6 +227,7 @@ class AggregateCounter : public Element { public:
     enum WriteFormat { WR_TEXT = 0, WR_BINARY = 1, WR_TEXT_IP = 2, WR_TEXT_PDF = 3 };
     int write_file(String, WriteFormat, ErrorHandler *) const;
     void reaggregate_counts();
+    int merge(const AggregateCounter *, const AggregateRenumberMap *, int, ErrorHandler *);
 
   private:
 
@@ -248,6 +265,7 @@ class AggregateCounter : public Element { public:
     Node *find_node(uint32_t, bool frozen = false);
     void reaggregate_node(Node *);
     void clear_node(Node *);
+    void merge_nodes(const Node *, const AggregateRenumberMap *, int, uint32_t &);
 
     void write_nodes(Node *, FILE *, WriteFormat, uint32_t *, int &, int, ErrorHandler *) const;
     static int write_file_handler(const String &, Element *, void *, ErrorHandler *);
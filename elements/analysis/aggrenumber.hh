@@ -0,0 +1,75 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_AGGRENUMBER_HH
+#define CLICK_AGGRENUMBER_HH
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+/** @class AggregateRenumberMap
+ * @brief Maps parallel workers' aggregate numbers to one merged numbering.
+ *
+ * Each worker numbers its aggregates independently.  renumber() assigns
+ * merged numbers sequentially from 1, in the order aggregates are first
+ * seen; lookup() reads the mapping back.  Aggregate 0 always maps to 0.
+ *
+ * TraceMerge keeps one, and returns it from cast("AggregateRenumberMap")
+ * when it renumbers, so AggregateCounter can combine per-worker counters
+ * without knowing about TraceMerge. */
+class AggregateRenumberMap { public:
+
+    AggregateRenumberMap()
+	: _maps(0), _nworkers(0), _next(0) {
+    }
+    ~AggregateRenumberMap() {
+	delete[] _maps;
+    }
+
+    void initialize(int nworkers) {
+	delete[] _maps;
+	_maps = new HashTable<uint32_t, uint32_t>[nworkers];
+	_nworkers = nworkers;
+	_next = 0;
+    }
+    void clear() {
+	delete[] _maps;
+	_maps = 0;
+	_nworkers = 0;
+    }
+
+    int nworkers() const		{ return _nworkers; }
+    /** @brief Return the number of merged aggregates assigned. */
+    uint32_t size() const		{ return _next; }
+
+    /** @brief Return worker @a w's aggregate @a agg's merged number,
+     * assigning the next one if it has none. */
+    inline uint32_t renumber(int w, uint32_t agg);
+
+    /** @brief Return worker @a w's aggregate @a agg's merged number, or 0
+     * if none was assigned. */
+    uint32_t lookup(int w, uint32_t agg) const {
+	return agg ? _maps[w].get(agg) : 0;
+    }
+
+  private:
+
+    HashTable<uint32_t, uint32_t> *_maps;
+    int _nworkers;
+    uint32_t _next;
+
+    AggregateRenumberMap(const AggregateRenumberMap &);
+    AggregateRenumberMap &operator=(const AggregateRenumberMap &);
+
+};
+
+inline uint32_t
+AggregateRenumberMap::renumber(int w, uint32_t agg)
+{
+    if (!agg)
+	return 0;
+    HashTable<uint32_t, uint32_t>::iterator it = _maps[w].find_insert(agg);
+    if (!it.value())
+	it.value() = ++_next;
+    return it.value();
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,372 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromipcolumndump.{cc,hh} -- element reads packets from a block-columnar
+ * IP summary file
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromipcolumndump.hh"
+#include <click/args.hh>
+#include <click/router.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+#define GET4(p)		((uint32_t) (p)[0]<<24 | (p)[1]<<16 | (p)[2]<<8 | (p)[3])
+
+FromIPColumnDump::FromIPColumnDump()
+    : _data(0), _data_cap(0), _nrows(0), _row(0), _count(0), _nblocks(0),
+      _nskipped(0), _task(this)
+{
+    _ff.set_landmark_pattern("%f");
+}
+
+FromIPColumnDump::~FromIPColumnDump()
+{
+}
+
+void *
+FromIPColumnDump::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0 && !output_is_push(0))
+	return static_cast<Notifier *>(&_notifier);
+    else
+	return Element::cast(n);
+}
+
+int
+FromIPColumnDump::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    IPAddress src, src_mask, dst, dst_mask;
+    _stop = false;
+    _active = true;
+
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _ff.filename())
+	.read("FIELDS", AnyArg(), _want)
+	.read("START", _start).read_status(_have_start)
+	.read("END", _end).read_status(_have_end)
+	.read("SRC", IPPrefixArg(true), src, src_mask).read_status(_have_src)
+	.read("DST", IPPrefixArg(true), dst, dst_mask).read_status(_have_dst)
+	.read("STOP", _stop)
+	.read("ACTIVE", _active)
+	.complete() < 0)
+	return -1;
+
+    _src_lo = ntohl((src & src_mask).addr());
+    _src_hi = _src_lo | ~ntohl(src_mask.addr());
+    _dst_lo = ntohl((dst & dst_mask).addr());
+    _dst_hi = _dst_lo | ~ntohl(dst_mask.addr());
+    return 0;
+}
+
+int
+FromIPColumnDump::sort_compare(const void *ap, const void *bp, void *user_data)
+{
+    int a = *reinterpret_cast<const int *>(ap);
+    int b = *reinterpret_cast<const int *>(bp);
+    FromIPColumnDump *f = reinterpret_cast<FromIPColumnDump *>(user_data);
+    int oa = f->_columns[a].f->order, ob = f->_columns[b].f->order;
+    if (oa != ob)
+	return oa < ob ? -1 : 1;
+    return (a < b ? -1 : (a == b ? 0 : 1));
+}
+
+int
+FromIPColumnDump::read_header(ErrorHandler *errh)
+{
+    String line;
+    if (_ff.read_line(line, errh, true) <= 0
+	|| line.substring(0, 13) != "!IPColumnDump")
+	return _ff.error(errh, "not an IPColumnDump file");
+
+    Vector<String> words;
+    while (1) {
+	if (_ff.read_line(line, errh, true) <= 0)
+	    return _ff.error(errh, "missing '!columns' line");
+	if (line.substring(0, 8) == "!columns")
+	    break;
+	else if (line.substring(0, 5) == "!data") {
+	    words.clear();
+	    cp_spacevec(line.substring(5), words);
+	}
+    }
+    if (!words.size())
+	return _ff.error(errh, "missing '!data' line");
+
+    Vector<String> want;
+    cp_spacevec(_want, want);
+    Vector<bool> found(want.size(), false);
+
+    for (int i = 0; i < words.size(); i++) {
+	Column c;
+	c.f = IPSummaryDump::FieldReader::find(words[i]);
+	c.width = c.f ? IPSummaryDump::column_width(c.f->type) : -1;
+	c.offset = 0;
+	bool projected = !want.size();
+	for (int j = 0; j < want.size(); j++) {
+	    const IPSummaryDump::FieldReader *wf = IPSummaryDump::FieldReader::find(cp_unquote(want[j]));
+	    if (wf && wf == c.f)
+		projected = found[j] = true;
+	}
+	if (!c.f || !c.f->inb || !c.f->inject || c.width <= 0) {
+	    if (want.size() && projected)
+		return _ff.error(errh, "field '%s' cannot be read", words[i].c_str());
+	    c.f = 0;
+	} else if (!projected)
+	    c.f = 0;
+	_columns.push_back(c);
+	if (c.f)
+	    _order.push_back(i);
+    }
+    for (int j = 0; j < want.size(); j++)
+	if (!found[j])
+	    return _ff.error(errh, "field '%s' not in file", want[j].c_str());
+
+    click_qsort(_order.begin(), _order.size(), sizeof(int), sort_compare, this);
+    return 0;
+}
+
+int
+FromIPColumnDump::initialize(ErrorHandler *errh)
+{
+    if (!output_is_push(0))
+	_notifier.initialize(Notifier::EMPTY_NOTIFIER, router());
+    if (output_is_push(0))
+	ScheduleInfo::initialize_task(this, &_task, _active, errh);
+
+    if (_ff.initialize(errh) < 0 || read_header(errh) < 0)
+	return -1;
+    _eof = false;
+    return 0;
+}
+
+void
+FromIPColumnDump::cleanup(CleanupStage)
+{
+    _ff.cleanup();
+    delete[] _data;
+    _data = 0;
+}
+
+bool
+FromIPColumnDump::read_block(ErrorHandler *errh)
+{
+    uint8_t hbuf[48];
+    while (1) {
+	const uint8_t *h = _ff.get_unaligned(48, hbuf, errh);
+	if (!h)
+	    return false;
+	uint32_t nrows = GET4(h), len = GET4(h + 4);
+	Timestamp ts_min = Timestamp((long) GET4(h + 8), GET4(h + 12));
+	Timestamp ts_max = Timestamp((long) GET4(h + 16), GET4(h + 20));
+	uint32_t src_min = GET4(h + 24), src_max = GET4(h + 28);
+	uint32_t dst_min = GET4(h + 32), dst_max = GET4(h + 36);
+
+	bool skip = (_have_start && ts_max < _start)
+	    || (_have_end && ts_min > _end)
+	    || (_have_src && (src_min > src_max || src_max < _src_lo || src_min > _src_hi))
+	    || (_have_dst && (dst_min > dst_max || dst_max < _dst_lo || dst_min > _dst_hi));
+
+	if (skip) {
+	    // don't read what the filter rejects
+	    if (_ff.seek(_ff.file_pos() + len, errh) < 0)
+		return false;
+	    ++_nskipped;
+	    continue;
+	}
+
+	String body = _ff.get_string(len, errh);
+	if (body.length() != (int) len) {
+	    _ff.error(errh, "truncated block");
+	    return false;
+	}
+
+	// lay out materialized columns
+	int need = 0;
+	for (Column *c = _columns.begin(); c != _columns.end(); ++c)
+	    if (c->f) {
+		c->offset = need;
+		need += nrows * c->width;
+	    }
+	if (need > _data_cap) {
+	    delete[] _data;
+	    _data_cap = need + need / 4;
+	    if (!(_data = new unsigned char[_data_cap])) {
+		_data_cap = 0;
+		_ff.error(errh, strerror(ENOMEM));
+		return false;
+	    }
+	}
+
+	const uint8_t *s = (const uint8_t *) body.begin();
+	const uint8_t *end = (const uint8_t *) body.end();
+	for (Column *c = _columns.begin(); c != _columns.end() && s; ++c)
+	    s = IPSummaryDump::column_decode(c->f ? _data + c->offset : 0,
+					     s, end, nrows, c->width);
+	if (!s) {
+	    _ff.error(errh, "bad block");
+	    return false;
+	}
+
+	++_nblocks;
+	_nrows = nrows;
+	_row = 0;
+	if (nrows)
+	    return true;
+    }
+}
+
+Packet *
+FromIPColumnDump::next_packet()
+{
+    while (_row == _nrows)
+	if (_eof || !read_block(ErrorHandler::default_handler())) {
+	    _eof = true;
+	    return 0;
+	}
+
+    WritablePacket *q = Packet::make(16, (const unsigned char *) 0, 0, 1000);
+    if (!q)
+	return 0;
+    memset(q->buffer(), 0, q->buffer_length());
+
+    IPSummaryDump::PacketOdesc d(this, q, IP_PROTO_TCP, 0, IPSummaryDump::MINOR_VERSION);
+    for (int *oi = _order.begin(); oi != _order.end() && d.p; ++oi) {
+	const Column &c = _columns[*oi];
+	const uint8_t *v = _data + c.offset + _row * c.width;
+	d.clear_values();
+	if (c.f->inb(d, v, v + c.width, c.f))
+	    c.f->inject(d, c.f);
+    }
+    ++_row;
+
+    if (d.p && d.is_ip && d.p->ip_header())
+	(void) d.make_transp();
+
+    if (d.p && d.is_ip && d.p->ip_header()) {
+	click_ip *iph = d.p->ip_header();
+	uint32_t ip_len;
+	if (!iph->ip_len) {
+	    ip_len = d.want_len;
+	    if (ip_len >= (uint32_t) d.p->network_header_offset())
+		ip_len -= d.p->network_header_offset();
+	    if (ip_len > 0xFFFF)
+		ip_len = 0xFFFF;
+	    else if (ip_len == 0)
+		ip_len = d.p->network_length();
+	    iph->ip_len = htons(ip_len);
+	} else
+	    ip_len = ntohs(iph->ip_len);
+	if (iph->ip_p == IP_PROTO_UDP && IP_FIRSTFRAG(iph)
+	    && !d.p->udp_header()->uh_ulen)
+	    d.p->udp_header()->uh_ulen = htons(ip_len - d.p->network_header_length());
+	d.p->set_dst_ip_anno(iph->ip_dst);
+    }
+
+    if (d.p && d.want_len > d.p->length())
+	SET_EXTRA_LENGTH_ANNO(d.p, d.want_len - d.p->length());
+    if (d.p)
+	++_count;
+    return d.p;
+}
+
+bool
+FromIPColumnDump::run_task(Task *)
+{
+    if (!_active)
+	return false;
+    int n;
+    for (n = 0; n < 32; ++n) {
+	Packet *p = next_packet();
+	if (!p)
+	    break;
+	output(0).push(p);
+    }
+    if (n)
+	_task.fast_reschedule();
+    else if (_eof && _stop)
+	router()->please_stop_driver();
+    return n != 0;
+}
+
+Packet *
+FromIPColumnDump::pull(int)
+{
+    if (!_active)
+	return 0;
+    Packet *p = next_packet();
+    if (!p) {
+	if (_eof && _stop)
+	    router()->please_stop_driver();
+	_notifier.sleep();
+    } else
+	_notifier.wake();
+    return p;
+}
+
+enum { h_count, h_blocks, h_skipped, h_active };
+
+String
+FromIPColumnDump::read_handler(Element *e, void *thunk)
+{
+    FromIPColumnDump *fd = static_cast<FromIPColumnDump *>(e);
+    switch ((intptr_t) thunk) {
+    case h_count:
+	return String(fd->_count);
+    case h_blocks:
+	return String(fd->_nblocks);
+    case h_skipped:
+	return String(fd->_nskipped);
+    case h_active:
+	return BoolArg::unparse(fd->_active);
+    default:
+	return "<error>";
+    }
+}
+
+int
+FromIPColumnDump::write_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+    FromIPColumnDump *fd = static_cast<FromIPColumnDump *>(e);
+    bool active;
+    if (!BoolArg().parse(s, active))
+	return errh->error("type mismatch");
+    fd->_active = active;
+    if (active && fd->output_is_push(0) && !fd->_task.scheduled())
+	fd->_task.reschedule();
+    else if (active && !fd->output_is_push(0))
+	fd->_notifier.wake();
+    return 0;
+}
+
+void
+FromIPColumnDump::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("blocks", read_handler, h_blocks);
+    add_read_handler("skipped_blocks", read_handler, h_skipped);
+    add_read_handler("active", read_handler, h_active, Handler::CHECKBOX);
+    add_write_handler("active", write_handler, h_active);
+    _ff.add_handlers(this);
+    if (output_is_push(0))
+	add_task_handlers(&_task);
+}
+
+ELEMENT_REQUIRES(userlevel int64 IPSummaryDump IPSummaryDump_Anno IPSummaryDump_IP IPSummaryDump_TCP IPSummaryDump_UDP IPSummaryDump_ICMP IPSummaryDump_Payload IPSummaryDump_Link)
+EXPORT_ELEMENT(FromIPColumnDump)
+CLICK_ENDDECLS
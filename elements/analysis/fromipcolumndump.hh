@@ -0,0 +1,158 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_FROMIPCOLUMNDUMP_HH
+#define CLICK_FROMIPCOLUMNDUMP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/fromfile.hh>
+#include "ipsumdumpinfo.hh"
+CLICK_DECLS
+
+/*
+=c
+
+FromIPColumnDump(FILENAME [, I<keywords> FIELDS, START, END, SRC, DST, STOP, ACTIVE])
+
+=s traces
+
+reads packets from a block-columnar IP summary file
+
+=d
+
+Reads packet descriptions from FILENAME, a file written by ToIPColumnDump,
+and creates packets containing that information, like FromIPSummaryDump.
+FILENAME may be compressed with gzip or bzip2.
+
+Reading is driven by the file's blocks.  First, the block header is checked
+against the START, END, SRC, and DST restrictions.  A block that cannot
+contain any matching packet is skipped without being decoded.  Then only the
+columns named in FIELDS are decoded; the others are skipped by length.  Only
+those fields are set on the emitted packets.  Restrictions are applied per
+block, so a block that overlaps a restriction is emitted in full.  Follow
+FromIPColumnDump with TimeFilter or IPFilter to filter exactly.
+
+Keyword arguments are:
+
+=over 8
+
+=item FIELDS
+
+Space-separated list of field names to materialize.  Each must be present in
+the file.  Default is every field in the file that can be read.
+
+=item START
+
+Timestamp.  Skip blocks whose packets all precede START.
+
+=item END
+
+Timestamp.  Skip blocks whose packets all follow END.
+
+=item SRC
+
+IP prefix.  Skip blocks with no IP source address in SRC.
+
+=item DST
+
+IP prefix.  Skip blocks with no IP destination address in DST.
+
+=item STOP
+
+Boolean.  If true, then stop the driver when the file is exhausted.  Default
+is false.
+
+=item ACTIVE
+
+Boolean.  If false, then do not emit packets until the C<active> handler is
+written.  Default is true.
+
+=back
+
+=h count read-only
+
+Returns the number of packets emitted.
+
+=h blocks read-only
+
+Returns the number of blocks decoded.
+
+=h skipped_blocks read-only
+
+Returns the number of blocks skipped by the START, END, SRC, and DST
+restrictions.
+
+=h active read/write
+
+Returns or sets the ACTIVE parameter.
+
+=a
+
+ToIPColumnDump, FromIPSummaryDump, TimeFilter */
+
+class FromIPColumnDump : public Element, public IPSummaryDumpInfo { public:
+
+    FromIPColumnDump() CLICK_COLD;
+    ~FromIPColumnDump() CLICK_COLD;
+
+    const char *class_name() const	{ return "FromIPColumnDump"; }
+    const char *port_count() const	{ return PORTS_0_1; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+    Packet *pull(int);
+
+  private:
+
+    struct Column {
+	const IPSummaryDump::FieldReader *f;	// null if not materialized
+	int width;
+	int offset;		// of decoded values in _data
+    };
+
+    FromFile _ff;
+    String _want;
+    Vector<Column> _columns;
+    Vector<int> _order;		// materialized columns, in inject order
+
+    Timestamp _start;
+    Timestamp _end;
+    uint32_t _src_lo, _src_hi;
+    uint32_t _dst_lo, _dst_hi;
+    bool _have_start;
+    bool _have_end;
+    bool _have_src;
+    bool _have_dst;
+
+    bool _stop;
+    bool _active;
+    bool _eof;
+
+    unsigned char *_data;
+    int _data_cap;
+    uint32_t _nrows;
+    uint32_t _row;
+
+    uint64_t _count;
+    uint32_t _nblocks;
+    uint32_t _nskipped;
+
+    Task _task;
+    ActiveNotifier _notifier;
+
+    int read_header(ErrorHandler *);
+    bool read_block(ErrorHandler *);
+    Packet *next_packet();
+    static int sort_compare(const void *, const void *, void *);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -487,6 +487,122 @@ bool PacketOdesc::hard_make_transp()
 }
 
 
+#if HAVE_INT64_TYPES
+// Column compression for ToIPColumnDump and FromIPColumnDump.  A column is
+// nrows fixed-width big-endian values, laid out exactly as outb() writes
+// them.  COL_DELTA stores each value as the zigzag-encoded difference from
+// the previous one, in little-endian base-128 varints; sorted timestamps,
+// sequential counters, and repeated addresses shrink to a byte or two.
+
+int column_width(int type)
+{
+    switch (type) {
+      case B_1:
+	return 1;
+      case B_2:
+	return 2;
+      case B_4:
+      case B_4NET:
+	return 4;
+      case B_6PTR:
+	return 6;
+      case B_8:
+	return 8;
+      case B_16:
+	return 16;
+      default:
+	return -1;
+    }
+}
+
+static inline uint64_t column_get(const uint8_t *s, int width)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < width; ++i)
+	v = (v << 8) | s[i];
+    return v;
+}
+
+static inline void column_put(uint8_t *s, uint64_t v, int width)
+{
+    for (int i = width - 1; i >= 0; --i, v >>= 8)
+	s[i] = v;
+}
+
+void column_encode(StringAccum &sa, const uint8_t *data, int nrows, int width)
+{
+    int rawlen = nrows * width;
+    int start = sa.length();
+    char *hdr = sa.extend(5);
+    hdr[0] = COL_RAW;
+
+    if (width == 1 || width == 2 || width == 4 || width == 8) {
+	int shift = 64 - 8 * width;
+	uint64_t prev = 0;
+	for (int i = 0; i < nrows && sa.length() - start - 5 < rawlen; ++i) {
+	    uint64_t v = column_get(data + i * width, width);
+	    // sign-extend the difference from the value's width
+	    int64_t d = (int64_t) ((v - prev) << shift) >> shift;
+	    uint64_t z = ((uint64_t) d << 1) ^ (uint64_t) (d >> 63);
+	    prev = v;
+	    do {
+		sa << (char) ((z & 127) | (z > 127 ? 128 : 0));
+		z >>= 7;
+	    } while (z);
+	}
+	if (sa.length() - start - 5 < rawlen)
+	    sa.data()[start] = COL_DELTA;
+	else
+	    sa.adjust_length(start + 5 - sa.length());
+    }
+
+    if (sa.data()[start] == COL_RAW)
+	sa.append((const char *) data, rawlen);
+    uint32_t len = sa.length() - start - 5;
+    uint8_t *l = (uint8_t *) sa.data() + start + 1;
+    PUT4(l, len);
+}
+
+const uint8_t *column_decode(uint8_t *out, const uint8_t *s, const uint8_t *end, int nrows, int width)
+{
+    if (s + 5 > end)
+	return 0;
+    int enc = s[0];
+    uint32_t len = GET4(s + 1);
+    s += 5;
+    if (len > (uint32_t) (end - s))
+	return 0;
+    end = s + len;
+    if (!out)			// skipping this column
+	return end;
+
+    if (enc == COL_RAW) {
+	if (len != (uint32_t) (nrows * width))
+	    return 0;
+	memcpy(out, s, len);
+	return end;
+    } else if (enc != COL_DELTA
+	       || (width != 1 && width != 2 && width != 4 && width != 8))
+	return 0;
+
+    uint64_t prev = 0;
+    for (int i = 0; i < nrows; ++i) {
+	uint64_t z = 0;
+	int shift = 0;
+	do {
+	    if (s == end || shift > 63)
+		return 0;
+	    z |= (uint64_t) (*s & 127) << shift;
+	    shift += 7;
+	} while (*s++ & 128);
+	prev += (z >> 1) ^ -(z & 1);
+	column_put(out + i * width, prev, width);
+    }
+    return s == end ? end : 0;
+}
+#endif
+
+
 const char tcp_flags_word[] = "FSRPAUECN";
 
 const uint8_t tcp_flag_mapping[256] = {
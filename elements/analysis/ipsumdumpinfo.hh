@@ -179,6 +179,14 @@ enum { MISSING_IP = 0,
 inline bool field_missing(const PacketDesc &d, int proto, int l);
 bool hard_field_missing(const PacketDesc &d, int proto, int l);
 
+#if HAVE_INT64_TYPES
+// block-columnar format (ToIPColumnDump, FromIPColumnDump)
+enum { COL_RAW = 0, COL_DELTA = 1 };
+int column_width(int type);
+void column_encode(StringAccum &, const uint8_t *data, int nrows, int width);
+const uint8_t *column_decode(uint8_t *out, const uint8_t *s, const uint8_t *end, int nrows, int width);
+#endif
+
 // particular parsers
 void ip_prepare(PacketDesc &, const FieldWriter *);
 
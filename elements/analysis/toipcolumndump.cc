@@ -0,0 +1,277 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * toipcolumndump.{cc,hh} -- element writes packet summary in a
+ * block-columnar binary format
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "toipcolumndump.hh"
+#include <click/standard/scheduleinfo.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+#define PUT4(p, d)	do { (p)[0] = (d)>>24; (p)[1] = (d)>>16; (p)[2] = (d)>>8; (p)[3] = (d); } while (0)
+
+ToIPColumnDump::ToIPColumnDump()
+    : _f(0), _nrows(0), _count(0), _task(this)
+{
+}
+
+ToIPColumnDump::~ToIPColumnDump()
+{
+}
+
+int
+ToIPColumnDump::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String save = "timestamp ip_src";
+    _block = 8192;
+    _careful_trunc = true;
+    _extra_length = true;
+
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read("FIELDS", AnyArg(), save)
+	.read("CONTENTS", AnyArg(), save)
+	.read("BLOCK", _block)
+	.read("BANNER", _banner)
+	.read("CAREFUL_TRUNC", _careful_trunc)
+	.read("EXTRA_LENGTH", _extra_length)
+	.complete() < 0)
+	return -1;
+
+    if (_block < 1 || _block > 0x100000)
+	return errh->error("BLOCK out of range");
+
+    Vector<String> v;
+    cp_spacevec(save, v);
+    for (int i = 0; i < v.size(); i++) {
+	String word = cp_unquote(v[i]);
+	const IPSummaryDump::FieldWriter *f = IPSummaryDump::FieldWriter::find(word);
+	if (!f) {
+	    errh->error("unknown content type '%s'", word.c_str());
+	    continue;
+	}
+	int width = IPSummaryDump::column_width(f->type);
+	if (width <= 0 || !f->outb) {
+	    errh->error("field '%s' has no fixed-size binary form", word.c_str());
+	    continue;
+	}
+
+	_fields.push_back(f);
+	_widths.push_back(width);
+
+	for (int j = 0; j < _prepare_fields.size(); j++)
+	    if (_prepare_fields[j]->prepare == f->prepare)
+		goto found_prepare;
+	if (f->prepare)
+	    _prepare_fields.push_back(f);
+      found_prepare: ;
+    }
+    if (_fields.size() == 0)
+	errh->error("no contents specified");
+
+    return errh->nerrors() ? -1 : 0;
+}
+
+int
+ToIPColumnDump::initialize(ErrorHandler *errh)
+{
+    assert(!_f);
+    if (_filename != "-") {
+	_f = fopen(_filename.c_str(), "wb");
+	if (!_f)
+	    return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    } else {
+	_f = stdout;
+	_filename = "<stdout>";
+    }
+
+    if (input_is_pull(0)) {
+	ScheduleInfo::join_scheduler(this, &_task, errh);
+	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    }
+    _active = true;
+
+    _columns.resize(_fields.size());
+    for (int i = 0; i < _fields.size(); i++)
+	_columns[i].reserve(_block * _widths[i]);
+    reset_block();
+
+    StringAccum sa;
+    sa << "!IPColumnDump 1.0\n";
+    if (_banner)
+	sa << "!creator " << cp_quote(_banner) << '\n';
+    sa << "!data";
+    for (int i = 0; i < _fields.size(); i++)
+	sa << ' ' << _fields[i]->name;
+    sa << "\n!columns\n";
+    ignore_result(fwrite(sa.data(), 1, sa.length(), _f));
+    return 0;
+}
+
+void
+ToIPColumnDump::cleanup(CleanupStage)
+{
+    if (_f) {
+	flush_block();
+	if (_f != stdout)
+	    fclose(_f);
+	else
+	    fflush(_f);
+    }
+    _f = 0;
+}
+
+void
+ToIPColumnDump::reset_block()
+{
+    _nrows = 0;
+    for (int i = 0; i < _columns.size(); i++)
+	_columns[i].clear();
+    _ts_min = Timestamp::make_sec(0x7FFFFFFF);
+    _ts_max = Timestamp();
+    _src_min = _dst_min = 0xFFFFFFFFU;
+    _src_max = _dst_max = 0;
+}
+
+void
+ToIPColumnDump::flush_block()
+{
+    if (!_nrows)
+	return;
+
+    _out.clear();
+    _out.extend(48);
+    for (int i = 0; i < _fields.size(); i++)
+	IPSummaryDump::column_encode(_out, (const uint8_t *) _columns[i].data(),
+				     _nrows, _widths[i]);
+
+    uint32_t hv[12];
+    hv[0] = _nrows;
+    hv[1] = _out.length() - 48;
+    hv[2] = _ts_min.sec();
+    hv[3] = _ts_min.subsec();
+    hv[4] = _ts_max.sec();
+    hv[5] = _ts_max.subsec();
+    hv[6] = _src_min;
+    hv[7] = _src_max;
+    hv[8] = _dst_min;
+    hv[9] = _dst_max;
+    hv[10] = hv[11] = 0;	// reserved
+    uint8_t *h = (uint8_t *) _out.data();
+    for (int i = 0; i < 12; i++)
+	PUT4(h + 4 * i, hv[i]);
+
+    ignore_result(fwrite(_out.data(), 1, _out.length(), _f));
+    reset_block();
+}
+
+void
+ToIPColumnDump::write_packet(Packet *p)
+{
+    IPSummaryDump::PacketDesc d(this, p, 0, 0, _careful_trunc, _extra_length);
+
+    for (int i = 0; i < _prepare_fields.size(); i++)
+	_prepare_fields[i]->prepare(d, _prepare_fields[i]);
+
+    for (int i = 0; i < _fields.size(); i++) {
+	StringAccum &col = _columns[i];
+	int want = col.length() + _widths[i];
+	d.sa = &col;
+	d.clear_values();
+	if (_fields[i]->extract(d, _fields[i]))
+	    _fields[i]->outb(d, true, _fields[i]);
+	// missing values, and any writer that strays from its declared
+	// width, are stored as zero-filled fixed-width values
+	if (col.length() < want)
+	    memset(col.extend(want - col.length()), 0, want - col.length());
+	else if (col.length() > want)
+	    col.adjust_length(want - col.length());
+    }
+
+    const Timestamp &ts = p->timestamp_anno();
+    if (ts < _ts_min)
+	_ts_min = ts;
+    if (ts > _ts_max)
+	_ts_max = ts;
+    if (p->has_network_header() && p->network_length() >= (int) sizeof(click_ip)) {
+	const click_ip *iph = p->ip_header();
+	uint32_t src = ntohl(iph->ip_src.s_addr);
+	uint32_t dst = ntohl(iph->ip_dst.s_addr);
+	if (src < _src_min)
+	    _src_min = src;
+	if (src > _src_max)
+	    _src_max = src;
+	if (dst < _dst_min)
+	    _dst_min = dst;
+	if (dst > _dst_max)
+	    _dst_max = dst;
+    }
+
+    ++_count;
+    if (++_nrows == _block)
+	flush_block();
+}
+
+void
+ToIPColumnDump::push(int, Packet *p)
+{
+    if (_active)
+	write_packet(p);
+    checked_output_push(0, p);
+}
+
+bool
+ToIPColumnDump::run_task(Task *)
+{
+    if (!_active)
+	return false;
+    if (Packet *p = input(0).pull()) {
+	write_packet(p);
+	checked_output_push(0, p);
+	_task.fast_reschedule();
+	return true;
+    } else if (_signal) {
+	_task.fast_reschedule();
+	return false;
+    } else
+	return false;
+}
+
+int
+ToIPColumnDump::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    ToIPColumnDump *tcd = (ToIPColumnDump *) e;
+    if (tcd->_f) {
+	tcd->flush_block();
+	fflush(tcd->_f);
+    }
+    return 0;
+}
+
+void
+ToIPColumnDump::add_handlers()
+{
+    if (input_is_pull(0))
+	add_task_handlers(&_task);
+    add_data_handlers("count", Handler::OP_READ, &_count);
+    add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+}
+
+ELEMENT_REQUIRES(userlevel int64 IPSummaryDump IPSummaryDump_Anno IPSummaryDump_IP IPSummaryDump_TCP IPSummaryDump_UDP IPSummaryDump_ICMP IPSummaryDump_Payload IPSummaryDump_Link)
+EXPORT_ELEMENT(ToIPColumnDump)
+CLICK_ENDDECLS
@@ -0,0 +1,154 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_TOIPCOLUMNDUMP_HH
+#define CLICK_TOIPCOLUMNDUMP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/straccum.hh>
+#include <click/notifier.hh>
+#include "ipsumdumpinfo.hh"
+CLICK_DECLS
+
+/*
+=c
+
+ToIPColumnDump(FILENAME [, I<keywords> FIELDS, BLOCK, BANNER, CAREFUL_TRUNC, EXTRA_LENGTH])
+
+=s traces
+
+writes packet summary information to a compressed block-columnar file
+
+=d
+
+Writes summary information about incoming packets to FILENAME, like
+ToIPSummaryDump, but in a block-columnar binary format designed for fast
+reprocessing by FromIPColumnDump.  Writes to standard output if FILENAME is a
+single dash `C<->'.
+
+FIELDS takes the same field names as ToIPSummaryDump, except that every field
+must have a fixed-size binary representation.  This rules out 'C<ip_opt>',
+'C<tcp_opt>', 'C<payload>', and similar variable-length fields.  A field that
+does not apply to a packet is stored as zero, as in ToIPSummaryDump's BINARY
+mode.  Also as in BINARY mode, 'C<timestamp>' has microsecond precision; use
+'C<ntimestamp>' to keep nanoseconds.
+
+Packets are buffered into blocks of BLOCK records.  Each block stores its
+fields column by column.  Each column is delta- and varint-encoded when that
+is smaller than its raw form.  Each block header records the block's
+timestamp range and its IP source and destination address ranges, taken from
+the packets' timestamp annotations and IP headers whether or not those
+fields are stored, so readers can skip blocks without decoding them.
+
+ToIPColumnDump can optionally be used as a filter: it pushes received packets
+to its output if that output exists.
+
+Keyword arguments are:
+
+=over 8
+
+=item FIELDS
+
+Space-separated list of field names.  Default is 'C<timestamp ip_src>'.
+
+=item BLOCK
+
+Integer.  Number of records per block.  Default is 8192.
+
+=item BANNER
+
+String.  If supplied, writes a 'C<!creator "BANNER">' line in the file header.
+
+=item CAREFUL_TRUNC
+
+Boolean.  As for ToIPSummaryDump.  Default is true.
+
+=item EXTRA_LENGTH
+
+Boolean.  If false, then ignore extra length annotations.  Default is true.
+
+=back
+
+=n
+
+The file starts with text lines like those of ToIPSummaryDump:
+
+  !IPColumnDump 1.0
+  !data timestamp ip_src ip_dst sport dport ip_proto ip_len
+  !columns
+
+Blocks follow the 'C<!columns>' line.  A block is a 48-byte header, then one
+column per field in 'C<!data>' order.  The header holds, as 4-byte integers in
+network byte order: the record count, the total length of the columns in
+bytes, the minimum and maximum timestamps (seconds and subseconds each), and
+the minimum and maximum source and destination IP addresses (as host-order
+integers; the minimum exceeds the maximum if the block has no IP packets).
+A column is a 1-byte encoding (0 for raw, 1 for delta-varint), a 4-byte
+length, and that many bytes of data.  Raw data is the ToIPSummaryDump binary
+representation of each value, back to back.  Delta-varint data encodes each
+value as the zigzag-encoded difference from the previous value in
+little-endian base-128.
+
+=h flush write-only
+
+Writes out the current partial block.
+
+=h count read-only
+
+Returns the number of records written.
+
+=a
+
+FromIPColumnDump, ToIPSummaryDump, FromIPSummaryDump */
+
+class ToIPColumnDump : public Element { public:
+
+    ToIPColumnDump() CLICK_COLD;
+    ~ToIPColumnDump() CLICK_COLD;
+
+    const char *class_name() const	{ return "ToIPColumnDump"; }
+    const char *port_count() const	{ return "1/0-1"; }
+    const char *processing() const	{ return "a/h"; }
+    const char *flags() const		{ return "S2"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    bool run_task(Task *);
+
+  private:
+
+    FILE *_f;
+    String _filename;
+    String _banner;
+    Vector<const IPSummaryDump::FieldWriter *> _fields;
+    Vector<const IPSummaryDump::FieldWriter *> _prepare_fields;
+    Vector<int> _widths;
+    Vector<StringAccum> _columns;
+    int _block;
+    int _nrows;
+    bool _careful_trunc;
+    bool _extra_length;
+    bool _active;
+
+    Timestamp _ts_min;
+    Timestamp _ts_max;
+    uint32_t _src_min, _src_max;
+    uint32_t _dst_min, _dst_max;
+
+    StringAccum _out;
+    uint64_t _count;
+
+    Task _task;
+    NotifierSignal _signal;
+
+    void write_packet(Packet *);
+    void reset_block();
+    void flush_block();
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,300 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * tracemerge.{cc,hh} -- merge parallel analysis workers back into trace order
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "tracemerge.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+TraceMerge::TraceMerge()
+    : _split(0), _in(0)
+{
+}
+
+TraceMerge::~TraceMerge()
+{
+}
+
+int
+TraceMerge::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _renumber = _stop = false;
+
+    if (Args(conf, this, errh)
+	.read_mp("SPLIT", ElementCastArg("TraceSplit"), _split)
+	.read("RENUMBER", _renumber)
+	.read("STOP", _stop)
+	.complete() < 0)
+	return -1;
+
+    if (_split->noutputs() != ninputs())
+	return errh->error("%d inputs, but %p{element} has %d outputs", ninputs(), _split, _split->noutputs());
+    _split->attach();
+    return 0;
+}
+
+int
+TraceMerge::initialize(ErrorHandler *errh)
+{
+    // at most WINDOW packets are in flight, so queues that size never fill
+    // unless a worker holds packets back
+    uint32_t capacity;
+    for (capacity = 1; capacity < _split->window(); capacity <<= 1)
+	/* nada */;
+    _in = new Input[ninputs()];
+    for (int i = 0; i < ninputs(); i++)
+	_in[i].q = 0;
+    for (int i = 0; i < ninputs(); i++) {
+	Input &in = _in[i];
+	if (!(in.q = new Packet *[capacity]))
+	    return errh->error("out of memory!");
+	in.mask = capacity - 1;
+	in.head = in.tail = 0;
+	in.next = in.taken = in.over_head = in.over_tail = 0;
+	in.overflows = 0;
+    }
+    if (_renumber)
+	_agg_map.initialize(ninputs());
+    _anno = _split->seq_anno();
+    _well_ordered = true;
+    _done = false;
+    _last = _count = _waits = 0;
+    return 0;
+}
+
+void
+TraceMerge::cleanup(CleanupStage)
+{
+    if (_in) {
+	for (int i = 0; i < ninputs(); i++) {
+	    Input &in = _in[i];
+	    if (in.q) {
+		for (uint32_t h = in.head; h != in.tail; ++h)
+		    in.q[h & in.mask]->kill();
+		delete[] in.q;
+	    }
+	    if (in.next)
+		in.next->kill();
+	    for (Packet *l = in.taken; l; l = in.taken) {
+		in.taken = l->next();
+		l->kill();
+	    }
+	    for (Packet *l = in.over_head; l; l = in.over_head) {
+		in.over_head = l->next();
+		l->kill();
+	    }
+	}
+	delete[] _in;
+    }
+    _agg_map.clear();
+    _in = 0;
+}
+
+void *
+TraceMerge::cast(const char *name)
+{
+    if (strcmp(name, "AggregateRenumberMap") == 0)
+	return _renumber ? &_agg_map : 0;
+    return Element::cast(name);
+}
+
+void
+TraceMerge::push(int port, Packet *p)
+{
+    Input &in = _in[port];
+    uint32_t t = in.tail;
+    if (in.over_head || t - in.head > in.mask) {
+	// Only held-back packets can overflow the queue.  Waiting for the
+	// puller could livelock when it shares this thread.
+	overflow(in, port, p);
+	return;
+    }
+    in.q[t & in.mask] = p;
+    click_write_fence();
+    in.tail = t + 1;
+}
+
+void
+TraceMerge::overflow(Input &in, int port, Packet *p)
+{
+    if (in.overflows++ == 0)
+	click_chatter("%p{element}: input %d overflowed, its worker is holding packets", this, port);
+    p->set_next(0);
+    in.lock.acquire();
+    if (in.over_head)
+	in.over_tail->set_next(p);
+    else
+	in.over_head = p;
+    in.over_tail = p;
+    in.lock.release();
+}
+
+inline Packet *
+TraceMerge::dequeue(Input &in)
+{
+    // Overflowed packets arrived after everything in the ring when the
+    // list was taken, and before anything pushed since.
+    if (Packet *p = in.taken) {
+	in.taken = p->next();
+	p->set_next(0);
+	return p;
+    }
+    uint32_t h = in.head;
+    if (h == in.tail) {
+	if (!in.over_head)
+	    return 0;
+	// The producer appends to the list while it is nonempty, so once
+	// the ring is empty under the lock, the whole list comes next.
+	Packet *p = 0;
+	in.lock.acquire();
+	if (h == in.tail) {
+	    p = in.over_head;
+	    in.over_head = 0;
+	}
+	in.lock.release();
+	if (p) {
+	    in.taken = p->next();
+	    p->set_next(0);
+	    return p;
+	}
+    }
+    click_read_fence();
+    Packet *p = in.q[h & in.mask];
+    click_compiler_fence();
+    in.head = h + 1;
+    return p;
+}
+
+bool
+TraceMerge::drained()
+{
+    if (!_split->done())
+	return false;
+    for (int i = 0; i < ninputs(); i++)
+	if (_in[i].next || !_split->drained(i, ~(uint64_t) 0))
+	    return false;
+    // check again: a worker finishes pushing before it marks a packet done
+    for (int i = 0; i < ninputs(); i++)
+	if (_in[i].tail != _in[i].head || _in[i].taken || _in[i].over_head)
+	    return false;
+    return true;
+}
+
+Packet *
+TraceMerge::pull(int)
+{
+    int best;
+    uint64_t bseq;
+
+  retry:
+    best = -1;
+    bseq = 0;
+    for (int i = 0; i < ninputs(); i++) {
+	Input &in = _in[i];
+	if (!in.next)
+	    in.next = dequeue(in);
+	if (in.next) {
+	    uint64_t s = in.next->anno_u64(_anno);
+	    if (best < 0 || s < bseq) {
+		best = i;
+		bseq = s;
+	    }
+	}
+    }
+
+    if (best < 0) {
+	if (!_done && drained()) {
+	    _done = true;
+	    if (_stop)
+		router()->please_stop_driver();
+	}
+	return 0;
+    }
+
+    // Every empty input's worker must be past bseq.  Check the worker
+    // first, then the input, so a packet pushed in between is not missed.
+    for (int i = 0; i < ninputs(); i++)
+	if (!_in[i].next) {
+	    if (!_split->drained(i, bseq)) {
+		++_waits;
+		return 0;
+	    }
+	    if ((_in[i].next = dequeue(_in[i])))
+		goto retry;
+	}
+
+    Packet *p = _in[best].next;
+    _in[best].next = 0;
+    if (bseq < _last)
+	_well_ordered = false;
+    else {
+	_last = bseq;
+	_split->release(bseq);
+    }
+
+    if (_renumber)
+	if (uint32_t agg = AGGREGATE_ANNO(p))
+	    SET_AGGREGATE_ANNO(p, _agg_map.renumber(best, agg));
+
+    _done = false;
+    ++_count;
+    return p;
+}
+
+enum { H_COUNT, H_WAITS, H_OVERFLOWS, H_NAGG, H_WELL_ORDERED, H_DONE };
+
+String
+TraceMerge::read_handler(Element *e, void *thunk)
+{
+    TraceMerge *tm = static_cast<TraceMerge *>(e);
+    switch ((intptr_t) thunk) {
+    case H_COUNT:
+	return String(tm->_count);
+    case H_WAITS:
+	return String(tm->_waits);
+    case H_OVERFLOWS: {
+	uint64_t overflows = 0;
+	for (int i = 0; i < tm->ninputs(); i++)
+	    overflows += tm->_in[i].overflows;
+	return String(overflows);
+    }
+    case H_NAGG:
+	return String(tm->_agg_map.size());
+    case H_WELL_ORDERED:
+	return String(tm->_well_ordered);
+    case H_DONE:
+	return String(tm->_done);
+    default:
+	return String();
+    }
+}
+
+void
+TraceMerge::add_handlers()
+{
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("waits", read_handler, H_WAITS);
+    add_read_handler("overflows", read_handler, H_OVERFLOWS);
+    add_read_handler("nagg", read_handler, H_NAGG);
+    add_read_handler("well_ordered", read_handler, H_WELL_ORDERED);
+    add_read_handler("done", read_handler, H_DONE);
+}
+
+ELEMENT_REQUIRES(TraceSplit int64)
+EXPORT_ELEMENT(TraceMerge)
+CLICK_ENDDECLS
@@ -0,0 +1,160 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_TRACEMERGE_HH
+#define CLICK_TRACEMERGE_HH
+#include <click/element.hh>
+#include <click/sync.hh>
+#include "tracesplit.hh"
+#include "aggrenumber.hh"
+CLICK_DECLS
+
+/*
+=c
+
+TraceMerge(SPLIT [, I<keywords> RENUMBER, STOP])
+
+=s traces
+
+merges parallel analysis workers back into trace order
+
+=d
+
+TraceMerge collects the packets produced by the workers fed by the TraceSplit
+element SPLIT and emits them in their original arrival order, as given by
+SPLIT's sequence numbers.  Input port K must receive the packets from
+SPLIT's output K, after that worker's analysis subgraph.
+
+Before emitting a packet, TraceMerge makes sure that no worker is still
+processing a packet that arrived earlier.  The result is the same packet
+stream a single copy of the subgraph would have produced, provided each
+worker passes packets straight through.  A worker that holds packets, such
+as AggregateIPFlows with FRAGMENTS true or a Queue, can make a packet
+arrive after later packets were emitted.  TraceMerge emits such packets
+immediately and reports false from C<well_ordered>.
+
+With RENUMBER true, TraceMerge also renumbers aggregate annotations so they
+match a single-threaded run of AggregateIPFlows.  Each worker numbers its
+flows independently, starting from 1.  TraceMerge replaces each worker's
+aggregate number with a new number, assigned sequentially from 1 in order of
+first appearance in the merged stream.  AggregateIPFlows assigns its numbers
+in that same order.  Aggregate 0 is left alone.  AggregateCounter's C<merge>
+handler can use the same mapping to combine per-worker counters.
+
+Each input has a queue as large as SPLIT's WINDOW, so a worker never waits
+for TraceMerge's output to catch up.  Only a worker that holds packets back
+can overflow its queue.  TraceMerge never drops packets.  Packets that
+overflow are kept in order on a list behind the queue and counted in
+C<overflows>, and the first overflow on each input is reported with a
+warning.  Blocking the worker instead could deadlock a thread that is
+also the one pulling.  The list is as long as the worker lets it grow, so
+a worker that holds packets must bound what it holds.  TraceMerge has no
+empty notifier, since a worker can finish a packet without pushing
+anything.
+
+Keyword arguments are:
+
+=over 8
+
+=item RENUMBER
+
+Boolean.  If true, renumber aggregate annotations as described above.
+Default is false.
+
+=item STOP
+
+Boolean.  If true, stop the driver once SPLIT's input is exhausted and every
+packet has been emitted.  Default is false.
+
+=back
+
+=h count read-only
+
+Returns the number of packets emitted.
+
+=h waits read-only
+
+Returns the number of pulls that found a packet ready but had to wait for a
+slower worker.
+
+=h overflows read-only
+
+Returns the number of packets that arrived while their input's queue was
+full.
+
+=h nagg read-only
+
+Returns the number of aggregates renumbered so far.
+
+=h well_ordered read-only
+
+Returns "false" if TraceMerge ever emitted a packet out of sequence order,
+"true" otherwise.
+
+=h done read-only
+
+Returns "true" once SPLIT's input is exhausted and every packet has been
+emitted.
+
+=a
+
+TraceSplit, AggregateIPFlows, AggregateCounter, TimeSortedSched */
+
+class TraceMerge : public Element { public:
+
+    TraceMerge() CLICK_COLD;
+    ~TraceMerge() CLICK_COLD;
+
+    const char *class_name() const	{ return "TraceMerge"; }
+    const char *port_count() const	{ return "1-/1"; }
+    const char *processing() const	{ return "h/l"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void *cast(const char *);
+    void push(int, Packet *);
+    Packet *pull(int);
+
+  private:
+
+    // Single-producer, single-consumer packet ring per input.  The
+    // producer is the worker; the consumer is whoever pulls TraceMerge.
+    // When the ring is full, the producer appends to the overflow list
+    // instead, and keeps doing so until the consumer takes the whole list.
+    struct Input {
+	Packet **q;
+	uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	Packet *next;		// dequeued, not yet emitted
+	Packet *taken;		// overflow list taken by the consumer
+	Packet * volatile over_head; // overflow list, guarded by lock
+	Packet *over_tail;
+	SimpleSpinlock lock;
+	uint64_t overflows;	// written by the producer
+    };
+
+    TraceSplit *_split;
+    Input *_in;
+    AggregateRenumberMap _agg_map;
+    int _anno;
+    bool _renumber;
+    bool _stop;
+    bool _well_ordered;
+    bool _done;
+
+    uint64_t _last;
+    uint64_t _count;
+    uint64_t _waits;
+
+    void overflow(Input &, int, Packet *);
+    inline Packet *dequeue(Input &);
+    bool drained();
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
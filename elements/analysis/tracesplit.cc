@@ -0,0 +1,272 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * tracesplit.{cc,hh} -- split a packet trace across parallel workers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "tracesplit.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ip.h>
+#include <clicknet/icmp.h>
+CLICK_DECLS
+
+TraceSplit::TraceSplit()
+    : _out(0), _attached(false), _pending(0), _pending_port(0), _task(this)
+{
+}
+
+TraceSplit::~TraceSplit()
+{
+}
+
+void *
+TraceSplit::port_cast(bool isoutput, int port, const char *name)
+{
+    if (isoutput && _out && port >= 0 && port < noutputs()
+	&& strcmp(name, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_out[port].notifier);
+    return Element::port_cast(isoutput, port, name);
+}
+
+int
+TraceSplit::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t capacity = 1024;
+    _window = 65536;
+    _burst = 32;
+    _anno = 40;
+
+    if (Args(conf, this, errh)
+	.read("CAPACITY", capacity)
+	.read("WINDOW", _window)
+	.read("BURST", _burst)
+	.read("ANNO", AnnoArg(8), _anno)
+	.complete() < 0)
+	return -1;
+
+    if (capacity < 1 || capacity > 0x1000000)
+	return errh->error("CAPACITY out of range");
+    if (_window < 1 || _window > 0x1000000)
+	return errh->error("WINDOW out of range");
+    if (_burst < 1)
+	return errh->error("BURST must be positive");
+    for (_capacity = 1; _capacity < capacity; _capacity <<= 1)
+	/* nada */;
+
+    _out = new Output[noutputs()];
+    for (int i = 0; i < noutputs(); i++) {
+	_out[i].q = 0;
+	_out[i].notifier.initialize(Notifier::EMPTY_NOTIFIER, router());
+    }
+    return 0;
+}
+
+int
+TraceSplit::initialize(ErrorHandler *errh)
+{
+    for (int i = 0; i < noutputs(); i++) {
+	Output &o = _out[i];
+	if (!(o.q = new Packet *[_capacity]))
+	    return errh->error("out of memory!");
+	o.mask = _capacity - 1;
+	o.head = o.tail = 0;
+	o.dispatched = o.handed = o.completed = 0;
+	o.count = 0;
+    }
+    _seq = _released = 0;
+    _eof = false;
+    _stalls = 0;
+
+    ScheduleInfo::initialize_task(this, &_task, errh);
+    _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    return 0;
+}
+
+void
+TraceSplit::cleanup(CleanupStage)
+{
+    if (_out) {
+	for (int i = 0; i < noutputs(); i++) {
+	    Output &o = _out[i];
+	    if (o.q) {
+		for (uint32_t h = o.head; h != o.tail; ++h)
+		    o.q[h & o.mask]->kill();
+		delete[] o.q;
+	    }
+	}
+	delete[] _out;
+    }
+    _out = 0;
+    if (_pending)
+	_pending->kill();
+    _pending = 0;
+}
+
+int
+TraceSplit::classify(Packet *p) const
+{
+    if (!p->has_network_header() || p->network_length() < (int) sizeof(click_ip))
+	return 0;
+    const click_ip *iph = p->ip_header();
+
+    // ICMP errors belong to the flow they report on, as in AggregateIPFlows
+    if (iph->ip_p == IP_PROTO_ICMP && IP_FIRSTFRAG(iph)
+	&& p->transport_length() >= (int) (sizeof(click_icmp) + sizeof(click_ip))) {
+	const click_icmp *icmph = p->icmp_header();
+	if (icmph->icmp_type == ICMP_UNREACH
+	    || icmph->icmp_type == ICMP_TIMXCEED
+	    || icmph->icmp_type == ICMP_PARAMPROB
+	    || icmph->icmp_type == ICMP_SOURCEQUENCH
+	    || icmph->icmp_type == ICMP_REDIRECT)
+	    iph = reinterpret_cast<const click_ip *>(icmph + 1);
+    }
+
+    // order-independent, so both directions of a host pair hash alike
+    uint32_t a = iph->ip_src.s_addr, b = iph->ip_dst.s_addr;
+    if (a > b) {
+	uint32_t t = a;
+	a = b;
+	b = t;
+    }
+    uint32_t h = (a * 0x9E3779B1U) ^ b;
+    h ^= h >> 15;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    return h % noutputs();
+}
+
+bool
+TraceSplit::run_task(Task *)
+{
+    int n = 0;
+    bool blocked = false;
+    while (n < _burst) {
+	Packet *p = _pending;
+	int port = _pending_port;
+	if (!p) {
+	    if (_attached && _seq - _released >= _window) {
+		blocked = true;
+		break;
+	    }
+	    if (!(p = input(0).pull())) {
+		_eof = !_signal;
+		break;
+	    }
+	    port = classify(p);
+	    p->set_anno_u64(_anno, ++_seq);
+	    // Publish the assignment before the packet can reach anyone, so
+	    // TraceMerge never considers this output drained past it.
+	    _out[port].dispatched = _seq;
+	    click_write_fence();
+	}
+
+	Output &o = _out[port];
+	uint32_t t = o.tail;
+	if (t - o.head > o.mask) {
+	    _pending = p;
+	    _pending_port = port;
+	    blocked = true;
+	    break;
+	}
+	o.q[t & o.mask] = p;
+	click_write_fence();
+	o.tail = t + 1;
+	++o.count;
+	_pending = 0;
+	_eof = false;
+	++n;
+    }
+
+    // Wake sleeping workers.  The fence pairs with the one in pull(): a
+    // worker that went to sleep on an empty output either sees our new tail
+    // or has already cleared its notifier for us to see.
+    if (n) {
+	click_fence();
+	for (int i = 0; i < noutputs(); i++) {
+	    Output &o = _out[i];
+	    if (o.tail != o.head && !o.notifier.active())
+		o.notifier.wake();
+	}
+    }
+
+    if (blocked)
+	++_stalls;
+    if (n || blocked || _signal)
+	_task.fast_reschedule();
+    return n > 0;
+}
+
+Packet *
+TraceSplit::pull(int port)
+{
+    Output &o = _out[port];
+    // The worker pulls again only once it has finished with the packet it
+    // pulled last.
+    o.completed = o.handed;
+
+    uint32_t h = o.head;
+    if (h != o.tail) {
+	click_read_fence();
+	Packet *p = o.q[h & o.mask];
+	o.handed = p->anno_u64(_anno);
+	click_compiler_fence();
+	o.head = h + 1;
+	return p;
+    }
+
+    o.notifier.sleep();
+    // Work around race with run_task(), which may have just enqueued a
+    // packet and woken us.
+    click_fence();
+    if (o.tail != o.head)
+	o.notifier.wake();
+    return 0;
+}
+
+enum { H_COUNT, H_STALLS, H_COUNTS };
+
+String
+TraceSplit::read_handler(Element *e, void *thunk)
+{
+    TraceSplit *ts = static_cast<TraceSplit *>(e);
+    switch ((intptr_t) thunk) {
+    case H_COUNT:
+	return String(ts->_seq);
+    case H_STALLS:
+	return String(ts->_stalls);
+    case H_COUNTS: {
+	StringAccum sa;
+	for (int i = 0; i < ts->noutputs(); i++)
+	    sa << ts->_out[i].count << '\n';
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+void
+TraceSplit::add_handlers()
+{
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("stalls", read_handler, H_STALLS);
+    add_read_handler("counts", read_handler, H_COUNTS);
+    add_task_handlers(&_task);
+}
+
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(TraceSplit)
+CLICK_ENDDECLS
@@ -0,0 +1,189 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_TRACESPLIT_HH
+#define CLICK_TRACESPLIT_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+CLICK_DECLS
+
+/*
+=c
+
+TraceSplit([I<keywords> CAPACITY, WINDOW, BURST, ANNO])
+
+=s traces
+
+splits a packet trace across parallel analysis workers
+
+=d
+
+TraceSplit pulls packets from its input, numbers them in arrival order, and
+divides them among its outputs so that each output can be analyzed by a
+separate thread.  TraceMerge later puts the workers' results back into
+arrival order.  Together they run one analysis subgraph per thread and
+produce the same packets, in the same order, as a single copy of the
+subgraph would.
+
+Packets are divided by IP host pair: every packet between two given
+addresses, in either direction, goes to the same output.  Each ICMP error is
+sent with the host pair of the packet it encapsulates.  Each flow that
+AggregateIPFlows tracks therefore lives entirely within one worker.  Non-IP
+packets go to output 0.
+
+Each packet's sequence number is stored in an 8-byte annotation, and each
+output has a queue of CAPACITY packets.  Each output must be pulled by a
+pull-to-push element, such as Unqueue, that finishes pushing one packet
+before pulling the next.  Each worker must also push every packet it does not
+drop to the corresponding TraceMerge input without holding it.
+TraceSplit relies on this to tell TraceMerge which sequence numbers are
+still in progress.  It provides a separate empty notifier per output.
+
+TraceSplit runs a task that pulls up to BURST packets per run.  When the
+queue for a packet's output is full, TraceSplit holds the packet and retries
+later.  TraceSplit also stops pulling while WINDOW packets are between it and
+TraceMerge's output, which bounds the memory TraceMerge needs to restore
+order.  Neither TraceSplit nor TraceMerge ever blocks a thread, so any
+element may share a thread with any other, but the workers gain most from
+threads of their own.
+
+Keyword arguments are:
+
+=over 8
+
+=item CAPACITY
+
+Integer.  Capacity of each output queue, rounded up to a power of two.
+Default is 1024.
+
+=item WINDOW
+
+Integer.  Maximum number of packets numbered but not yet emitted by
+TraceMerge.  Default is 65536.
+
+=item BURST
+
+Integer.  Maximum number of packets to dispatch per task run.  Default is 32.
+
+=item ANNO
+
+Annotation offset of the 8-byte sequence number.  Default is 40, the offset
+of the performance-counter annotation, which the analysis elements do not
+use.
+
+=back
+
+=h count read-only
+
+Returns the number of packets dispatched.
+
+=h stalls read-only
+
+Returns the number of task runs held up by a full output queue or by
+WINDOW.
+
+=h counts read-only
+
+Returns the number of packets dispatched to each output, one per line.
+
+=e
+
+This configuration runs AggregateIPFlows on four threads and writes the same
+summary a single-threaded configuration would.
+
+  elementclass Worker {
+      input -> uq :: Unqueue -> AggregateIPFlows -> output;
+  }
+  FromDump(FILE, FORCE_IP true) -> ts :: TraceSplit;
+  tm :: TraceMerge(ts, RENUMBER true, STOP true);
+  ts[0] -> w0 :: Worker -> [0] tm;
+  ts[1] -> w1 :: Worker -> [1] tm;
+  ts[2] -> w2 :: Worker -> [2] tm;
+  ts[3] -> w3 :: Worker -> [3] tm;
+  tm -> ToIPSummaryDump(-, FIELDS timestamp aggregate ip_src ip_dst);
+  StaticThreadSched(w0/uq 1, w1/uq 2, w2/uq 3, w3/uq 4);
+
+=a
+
+TraceMerge, TimeSortedSched, AggregateIPFlows, AggregateCounter, Unqueue */
+
+class TraceSplit : public Element { public:
+
+    TraceSplit() CLICK_COLD;
+    ~TraceSplit() CLICK_COLD;
+
+    const char *class_name() const	{ return "TraceSplit"; }
+    const char *port_count() const	{ return "1/1-"; }
+    const char *processing() const	{ return PULL; }
+    void *port_cast(bool isoutput, int port, const char *name);
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+    Packet *pull(int);
+
+    int seq_anno() const		{ return _anno; }
+    inline bool drained(int port, uint64_t seq) const;
+    bool done() const			{ return _eof && !_pending; }
+    uint32_t window() const		{ return _window; }
+    void attach()			{ _attached = true; }
+    void release(uint64_t seq)		{ _released = seq; }
+
+  private:
+
+    // Single-producer, single-consumer packet ring.  The producer is
+    // TraceSplit's task; the consumer is the worker pulling the output.
+    struct Output {
+	Packet **q;
+	uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint64_t dispatched;	// last sequence assigned here
+	volatile uint64_t handed;	// last sequence pulled by the worker
+	volatile uint64_t completed;	// last sequence the worker finished
+	uint64_t count;
+	ActiveNotifier notifier;
+    };
+
+    Output *_out;
+    uint32_t _capacity;
+    uint32_t _window;
+    int _burst;
+    int _anno;
+
+    uint64_t _seq;
+    volatile uint64_t _released;	// last sequence TraceMerge emitted
+    bool _attached;
+    Packet *_pending;
+    int _pending_port;
+    bool _eof;
+    uint64_t _stalls;
+
+    Task _task;
+    NotifierSignal _signal;
+
+    int classify(Packet *) const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+/** @brief Return true iff output @a port has no packet in progress whose
+ * sequence number is less than @a seq.
+ *
+ * Call this only after finding @a port's TraceMerge input empty, then check
+ * that input again: a worker pushes its output before it marks the packet
+ * completed. */
+inline bool
+TraceSplit::drained(int port, uint64_t seq) const
+{
+    const Output &o = _out[port];
+    uint64_t c = o.completed;
+    click_read_fence();
+    return c >= seq || c == o.dispatched;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,409 @@
+/*
+ * fqcodel.{cc,hh} -- element implements the FQ-CoDel queue discipline
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fqcodel.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/integers.hh>
+#include <click/heap.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+inline void
+FQCoDel::FlowList::push_back(Flow *f)
+{
+    f->next = 0;
+    if (tail)
+	tail->next = f;
+    else
+	head = f;
+    tail = f;
+}
+
+inline FQCoDel::Flow *
+FQCoDel::FlowList::pop_front()
+{
+    Flow *f = head;
+    if (f && !(head = f->next))
+	tail = 0;
+    return f;
+}
+
+FQCoDel::FQCoDel()
+    : _flows(0), _nflows(0), _packets(0), _bytes(0),
+      _drops(0), _overlimit_drops(0)
+{
+}
+
+FQCoDel::~FQCoDel()
+{
+}
+
+void *
+FQCoDel::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    return Element::cast(n);
+}
+
+int
+FQCoDel::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _nflows = 1024;
+    _limit = 10240;
+    _memory_limit = 32 << 20;
+    _quantum = 1514;
+    _target = Timestamp::make_msec(0, 5);
+    _interval = Timestamp::make_msec(0, 100);
+    if (Args(conf, this, errh)
+	.read("FLOWS", _nflows)
+	.read("LIMIT", _limit)
+	.read("MEMORY_LIMIT", _memory_limit)
+	.read("QUANTUM", _quantum)
+	.read("TARGET", _target)
+	.read("INTERVAL", _interval)
+	.complete() < 0)
+	return -1;
+    if (_nflows < 1 || _nflows > 65536)
+	return errh->error("FLOWS must be between 1 and 65536");
+    if (_quantum < 1)
+	return errh->error("QUANTUM must be positive");
+    if (_limit < 1)
+	return errh->error("LIMIT must be positive");
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    return 0;
+}
+
+int
+FQCoDel::initialize(ErrorHandler *errh)
+{
+    if (!(_flows = new Flow[_nflows]))
+	return errh->error("out of memory");
+    _fat_heap.reserve(_nflows);
+    // A random perturbation keeps hosts from aiming at each other's
+    // sub-queues.
+    _perturb = click_random();
+    return 0;
+}
+
+void
+FQCoDel::cleanup(CleanupStage)
+{
+    for (uint32_t i = 0; i < _nflows && _flows; ++i)
+	while (Packet *p = flow_pop(&_flows[i]))
+	    p->kill();
+    delete[] _flows;
+    _flows = 0;
+    _fat_heap.clear();
+}
+
+uint32_t
+FQCoDel::flow_index(Packet *p) const
+{
+    if (!p->has_network_header())
+	return 0;
+    const click_ip *iph = p->ip_header();
+    uint32_t h = _perturb ^ iph->ip_src.s_addr;
+    h *= 0x85EBCA6BU;
+    h ^= (h >> 13) ^ iph->ip_dst.s_addr;
+    h *= 0xC2B2AE35U;
+    h ^= (h >> 16) ^ iph->ip_p;
+    if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+	&& IP_FIRSTFRAG(iph) && p->transport_length() >= 4) {
+	uint32_t ports;
+	memcpy(&ports, p->transport_header(), 4);
+	h ^= ports;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+    }
+    return (uint32_t) (((uint64_t) h * _nflows) >> 32);
+}
+
+/** @brief Restore _fat_heap after @a f's backlog changed. */
+inline void
+FQCoDel::fat_update(Flow *f)
+{
+    if (f->fat_place < 0) {
+	_fat_heap.push_back(f);
+	push_heap(_fat_heap.begin(), _fat_heap.end(), fat_less(), fat_place());
+    } else if (f->packets)
+	change_heap(_fat_heap.begin(), _fat_heap.end(),
+		    _fat_heap.begin() + f->fat_place, fat_less(), fat_place());
+    else {
+	remove_heap(_fat_heap.begin(), _fat_heap.end(),
+		    _fat_heap.begin() + f->fat_place, fat_less(), fat_place());
+	_fat_heap.pop_back();
+	f->fat_place = -1;
+    }
+}
+
+inline Packet *
+FQCoDel::flow_pop(Flow *f)
+{
+    Packet *p = f->head;
+    if (p) {
+	if (!(f->head = p->next()))
+	    f->tail = 0;
+	p->set_next(0);
+	--f->packets;
+	f->backlog -= p->length();
+	--_packets;
+	_bytes -= p->length();
+	fat_update(f);
+    }
+    return p;
+}
+
+void
+FQCoDel::emit_drops(Packet *dropped)
+{
+    while (dropped) {
+	Packet *next = dropped->next();
+	dropped->set_next(0);
+	checked_output_push(1, dropped);
+	dropped = next;
+    }
+}
+
+void
+FQCoDel::push(int, Packet *p)
+{
+    Packet *dropped = 0;
+    SET_FIRST_TIMESTAMP_ANNO(p, Timestamp::now_steady());
+    p->set_next(0);
+
+    _lock.acquire();
+    Flow *f = &_flows[flow_index(p)];
+    if (f->tail)
+	f->tail->set_next(p);
+    else
+	f->head = p;
+    f->tail = p;
+    ++f->packets;
+    f->backlog += p->length();
+    ++_packets;
+    _bytes += p->length();
+    fat_update(f);
+
+    if (!f->listed) {
+	f->listed = true;
+	f->deficit = _quantum;
+	_new_flows.push_back(f);
+    }
+
+    while (_packets > _limit || _bytes > _memory_limit) {
+	// As in Linux, drop up to half of the largest flow's backlog at once.
+	Flow *fat = _fat_heap[0];
+	uint32_t threshold = fat->backlog / 2;
+	int n = 0;
+	do {
+	    Packet *q = flow_pop(fat);
+	    ++fat->drops;
+	    ++_overlimit_drops;
+	    q->set_next(dropped);
+	    dropped = q;
+	} while (fat->packets && ++n < DROP_BATCH && fat->backlog > threshold);
+    }
+    _lock.release();
+
+    _empty_note.wake();
+    emit_drops(dropped);
+}
+
+Timestamp
+FQCoDel::control_law(const Timestamp &t, uint32_t count) const
+{
+    // t + interval / sqrt(count), scaled to keep int_sqrt precise.
+    uint64_t ns = int_divide((uint64_t) _interval.nsecval() * 16,
+			     (uint32_t) int_sqrt((uint64_t) count << 8));
+    return t + Timestamp::make_nsec(ns);
+}
+
+inline Packet *
+FQCoDel::flow_dequeue(Flow *f, const Timestamp &now, bool &ok_to_drop)
+{
+    ok_to_drop = false;
+    Packet *p = flow_pop(f);
+    if (!p) {
+	f->first_above_time = Timestamp();
+	return 0;
+    }
+    Timestamp sojourn = now - FIRST_TIMESTAMP_ANNO(p);
+    if (sojourn < _target || f->backlog <= (uint32_t) _quantum)
+	f->first_above_time = Timestamp();
+    else if (!f->first_above_time)
+	f->first_above_time = now + _interval;
+    else if (now >= f->first_above_time)
+	ok_to_drop = true;
+    return p;
+}
+
+Packet *
+FQCoDel::codel_dequeue(Flow *f, const Timestamp &now, Packet *&dropped)
+{
+    bool ok_to_drop;
+    Packet *p = flow_dequeue(f, now, ok_to_drop);
+    if (!p) {
+	f->dropping = false;
+	return 0;
+    }
+
+#define FQCODEL_DROP(p) do { ++f->drops; ++_drops; \
+	(p)->set_next(dropped); dropped = (p); } while (0)
+    if (f->dropping) {
+	if (!ok_to_drop)
+	    f->dropping = false;
+	while (f->dropping && now >= f->drop_next) {
+	    FQCODEL_DROP(p);
+	    ++f->count;
+	    if (!(p = flow_dequeue(f, now, ok_to_drop)) || !ok_to_drop)
+		f->dropping = false;
+	    else
+		f->drop_next = control_law(f->drop_next, f->count);
+	}
+    } else if (ok_to_drop) {
+	FQCODEL_DROP(p);
+	p = flow_dequeue(f, now, ok_to_drop);
+	f->dropping = true;
+	// Resume near the previous drop rate if we were dropping recently.
+	uint32_t delta = f->count - f->lastcount;
+	if (delta > 1 && now - f->drop_next < _interval * 16)
+	    f->count = delta;
+	else
+	    f->count = 1;
+	f->lastcount = f->count;
+	f->drop_next = control_law(now, f->count);
+    }
+#undef FQCODEL_DROP
+    return p;
+}
+
+Packet *
+FQCoDel::pull(int)
+{
+    Packet *dropped = 0, *p = 0;
+    Timestamp now = Timestamp::now_steady();
+
+    _lock.acquire();
+    while (1) {
+	FlowList *list = _new_flows.head ? &_new_flows : &_old_flows;
+	Flow *f = list->head;
+	if (!f)
+	    break;
+	if (f->deficit <= 0) {
+	    f->deficit += _quantum;
+	    list->pop_front();
+	    _old_flows.push_back(f);
+	    continue;
+	}
+	p = codel_dequeue(f, now, dropped);
+	if (!p) {
+	    list->pop_front();
+	    // An emptied new flow goes to the old list once, so it cannot
+	    // regain priority by oscillating between empty and nonempty.
+	    if (list == &_new_flows && _old_flows.head)
+		_old_flows.push_back(f);
+	    else
+		f->listed = false;
+	    continue;
+	}
+	f->deficit -= p->length();
+	Timestamp sojourn = now - FIRST_TIMESTAMP_ANNO(p);
+	++f->dequeued;
+	f->sojourn_sum += sojourn;
+	if (sojourn > f->sojourn_max)
+	    f->sojourn_max = sojourn;
+	break;
+    }
+    bool empty = !_packets;
+    _lock.release();
+
+    if (empty && !p) {
+	_empty_note.sleep();
+#if HAVE_MULTITHREAD
+	// Undo a racing push()'s wake() if we just cancelled it.
+	if (_packets)
+	    _empty_note.wake();
+#endif
+    }
+    emit_drops(dropped);
+    return p;
+}
+
+enum { h_length, h_bytes, h_flows, h_reset };
+
+String
+FQCoDel::read_handler(Element *e, void *thunk)
+{
+    FQCoDel *fq = static_cast<FQCoDel *>(e);
+    switch ((intptr_t) thunk) {
+    case h_length:
+	return String(fq->_packets);
+    case h_bytes:
+	return String(fq->_bytes);
+    case h_flows: {
+	StringAccum sa;
+	fq->_lock.acquire();
+	for (uint32_t i = 0; i < fq->_nflows; ++i) {
+	    Flow &f = fq->_flows[i];
+	    if (!f.packets && !f.dequeued && !f.drops)
+		continue;
+	    Timestamp mean = f.dequeued ? f.sojourn_sum / (double) f.dequeued : Timestamp();
+	    sa << i << ' ' << f.packets << ' ' << f.backlog << ' '
+	       << f.dequeued << ' ' << f.drops << ' '
+	       << mean << ' ' << f.sojourn_max << '\n';
+	}
+	fq->_lock.release();
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+int
+FQCoDel::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    FQCoDel *fq = static_cast<FQCoDel *>(e);
+    fq->_lock.acquire();
+    fq->_drops = fq->_overlimit_drops = 0;
+    for (uint32_t i = 0; i < fq->_nflows; ++i) {
+	Flow &f = fq->_flows[i];
+	f.dequeued = 0;
+	f.drops = 0;
+	f.sojourn_sum = f.sojourn_max = Timestamp();
+    }
+    fq->_lock.release();
+    return 0;
+}
+
+void
+FQCoDel::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("bytes", read_handler, h_bytes);
+    add_data_handlers("drops", Handler::OP_READ, &_drops);
+    add_data_handlers("overlimit_drops", Handler::OP_READ, &_overlimit_drops);
+    add_read_handler("flows", read_handler, h_flows);
+    add_write_handler("reset_counts", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(FQCoDel)
+ELEMENT_MT_SAFE(FQCoDel)
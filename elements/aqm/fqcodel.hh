@@ -0,0 +1,218 @@
+#ifndef CLICK_FQCODEL_HH
+#define CLICK_FQCODEL_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+#include <click/sync.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FQCoDel([I<KEYWORDS>])
+
+=s aqm
+
+per-flow fair queue with CoDel dropping (FQ-CoDel)
+
+=d
+
+A queue that implements the FQ-CoDel scheduler and active queue management
+algorithm of RFC 8290.  Packets pushed to the input are hashed by IP 5-tuple
+into one of FLOWS sub-queues; packets without an IP header annotation share
+sub-queue 0.  Pulls from the output are served from the sub-queues by deficit
+round robin, favoring flows that have just become active (the DRR++ "new
+flows" list), so sparse flows see little queueing delay even while a bulk
+flow keeps its sub-queue full.  Each sub-queue runs its own CoDel instance,
+which drops from the head of that sub-queue only.
+
+When the element holds more than LIMIT packets or MEMORY_LIMIT bytes, it
+drops from the head of the flow with the largest byte backlog.  Nonempty
+sub-queues are kept in a heap ordered by backlog, so that flow is found in
+constant time; keeping the heap costs O(log I<n>) per packet, where I<n> is
+the number of nonempty sub-queues.  Like Linux, FQCoDel then drops up to
+half of the flow's backlog (at most 64 packets) at once.
+
+FQCoDel stamps each packet's "first timestamp" annotation with its enqueue
+time, so there is no need for SetTimestamp.  Dropped packets are emitted on
+output 1, if present, and otherwise killed.  Push and pull may run on
+different threads.  The downstream empty notifier is supported, so pullers
+such as Unqueue sleep while every sub-queue is empty.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOWS
+
+Integer.  Number of flow sub-queues.  Default is 1024.
+
+=item LIMIT
+
+Integer.  Maximum number of packets held.  Default is 10240.
+
+=item MEMORY_LIMIT
+
+Integer.  Maximum number of bytes held.  Default is 32 MB.
+
+=item QUANTUM
+
+Integer.  Bytes a flow may send per round.  Default is 1514.
+
+=item TARGET
+
+Time.  CoDel target sojourn time.  Default is 5 ms.
+
+=item INTERVAL
+
+Time.  CoDel interval.  Default is 100 ms.
+
+=back
+
+=e
+
+  ... -> fq :: FQCoDel(FLOWS 256) -> Unqueue -> ...
+
+=h length read-only
+
+Returns the number of packets held.
+
+=h bytes read-only
+
+Returns the number of bytes held.
+
+=h drops read-only
+
+Returns the number of packets dropped by CoDel.
+
+=h overlimit_drops read-only
+
+Returns the number of packets dropped because LIMIT or MEMORY_LIMIT was
+reached.
+
+=h flows read-only
+
+Returns one line for each sub-queue that has carried traffic since the last
+reset: index, packets queued, bytes queued, packets dequeued, packets
+dropped, mean sojourn time, and maximum sojourn time (both in seconds).
+
+=h reset_counts write-only
+
+Resets the drop counters and per-flow statistics.
+
+=a
+
+CoDel, Queue, DRRSched, RED
+
+RFC 8290, I<The Flow Queue CoDel Packet Scheduler and Active Queue Management
+Algorithm>. */
+
+class FQCoDel : public Element { public:
+
+    FQCoDel() CLICK_COLD;
+    ~FQCoDel() CLICK_COLD;
+
+    const char *class_name() const		{ return "FQCoDel"; }
+    const char *port_count() const		{ return "1/1-2"; }
+    const char *processing() const		{ return "h/lh"; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+
+  private:
+
+    enum { DROP_BATCH = 64 };
+
+    struct Flow {
+	Packet *head;
+	Packet *tail;
+	Flow *next;		// next flow in the new or old list
+	uint32_t packets;
+	uint32_t backlog;
+	int deficit;
+	bool listed;
+	int fat_place;		// position in _fat_heap, or -1
+
+	// CoDel state
+	bool dropping;
+	uint32_t count;
+	uint32_t lastcount;
+	Timestamp first_above_time;
+	Timestamp drop_next;
+
+	// statistics
+	uint64_t dequeued;
+	uint32_t drops;
+	Timestamp sojourn_sum;
+	Timestamp sojourn_max;
+
+	Flow()
+	    : head(0), tail(0), next(0), packets(0), backlog(0), deficit(0),
+	      listed(false), fat_place(-1), dropping(false), count(0),
+	      lastcount(0), dequeued(0), drops(0) {
+	}
+    };
+
+    // Orders _fat_heap with the largest backlog on top.
+    struct fat_less {
+	inline bool operator()(Flow *a, Flow *b) {
+	    return a->backlog > b->backlog;
+	}
+    };
+    struct fat_place {
+	inline void operator()(Flow **begin, Flow **it) {
+	    (*it)->fat_place = it - begin;
+	}
+    };
+
+    struct FlowList {
+	Flow *head;
+	Flow *tail;
+	FlowList() : head(0), tail(0) { }
+	inline void push_back(Flow *f);
+	inline Flow *pop_front();
+    };
+
+    Flow *_flows;
+    uint32_t _nflows;
+    uint32_t _perturb;
+    FlowList _new_flows;
+    FlowList _old_flows;
+    Vector<Flow *> _fat_heap;	// nonempty flows
+
+    uint32_t _packets;
+    uint32_t _bytes;
+    uint32_t _limit;
+    uint32_t _memory_limit;
+    int _quantum;
+    Timestamp _target;
+    Timestamp _interval;
+
+    uint32_t _drops;
+    uint32_t _overlimit_drops;
+
+    SimpleSpinlock _lock;
+    ActiveNotifier _empty_note;
+
+    uint32_t flow_index(Packet *p) const;
+    inline Packet *flow_pop(Flow *f);
+    inline Packet *flow_dequeue(Flow *f, const Timestamp &now, bool &ok_to_drop);
+    Packet *codel_dequeue(Flow *f, const Timestamp &now, Packet *&dropped);
+    Timestamp control_law(const Timestamp &t, uint32_t count) const;
+    inline void fat_update(Flow *f);
+    void emit_drops(Packet *dropped);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -26,21 +26,69 @@
 CLICK_DECLS
 
 EtherSwitch::EtherSwitch()
-    : _table(AddrInfo(-1, Timestamp())), _timeout(300)
+    : _slots(0), _mask(0), _timeout(300), _updates(0), _overflows(0)
 {
 }
 
 EtherSwitch::~EtherSwitch()
 {
-    _table.clear();
+    delete[] _slots;
 }
 
 int
 EtherSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh)
+    uint32_t capacity = 8192;
+    if (Args(conf, this, errh)
 	.read("TIMEOUT", SecondsArg(), _timeout)
-	.complete();
+	.read("CAPACITY", capacity)
+	.complete() < 0)
+	return -1;
+    if (capacity < 1 || capacity > (1U << 24))
+	return errh->error("CAPACITY out of range");
+
+    uint32_t n = MAX_PROBE;
+    while (n < capacity)
+	n *= 2;
+    delete[] _slots;
+    if (!(_slots = new SeqlockValue<AddrInfo>[n]))
+	return errh->error("out of memory!");
+    _mask = n - 1;
+    return 0;
+}
+
+/** @brief Associate @a a with @a port at time @a now.
+ *
+ * Reuses @a a's slot if it has one, otherwise the first empty or expired
+ * slot on its probe sequence. */
+void
+EtherSwitch::learn(const EtherAddress &a, int port, uint32_t now)
+{
+    AddrInfo ai;
+    SeqlockValue<AddrInfo> *slot = 0;
+
+    _lock.acquire();
+    for (uint32_t i = hash(a), n = 0; n < MAX_PROBE; ++i, ++n) {
+	SeqlockValue<AddrInfo> *s = &_slots[i & _mask];
+	ai = s->read();
+	if (ai.port && ai.addr == a) {
+	    slot = s;
+	    break;
+	} else if (!slot && (!ai.port || now >= (uint64_t) ai.stamp + _timeout))
+	    slot = s;
+	if (!ai.port)
+	    break;
+    }
+
+    if (slot) {
+	ai.addr = a;
+	ai.port = port + 1;
+	ai.stamp = now;
+	slot->publish(ai);
+	++_updates;
+    } else
+	++_overflows;
+    _lock.release();
 }
 
 void
@@ -61,25 +109,7 @@ EtherSwitch::broadcast(int source, Packet *p)
 void
 EtherSwitch::push(int source, Packet *p)
 {
-    click_ether* e = (click_ether*) p->data();
-    int outport = -1;		// Broadcast
-
-    // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
-	}
-    }
+    int outport = lookup(source, p); // -1 means broadcast
 
   if (outport < 0)
     broadcast(source, p);
@@ -96,12 +126,21 @@ EtherSwitch::reader(Element* f, void *thunk)
     switch ((intptr_t) thunk) {
     case 0: {
 	StringAccum sa;
-	for (Table::iterator iter = sw->_table.begin(); iter.live(); iter++)
-	    sa << iter.key() << ' ' << iter.value().port << '\n';
+	for (uint32_t i = 0; sw->_slots && i <= sw->_mask; ++i) {
+	    AddrInfo ai = sw->_slots[i].read();
+	    if (ai.port)
+		sa << ai.addr << ' ' << (ai.port - 1) << '\n';
+	}
 	return sa.take_string();
     }
     case 1:
 	return String(sw->_timeout);
+    case 2:
+	return String(sw->_mask + 1);
+    case 3:
+	return String(sw->_updates);
+    case 4:
+	return String(sw->_overflows);
     default:
 	return String();
     }
@@ -122,7 +161,11 @@ EtherSwitch::add_handlers()
     add_read_handler("table", reader, 0);
     add_read_handler("timeout", reader, 1);
     add_write_handler("timeout", writer, 0);
+    add_read_handler("capacity", reader, 2);
+    add_read_handler("updates", reader, 3);
+    add_read_handler("overflows", reader, 4);
 }
 
 EXPORT_ELEMENT(EtherSwitch)
+ELEMENT_MT_SAFE(EtherSwitch)
 CLICK_ENDDECLS
@@ -2,13 +2,14 @@
 #define CLICK_ETHERSWITCH_HH
 #include <click/element.hh>
 #include <click/etheraddress.hh>
-#include <click/hashtable.hh>
+#include <click/sync.hh>
+#include <clicknet/ether.h>
 CLICK_DECLS
 
 /*
 =c
 
-EtherSwitch([I<keywords> TIMEOUT])
+EtherSwitch([I<keywords> TIMEOUT, CAPACITY])
 
 =s ethernet
 
@@ -29,6 +30,14 @@ the one corresponding to the packet's input port.  The TIMEOUT parameter
 affects how long port associations last.  If it is 0, then the element does
 not learn addresses, and acts like a dumb hub.
 
+EtherSwitch may be used from several threads at once; for example, each
+input may be driven by its own FromDevice on its own thread, with each output
+feeding a ThreadSafeQueue in front of a ToDevice.  Address lookups take no
+locks and do not write to the table.  An association is rewritten only when an
+address moves to a different port, or when its timestamp is at least a second
+old, so steady traffic between known hosts does not bounce cache lines between
+threads.
+
 Keyword arguments are:
 
 =over 8
@@ -38,13 +47,22 @@ Keyword arguments are:
 The timeout for port associations, in seconds.  Any port mapping (i.e.,
 binding between an address and a port number) is dropped after TIMEOUT seconds
 of inactivity.  If 0, the element acts like a dumb hub.  Default is 300.
+Inactivity is measured with packets' timestamp annotations, at a granularity
+of one second.
+
+=item CAPACITY
+
+The maximum number of addresses in the table, rounded up to a power of two.
+Default is 8192.
 
 =back
 
 =n
 
-The EtherSwitch element has no limit on the memory consumed by cached Ethernet
-addresses.
+The table has a fixed size.  An address that cannot be placed within a short
+probe of its home slot is not learned, and packets to it are flooded, as in a
+hardware switch whose address table is full; expired associations make room
+for new ones.
 
 =h table read-only
 
@@ -54,6 +72,19 @@ Returns the current port association table.
 
 Returns or sets the TIMEOUT argument.
 
+=h capacity read-only
+
+Returns the table's capacity.
+
+=h updates read-only
+
+Returns the number of times an association was created or rewritten.
+
+=h overflows read-only
+
+Returns the number of times an address could not be learned because the table
+was full near its home slot.
+
 =a
 
 ListenEtherSwitch, EtherSpanTree
@@ -75,17 +106,31 @@ class EtherSwitch : public Element { public:
   void push(int port, Packet* p);
 
     struct AddrInfo {
-	int port;
-	Timestamp stamp;
-	inline AddrInfo(int p, const Timestamp &t);
+	EtherAddress addr;
+	uint16_t port;		// output port + 1, or 0 if the slot is empty
+	uint32_t stamp;		// seconds
     };
 
   private:
 
-    typedef HashTable<EtherAddress, AddrInfo> Table;
-    Table _table;
-    uint32_t _timeout;
+    enum { MAX_PROBE = 16, REFRESH = 1 };
 
+    // Each slot is written only under _lock, and read without it.  Slots
+    // never become empty again, so a probe may stop at the first empty one.
+    SeqlockValue<AddrInfo> *_slots;
+    uint32_t _mask;
+    SimpleSpinlock _lock;
+    uint32_t _timeout;
+    uint32_t _updates;
+    uint32_t _overflows;
+
+    static inline uint32_t hash(const EtherAddress &a) {
+	uint32_t h = a.hashcode() * 0x9E3779B1U;
+	return h ^ (h >> 16);
+    }
+    inline bool find(const EtherAddress &a, AddrInfo &ai) const;
+    void learn(const EtherAddress &a, int port, uint32_t now);
+    inline int lookup(int source, Packet *p);
     void broadcast(int source, Packet*);
 
     static String reader(Element *, void *);
@@ -94,10 +139,49 @@ class EtherSwitch : public Element { public:
 
 };
 
-inline
-EtherSwitch::AddrInfo::AddrInfo(int p, const Timestamp& s)
-    : port(p), stamp(s)
+/** @brief Find @a a in the table without locking.
+ *
+ * Returns true and sets @a ai if @a a has an association, expired or not. */
+inline bool
+EtherSwitch::find(const EtherAddress &a, AddrInfo &ai) const
+{
+    for (uint32_t i = hash(a), n = 0; n < MAX_PROBE; ++i, ++n) {
+	ai = _slots[i & _mask].read();
+	if (!ai.port)
+	    return false;
+	if (ai.addr == a)
+	    return true;
+    }
+    return false;
+}
+
+/** @brief Learn packet @a p's source and return its output port.
+ *
+ * Returns -1 if @a p should be flooded. */
+inline int
+EtherSwitch::lookup(int source, Packet *p)
 {
+    // 0 timeout means dumb switch
+    if (_timeout == 0)
+	return -1;
+
+    const click_ether *e = (const click_ether *) p->data();
+    uint32_t now = p->timestamp_anno().sec();
+    AddrInfo ai;
+
+    // Only write to the table if the source moved or its entry is stale.
+    EtherAddress src(e->ether_shost);
+    if (!find(src, ai) || ai.port != source + 1
+	|| (int32_t) (now - ai.stamp) >= REFRESH)
+	learn(src, source, now);
+
+    // Set outport if dst is unicast, we have info about it, and the
+    // info is still valid.
+    EtherAddress dst(e->ether_dhost);
+    if (!dst.is_group() && find(dst, ai)
+	&& now < (uint64_t) ai.stamp + _timeout)
+	return ai.port - 1;
+    return -1;
 }
 
 CLICK_ENDDECLS
@@ -35,25 +35,7 @@ ListenEtherSwitch::~ListenEtherSwitch()
 void
 ListenEtherSwitch::push(int source, Packet *p)
 {
-    const click_ether* e = (const click_ether*) p->data();
-    int outport = -1;		// Broadcast
-
-    // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
-	}
-    }
+    int outport = lookup(source, p); // -1 means broadcast
 
     if (outport < 0)
 	broadcast(source, p);
@@ -67,4 +49,5 @@ ListenEtherSwitch::push(int source, Packet *p)
 
 ELEMENT_REQUIRES(EtherSwitch)
 EXPORT_ELEMENT(ListenEtherSwitch)
+ELEMENT_MT_SAFE(ListenEtherSwitch)
 CLICK_ENDDECLS
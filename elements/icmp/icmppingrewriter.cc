@@ -71,6 +71,7 @@ ICMPPingRewriter::ICMPPingFlow::unparse(StringAccum &sa, bool direction,
 
 ICMPPingRewriter::ICMPPingRewriter()
 {
+    _flow_size = sizeof(ICMPPingFlow);
 }
 
 ICMPPingRewriter::~ICMPPingRewriter()
@@ -114,7 +115,8 @@ ICMPPingRewriter::get_entry(int ip_p, const IPFlowID &xflowid, int input)
     bool echo = (input != get_entry_reply);
     IPFlowID flowid(xflowid.saddr(), xflowid.sport() + !echo,
 		    xflowid.daddr(), xflowid.sport() + echo);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
 	IPRewriterInput &is = _input_specs[input];
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
@@ -131,16 +133,17 @@ ICMPPingRewriter::add_flow(int, const IPFlowID &flowid,
 			   const IPFlowID &rewritten_flowid, int input)
 {
     void *data;
+    IPRewriterShard &shard = local_shard();
     if ((uint16_t) (flowid.sport() + 1) != flowid.dport()
 	|| (uint16_t) (rewritten_flowid.sport() + 1) != rewritten_flowid.dport()
-	|| !(data = _allocator.allocate()))
+	|| !(data = shard.allocator.allocate()))
 	return 0;
 
     ICMPPingFlow *flow = new(data) ICMPPingFlow
 	(&_input_specs[input], flowid, rewritten_flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard.map);
 }
 
 void
@@ -168,7 +171,8 @@ ICMPPingRewriter::push(int port, Packet *p_in)
     IPFlowID flowid(iph->ip_src, icmph->icmp_identifier + !echo,
 		    iph->ip_dst, icmph->icmp_identifier + echo);
 
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
 
     if (!m && !echo)
 	goto mapping_fail;
@@ -189,7 +193,7 @@ ICMPPingRewriter::push(int port, Packet *p_in)
 
     ICMPPingFlow *mf = static_cast<ICMPPingFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
-    mf->change_expiry_by_timeout(_heap, click_jiffies(), _timeouts);
+    mf->change_expiry_by_timeout(shard.heap, click_jiffies(), _timeouts);
 
     output(m->output()).push(p);
 }
@@ -201,10 +205,15 @@ ICMPPingRewriter::dump_mappings_handler(Element *e, void *)
     ICMPPingRewriter *rw = (ICMPPingRewriter *)e;
     StringAccum sa;
     click_jiffies_t now = click_jiffies();
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); ++iter) {
-	ICMPPingFlow *f = static_cast<ICMPPingFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.map.begin(); iter.live(); ++iter) {
+	    ICMPPingFlow *f = static_cast<ICMPPingFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
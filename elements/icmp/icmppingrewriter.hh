@@ -116,7 +116,6 @@ class ICMPPingRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(ICMPPingFlow)> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
@@ -127,9 +126,10 @@ class ICMPPingRewriter : public IPRewriterBase { public:
 inline void
 ICMPPingRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    unmap_flow(flow, _map);
+    IPRewriterShard &shard = flow_shard(flow);
+    unmap_flow(flow, shard.map);
     static_cast<ICMPPingFlow *>(flow)->~ICMPPingFlow();
-    _allocator.deallocate(flow);
+    shard.allocator.deallocate(flow);
 }
 
 CLICK_ENDDECLS
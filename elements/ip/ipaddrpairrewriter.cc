@@ -68,6 +68,7 @@ IPAddrPairRewriter::IPAddrPairFlow::unparse(StringAccum &sa, bool direction,
 
 IPAddrPairRewriter::IPAddrPairRewriter()
 {
+    _flow_size = sizeof(IPAddrPairFlow);
 }
 
 IPAddrPairRewriter::~IPAddrPairRewriter()
@@ -105,7 +106,8 @@ IPRewriterEntry *
 IPAddrPairRewriter::get_entry(int, const IPFlowID &xflowid, int input)
 {
     IPFlowID flowid(xflowid.saddr(), 0, xflowid.daddr(), 0);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
 	IPRewriterInput &is = _input_specs[input];
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
@@ -120,16 +122,17 @@ IPAddrPairRewriter::add_flow(int, const IPFlowID &flowid,
 			     const IPFlowID &rewritten_flowid, int input)
 {
     void *data;
+    IPRewriterShard &shard = local_shard();
     if (rewritten_flowid.sport()
 	|| rewritten_flowid.dport()
-	|| !(data = _allocator.allocate()))
+	|| !(data = shard.allocator.allocate()))
 	return 0;
 
     IPAddrPairFlow *flow = new(data) IPAddrPairFlow
 	(&_input_specs[input], flowid, rewritten_flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard.map);
 }
 
 void
@@ -139,7 +142,8 @@ IPAddrPairRewriter::push(int port, Packet *p_in)
     click_ip *iph = p->ip_header();
 
     IPFlowID flowid(iph->ip_src, 0, iph->ip_dst, 0);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -156,7 +160,7 @@ IPAddrPairRewriter::push(int port, Packet *p_in)
 
     IPAddrPairFlow *mf = static_cast<IPAddrPairFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
-    mf->change_expiry_by_timeout(_heap, click_jiffies(), _timeouts);
+    mf->change_expiry_by_timeout(shard.heap, click_jiffies(), _timeouts);
     output(m->output()).push(p);
 }
 
@@ -167,10 +171,15 @@ IPAddrPairRewriter::dump_mappings_handler(Element *e, void *)
     IPAddrPairRewriter *rw = (IPAddrPairRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); iter++) {
-	IPAddrPairFlow *f = static_cast<IPAddrPairFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.map.begin(); iter.live(); ++iter) {
+	    IPAddrPairFlow *f = static_cast<IPAddrPairFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
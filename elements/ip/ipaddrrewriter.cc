@@ -69,6 +69,7 @@ IPAddrRewriter::IPAddrFlow::unparse(StringAccum &sa, bool direction,
 
 IPAddrRewriter::IPAddrRewriter()
 {
+    _flow_size = sizeof(IPAddrFlow);
 }
 
 IPAddrRewriter::~IPAddrRewriter()
@@ -106,10 +107,11 @@ IPRewriterEntry *
 IPAddrRewriter::get_entry(int, const IPFlowID &xflowid, int input)
 {
     IPFlowID flowid(xflowid.saddr(), 0, IPAddress(), 0);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
     if (!m) {
 	IPFlowID rflowid(IPAddress(), 0, xflowid.daddr(), 0);
-	m = _map.get(rflowid);
+	m = shard.map.get(rflowid);
     }
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
 	IPRewriterInput &is = _input_specs[input];
@@ -125,17 +127,18 @@ IPAddrRewriter::add_flow(int, const IPFlowID &flowid,
 			 const IPFlowID &rewritten_flowid, int input)
 {
     void *data;
+    IPRewriterShard &shard = local_shard();
     if (rewritten_flowid.sport()
 	|| rewritten_flowid.dport()
 	|| rewritten_flowid.daddr()
-	|| !(data = _allocator.allocate()))
+	|| !(data = shard.allocator.allocate()))
 	return 0;
 
     IPAddrFlow *flow = new(data) IPAddrFlow
 	(&_input_specs[input], flowid, rewritten_flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard.map);
 }
 
 void
@@ -145,11 +148,12 @@ IPAddrRewriter::push(int port, Packet *p_in)
     click_ip *iph = p->ip_header();
 
     IPFlowID flowid(iph->ip_src, 0, IPAddress(), 0);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
 
     if (!m) {
 	IPFlowID rflowid = IPFlowID(IPAddress(), 0, iph->ip_dst, 0);
-	m = _map.get(rflowid);
+	m = shard.map.get(rflowid);
     }
 
     if (!m) {			// create new mapping
@@ -167,7 +171,7 @@ IPAddrRewriter::push(int port, Packet *p_in)
 
     IPAddrFlow *mf = static_cast<IPAddrFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
-    mf->change_expiry_by_timeout(_heap, click_jiffies(), _timeouts);
+    mf->change_expiry_by_timeout(shard.heap, click_jiffies(), _timeouts);
     output(m->output()).push(p);
 }
 
@@ -178,10 +182,15 @@ IPAddrRewriter::dump_mappings_handler(Element *e, void *)
     IPAddrRewriter *rw = (IPAddrRewriter *)e;
     StringAccum sa;
     click_jiffies_t now = click_jiffies();
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); iter++) {
-	IPAddrFlow *f = static_cast<IPAddrFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.map.begin(); iter.live(); ++iter) {
+	    IPAddrFlow *f = static_cast<IPAddrFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
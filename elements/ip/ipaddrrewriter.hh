@@ -150,7 +150,6 @@ class IPAddrRewriter : public IPRewriterBase { public:
 
   protected:
 
-    SizedHashAllocator<sizeof(IPAddrFlow)> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
@@ -161,9 +160,10 @@ class IPAddrRewriter : public IPRewriterBase { public:
 inline void
 IPAddrRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    unmap_flow(flow, _map);
+    IPRewriterShard &shard = flow_shard(flow);
+    unmap_flow(flow, shard.map);
     static_cast<IPAddrFlow *>(flow)->~IPAddrFlow();
-    _allocator.deallocate(flow);
+    shard.allocator.deallocate(flow);
 }
 
 CLICK_ENDDECLS
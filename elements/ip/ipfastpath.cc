@@ -0,0 +1,224 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipfastpath.{cc,hh} -- burst IP forwarding fast path
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipfastpath.hh"
+#include "iproutetable.hh"
+#include "checkipheader.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ip.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+CLICK_DECLS
+
+IPFastPath::IPFastPath()
+    : _table(0), _burst(32), _task(this), _count(0), _slow(0)
+{
+}
+
+int
+IPFastPath::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *table;
+    if (Args(conf, this, errh)
+	.read_mp("TABLE", table)
+	.read("BURST", _burst)
+	.read("INTERFACES", CheckIPHeader::InterfacesArg(), _bad_src, _good_dst)
+	.read("BADSRC", _bad_src)
+	.read("GOODDST", _good_dst)
+	.complete() < 0)
+	return -1;
+    if (!(_table = static_cast<IPRouteTable *>(table->cast("IPRouteTable"))))
+	return errh->error("%s is not an IPRouteTable", table->name().c_str());
+    if (_burst < 1 || _burst > max_burst)
+	return errh->error("BURST must be between 1 and %d", (int) max_burst);
+    return 0;
+}
+
+int
+IPFastPath::initialize(ErrorHandler *errh)
+{
+    ScheduleInfo::initialize_task(this, &_task, errh);
+    _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    _head.assign(noutputs(), 0);
+    _tail.assign(noutputs(), 0);
+    return 0;
+}
+
+// Checks the checksum of an option-free, 20-byte IP header.
+static inline bool
+ip_checksum_ok(const click_ip *ip)
+{
+    uint32_t sum;
+#if defined(__SSE2__)
+    // Widen the first eight 16-bit words to 32 bits and add them
+    // pairwise; the last two words are added separately.
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ip));
+    __m128i zero = _mm_setzero_si128();
+    __m128i s = _mm_add_epi32(_mm_unpacklo_epi16(v, zero),
+			      _mm_unpackhi_epi16(v, zero));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(s);
+    uint16_t tail[2];
+    memcpy(tail, reinterpret_cast<const uint8_t *>(ip) + 16, 4);
+    sum += tail[0] + tail[1];
+#else
+    uint16_t w[10];
+    memcpy(w, ip, sizeof(w));
+    sum = 0;
+    for (int i = 0; i < 10; ++i)
+	sum += w[i];
+#endif
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum == 0xFFFF;
+}
+
+/** @brief Return the output port for @a p, or the slow path port.
+ *
+ * Does not modify @a p.  The last_* arguments cache the previous lookup
+ * within a burst. */
+inline int
+IPFastPath::classify(Packet *p, IPAddress &last_dst, int &last_port,
+		     IPAddress &last_gw)
+{
+    int slow = noutputs() - 1;
+    const click_ip *ip = reinterpret_cast<const click_ip *>(p->data());
+    if (p->length() < sizeof(click_ip)
+	|| reinterpret_cast<const uint8_t *>(ip)[0] != 0x45
+	|| ip->ip_ttl <= 1)
+	return slow;
+    unsigned len = ntohs(ip->ip_len);
+    if (len < sizeof(click_ip) || len > p->length()
+	|| !ip_checksum_ok(ip))
+	return slow;
+
+    // RFC1812 5.3.7: leave illegal source addresses to the slow path.
+    IPAddress src(ip->ip_src);
+    if (src.addr() == 0xFFFFFFFFU || src.is_multicast())
+	return slow;
+    if (_bad_src.size()
+	&& find(_bad_src.begin(), _bad_src.end(), src) < _bad_src.end()
+	&& find(_good_dst.begin(), _good_dst.end(), IPAddress(ip->ip_dst)) == _good_dst.end())
+	return slow;
+
+    IPAddress dst(ip->ip_dst);
+    if (dst != last_dst || last_port == -2) {
+	last_dst = dst;
+	last_gw = IPAddress();
+	last_port = _table->lookup_route(dst, last_gw);
+    }
+    if (last_port < 0 || last_port >= slow)
+	return slow;
+    return last_port;
+}
+
+bool
+IPFastPath::run_task(Task *)
+{
+    int slow = noutputs() - 1;
+    int n = 0;
+    IPAddress last_dst, last_gw;
+    int last_port = -2;
+
+    // Pull the burst and sort it into per-port lists.
+    for (; n < _burst; ++n) {
+	Packet *p = input(0).pull();
+	if (!p)
+	    break;
+	int port = classify(p, last_dst, last_port, last_gw);
+	if (port != slow) {
+	    WritablePacket *q = p->uniqueify();
+	    if (!q)
+		continue;
+	    click_ip *ip = reinterpret_cast<click_ip *>(q->data());
+	    q->set_ip_header(ip, sizeof(click_ip));
+	    unsigned len = ntohs(ip->ip_len);
+	    if (q->length() > len)
+		q->take(q->length() - len);
+	    // Same RFC 1624 incremental update as DecIPTTL.
+	    --ip->ip_ttl;
+	    unsigned long sum = (~ntohs(ip->ip_sum) & 0xFFFF) + 0xFEFF;
+	    ip->ip_sum = ~htons(sum + (sum >> 16));
+	    q->set_dst_ip_anno(last_gw ? last_gw : IPAddress(ip->ip_dst));
+	    p = q;
+	    ++_count;
+	} else
+	    ++_slow;
+	p->set_next(0);
+	if (_head[port])
+	    _tail[port]->set_next(p);
+	else
+	    _head[port] = p;
+	_tail[port] = p;
+    }
+
+    for (int port = 0; port <= slow; ++port)
+	if (Packet *p = _head[port]) {
+	    _head[port] = 0;
+	    while (p) {
+		Packet *next = p->next();
+		p->set_next(0);
+		output(port).push(p);
+		p = next;
+	    }
+	}
+
+    if (n > 0 || _signal)
+	_task.fast_reschedule();
+    return n > 0;
+}
+
+enum { h_burst, h_reset };
+
+int
+IPFastPath::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    IPFastPath *fp = static_cast<IPFastPath *>(e);
+    switch ((intptr_t) thunk) {
+    case h_burst: {
+	int burst;
+	if (!IntArg().parse(str, burst) || burst < 1 || burst > max_burst)
+	    return errh->error("expected integer between 1 and %d", (int) max_burst);
+	fp->_burst = burst;
+	return 0;
+    }
+    case h_reset:
+	fp->_count = fp->_slow = 0;
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+IPFastPath::add_handlers()
+{
+    add_data_handlers("count", Handler::f_read, &_count);
+    add_data_handlers("slow", Handler::f_read, &_slow);
+    add_data_handlers("burst", Handler::f_read, &_burst);
+    add_write_handler("burst", write_handler, h_burst);
+    add_write_handler("reset_counts", write_handler, h_reset, Handler::f_button);
+    add_task_handlers(&_task, &_signal);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPRouteTable CheckIPHeader)
+EXPORT_ELEMENT(IPFastPath)
+ELEMENT_MT_SAFE(IPFastPath)
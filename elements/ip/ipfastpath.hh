@@ -0,0 +1,191 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPFASTPATH_HH
+#define CLICK_IPFASTPATH_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+CLICK_DECLS
+class IPRouteTable;
+
+/*
+=c
+
+IPFastPath(TABLE, [I<keywords> BURST, INTERFACES, BADSRC, GOODDST])
+
+=s iproute
+
+pulls bursts of IP packets, validates, decrements TTL, and routes them
+
+=d
+
+IPFastPath is a fused plain-forwarding fast path.  It pulls up to BURST
+packets at a time from its input.  Each packet should start with an IP
+header.  For each packet it makes one pass over the header:
+
+=over 4
+
+=item *
+
+It validates the header, as CheckIPHeader would, including its source
+address checks (see BADSRC below).  The IP checksum is summed with SIMD
+instructions where the CPU provides them.
+
+=item *
+
+It looks up the destination in the IPRouteTable element TABLE.  Packets in
+a row to the same destination share one lookup.
+
+=item *
+
+It decrements the TTL and updates the checksum incrementally, as DecIPTTL
+would.
+
+=back
+
+Once the burst is sorted, the packets are pushed out one output port at a
+time.  A packet routed to TABLE's output port K leaves on IPFastPath's
+output K.  Its destination IP address annotation is set to the route's
+gateway, or to the packet's destination address if the route has no
+gateway.  Like CheckIPHeader, the element also sets the IP header
+annotation and trims the packet to the IP length.
+
+IPFastPath handles only the common case.  The following packets go to the
+last output, the slow path, unmodified and without annotations:
+
+=over 4
+
+=item *
+
+packets with IP options;
+
+=item *
+
+packets with a bad header, length, or checksum;
+
+=item *
+
+packets from the limited broadcast address 255.255.255.255, from a
+multicast address, or from an address on the BADSRC list, unless their
+destination is on the GOODDST list (RFC1812 5.3.7);
+
+=item *
+
+packets whose TTL would expire;
+
+=item *
+
+packets with no route;
+
+=item *
+
+packets whose route port has no matching IPFastPath output.
+
+=back
+
+Connect the slow path to the ordinary CheckIPHeader/DecIPTTL/lookup pipeline
+so that those packets still get full treatment.  Packets of one flow are
+kept in order on the fast path.  A packet that takes the slow path may be
+reordered relative to fast-path packets of the same flow.
+
+Keyword arguments are:
+
+=over 8
+
+=item BURST
+
+Integer.  The maximum number of packets to pull per task run.  Default is
+32.
+
+=item BADSRC
+
+Space-separated list of IP addresses.  Packets from these addresses take
+the slow path, as with CheckIPHeader's BADSRC.  Default is empty.
+
+=item GOODDST
+
+Space-separated list of IP addresses.  Packets to these addresses are
+exempt from BADSRC processing.  Default is empty.
+
+=item INTERFACES
+
+Space-separated list of IP addresses with network prefixes, meant to
+represent this router's interface addresses.  Sets BADSRC and GOODDST as
+CheckIPHeader's INTERFACES does.  Give the slow path's CheckIPHeader the
+same arguments.
+
+=back
+
+=h count read-only
+
+Returns the number of packets forwarded on the fast path.
+
+=h slow read-only
+
+Returns the number of packets sent to the slow path.
+
+=h burst read/write
+
+Returns or sets the BURST parameter.
+
+=h reset_counts write-only
+
+Resets the counters to zero.
+
+=e
+
+  rt :: RadixIPLookup(10.0.0.0/8 0, 0.0.0.0/0 10.0.0.1 1);
+  q :: Queue -> fp :: IPFastPath(rt);
+  fp[0] -> out0; fp[1] -> out1;
+  fp[2] -> CheckIPHeader -> DecIPTTL -> rt;
+  rt[0] -> out0; rt[1] -> out1;
+
+The file conf/ipfastpath-bench.click compares IPFastPath with the
+equivalent element-by-element pipeline.
+
+=a
+
+CheckIPHeader, DecIPTTL, IPRouteTable, RadixIPLookup, IPInputCombo,
+IPOutputCombo, Unqueue */
+
+class IPFastPath : public Element { public:
+
+    IPFastPath() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPFastPath"; }
+    const char *port_count() const	{ return "1/2-"; }
+    const char *processing() const	{ return "l/h"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+
+    enum { max_burst = 256 };
+
+  private:
+
+    IPRouteTable *_table;
+    int _burst;
+    Task _task;
+    NotifierSignal _signal;
+
+    uint64_t _count;
+    uint64_t _slow;
+
+    Vector<IPAddress> _bad_src;
+    Vector<IPAddress> _good_dst;
+
+    // Per-port packet lists built during a burst.
+    Vector<Packet *> _head;
+    Vector<Packet *> _tail;
+
+    int classify(Packet *p, IPAddress &last_dst, int &last_port,
+		 IPAddress &last_gw);
+
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -23,7 +23,6 @@
 #include "ipreassembler.hh"
 #include <click/ipaddress.hh>
 #include <click/args.hh>
-#include <click/bitvector.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
@@ -31,17 +30,12 @@
 #include <click/ipflowid.hh>
 CLICK_DECLS
 
-#define PACKET_CHUNK(p)		(*((ChunkLink *)((p)->anno_u8() + IPREASSEMBLER_ANNO_OFFSET)))
 #define PACKET_DLEN(p)		((p)->transport_length())
 #define IP_BYTE_OFF(iph)	((ntohs((iph)->ip_off) & IP_OFFMASK) << 3)
 
 IPReassembler::IPReassembler()
-    : _stat_frags_seen(0), _stat_good_assem(0), _stat_failed_assem(0), _stat_bad_pkts(0)
+    : _tables(0), _ntables(0)
 {
-    for (int i = 0; i < NMAP; i++)
-	_map[i] = 0;
-    static_assert(IPREASSEMBLER_ANNO_OFFSET + IPREASSEMBLER_ANNO_SIZE <= Packet::anno_size, "anno too big");
-    static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
 }
 
 IPReassembler::~IPReassembler()
@@ -52,183 +46,248 @@ int
 IPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _mem_high_thresh = 256 * 1024;
+    _capacity = 0;
+    _source_quota = 0;
     int mtu_anno = -1;
     if (Args(conf, this, errh)
 	.read("HIMEM", _mem_high_thresh)
+	.read("CAPACITY", _capacity)
+	.read("SOURCE_QUOTA", _source_quota)
 	.read("MAX_MTU_ANNO", AnnoArg(2), mtu_anno)
 	.complete() < 0)
 	return -1;
+    if (_capacity > 65536)
+	return errh->error("CAPACITY must be at most 65536");
     _mtu_anno = mtu_anno;
     _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
     return 0;
 }
 
 int
-IPReassembler::initialize(ErrorHandler *)
+IPReassembler::initialize(ErrorHandler *errh)
 {
-    _mem_used = 0;
-    _reap_time = 0;
+    // Tables are created by the threads that use them.
+    _ntables = click_max_cpu_ids();
+    if (!(_tables = new Table *[_ntables]))
+	return errh->error("out of memory!");
+    for (unsigned i = 0; i < _ntables; ++i)
+	_tables[i] = 0;
     return 0;
 }
 
 void
 IPReassembler::cleanup(CleanupStage)
 {
-    for (int i = 0; i < NMAP; i++)
-	while (_map[i]) {
-	    WritablePacket *next = (WritablePacket *)(_map[i]->next());
-	    _map[i]->kill();
-	    _map[i] = next;
+    for (unsigned i = 0; i < _ntables; ++i)
+	if (Table *t = _tables[i]) {
+	    for (Reassembly *r = t->lru.next, *next; r != &t->lru; r = next) {
+		next = r->next;
+		r->q->kill();
+		if (!t->slab)
+		    delete r;
+	    }
+	    delete[] t->slab;
+	    delete[] t->bucket;
+	    delete t;
 	}
+    delete[] _tables;
+    _tables = 0;
+    _ntables = 0;
 }
 
-void
-IPReassembler::check_error(ErrorHandler *errh, int bucket, const Packet *p, const char *format, ...)
+IPReassembler::Table *
+IPReassembler::make_table()
 {
-    va_list val;
-    va_start(val, format);
-    StringAccum sa;
-    sa << "buck " << bucket << ": ";
-    if (p->has_network_header()) {
-	const click_ip *iph = p->ip_header();
-	sa << iph->ip_src << " > " << iph->ip_dst << " [" << ntohs(iph->ip_id) << ':' << PACKET_DLEN(p) << ((iph->ip_off & htons(IP_MF)) ? "+]: " : "]: ");
+    Table *t = new Table;
+    if (!t)
+	return 0;
+    // Without CAPACITY, reassemblies are allocated as fragments arrive and
+    // HIMEM alone bounds the table.
+    uint32_t nbuckets = 16;
+    while (nbuckets < 2 * (_capacity ? _capacity : UNBOUNDED_BUCKETS / 2))
+	nbuckets *= 2;
+    t->slab = (_capacity ? new Reassembly[_capacity] : 0);
+    t->bucket = new Reassembly *[nbuckets];
+    if ((_capacity && !t->slab) || !t->bucket) {
+	delete[] t->slab;
+	delete[] t->bucket;
+	delete t;
+	return 0;
+    }
+    memset(t->bucket, 0, sizeof(Reassembly *) * nbuckets);
+    t->mask = nbuckets - 1;
+    t->free = 0;
+    for (uint32_t i = _capacity; i > 0; --i) {
+	t->slab[i - 1].hnext = t->free;
+	t->free = &t->slab[i - 1];
     }
-    sa << format;
-    errh->xmessage(ErrorHandler::e_error, sa.c_str(), val);
-    va_end(val);
+    t->lru.prev = t->lru.next = &t->lru;
+    t->mem_used = t->n = 0;
+    t->frags_seen = t->good_assem = t->failed_assem = t->bad_pkts = 0;
+    t->quota_drops = 0;
+    t->evicted = 0;
+    return t;
 }
 
-int
-IPReassembler::check(ErrorHandler *errh)
+/** @brief Return the current thread's table, creating it if necessary. */
+inline IPReassembler::Table *
+IPReassembler::table()
 {
-    if (!errh)
-	errh = ErrorHandler::default_handler();
-    uint32_t mem_used = 0;
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = _map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (q->has_network_header()) {
-		const click_ip *qip = q->ip_header();
-		if (bucketno(qip) != b)
-		    check_error(errh, b, q, "in wrong bucket");
-		mem_used += IPH_MEM_USED + q->transport_length();
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		int off = 0;
-#if VERBOSE_DEBUG
-		check_error(errh, b, q, "");
-		StringAccum sa;
-		while (chunk && (!off || off < q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-		errh->message("  %s", sa.c_str());
-		chunk = &PACKET_CHUNK(q);
-		off = 0;
-#endif
-		while (chunk) {
-		    if (chunk->off >= chunk->lastoff
-			|| chunk->lastoff > q->transport_length()
-			|| (off != 0 && chunk->off < off + 8)) {
-			check_error(errh, b, q, "bad chunk (%d, %d) at %d", chunk->off, chunk->lastoff, off);
-			break;
-		    }
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-	    } else
-		errh->error("buck %d: missing IP header", b);
-    if (mem_used != _mem_used)
-	errh->error("bad mem_used: have %u, claim %u", mem_used, _mem_used);
-    return 0;
+    unsigned i = click_current_cpu_id();
+    if (i >= _ntables)
+	i = 0;
+    if (!_tables[i]) {
+	Table *t = make_table();
+	click_write_fence();
+	_tables[i] = t;
+    }
+    return _tables[i];
 }
 
-String
-IPReassembler::debug_dump(Element *e, void *)
+inline void
+IPReassembler::lru_remove(Reassembly *r)
 {
-    IPReassembler *r = (IPReassembler *) e;
-    r->check();
-    StringAccum sa;
-    sa <<
-	"frags seen total:    " << r->_stat_frags_seen << "\n"
-	"good reassemblies:   " << r->_stat_good_assem << "\n"
-	"failed reassemblies: " << r->_stat_failed_assem << "\n"
-	"bad fragments seen:  " << r->_stat_bad_pkts << "\n"
-	"cached chunk data:\n";
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = r->_map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (const click_ip *qip = q->ip_header()) {
-		sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		while (chunk &&
-		       (chunk->lastoff > chunk->off) &&
-		       (chunk->lastoff <= q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    chunk = next_chunk(q, chunk);
-		}
-		sa << '\n';
-	    }
-    return sa.take_string();
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
 }
 
-WritablePacket *
-IPReassembler::find_queue(Packet *p, WritablePacket ***store_pprev)
+inline void
+IPReassembler::lru_push(Table *t, Reassembly *r)
 {
-    const click_ip *iph = p->ip_header();
-    int bucket = bucketno(iph);
-    WritablePacket **pprev = &_map[bucket];
-    WritablePacket *q;
-    for (q = *pprev; q; pprev = (WritablePacket **)&q->next(), q = *pprev) {
-	const click_ip *qiph = q->ip_header();
-	if (same_segment(iph, qiph)) {
-	    *store_pprev = pprev;
-	    return q;
-	}
+    r->prev = &t->lru;
+    r->next = t->lru.next;
+    r->next->prev = r;
+    t->lru.next = r;
+}
+
+/** @brief Mark blocks [@a off, @a lastoff) received.
+ *
+ * Offsets are in bytes.  Returns the number of blocks that were not already
+ * marked. */
+inline uint32_t
+IPReassembler::set_blocks(Reassembly *r, int off, int lastoff)
+{
+    uint32_t added = 0;
+    int b = off >> 3, end = (lastoff + 7) >> 3;
+    while (b < end) {
+	int w = b >> 6, lo = b & 63;
+	int hi = end - (w << 6) < 64 ? end - (w << 6) : 64;
+	uint64_t mask = (hi == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << hi) - 1)
+	    & (~(uint64_t) 0 << lo);
+	added += __builtin_popcountll(mask & ~r->bitmap[w]);
+	r->bitmap[w] |= mask;
+	b = (w << 6) + hi;
     }
-    *store_pprev = &_map[bucket];
-    return 0;
+    return added;
 }
 
-Packet *
-IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
-				 Packet *p_in)
+IPReassembler::Reassembly *
+IPReassembler::find(Table *t, const click_ip *iph)
 {
-    ++_stat_good_assem;
-    *q_pprev = (WritablePacket *)q->next();
+    for (Reassembly *r = t->bucket[hash(iph) & t->mask]; r; r = r->hnext)
+	if (same_segment(r, iph))
+	    return r;
+    return 0;
+}
 
-    click_ip *q_iph = q->ip_header();
-    q_iph->ip_len = htons(q->network_length());
-    q_iph->ip_sum = 0;
-    q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
+/** @brief Remove @a r from @a t and return its slot to the free list.
+ *
+ * The caller is responsible for r->q, which may be null if it has already
+ * been freed and its memory uncounted. */
+void
+IPReassembler::unlink(Table *t, Reassembly *r)
+{
+    Reassembly **pprev = &t->bucket[hash(r->src, r->dst, r->id, r->proto) & t->mask];
+    while (*pprev != r)
+	pprev = &(*pprev)->hnext;
+    *pprev = r->hnext;
+    lru_remove(r);
+
+    if (_source_quota) {
+	HashTable<uint32_t, int>::iterator it = t->sources.find(r->src);
+	if (--it.value() == 0)
+	    t->sources.erase(it);
+    }
 
-    // zero out the annotations we used
-    memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
-    q->set_timestamp_anno(p_in->timestamp_anno());
-    q->set_next(0);
+    t->mem_used -= IPH_MEM_USED + (r->q ? r->q->transport_length() : 0);
+    --t->n;
+    r->q = 0;
+    if (t->slab) {
+	r->hnext = t->free;
+	t->free = r;
+    } else
+	delete r;
+}
 
-    p_in->kill();
-    _mem_used -= IPH_MEM_USED + q->transport_length();
-    return q;
+/** @brief Abandon @a r.
+ *
+ * Its packet is emitted on output 1 once the table is unlocked. */
+void
+IPReassembler::evict(Table *t, Reassembly *r)
+{
+    WritablePacket *q = r->q;
+    unlink(t, r);
+    q->set_next(t->evicted);
+    t->evicted = q;
+    ++t->failed_assem;
 }
 
 void
-IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
+IPReassembler::reap(Table *t, uint32_t now)
+{
+    // The LRU list is in order of last activity, so only its tail can have
+    // been dormant for REAP_TIMEOUT seconds.
+    while (t->lru.prev != &t->lru
+	   && (int32_t) (now - t->lru.prev->stamp) > REAP_TIMEOUT)
+	evict(t, t->lru.prev);
+}
+
+IPReassembler::Reassembly *
+IPReassembler::make_reassembly(Table *t, Packet *p, uint32_t now)
 {
-    int p_off = IP_BYTE_OFF(p->ip_header());
+    const click_ip *iph = p->ip_header();
+    int p_off = IP_BYTE_OFF(iph);
     int p_lastoff = p_off + PACKET_DLEN(p);
-    WritablePacket *q;
 
+    // don't let one source tie up the table
+    if (_source_quota)
+	if (int *count = t->sources.get_pointer(iph->ip_src.s_addr))
+	    if ((uint32_t) *count >= _source_quota) {
+		++t->quota_drops;
+		p->kill();
+		return 0;
+	    }
+
+    Reassembly *r;
+    if (!t->slab) {
+	if (!(r = new Reassembly)) {
+	    p->kill();
+	    click_chatter("out of memory");
+	    return 0;
+	}
+    } else {
+	if (!t->free)
+	    evict(t, t->lru.prev);
+	r = t->free;
+    }
+
+    WritablePacket *q;
     if (p_off == 0) {
 	q = p->uniqueify();
 	if (!q) {
+	    if (!t->slab)
+		delete r;
 	    click_chatter("out of memory");
-	    return;
+	    return 0;
 	}
     } else {
 	q = Packet::make(p->headroom() + p->ip_header_offset(), 0, 20 + p_lastoff, 0);
 	if (!q) {
+	    if (!t->slab)
+		delete r;
 	    p->kill();
 	    click_chatter("out of memory");
-	    return;
+	    return 0;
 	}
 	q->set_ip_header((click_ip *)q->data(), 20);
 	memcpy(q->ip_header(), p->ip_header(), 20);
@@ -237,31 +296,52 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
 	p->kill();
     }
 
-    _mem_used += IPH_MEM_USED + p_lastoff;
-
     click_ip *q_iph = q->ip_header();
     q_iph->ip_off = (q_iph->ip_off & ~htons(IP_OFFMASK)); // leave MF, DF, RF
 
     if (_mtu_anno >= 0)
 	q->set_anno_u16(_mtu_anno, q->network_length());
 
-    PACKET_CHUNK(q).off = p_off;
-    PACKET_CHUNK(q).lastoff = p_lastoff;
+    if (t->slab)
+	t->free = r->hnext;
+    r->src = q_iph->ip_src.s_addr;
+    r->dst = q_iph->ip_dst.s_addr;
+    r->id = q_iph->ip_id;
+    r->proto = q_iph->ip_p;
+    r->stamp = now;
+    r->q = q;
+    memset(r->bitmap, 0, sizeof(r->bitmap));
+    r->nblocks = set_blocks(r, p_off, p_lastoff);
 
     // link it up
-    q->set_next(*q_pprev);
-    *q_pprev = q;
-
-    check();
+    Reassembly **bucket = &t->bucket[hash(q_iph) & t->mask];
+    r->hnext = *bucket;
+    *bucket = r;
+    lru_push(t, r);
+    if (_source_quota)
+	++t->sources[r->src];
+    ++t->n;
+    t->mem_used += IPH_MEM_USED + p_lastoff;
+    return r;
 }
 
-IPReassembler::ChunkLink *
-IPReassembler::next_chunk(WritablePacket *q, ChunkLink *chunk)
+Packet *
+IPReassembler::emit_whole_packet(Table *t, Reassembly *r, Packet *p_in)
 {
-    if (chunk->lastoff >= q->transport_length())
-	return 0;
-    else
-	return (ChunkLink *)(q->transport_header() + chunk->lastoff);
+    ++t->good_assem;
+    WritablePacket *q = r->q;
+    unlink(t, r);
+
+    click_ip *q_iph = q->ip_header();
+    q_iph->ip_len = htons(q->network_length());
+    q_iph->ip_sum = 0;
+    q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
+
+    q->set_timestamp_anno(p_in->timestamp_anno());
+    q->set_next(0);
+
+    p_in->kill();
+    return q;
 }
 
 Packet *
@@ -273,16 +353,41 @@ IPReassembler::simple_action(Packet *p)
     if (!IP_ISFRAG(iph))
 	return p;
 
-    ++_stat_frags_seen;
+    Table *t = table();
+    if (!t) {
+	click_chatter("out of memory");
+	p->kill();
+	return 0;
+    }
 
-    // reap if necessary
     int now = p->timestamp_anno().sec();
     if (!now) {
 	p->timestamp_anno().assign_now();
 	now = p->timestamp_anno().sec();
     }
-    if (now >= _reap_time)
-	reap(now);
+
+    t->lock.acquire();
+    ++t->frags_seen;
+    Packet *result = add_fragment(t, p, now);
+    WritablePacket *evicted = t->evicted;
+    t->evicted = 0;
+    t->lock.release();
+
+    // emit abandoned reassemblies outside the lock
+    while (evicted) {
+	WritablePacket *next = (WritablePacket *) evicted->next();
+	evicted->set_next(0);
+	checked_output_push(1, evicted);
+	evicted = next;
+    }
+    return result;
+}
+
+Packet *
+IPReassembler::add_fragment(Table *t, Packet *p, uint32_t now)
+{
+    const click_ip *iph = p->ip_header();
+    reap(t, now);
 
     // calculate packet edges
     int p_off = IP_BYTE_OFF(iph);
@@ -294,7 +399,7 @@ IPReassembler::simple_action(Packet *p)
 	|| ((p_lastoff & 7) != 0 && (iph->ip_off & htons(IP_MF)) != 0)
 	|| PACKET_DLEN(p) < p_lastoff - p_off) {
 	p->kill();
-	++_stat_bad_pkts;
+	++t->bad_pkts;
 	return 0;
     }
     p->take(PACKET_DLEN(p) - (p_lastoff - p_off));
@@ -302,17 +407,21 @@ IPReassembler::simple_action(Packet *p)
     // otherwise, we need to keep the packet
 
     // clean up memory if necessary
-    if (_mem_used > _mem_high_thresh)
-	reap_overfull(now);
-
-    // get its Packet queue
-    WritablePacket **q_pprev;
-    WritablePacket *q = find_queue(p, &q_pprev);
-    if (!q) {			// make a new queue
-	make_queue(p, q_pprev);
+    if (t->mem_used > _mem_high_thresh) {
+	while (t->mem_used > _mem_low_thresh && t->lru.prev != &t->lru)
+	    evict(t, t->lru.prev);
+    }
+
+    // get its reassembly
+    Reassembly *r = find(t, iph);
+    if (!r) {
+	make_reassembly(t, p, now);
 	return 0;
     }
-    WritablePacket *q_bucket_next = (WritablePacket *)(q->next());
+    r->stamp = now;
+    lru_remove(r);
+    lru_push(t, r);
+    WritablePacket *q = r->q;
 
     if (_mtu_anno >= 0 && q->anno_u16(_mtu_anno) < p->network_length())
 	q->set_anno_u16(_mtu_anno, p->network_length());
@@ -324,60 +433,36 @@ IPReassembler::simple_action(Packet *p)
 	    p->kill();
 	    return 0;
 	}
-	// Figure out how much space to request. Add 8 extra bytes to ensure
-	// room for a ChunkLink, and request extra space if this packet has MF
-	// set. XXX This algorithm could result in a number of intermediate
-	// packet copies linear in the final packet length.
+	// Figure out how much space to request, requesting extra space if
+	// this packet has MF set. XXX This algorithm could result in a number
+	// of intermediate packet copies linear in the final packet length.
 	int old_transport_length = q->transport_length();
-	assert((old_transport_length & 7) == 0);
-	int want_space = p_lastoff - old_transport_length + 8;
+	int want_space = p_lastoff - old_transport_length;
 	if (iph->ip_off & htons(IP_MF))
 	    want_space += (p_lastoff - p_off);
-	// request space
-	if (!(q = q->put(want_space))) {
+	// request space; put() frees q on failure
+	if (!(q = r->q = q->put(want_space))) {
 	    click_chatter("out of memory");
-	    *q_pprev = q_bucket_next;
-	    _mem_used -= IPH_MEM_USED + old_transport_length;
+	    t->mem_used -= old_transport_length;
+	    unlink(t, r);
 	    p->kill();
 	    return 0;
 	}
 	// get rid of extra space
 	q->take(q->transport_length() - p_lastoff);
-	// hook up packet, and add final chunk
-	*q_pprev = q;
-	ChunkLink *last_chunk = (ChunkLink *)(q->transport_header() + old_transport_length);
-	last_chunk->off = last_chunk->lastoff = p_lastoff;
-	_mem_used += p_lastoff - old_transport_length;
+	t->mem_used += p_lastoff - old_transport_length;
     }
 
-    // find chunks before and after p
-    ChunkLink *chunk = &PACKET_CHUNK(q);
-    while (chunk->lastoff < p_off)
-	chunk = next_chunk(q, chunk);
-    ChunkLink *last = chunk;
-    while (last && last->lastoff < p_lastoff)
-	last = next_chunk(q, last);
-
-    // patch chunks
-    assert(chunk && last);
-    if (p_lastoff < last->off) {
-	ChunkLink *new_chunk = (ChunkLink *)(q->transport_header() + p_lastoff);
-	*new_chunk = *last;
-	chunk->lastoff = p_lastoff;
-    } else
-	chunk->lastoff = last->lastoff;
-    if (p_off < chunk->off)
-	chunk->off = p_off;
-
-    // copy p's data into q
+    // copy p's data into q, and note which blocks it covered
     memcpy(q->transport_header() + p_off, p->transport_header(), p_lastoff - p_off);
+    r->nblocks += set_blocks(r, p_off, p_lastoff);
 
     // copy p's annotations and IP header if it is the first packet
     if (p_off == 0) {
 	uint16_t old_ip_off = q->ip_header()->ip_off;
 	int header_delta = p->ip_header_offset() - q->ip_header_offset();
 	if (header_delta > 0)
-	    q = q->push(header_delta);
+	    q = r->q = q->push(header_delta);
 	else if (header_delta < 0)
 	    q->pull(-header_delta);
 	q->set_ip_header((click_ip *)(q->data() + p->ip_header_offset()), p->ip_header_length());
@@ -385,7 +470,6 @@ IPReassembler::simple_action(Packet *p)
 	    q->set_mac_header((q->data() + p->mac_header_offset()), p->mac_header_length());
 	memcpy(q->data(), p->data(), p->ip_header_offset() + p->ip_header_length());
 	q->ip_header()->ip_off = old_ip_off;
-	ChunkLink old_chunk = PACKET_CHUNK(q);
 	if (_mtu_anno >= 0) {
 	    uint16_t old_mtu = q->anno_u16(_mtu_anno);
 	    q->copy_annotations(p);
@@ -393,7 +477,6 @@ IPReassembler::simple_action(Packet *p)
 	} else {
 	    q->copy_annotations(p);
 	}
-	PACKET_CHUNK(q) = old_chunk;
     }
 
     // clear MF if incoming packet has it cleared
@@ -402,71 +485,116 @@ IPReassembler::simple_action(Packet *p)
 
     // Are we done with this packet?
     if ((q->ip_header()->ip_off & htons(IP_MF)) == 0
-	&& PACKET_CHUNK(q).off == 0
-	&& PACKET_CHUNK(q).lastoff == q->transport_length())
-	return emit_whole_packet(q, q_pprev, p);
+	&& r->nblocks == (q->transport_length() + 7) >> 3)
+	return emit_whole_packet(t, r, p);
 
     // Otherwise, done for now
-    //check();
     p->kill();
     return 0;
 }
 
-void
-IPReassembler::reap_overfull(int now)
+int
+IPReassembler::check(ErrorHandler *errh)
 {
-    check();
-
-    // First throw away fragments at least 10 seconds old, then at least 5
-    // seconds old, then any fragments.
-    for (int delta = 10; delta >= 0; delta -= 5)
-	for (int bucket = 0; bucket < NMAP; bucket++) {
-	    WritablePacket **pprev = &_map[bucket];
-	    for (WritablePacket *q = *pprev; q; q = *pprev)
-		if (!delta || q->timestamp_anno().sec() < now - delta) {
-		    *pprev = (WritablePacket *)q->next();
-		    _mem_used -= IPH_MEM_USED + q->transport_length();
-		    q->set_next(0);
-		    checked_output_push(1, q);
-		    ++_stat_failed_assem;
-		    if (_mem_used <= _mem_low_thresh)
-			return;
-		} else
-		    pprev = (WritablePacket **)&q->next();
+    if (!errh)
+	errh = ErrorHandler::default_handler();
+    for (unsigned i = 0; i < _ntables; ++i) {
+	Table *t = _tables[i];
+	if (!t)
+	    continue;
+	t->lock.acquire();
+	uint32_t mem_used = 0, n = 0;
+	for (Reassembly *r = t->lru.next; r != &t->lru; r = r->next, ++n) {
+	    const click_ip *qip = r->q->ip_header();
+	    if (find(t, qip) != r)
+		errh->error("table %u: %s > %s [%d] not in its bucket", i,
+			    IPAddress(qip->ip_src).unparse().c_str(),
+			    IPAddress(qip->ip_dst).unparse().c_str(), ntohs(qip->ip_id));
+	    uint32_t nblocks = 0;
+	    for (int w = 0; w < NWORDS; ++w)
+		nblocks += __builtin_popcountll(r->bitmap[w]);
+	    if (nblocks != r->nblocks)
+		errh->error("table %u: bad block count: have %u, claim %u", i, nblocks, r->nblocks);
+	    mem_used += IPH_MEM_USED + r->q->transport_length();
 	}
-
-    click_chatter("IPReassembler: cannot free enough memory!");
+	if (n != t->n)
+	    errh->error("table %u: bad count: have %u, claim %u", i, n, t->n);
+	if (mem_used != t->mem_used)
+	    errh->error("table %u: bad mem_used: have %u, claim %u", i, mem_used, t->mem_used);
+	t->lock.release();
+    }
+    return 0;
 }
 
-void
-IPReassembler::reap(int now)
+enum { h_dump, h_fragments, h_reassembled, h_failed, h_quota_drops, h_mem_used };
+
+String
+IPReassembler::read_handler(Element *e, void *thunk)
 {
-    // look at all queues. If no activity for 30 seconds, kill that queue
-
-    int kill_time = now - REAP_TIMEOUT;
-
-    for (int i = 0; i < NMAP; i++) {
-	WritablePacket **q_pprev = &_map[i];
-	for (WritablePacket *q = *q_pprev; q; ) {
-	    if (q->timestamp_anno().sec() < kill_time) {
-		*q_pprev = (WritablePacket *)q->next();
-		q->set_next(0);
-		_mem_used -= IPH_MEM_USED + q->transport_length();
-		checked_output_push(1, q);
-	    } else
-		q_pprev = (WritablePacket **)&q->next();
-	    q = *q_pprev;
+    IPReassembler *r = static_cast<IPReassembler *>(e);
+    int which = reinterpret_cast<intptr_t>(thunk);
+    if (which == h_dump)
+	r->check();
+
+    uint32_t sum[h_mem_used + 1];
+    memset(sum, 0, sizeof(sum));
+    StringAccum chunks;
+    for (unsigned i = 0; i < r->_ntables; ++i)
+	if (Table *t = r->_tables[i]) {
+	    sum[h_fragments] += t->frags_seen;
+	    sum[h_reassembled] += t->good_assem;
+	    sum[h_failed] += t->failed_assem;
+	    sum[h_quota_drops] += t->quota_drops;
+	    sum[h_mem_used] += t->mem_used;
+	    sum[h_dump] += t->bad_pkts;
+	    if (which != h_dump)
+		continue;
+	    t->lock.acquire();
+	    for (Reassembly *ra = t->lru.next; ra != &t->lru; ra = ra->next) {
+		const click_ip *qip = ra->q->ip_header();
+		chunks << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
+		// print runs of received bytes
+		int len = ra->q->transport_length();
+		for (int b = 0; b * 8 < len; ) {
+		    if (!(ra->bitmap[b >> 6] & ((uint64_t) 1 << (b & 63)))) {
+			++b;
+			continue;
+		    }
+		    int first = b;
+		    while (b * 8 < len && (ra->bitmap[b >> 6] & ((uint64_t) 1 << (b & 63))))
+			++b;
+		    chunks << " (" << first * 8 << ',' << (b * 8 < len ? b * 8 : len) << ')';
+		}
+		chunks << '\n';
+	    }
+	    t->lock.release();
 	}
-    }
 
-    _reap_time = now + REAP_INTERVAL;
+    if (which != h_dump)
+	return String(sum[which]);
+    StringAccum sa;
+    sa <<
+	"frags seen total:    " << sum[h_fragments] << "\n"
+	"good reassemblies:   " << sum[h_reassembled] << "\n"
+	"failed reassemblies: " << sum[h_failed] << "\n"
+	"bad fragments seen:  " << sum[h_dump] << "\n"
+	"quota drops:         " << sum[h_quota_drops] << "\n"
+	"memory used:         " << sum[h_mem_used] << "\n"
+	"cached chunk data:\n" << chunks;
+    return sa.take_string();
 }
 
 void
 IPReassembler::add_handlers()
 {
-    add_read_handler("dump", debug_dump);
+    add_read_handler("dump", read_handler, h_dump);
+    add_read_handler("fragments", read_handler, h_fragments);
+    add_read_handler("reassembled", read_handler, h_reassembled);
+    add_read_handler("failed", read_handler, h_failed);
+    add_read_handler("quota_drops", read_handler, h_quota_drops);
+    add_read_handler("mem_used", read_handler, h_mem_used);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPReassembler)
+ELEMENT_MT_SAFE(IPReassembler)
@@ -4,7 +4,8 @@
 #include <click/element.hh>
 #include <click/glue.hh>
 #include <clicknet/ip.h>
-#include <click/timer.hh>
+#include <click/sync.hh>
+#include <click/hashtable.hh>
 CLICK_DECLS
 
 /*
@@ -26,24 +27,46 @@ seconds, the fragments are generally dropped. If IPReassembler has two
 outputs, however, a single packet containing all the received fragments at
 their proper offsets is pushed onto output 1.
 
-IPReassembler's memory usage is bounded. When memory consumption rises above
-HIMEM bytes, IPReassembler throws away old fragments until memory consumption
-drops below 3/4*HIMEM bytes. Default HIMEM is 256K.
+Reassemblies in progress are kept in per-thread tables keyed by source,
+destination, IP ID, and protocol, so IPReassembler may be used from several
+threads at once without locking.  The fragments of one packet must all arrive
+on the same thread; NICs that hash fragments on their addresses alone, or a
+single input thread, ensure this.  Each reassembly tracks the 8-byte blocks
+received so far in a bitmap, so overlapping and duplicate fragments cost no
+more than others.
+
+IPReassembler's memory usage is bounded. When a table's memory consumption
+rises above HIMEM bytes, IPReassembler throws away the least recently used
+reassemblies until memory consumption drops below 3/4*HIMEM bytes. HIMEM
+applies to each thread's table separately, so total memory use can reach
+HIMEM times the number of threads that see fragments.  With CAPACITY, each
+table also has a fixed number of reassembly slots, allocated up front, and a
+new reassembly evicts the least recently used one when they are all taken.
+With SOURCE_QUOTA, a single source address may have at most SOURCE_QUOTA
+reassemblies in progress per table; fragments that would start more are
+dropped, so a flood from one host cannot evict other hosts' packets.
 
 Output packets have the same MAC header as the fragment that contains
 offset 0.  Other than that, input MAC headers are ignored.
 
-The IPREASSEMBLER annotation area is used to store packet metadata about
-packets in the process of reassembly.  On emitted reassembled packets,
-this annotation area is set to 0.
-
 Keyword arguments are:
 
 =over 8
 
 =item HIMEM
 
-The upper bound for memory consumption, in bytes. Default is 256K.
+The upper bound for each thread's packet memory consumption, in bytes.
+Default is 256K.
+
+=item CAPACITY
+
+The number of reassemblies each table can hold at once, at most 65536.  Zero
+means no limit other than HIMEM.  Default is 0.
+
+=item SOURCE_QUOTA
+
+The number of reassemblies one source address may have in progress in each
+table.  Zero means no limit.  Default is 0.
 
 =item MAX_MTU_ANNO
 
@@ -53,6 +76,33 @@ is unchanged.
 
 =back
 
+=h dump read-only
+
+Returns statistics and the reassemblies in progress.
+
+=h fragments read-only
+
+Returns the number of fragments seen.
+
+=h reassembled read-only
+
+Returns the number of packets reassembled.
+
+=h failed read-only
+
+Returns the number of reassemblies abandoned because they timed out or were
+evicted.
+
+=h quota_drops read-only
+
+Returns the number of fragments dropped because their source had
+SOURCE_QUOTA reassemblies in progress.
+
+=h mem_used read-only
+
+Returns the packet memory held by reassemblies in progress, summed over
+tables.
+
 =n
 
 You may want to attach an C<ICMPError(ADDR, timeexceeded, reassembly)> to the
@@ -81,59 +131,99 @@ class IPReassembler : public Element { public:
 
     void add_handlers() CLICK_COLD;
 
-    struct ChunkLink {
-	uint16_t off;
-	uint16_t lastoff;
-    };
-
   private:
 
     enum { REAP_TIMEOUT = 30, // seconds
-	   REAP_INTERVAL = 10, // seconds
-	   IPH_MEM_USED = 40 };
-
-    enum { NMAP = 256 };
-    WritablePacket *_map[NMAP];
-
-    int _reap_time;
+	   IPH_MEM_USED = 40,
+	   UNBOUNDED_BUCKETS = 1024, // hash buckets without CAPACITY
+	   NBLOCKS = 8192,	// 8-byte blocks in a 64KB packet
+	   NWORDS = NBLOCKS / 64 };
+
+    // One packet being reassembled.  q holds the data received so far at
+    // its final offsets; bitmap marks the 8-byte blocks that have arrived.
+    struct Reassembly {
+	uint32_t src;
+	uint32_t dst;
+	uint16_t id;
+	uint8_t proto;
+	uint16_t nblocks;	// blocks received
+	uint32_t stamp;		// last activity, in seconds
+	WritablePacket *q;
+	Reassembly *hnext;
+	Reassembly *prev;	// LRU list, most recent first
+	Reassembly *next;
+	uint64_t bitmap[NWORDS];
+    };
 
-    uint32_t _stat_frags_seen;
-    uint32_t _stat_good_assem;
-    uint32_t _stat_failed_assem;
-    uint32_t _stat_bad_pkts;
+    // Per-thread state.  Only the owning thread processes packets with a
+    // table; the lock lets handlers look at it safely.
+    struct Table {
+	SimpleSpinlock lock;
+	Reassembly *slab;
+	Reassembly *free;
+	Reassembly **bucket;
+	uint32_t mask;
+	Reassembly lru;		// sentinel
+	HashTable<uint32_t, int> sources;
+	uint32_t mem_used;
+	uint32_t n;
+	uint32_t frags_seen;
+	uint32_t good_assem;
+	uint32_t failed_assem;
+	uint32_t bad_pkts;
+	uint32_t quota_drops;
+	WritablePacket *evicted; // to emit on output 1 after unlocking
+    };
 
-    uint32_t _mem_used;
+    Table **_tables;
+    unsigned _ntables;
+    uint32_t _capacity;
+    uint32_t _source_quota;
     uint32_t _mem_high_thresh;	// defaults to 256K
     uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
     int8_t _mtu_anno;
 
-    static inline int bucketno(const click_ip *);
-    static inline bool same_segment(const click_ip *, const click_ip *);
-    static String debug_dump(Element *e, void *);
-
-    WritablePacket *find_queue(Packet *, WritablePacket ***);
-    void make_queue(Packet *, WritablePacket **);
-    static ChunkLink *next_chunk(WritablePacket *, ChunkLink *);
-    Packet *emit_whole_packet(WritablePacket *, WritablePacket **, Packet *);
-    void reap_overfull(int);
-    void reap(int);
-    static void check_error(ErrorHandler *, int, const Packet *, const char *, ...);
+    static inline uint32_t hash(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto);
+    static inline uint32_t hash(const click_ip *);
+    static inline bool same_segment(const Reassembly *, const click_ip *);
+    static inline uint32_t set_blocks(Reassembly *, int off, int lastoff);
+    static String read_handler(Element *, void *);
+
+    Table *make_table();
+    inline Table *table();
+    Reassembly *find(Table *, const click_ip *);
+    Reassembly *make_reassembly(Table *, Packet *, uint32_t now);
+    Packet *add_fragment(Table *, Packet *, uint32_t now);
+    Packet *emit_whole_packet(Table *, Reassembly *, Packet *);
+    void unlink(Table *, Reassembly *);
+    void evict(Table *, Reassembly *);
+    void reap(Table *, uint32_t now);
+    static inline void lru_remove(Reassembly *);
+    static inline void lru_push(Table *, Reassembly *);
 
 };
 
 
-inline int
-IPReassembler::bucketno(const click_ip *h)
+inline uint32_t
+IPReassembler::hash(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto)
+{
+    uint32_t x = (src ^ (dst * 0x9E3779B1U)) + id + (proto << 16);
+    x *= 0x85EBCA6BU;
+    return x ^ (x >> 15);
+}
+
+inline uint32_t
+IPReassembler::hash(const click_ip *h)
 {
-    return (h->ip_id % NMAP);
+    return hash(h->ip_src.s_addr, h->ip_dst.s_addr, h->ip_id, h->ip_p);
 }
 
 inline bool
-IPReassembler::same_segment(const click_ip *h, const click_ip *h2)
+IPReassembler::same_segment(const Reassembly *r, const click_ip *h)
 {
-    return h->ip_id == h2->ip_id && h->ip_p == h2->ip_p
-	&& h->ip_src.s_addr == h2->ip_src.s_addr
-	&& h->ip_dst.s_addr == h2->ip_dst.s_addr;
+    return r->id == h->ip_id && r->proto == h->ip_p
+	&& r->src == h->ip_src.s_addr
+	&& r->dst == h->ip_dst.s_addr;
 }
 
 CLICK_ENDDECLS
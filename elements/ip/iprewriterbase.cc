@@ -33,6 +33,8 @@
 #include <click/error.hh>
 #include <click/algorithm.hh>
 #include <click/heap.hh>
+#include <click/router.hh>
+#include <click/master.hh>
 
 #ifdef CLICK_LINUXMODULE
 #include <click/cxxprotect.h>
@@ -68,7 +70,8 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _map(0), _heap(new IPRewriterHeap), _gc_timer(gc_timer_hook, this)
+    : _shards(0), _nshards(1), _flow_size(sizeof(IPRewriterFlow)),
+      _capacity_element(0), _gc_timer(gc_timer_hook, this)
 {
     _timeouts[0] = default_timeout;
     _timeouts[1] = default_guarantee;
@@ -77,8 +80,16 @@ IPRewriterBase::IPRewriterBase()
 
 IPRewriterBase::~IPRewriterBase()
 {
-    if (_heap)
-	_heap->unuse();
+    for (int i = 0; _shards && i < _nshards; ++i)
+	if (_shards[i].heap)
+	    _shards[i].heap->unuse();
+    delete[] _shards;
+}
+
+static int32_t
+shard_capacity(int32_t capacity, int nshards)
+{
+    return capacity / nshards + (capacity % nshards != 0);
 }
 
 
@@ -150,6 +161,7 @@ int
 IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String capacity_word;
+    int32_t capacity = 0x7FFFFFFF;
 
     if (Args(this, errh).bind(conf)
 	.read("CAPACITY", AnyArg(), capacity_word)
@@ -158,23 +170,37 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("GUARANTEE", SecondsArg(), _timeouts[1])
 	.read("REAP_INTERVAL", SecondsArg(), _gc_interval_sec)
 	.read("REAP_TIME", Args::deprecated, SecondsArg(), _gc_interval_sec)
+	.read("SHARDS", _nshards)
 	.consume() < 0)
 	return -1;
 
+    if (_nshards < 1 || _nshards > max_shards)
+	return errh->error("SHARDS must be between 1 and %d", (int) max_shards);
+
     if (capacity_word) {
 	Element *e;
-	IPRewriterBase *rwb;
-	if (IntArg().parse(capacity_word, _heap->_capacity))
+	if (IntArg().parse(capacity_word, capacity) && capacity >= 0)
 	    /* OK */;
 	else if ((e = cp_element(capacity_word, this))
-		 && (rwb = (IPRewriterBase *) e->cast("IPRewriterBase"))) {
-	    rwb->_heap->use();
-	    _heap->unuse();
-	    _heap = rwb->_heap;
-	} else
+		 && (_capacity_element = (IPRewriterBase *) e->cast("IPRewriterBase")))
+	    /* OK */;
+	else
 	    return errh->error("bad MAPPING_CAPACITY");
     }
 
+    // Each shard gets its own map, heap, and allocator.  Heaps shared
+    // through MAPPING_CAPACITY are hooked up in initialize().
+    _shards = new IPRewriterShard[_nshards];
+    for (int i = 0; i < _nshards; ++i) {
+	_shards[i].heap = new IPRewriterHeap;
+	_shards[i].heap->_capacity = shard_capacity(capacity, _nshards);
+	_shards[i].allocator.increase_size(_flow_size);
+	_shards[i].count = new uint32_t[ninputs()];
+	_shards[i].failures = new uint32_t[ninputs()];
+	for (int j = 0; j < ninputs(); ++j)
+	    _shards[i].count[j] = _shards[i].failures[j] = 0;
+    }
+
     if (conf.size() != ninputs())
 	return errh->error("need %d arguments, one per input port", ninputs());
 
@@ -190,26 +216,79 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
     return _input_specs.size() == ninputs() ? 0 : -1;
 }
 
+IPRewriterBase *
+IPRewriterBase::capacity_root()
+{
+    // Follow MAPPING_CAPACITY to the element whose heaps are shared.  That
+    // depends only on configuration, so any element may call this whether
+    // or not the others are initialized.  In a cycle, the element with the
+    // lowest index owns the heaps.
+    IPRewriterBase *rwb = this;
+    for (int n = router()->nelements(); rwb->_capacity_element && n > 0; --n)
+	rwb = rwb->_capacity_element;
+    if (rwb->_capacity_element) {
+	IPRewriterBase *root = rwb;
+	for (IPRewriterBase *x = rwb->_capacity_element; x != rwb;
+	     x = x->_capacity_element)
+	    if (x->eindex() < root->eindex())
+		root = x;
+	rwb = root;
+    }
+    return rwb;
+}
+
 int
 IPRewriterBase::initialize(ErrorHandler *errh)
 {
+    IPRewriterBase *root = capacity_root();
+    if (root != this) {
+	if (root->_nshards != _nshards)
+	    return errh->error("MAPPING_CAPACITY element %<%s%> has %d SHARDS, not %d", root->name().c_str(), root->_nshards, _nshards);
+	for (int s = 0; s < _nshards; ++s) {
+	    root->_shards[s].heap->use();
+	    _shards[s].heap->unuse();
+	    _shards[s].heap = root->_shards[s].heap;
+	}
+    }
+
     for (int i = 0; i < _input_specs.size(); ++i) {
 	PrefixErrorHandler cerrh(errh, "input spec " + String(i) + ": ");
-	if (_input_specs[i].reply_element->_heap != _heap)
-	    cerrh.error("reply element %<%s%> must share this MAPPING_CAPACITY", i, _input_specs[i].reply_element->name().c_str());
-	if (_input_specs[i].kind == IPRewriterInput::i_mapper)
+	IPRewriterBase *reply_element = _input_specs[i].reply_element;
+	if (reply_element->_nshards != _nshards)
+	    return cerrh.error("reply element %<%s%> must have the same number of SHARDS", reply_element->name().c_str());
+	else if (reply_element->capacity_root() != root)
+	    return cerrh.error("reply element %<%s%> must share this MAPPING_CAPACITY", reply_element->name().c_str());
+	if (_input_specs[i].kind == IPRewriterInput::i_pattern)
+	    _input_specs[i].u.pattern->reserve_shards(_nshards);
+	else if (_input_specs[i].kind == IPRewriterInput::i_mapper) {
+	    int before = cerrh.nerrors();
 	    _input_specs[i].u.mapper->notify_rewriter(this, &_input_specs[i], &cerrh);
+	    if (cerrh.nerrors() != before)
+		return -1;
+	}
     }
+    if (_nshards > 1)
+	for (int s = 0; s < _nshards; ++s) {
+	    IPRewriterShard &shard = _shards[s];
+	    shard.owner = this;
+	    shard.gc_task = new Task(gc_task_hook, &shard);
+	    shard.gc_task->initialize(this, false);
+	    shard.gc_task->move_thread(s % master()->nthreads());
+	}
     _gc_timer.initialize(this);
     if (_gc_interval_sec)
 	_gc_timer.schedule_after_sec(_gc_interval_sec);
-    return errh->nerrors() ? -1 : 0;
+    return 0;
 }
 
 void
 IPRewriterBase::cleanup(CleanupStage)
 {
-    shrink_heap(true);
+    for (int s = 0; _shards && s < _nshards; ++s) {
+	delete _shards[s].gc_task;
+	_shards[s].gc_task = 0;
+	shrink_heap(_shards[s].heap, true);
+    }
     for (int i = 0; i < _input_specs.size(); ++i)
 	if (_input_specs[i].kind == IPRewriterInput::i_pattern)
 	    _input_specs[i].u.pattern->unuse();
@@ -219,7 +298,7 @@ IPRewriterBase::cleanup(CleanupStage)
 IPRewriterEntry *
 IPRewriterBase::get_entry(int ip_p, const IPFlowID &flowid, int input)
 {
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterEntry *m = local_shard().map.get(flowid);
     if (m && ip_p && m->flow()->ip_p() && m->flow()->ip_p() != ip_p)
 	return 0;
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
@@ -242,24 +321,35 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	return 0;
     }
 
+    IPRewriterShard &shard = flow_shard(flow);
+    IPRewriterHeap *heap = shard.heap;
+    if (!reply_map_ptr)
+	reply_map_ptr = &reply_element->_shards[flow->shard()].map;
+
+    if (_nshards > 1)
+	shard.lock.acquire();
     IPRewriterEntry *old = map.set(&flow->entry(false));
     assert(!old);
-
-    if (!reply_map_ptr)
-	reply_map_ptr = &reply_element->_map;
     old = reply_map_ptr->set(&flow->entry(true));
+    if (map.unbalanced())
+	map.rehash(map.bucket_count() + 1);
+    if (reply_map_ptr != &map && reply_map_ptr->unbalanced())
+	reply_map_ptr->rehash(reply_map_ptr->bucket_count() + 1);
+    if (_nshards > 1)
+	shard.lock.release();
+
     if (unlikely(old)) {		// Assume every map has the same heap.
 	if (likely(old->flow() != flow))
-	    old->flow()->destroy(_heap);
+	    old->flow()->destroy(heap);
     }
 
-    Vector<IPRewriterFlow *> &myheap = _heap->_heaps[flow->guaranteed()];
+    Vector<IPRewriterFlow *> &myheap = heap->_heaps[flow->guaranteed()];
     myheap.push_back(flow);
     push_heap(myheap.begin(), myheap.end(),
 	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
-    ++_input_specs[input].count;
+    ++shard.count[input];
 
-    if (unlikely(_heap->size() > _heap->capacity())) {
+    if (unlikely(heap->size() > heap->capacity())) {
 	// This may destroy the newly added mapping, if it has the lowest
 	// expiration time.  How can we tell?  If (1) flows are added to the
 	// heap one at a time, so the heap was formerly no bigger than the
@@ -267,76 +357,149 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	// destroy 'flow' if it's the top of the heap.
 	click_jiffies_t now_j = click_jiffies();
 	assert(click_jiffies_less(now_j, flow->expiry())
-	       && _heap->size() == _heap->capacity() + 1);
-	if (shrink_heap_for_new_flow(flow, now_j)) {
-	    ++_input_specs[input].failures;
+	       && heap->size() == heap->capacity() + 1);
+	if (shrink_heap_for_new_flow(heap, flow, now_j)) {
+	    ++shard.failures[input];
 	    return 0;
 	}
     }
 
-    if (map.unbalanced())
-	map.rehash(map.bucket_count() + 1);
-    if (reply_map_ptr != &map && reply_map_ptr->unbalanced())
-	reply_map_ptr->rehash(reply_map_ptr->bucket_count() + 1);
     return &flow->entry(false);
 }
 
 void
-IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
+IPRewriterBase::shift_heap_best_effort(IPRewriterHeap *heap,
+				       click_jiffies_t now_j)
 {
     // Shift flows with expired guarantees to the best-effort heap.
-    Vector<IPRewriterFlow *> &guaranteed_heap = _heap->_heaps[1];
+    Vector<IPRewriterFlow *> &guaranteed_heap = heap->_heaps[1];
     while (guaranteed_heap.size() && guaranteed_heap[0]->expired(now_j)) {
 	IPRewriterFlow *mf = guaranteed_heap[0];
 	click_jiffies_t new_expiry = mf->owner()->owner->best_effort_expiry(mf);
-	mf->change_expiry(_heap, false, new_expiry);
+	mf->change_expiry(heap, false, new_expiry);
     }
 }
 
 bool
-IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
+IPRewriterBase::shrink_heap_for_new_flow(IPRewriterHeap *heap,
+					 IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
-    shift_heap_best_effort(now_j);
+    shift_heap_best_effort(heap, now_j);
     // At this point, all flows in the guarantee heap expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
     // In that case we always remove the current flow to honor previous
     // guarantees (= admission control).
     IPRewriterFlow *deadf;
-    if (_heap->_heaps[0].empty()) {
+    if (heap->_heaps[0].empty()) {
 	assert(flow->guaranteed());
 	deadf = flow;
     } else
-	deadf = _heap->_heaps[0][0];
-    deadf->destroy(_heap);
+	deadf = heap->_heaps[0][0];
+    deadf->destroy(heap);
     return deadf == flow;
 }
 
 void
-IPRewriterBase::shrink_heap(bool clear_all)
+IPRewriterBase::shrink_heap(IPRewriterHeap *heap, bool clear_all)
 {
     click_jiffies_t now_j = click_jiffies();
-    shift_heap_best_effort(now_j);
-    Vector<IPRewriterFlow *> &best_effort_heap = _heap->_heaps[0];
+    shift_heap_best_effort(heap, now_j);
+    Vector<IPRewriterFlow *> &best_effort_heap = heap->_heaps[0];
     while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap);
+	best_effort_heap[0]->destroy(heap);
 
-    int32_t capacity = clear_all ? 0 : _heap->_capacity;
-    while (_heap->size() > capacity) {
-	IPRewriterFlow *deadf = _heap->_heaps[_heap->_heaps[0].empty()][0];
-	deadf->destroy(_heap);
+    int32_t capacity = clear_all ? 0 : heap->_capacity;
+    while (heap->size() > capacity) {
+	IPRewriterFlow *deadf = heap->_heaps[heap->_heaps[0].empty()][0];
+	deadf->destroy(heap);
     }
 }
 
+void
+IPRewriterBase::shrink_heaps(bool clear_all)
+{
+    if (_nshards == 1)
+	shrink_heap(_shards[0].heap, clear_all);
+    else {
+	// Only a shard's owning thread may touch its flows, so run each
+	// shard's GC task there.
+	if (clear_all)
+	    for (int s = 0; s < _nshards; ++s)
+		_shards[s].clear_pending = true;
+	click_fence();
+	for (int s = 0; s < _nshards; ++s)
+	    if (_shards[s].gc_task)
+		_shards[s].gc_task->reschedule();
+    }
+}
+
+void
+IPRewriterBase::shard_gc(IPRewriterShard &shard)
+{
+    bool clear_all = shard.clear_pending;
+    shard.clear_pending = false;
+    click_fence();
+    shrink_heap(shard.heap, clear_all);
+}
+
+bool
+IPRewriterBase::gc_task_hook(Task *, void *user_data)
+{
+    IPRewriterShard *shard = static_cast<IPRewriterShard *>(user_data);
+    shard->owner->shard_gc(*shard);
+    return true;
+}
+
+uint32_t
+IPRewriterBase::input_total(int input, bool failures) const
+{
+    uint32_t n = 0;
+    for (int s = 0; s < _nshards; ++s)
+	n += failures ? _shards[s].failures[input] : _shards[s].count[input];
+    return n;
+}
+
 void
 IPRewriterBase::gc_timer_hook(Timer *t, void *user_data)
 {
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(user_data);
-    rw->shrink_heap(false);
+    rw->shrink_heaps(false);
     if (rw->_gc_interval_sec)
 	t->reschedule_after_sec(rw->_gc_interval_sec);
 }
 
+int
+IPRewriterBase::map_flowid(int ip_p, IPFlowID &flowid)
+{
+    if (_nshards == 1) {
+	IPRewriterEntry *m = get_entry(ip_p, flowid, -1);
+	if (!m)
+	    return -EAGAIN;
+	flowid = m->rewritten_flowid();
+	return 0;
+    }
+
+    // Called from outside the data path, so look through every shard.
+    // Holding a shard's lock keeps its flows from being unmapped.
+    int mapid = IPRewriterInput::mapid_default;
+    if (ip_p == IP_PROTO_UDP
+	&& get_map(IPRewriterInput::mapid_iprewriter_udp, 0))
+	mapid = IPRewriterInput::mapid_iprewriter_udp;
+    for (int s = 0; s < _nshards; ++s) {
+	IPRewriterShard &shard = _shards[s];
+	shard.lock.acquire();
+	IPRewriterEntry *m = get_map(mapid, s)->get(flowid);
+	if (m && (!m->flow()->ip_p() || m->flow()->ip_p() == ip_p)) {
+	    flowid = m->rewritten_flowid();
+	    shard.lock.release();
+	    return 0;
+	}
+	shard.lock.release();
+    }
+    return -EAGAIN;
+}
+
 String
 IPRewriterBase::read_handler(Element *e, void *user_data)
 {
@@ -348,23 +511,27 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
     case h_nmappings: {
 	uint32_t count = 0;
 	for (int i = 0; i < rw->_input_specs.size(); ++i)
-	    count += rw->_input_specs[i].count;
+	    count += rw->input_total(i, false);
 	sa << count;
 	break;
     }
     case h_mapping_failures: {
 	uint32_t count = 0;
 	for (int i = 0; i < rw->_input_specs.size(); ++i)
-	    count += rw->_input_specs[i].failures;
+	    count += rw->input_total(i, true);
 	sa << count;
 	break;
     }
     case h_size:
-	sa << rw->_heap->size();
+	sa << rw->nflows();
 	break;
-    case h_capacity:
-	sa << rw->_heap->_capacity;
+    case h_capacity: {
+	uint32_t capacity = 0;
+	for (int s = 0; s < rw->_nshards; ++s)
+	    capacity += rw->_shards[s].heap->_capacity;
+	sa << capacity;
 	break;
+    }
     default:
 	for (int i = 0; i < rw->_input_specs.size(); ++i) {
 	    if (what != h_patterns && what != i)
@@ -386,8 +553,8 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
 		sa << "<mapper>";
 		break;
 	    }
-	    if (rw->_input_specs[i].count)
-		sa << " [" << rw->_input_specs[i].count << ']';
+	    if (uint32_t count = rw->input_total(i, false))
+		sa << " [" << count << ']';
 	    sa << '\n';
 	}
 	break;
@@ -401,14 +568,17 @@ IPRewriterBase::write_handler(const String &str, Element *e, void *user_data, Er
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(e);
     intptr_t what = reinterpret_cast<intptr_t>(user_data);
     if (what == h_capacity) {
+	int32_t capacity;
 	if (Args(e, errh).push_back_words(str)
-	    .read_mp("CAPACITY", rw->_heap->_capacity)
+	    .read_mp("CAPACITY", capacity)
 	    .complete() < 0)
 	    return -1;
-	rw->shrink_heap(false);
+	for (int s = 0; s < rw->_nshards; ++s)
+	    rw->_shards[s].heap->_capacity = shard_capacity(capacity, rw->_nshards);
+	rw->shrink_heaps(false);
 	return 0;
     } else if (what == h_clear) {
-	rw->shrink_heap(true);
+	rw->shrink_heaps(true);
 	return 0;
     } else
 	return -1;
@@ -420,16 +590,22 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(e);
     intptr_t what = reinterpret_cast<intptr_t>(user_data);
     IPRewriterInput is;
+    // Packets on every shard's thread read the input spec, and each shard's
+    // flows may be touched only by its own thread, so patterns are fixed
+    // when the table is sharded.
+    if (rw->_nshards > 1)
+	return errh->error("cannot change patterns when SHARDS > 1");
     int r = rw->parse_input_spec(str, is, what, errh);
     if (r >= 0) {
 	IPRewriterInput *spec = &rw->_input_specs[what];
 
 	// remove all existing flows created by this input
 	for (int which_heap = 0; which_heap < 2; ++which_heap) {
-	    Vector<IPRewriterFlow *> &myheap = rw->_heap->_heaps[which_heap];
+	    IPRewriterHeap *heap = rw->_shards[0].heap;
+	    Vector<IPRewriterFlow *> &myheap = heap->_heaps[which_heap];
 	    for (int i = myheap.size() - 1; i >= 0; --i)
 		if (myheap[i]->owner() == spec) {
-		    myheap[i]->destroy(rw->_heap);
+		    myheap[i]->destroy(heap);
 		    if (i < myheap.size())
 			++i;
 		}
@@ -438,6 +614,8 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
 	// change pattern
 	if (spec->kind == IPRewriterInput::i_pattern)
 	    spec->u.pattern->unuse();
+	if (is.kind == IPRewriterInput::i_pattern)
+	    is.u.pattern->reserve_shards(rw->_nshards);
 	*spec = is;
     }
     return 0;
@@ -473,11 +651,7 @@ IPRewriterBase::llrpc(unsigned command, void *data)
 	//	      -EAGAIN.
 
 	IPFlowID *val = reinterpret_cast<IPFlowID *>(data);
-	IPRewriterEntry *m = get_entry(IP_PROTO_TCP, *val, -1);
-	if (!m)
-	    return -EAGAIN;
-	*val = m->rewritten_flowid();
-	return 0;
+	return map_flowid(IP_PROTO_TCP, *val);
 
     } else if (command == CLICK_LLRPC_IPREWRITER_MAP_UDP) {
 	// Data	: unsigned saddr, daddr; unsigned short sport, dport
@@ -487,11 +661,7 @@ IPRewriterBase::llrpc(unsigned command, void *data)
 	//	      -EAGAIN.
 
 	IPFlowID *val = reinterpret_cast<IPFlowID *>(data);
-	IPRewriterEntry *m = get_entry(IP_PROTO_UDP, *val, -1);
-	if (!m)
-	    return -EAGAIN;
-	*val = m->rewritten_flowid();
-	return 0;
+	return map_flowid(IP_PROTO_UDP, *val);
 
     } else
 	return Element::llrpc(command, data);
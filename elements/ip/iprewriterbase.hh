@@ -2,6 +2,9 @@
 #ifndef CLICK_IPREWRITERBASE_HH
 #define CLICK_IPREWRITERBASE_HH
 #include <click/timer.hh>
+#include <click/task.hh>
+#include <click/sync.hh>
+#include <click/hashallocator.hh>
 #include "elements/ip/iprwmapping.hh"
 #include <click/bitvector.hh>
 CLICK_DECLS
@@ -18,15 +21,13 @@ class IPRewriterInput { public:
     int foutput;
     IPRewriterBase *reply_element;
     int routput;
-    uint32_t count;
-    uint32_t failures;
     union {
 	IPRewriterPattern *pattern;
 	IPMapper *mapper;
     } u;
 
     IPRewriterInput()
-	: kind(i_drop), foutput(-1), routput(-1), count(0), failures(0) {
+	: kind(i_drop), foutput(-1), routput(-1) {
 	u.pattern = 0;
     }
 
@@ -78,6 +79,46 @@ class IPRewriterHeap { public:
 
 };
 
+class IPRewriterShard { public:
+
+    IPRewriterShard()
+	: map(0), udp_map(0), heap(0), allocator(0), count(0), failures(0),
+	  owner(0), gc_task(0), clear_pending(false) {
+    }
+    ~IPRewriterShard() {
+	delete[] count;
+	delete[] failures;
+    }
+
+    HashContainer<IPRewriterEntry> map;
+    HashContainer<IPRewriterEntry> udp_map; // IPRewriter's UDP flows
+    IPRewriterHeap *heap;
+    HashAllocator allocator;
+
+    // Structural changes to this shard's maps happen only on the owning
+    // thread.  That thread looks flows up without locking; it takes 'lock'
+    // just around inserts and erases, so handlers running on other threads
+    // can walk the maps safely.
+    SimpleSpinlock lock;
+
+    // Mappings made and mapping failures, per input.  The handlers sum
+    // them over shards.
+    uint32_t *count;
+    uint32_t *failures;
+
+    // With more than one shard, expiry runs in 'gc_task' on the owning
+    // thread.  The GC timer and handlers schedule it.
+    IPRewriterBase *owner;
+    Task *gc_task;
+    volatile bool clear_pending;
+
+  private:
+
+    IPRewriterShard(const IPRewriterShard &);
+    IPRewriterShard &operator=(const IPRewriterShard &);
+
+};
+
 class IPRewriterBase : public Element { public:
 
     typedef HashContainer<IPRewriterEntry> Map;
@@ -104,14 +145,37 @@ class IPRewriterBase : public Element { public:
     void add_rewriter_handlers(bool writable_patterns);
     void cleanup(CleanupStage) CLICK_COLD;
 
-    const IPRewriterHeap *flow_heap() const {
-	return _heap;
+    /** @brief Return shard @a shard's flow heap. */
+    const IPRewriterHeap *flow_heap(int shard = 0) const {
+	return _shards[shard].heap;
+    }
+    /** @brief Return the number of flows in every shard's heap. */
+    uint32_t nflows() const {
+	uint32_t n = 0;
+	for (int s = 0; s < _nshards; ++s)
+	    n += _shards[s].heap->size();
+	return n;
     }
     IPRewriterBase *reply_element(int input) const {
 	return _input_specs[input].reply_element;
     }
-    virtual HashContainer<IPRewriterEntry> *get_map(int mapid) {
-	return likely(mapid == IPRewriterInput::mapid_default) ? &_map : 0;
+
+    /** @brief Return the number of flow table shards. */
+    int nshards() const {
+	return _nshards;
+    }
+    /** @brief Return the index of the shard owned by the running thread. */
+    inline int shard_index() const;
+    /** @brief Return the shard that holds @a flow. */
+    IPRewriterShard &flow_shard(const IPRewriterFlow *flow) const {
+	return _shards[flow->shard()];
+    }
+
+    virtual HashContainer<IPRewriterEntry> *get_map(int mapid, int shard) {
+	return likely(mapid == IPRewriterInput::mapid_default) ? &_shards[shard].map : 0;
+    }
+    HashContainer<IPRewriterEntry> *get_map(int mapid) {
+	return get_map(mapid, shard_index());
     }
 
     enum {
@@ -131,11 +195,14 @@ class IPRewriterBase : public Element { public:
 
   protected:
 
-    Map _map;
+    enum { max_shards = 256 };	// IPRewriterFlow::_shard is a uint8_t
+    IPRewriterShard *_shards;
+    int _nshards;
+    size_t _flow_size;
+    IPRewriterBase *_capacity_element;
 
     Vector<IPRewriterInput> _input_specs;
 
-    IPRewriterHeap *_heap;
     uint32_t _timeouts[2];
     uint32_t _gc_interval_sec;
     Timer _gc_timer;
@@ -150,12 +217,15 @@ class IPRewriterBase : public Element { public:
 	return timeouts[1] ? timeouts[1] : timeouts[0];
     }
 
+    inline IPRewriterShard &local_shard();
+
     IPRewriterEntry *store_flow(IPRewriterFlow *flow, int input,
 				Map &map, Map *reply_map_ptr = 0);
     inline void unmap_flow(IPRewriterFlow *flow,
 			   Map &map, Map *reply_map_ptr = 0);
 
     static void gc_timer_hook(Timer *t, void *user_data);
+    static bool gc_task_hook(Task *t, void *user_data);
 
     int parse_input_spec(const String &str, IPRewriterInput &is,
 			 int input_number, ErrorHandler *errh);
@@ -173,9 +243,15 @@ class IPRewriterBase : public Element { public:
 
   private:
 
-    void shift_heap_best_effort(click_jiffies_t now_j);
-    bool shrink_heap_for_new_flow(IPRewriterFlow *flow, click_jiffies_t now_j);
-    void shrink_heap(bool clear_all);
+    IPRewriterBase *capacity_root();
+    void shift_heap_best_effort(IPRewriterHeap *heap, click_jiffies_t now_j);
+    bool shrink_heap_for_new_flow(IPRewriterHeap *heap, IPRewriterFlow *flow,
+				  click_jiffies_t now_j);
+    void shrink_heap(IPRewriterHeap *heap, bool clear_all);
+    void shrink_heaps(bool clear_all);
+    void shard_gc(IPRewriterShard &shard);
+    uint32_t input_total(int input, bool failures) const;
+    int map_flowid(int ip_p, IPFlowID &flowid);
 
     friend class IPRewriterFlow;
 
@@ -211,11 +287,13 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	return IPRewriterBase::rw_addmap;
     case i_pattern: {
 	HashContainer<IPRewriterEntry> *reply_map;
+	int shard = reply_element->shard_index();
 	if (likely(mapid == mapid_default))
-	    reply_map = &reply_element->_map;
+	    reply_map = &reply_element->_shards[shard].map;
 	else
-	    reply_map = reply_element->get_map(mapid);
-	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map);
+	    reply_map = reply_element->get_map(mapid, shard);
+	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map,
+				      shard, reply_element->_nshards);
 	goto check_for_failure;
     }
     case i_mapper:
@@ -223,26 +301,43 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	goto check_for_failure;
     check_for_failure:
 	if (i == IPRewriterBase::rw_drop)
-	    ++failures;
+	    ++owner->_shards[owner->shard_index()].failures[owner_input];
 	return i;
     default:
 	return IPRewriterBase::rw_drop;
     }
 }
 
+inline int
+IPRewriterBase::shard_index() const
+{
+    return _nshards == 1 ? 0 : click_current_cpu_id() % _nshards;
+}
+
+inline IPRewriterShard &
+IPRewriterBase::local_shard()
+{
+    return _shards[shard_index()];
+}
+
 inline void
 IPRewriterBase::unmap_flow(IPRewriterFlow *flow, Map &map,
 			   Map *reply_map_ptr)
 {
     //click_chatter("kill %s", hashkey().s().c_str());
+    IPRewriterShard &shard = flow_shard(flow);
     if (!reply_map_ptr)
-	reply_map_ptr = &flow->owner()->reply_element->_map;
+	reply_map_ptr = &flow->owner()->reply_element->_shards[flow->shard()].map;
+    if (_nshards > 1)
+	shard.lock.acquire();
     Map::iterator it = map.find(flow->entry(0).hashkey());
     if (it.get() == &flow->entry(0))
 	map.erase(it);
     it = reply_map_ptr->find(flow->entry(1).hashkey());
     if (it.get() == &flow->entry(1))
 	reply_map_ptr->erase(it);
+    if (_nshards > 1)
+	shard.lock.release();
 }
 
 CLICK_ENDDECLS
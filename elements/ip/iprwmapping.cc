@@ -38,7 +38,7 @@ IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
 			       click_jiffies_t expiry_j)
     : _expiry_j(expiry_j), _ip_p(ip_p), _tflags(0),
       _guaranteed(guaranteed), _reply_anno(0),
-      _owner(owner)
+      _shard(owner->owner->shard_index()), _owner(owner)
 {
     _e[0].initialize(flowid, owner->foutput, false);
     _e[1].initialize(rewritten_flowid.reverse(), owner->routput, true);
@@ -119,7 +119,7 @@ IPRewriterFlow::destroy(IPRewriterHeap *heap)
     remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
 		heap_less(), heap_place());
     myheap.pop_back();
-    --_owner->count;
+    --_owner->owner->_shards[_shard].count[_owner->owner_input];
     _owner->owner->destroy_flow(this);
 }
 
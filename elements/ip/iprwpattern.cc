@@ -39,7 +39,7 @@ IPRewriterPattern::IPRewriterPattern(const IPAddress &saddr, int sport,
 		       bool is_napt, bool sequential, bool same_first,
 		       uint32_t variation_top)
     : _saddr(saddr), _sport(sport), _daddr(daddr), _dport(dport),
-      _variation_top(variation_top), _next_variation(0), _is_napt(is_napt),
+      _variation_top(variation_top), _next_variation(1, Cursor()), _is_napt(is_napt),
       _sequential(sequential), _same_first(same_first), _refcount(0)
 {
 }
@@ -216,10 +216,18 @@ IPRewriterPattern::parse_with_ports(const String &conf, IPRewriterInput *input,
 	&& parse_ports(port_words, input, e, errh);
 }
 
+void
+IPRewriterPattern::reserve_shards(int nshards)
+{
+    if (_next_variation.size() < nshards)
+	_next_variation.resize(nshards, Cursor());
+}
+
 int
 IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 				  IPFlowID &rewritten_flowid,
-				  const HashContainer<IPRewriterEntry> &reply_map)
+				  const HashContainer<IPRewriterEntry> &reply_map,
+				  int shard, int nshards)
 {
     rewritten_flowid = flowid;
     if (_saddr)
@@ -235,21 +243,33 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	IPFlowID lookup = rewritten_flowid.reverse();
 	uint32_t base = (_is_napt ? ntohs(_sport) : ntohl(_saddr.addr()));
 
+	// Shards have separate reply maps, so each one draws from its own
+	// slice of the variation range; that keeps rewritten flows unique.
+	uint32_t lo = 0, hi = _variation_top;
+	if (nshards > 1) {
+	    uint64_t range = (uint64_t) _variation_top + 1;
+	    lo = range * shard / nshards;
+	    if (range * (shard + 1) / nshards == lo)
+		return IPRewriterBase::rw_drop;
+	    hi = range * (shard + 1) / nshards - 1;
+	}
+	uint32_t &next_variation = _next_variation[shard].next;
+
 	uint32_t val;
 	if (_same_first
-	    && (val = ntohs(flowid.sport()) - base) <= _variation_top) {
+	    && (val = ntohs(flowid.sport()) - base) >= lo && val <= hi) {
 	    lookup.set_dport(flowid.sport());
 	    if (!reply_map.find(lookup))
 		goto found_variation;
 	}
 
 	if (_sequential)
-	    val = (_next_variation > _variation_top ? 0 : _next_variation);
+	    val = (next_variation > hi || next_variation < lo ? lo : next_variation);
 	else
-	    val = click_random(0, _variation_top);
+	    val = click_random(lo, hi);
 
-	for (uint32_t count = 0; count <= _variation_top;
-	     ++count, val = (val == _variation_top ? 0 : val + 1)) {
+	for (uint32_t count = lo; count <= hi;
+	     ++count, val = (val == hi ? lo : val + 1)) {
 	    if (_is_napt)
 		lookup.set_dport(htons(base + val));
 	    else
@@ -265,7 +285,7 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	    rewritten_flowid.set_sport(lookup.dport());
 	else
 	    rewritten_flowid.set_saddr(lookup.daddr());
-	_next_variation = val + 1;
+	next_variation = val + 1;
     }
 
     return IPRewriterBase::rw_addmap;
@@ -37,8 +37,10 @@ class IPRewriterPattern { public:
 	return _daddr;
     }
 
+    void reserve_shards(int nshards);
     int rewrite_flowid(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
-		       const HashContainer<IPRewriterEntry> &reply_map);
+		       const HashContainer<IPRewriterEntry> &reply_map,
+		       int shard = 0, int nshards = 1);
 
     String unparse() const;
 
@@ -50,7 +52,13 @@ class IPRewriterPattern { public:
     int _dport;			// net byte order
 
     uint32_t _variation_top;
-    uint32_t _next_variation;
+
+    // One cursor per shard, each on its own cache line.
+    struct Cursor {
+	uint32_t next;
+	Cursor() : next(0) { }
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    Vector<Cursor> _next_variation;
 
     bool _is_napt;
     bool _sequential;
@@ -125,6 +125,8 @@ SourceIPHashMapper::notify_rewriter(IPRewriterBase *user,
 	if (_is[i].foutput >= user->noutputs()
 	    || _is[i].routput >= input->reply_element->noutputs())
 	    errh->error("output port out of range in %s pattern %d", declaration().c_str(), i);
+	if (_is[i].kind == IPRewriterInput::i_pattern)
+	    _is[i].u.pattern->reserve_shards(user->nshards());
     }
 }
 
@@ -0,0 +1,178 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * aesgcm.{cc,hh} -- element implements IPsec ESP with AES-GCM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "aesgcm.hh"
+#include "esp.hh"
+#include "sadatatuple.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecAESGCM::IPsecAESGCM()
+    : _cache(0), _ncache(0)
+{
+}
+
+IPsecAESGCM::~IPsecAESGCM()
+{
+}
+
+int
+IPsecAESGCM::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _icv = AESGCM::TAG_LEN;
+    _software = false;
+    if (Args(conf, this, errh)
+	.read_mp("ENCRYPT", _encrypt)
+	.read("ICV", _icv)
+	.read("SOFTWARE", _software)
+	.complete() < 0)
+	return -1;
+    if (_icv != 8 && _icv != 12 && _icv != 16)
+	return errh->error("ICV must be 8, 12, or 16");
+    return 0;
+}
+
+int
+IPsecAESGCM::initialize(ErrorHandler *errh)
+{
+    _ncache = click_max_cpu_ids();
+    if (!(_cache = new KeyCache[_ncache]))
+	return errh->error("out of memory!");
+    for (unsigned i = 0; i < _ncache; ++i)
+	_cache[i].sa = 0;
+    _drops = 0;
+    return 0;
+}
+
+void
+IPsecAESGCM::cleanup(CleanupStage)
+{
+    delete[] _cache;
+    _cache = 0;
+}
+
+inline const IPsecAESGCM::KeyCache *
+IPsecAESGCM::lookup(const SADataTuple *sa)
+{
+    KeyCache &kc = _cache[click_current_cpu_id()];
+    // The SA's keys may change in place, so compare them too.
+    if (kc.sa != sa
+	|| memcmp(kc.key, sa->Encryption_key, AESGCM::KEY_LEN) != 0
+	|| memcmp(kc.key + AESGCM::KEY_LEN, sa->Authentication_key,
+		  AESGCM::SALT_LEN) != 0) {
+	memcpy(kc.key, sa->Encryption_key, AESGCM::KEY_LEN);
+	memcpy(kc.key + AESGCM::KEY_LEN, sa->Authentication_key,
+	       AESGCM::SALT_LEN);
+	kc.gcm.set_key(kc.key, !_software);
+	kc.sa = sa;
+    }
+    return &kc;
+}
+
+Packet *
+IPsecAESGCM::encrypt(Packet *p_in, const KeyCache *kc)
+{
+    WritablePacket *p = p_in->put(_icv);
+    if (!p)
+	return 0;
+    esp_new *esp = reinterpret_cast<esp_new *>(p->data());
+    memcpy(esp->esp_iv + 4, &esp->esp_rpl, 4);
+
+    unsigned char nonce[AESGCM::IV_LEN], tag[AESGCM::TAG_LEN];
+    memcpy(nonce, kc->key + AESGCM::KEY_LEN, AESGCM::SALT_LEN);
+    memcpy(nonce + AESGCM::SALT_LEN, esp->esp_iv, 8);
+    unsigned char *data = p->data() + sizeof(esp_new);
+    int len = p->length() - sizeof(esp_new) - _icv;
+    kc->gcm.seal(nonce, p->data(), 8, data, len, tag);
+    memcpy(data + len, tag, _icv);
+    return p;
+}
+
+Packet *
+IPsecAESGCM::decrypt(Packet *p_in, const KeyCache *kc)
+{
+    if (p_in->length() < sizeof(esp_new) + _icv) {
+	SADataTuple::release_anno(p_in);
+	p_in->kill();
+	return 0;
+    }
+    WritablePacket *p = p_in->uniqueify();
+    if (!p)
+	return 0;
+    const esp_new *esp = reinterpret_cast<const esp_new *>(p->data());
+
+    unsigned char nonce[AESGCM::IV_LEN];
+    memcpy(nonce, kc->key + AESGCM::KEY_LEN, AESGCM::SALT_LEN);
+    memcpy(nonce + AESGCM::SALT_LEN, esp->esp_iv, 8);
+    unsigned char *data = p->data() + sizeof(esp_new);
+    int len = p->length() - sizeof(esp_new) - _icv;
+    if (!kc->gcm.open(nonce, p->data(), 8, data, len, data + len, _icv)) {
+	if (_drops.fetch_and_add(1) == 0)
+	    click_chatter("%p{element}: invalid GCM authentication tag", this);
+	SADataTuple::release_anno(p);
+	checked_output_push(1, p);
+	return 0;
+    }
+    p->take(_icv);
+    return p;
+}
+
+Packet *
+IPsecAESGCM::simple_action(Packet *p)
+{
+    const SADataTuple *sa = (const SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    if (!sa) {
+	click_chatter("%p{element}: no SADataTuple annotation", this);
+	p->kill();
+	return 0;
+    }
+    const KeyCache *kc = lookup(sa);
+    return _encrypt ? encrypt(p, kc) : decrypt(p, kc);
+}
+
+enum { H_DROPS, H_ACCELERATED };
+
+String
+IPsecAESGCM::read_handler(Element *e, void *thunk)
+{
+    IPsecAESGCM *a = static_cast<IPsecAESGCM *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+    case H_DROPS:
+	return String(a->_drops.value());
+    case H_ACCELERATED:
+	return String(!a->_software && AESGCM::hardware_available());
+    default:
+	return String();
+    }
+}
+
+void
+IPsecAESGCM::add_handlers()
+{
+    add_read_handler("drops", read_handler, H_DROPS);
+    add_read_handler("accelerated", read_handler, H_ACCELERATED);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM)
+EXPORT_ELEMENT(IPsecAESGCM)
+ELEMENT_MT_SAFE(IPsecAESGCM)
@@ -0,0 +1,109 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSECAESGCM_HH
+#define CLICK_IPSECAESGCM_HH
+#include <click/element.hh>
+#include <click/atomic.hh>
+#include "gcm.hh"
+CLICK_DECLS
+class SADataTuple;
+
+/*
+ * =c
+ * IPsecAESGCM(ENCRYPT [, I<keywords> ICV, SOFTWARE])
+ * =s ipsec
+ * encrypt and authenticate ESP packets using AES-GCM
+ * =d
+ *
+ * Encrypts and authenticates, or verifies and decrypts, ESP packets with
+ * AES-128-GCM as specified by RFC 4106, in a single pass over the payload.
+ * IPsecAESGCM replaces the IPsecAuthHMACSHA1 and IPsecAES pair.  If ENCRYPT
+ * is 1, it expects packets from IPsecESPEncap.  It encrypts the payload,
+ * authenticates it along with the SPI and sequence number, and appends the
+ * ICV.  If ENCRYPT is 0, it checks and removes the ICV and decrypts the
+ * payload for IPsecESPUnencap.  Packets that fail verification are counted
+ * and emitted on output 1 if it exists, with their payload unchanged, or
+ * dropped otherwise.
+ *
+ * The key is the SA's encryption key.  RFC 4106 also takes a 4-byte salt
+ * from the keying material; since SAs hold no separate salt, IPsecAESGCM
+ * uses the first 4 bytes of the SA's authentication key, which GCM otherwise
+ * does not need.  On encryption, the low 32 bits of the ESP IV are replaced
+ * by the sequence number, so IVs do not repeat for a key while sequence
+ * numbers do not.
+ *
+ * Expanded keys are cached per thread, so steady traffic on an SA does no
+ * key setup.  On x86-64, IPsecAESGCM uses AES-NI and PCLMULQDQ if the
+ * processor supports them, encrypting eight blocks at a time.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item ICV
+ *
+ * Integer.  ICV length in bytes: 8, 12, or 16.  Default is 16.
+ *
+ * =item SOFTWARE
+ *
+ * Boolean.  If true, use the portable implementation even if the processor
+ * has AES instructions.  Default is false.
+ *
+ * =back
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets that failed verification.
+ *
+ * =h accelerated read-only
+ *
+ * Returns true iff IPsecAESGCM uses AES-NI and PCLMULQDQ.
+ *
+ * =e
+ *
+ *   rt[1] -> IPsecESPEncap() -> IPsecAESGCM(1) -> IPsecEncap(50) -> ...
+ *
+ *   rt[0] -> StripIPHeader() -> IPsecAESGCM(0) -> IPsecESPUnencap() -> ...
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAES, IPsecAuthHMACSHA1
+ */
+
+class IPsecAESGCM : public Element { public:
+
+    IPsecAESGCM() CLICK_COLD;
+    ~IPsecAESGCM() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPsecAESGCM"; }
+    const char *port_count() const	{ return "1/1-2"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+  private:
+
+    struct KeyCache {
+	const SADataTuple *sa;
+	unsigned char key[AESGCM::KEY_LEN + AESGCM::SALT_LEN];
+	AESGCM gcm;
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    bool _encrypt;
+    bool _software;
+    int _icv;
+    KeyCache *_cache;
+    unsigned _ncache;
+    atomic_uint32_t _drops;
+
+    inline const KeyCache *lookup(const SADataTuple *sa);
+    Packet *encrypt(Packet *p, const KeyCache *kc);
+    Packet *decrypt(Packet *p, const KeyCache *kc);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
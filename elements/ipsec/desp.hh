@@ -13,8 +13,9 @@ CLICK_DECLS
  * removes IPSec encapsulation
  * =d
  *
- * Removes ESP header added by IPsecESPEncap. see RFC 2406. Does not perform
- * the optional anti-replay attack checks.
+ * Removes ESP header added by IPsecESPEncap. see RFC 2406. Drops packets
+ * whose sequence numbers fail the SA's anti-replay window check; the check
+ * is safe to run on several threads at once.
  *
  * =a IPsecESPUnencap, IPsecDES, IPsecAuthSHA1
  */
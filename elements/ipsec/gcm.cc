@@ -0,0 +1,507 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * gcm.{cc,hh} -- AES-128-GCM authenticated encryption
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "gcm.hh"
+#include <click/glue.hh>
+#include <click/machine.hh>
+#if HAVE_AESGCM_X86
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+CLICK_DECLS
+
+// Portable AES tables, computed on first use.  Concurrent initializations
+// write identical values, and readers wait for aes_tables_ready.
+static uint8_t aes_sbox[256];
+static uint32_t aes_te[256];
+static volatile bool aes_tables_ready;
+
+static inline uint8_t
+rotl8(uint8_t x, int n)
+{
+    return (x << n) | (x >> (8 - n));
+}
+
+static inline uint32_t
+ror32(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint8_t
+xtime(uint8_t x)
+{
+    return (x << 1) ^ (x & 0x80 ? 0x1B : 0);
+}
+
+static void
+aes_init_tables()
+{
+    // Walk GF(2^8) by multiplying p by 3 and q by its inverse, so that q is
+    // always p's inverse, and apply the affine transform.
+    uint8_t p = 1, q = 1;
+    do {
+	p = p ^ xtime(p);
+	q ^= q << 1;
+	q ^= q << 2;
+	q ^= q << 4;
+	if (q & 0x80)
+	    q ^= 0x09;
+	aes_sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3)
+	    ^ rotl8(q, 4) ^ 0x63;
+    } while (p != 1);
+    aes_sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; ++i) {
+	uint8_t s = aes_sbox[i], s2 = xtime(s);
+	aes_te[i] = ((uint32_t) s2 << 24) | ((uint32_t) s << 16)
+	    | ((uint32_t) s << 8) | (uint8_t) (s2 ^ s);
+    }
+    click_write_fence();
+    aes_tables_ready = true;
+}
+
+static inline uint32_t
+load_be32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+	| ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void
+store_be32(unsigned char *p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+static inline uint64_t
+load_be64(const unsigned char *p)
+{
+    return ((uint64_t) load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static inline void
+store_be64(unsigned char *p, uint64_t x)
+{
+    store_be32(p, x >> 32);
+    store_be32(p + 4, x);
+}
+
+static inline uint32_t
+sub_word(uint32_t x)
+{
+    return ((uint32_t) aes_sbox[x >> 24] << 24)
+	| ((uint32_t) aes_sbox[(x >> 16) & 0xFF] << 16)
+	| ((uint32_t) aes_sbox[(x >> 8) & 0xFF] << 8)
+	| aes_sbox[x & 0xFF];
+}
+
+bool
+AESGCM::hardware_available()
+{
+#if HAVE_AESGCM_X86
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+	return false;
+    // AES-NI, PCLMULQDQ, SSSE3, SSE4.1
+    return (c & (1 << 25)) && (c & (1 << 1)) && (c & (1 << 9))
+	&& (c & (1 << 19));
+#else
+    return false;
+#endif
+}
+
+void
+AESGCM::set_key(const unsigned char *key, bool accelerate)
+{
+    if (!aes_tables_ready)
+	aes_init_tables();
+    click_read_fence();
+
+    for (int i = 0; i < 4; ++i)
+	_rk[i] = load_be32(key + 4 * i);
+    uint8_t rcon = 1;
+    for (int i = 4; i < 4 * (ROUNDS + 1); ++i) {
+	uint32_t t = _rk[i - 1];
+	if (i % 4 == 0) {
+	    t = sub_word((t << 8) | (t >> 24)) ^ ((uint32_t) rcon << 24);
+	    rcon = xtime(rcon);
+	}
+	_rk[i] = _rk[i - 4] ^ t;
+    }
+
+    // GHASH key H = E(K, 0^128), and Shoup's 4-bit table of its multiples
+    unsigned char h[16];
+    memset(h, 0, sizeof(h));
+    encrypt_block(h, h);
+    uint64_t vh = load_be64(h), vl = load_be64(h + 8);
+    memset(_htable, 0, sizeof(_htable));
+    for (int i = 8; i > 0; i >>= 1) {
+	_htable[i][0] = vh;
+	_htable[i][1] = vl;
+	uint64_t t = (vl & 1) ? 0xE100000000000000ULL : 0;
+	vl = (vh << 63) | (vl >> 1);
+	vh = (vh >> 1) ^ t;
+    }
+    for (int i = 2; i < 16; i <<= 1)
+	for (int j = 1; j < i; ++j) {
+	    _htable[i + j][0] = _htable[i][0] ^ _htable[j][0];
+	    _htable[i + j][1] = _htable[i][1] ^ _htable[j][1];
+	}
+
+    _accel = false;
+#if HAVE_AESGCM_X86
+    if (accelerate && hardware_available()) {
+	for (int i = 0; i < 4 * (ROUNDS + 1); ++i)
+	    store_be32(&_rkb[i / 4][4 * (i % 4)], _rk[i]);
+	init_x86();
+	_accel = true;
+    }
+#else
+    (void) accelerate;
+#endif
+}
+
+void
+AESGCM::encrypt_block(const unsigned char *in, unsigned char *out) const
+{
+    const uint32_t *rk = _rk;
+    uint32_t s0 = load_be32(in) ^ rk[0], s1 = load_be32(in + 4) ^ rk[1],
+	s2 = load_be32(in + 8) ^ rk[2], s3 = load_be32(in + 12) ^ rk[3];
+    for (int r = 1; r < ROUNDS; ++r) {
+	rk += 4;
+	uint32_t t0 = aes_te[s0 >> 24] ^ ror32(aes_te[(s1 >> 16) & 0xFF], 8)
+	    ^ ror32(aes_te[(s2 >> 8) & 0xFF], 16) ^ ror32(aes_te[s3 & 0xFF], 24)
+	    ^ rk[0];
+	uint32_t t1 = aes_te[s1 >> 24] ^ ror32(aes_te[(s2 >> 16) & 0xFF], 8)
+	    ^ ror32(aes_te[(s3 >> 8) & 0xFF], 16) ^ ror32(aes_te[s0 & 0xFF], 24)
+	    ^ rk[1];
+	uint32_t t2 = aes_te[s2 >> 24] ^ ror32(aes_te[(s3 >> 16) & 0xFF], 8)
+	    ^ ror32(aes_te[(s0 >> 8) & 0xFF], 16) ^ ror32(aes_te[s1 & 0xFF], 24)
+	    ^ rk[2];
+	uint32_t t3 = aes_te[s3 >> 24] ^ ror32(aes_te[(s0 >> 16) & 0xFF], 8)
+	    ^ ror32(aes_te[(s1 >> 8) & 0xFF], 16) ^ ror32(aes_te[s2 & 0xFF], 24)
+	    ^ rk[3];
+	s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+    }
+    rk += 4;
+#define AES_FINAL(a, b, c, d) \
+	(((uint32_t) aes_sbox[(a) >> 24] << 24) \
+	 | ((uint32_t) aes_sbox[((b) >> 16) & 0xFF] << 16) \
+	 | ((uint32_t) aes_sbox[((c) >> 8) & 0xFF] << 8) \
+	 | aes_sbox[(d) & 0xFF])
+    store_be32(out, AES_FINAL(s0, s1, s2, s3) ^ rk[0]);
+    store_be32(out + 4, AES_FINAL(s1, s2, s3, s0) ^ rk[1]);
+    store_be32(out + 8, AES_FINAL(s2, s3, s0, s1) ^ rk[2]);
+    store_be32(out + 12, AES_FINAL(s3, s0, s1, s2) ^ rk[3]);
+#undef AES_FINAL
+}
+
+// x := x * H in GF(2^128), 4 bits at a time
+void
+AESGCM::gmult(unsigned char *x) const
+{
+    static const uint64_t rem_4bit[16] = {
+	0x0000ULL << 48, 0x1C20ULL << 48, 0x3840ULL << 48, 0x2460ULL << 48,
+	0x7080ULL << 48, 0x6CA0ULL << 48, 0x48C0ULL << 48, 0x54E0ULL << 48,
+	0xE100ULL << 48, 0xFD20ULL << 48, 0xD940ULL << 48, 0xC560ULL << 48,
+	0x9180ULL << 48, 0x8DA0ULL << 48, 0xA9C0ULL << 48, 0xB5E0ULL << 48
+    };
+    int nlo = x[15], nhi = nlo >> 4;
+    nlo &= 0xF;
+    uint64_t zh = _htable[nlo][0], zl = _htable[nlo][1];
+    for (int i = 15; ; ) {
+	int rem = zl & 0xF;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ rem_4bit[rem] ^ _htable[nhi][0];
+	zl ^= _htable[nhi][1];
+	if (--i < 0)
+	    break;
+	nlo = x[i];
+	nhi = nlo >> 4;
+	nlo &= 0xF;
+	rem = zl & 0xF;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ rem_4bit[rem] ^ _htable[nlo][0];
+	zl ^= _htable[nlo][1];
+    }
+    store_be64(x, zh);
+    store_be64(x + 8, zl);
+}
+
+// Hash len bytes, zero-padding the last block.
+void
+AESGCM::ghash(unsigned char *x, const unsigned char *data, int len) const
+{
+    for (; len > 0; data += 16, len -= 16) {
+	int n = len < 16 ? len : 16;
+	for (int i = 0; i < n; ++i)
+	    x[i] ^= data[i];
+	gmult(x);
+    }
+}
+
+void
+AESGCM::crypt_portable(const unsigned char *j0, const unsigned char *aad,
+		       int aadlen, unsigned char *data, int len,
+		       unsigned char *tag, Mode mode) const
+{
+    unsigned char x[16], ctr[16], ks[16];
+    memset(x, 0, sizeof(x));
+    if (mode != m_decrypt)
+	ghash(x, aad, aadlen);
+
+    memcpy(ctr, j0, 16);
+    uint32_t c = load_be32(j0 + 12);
+    for (int pos = 0; pos < len; pos += 16) {
+	int n = len - pos < 16 ? len - pos : 16;
+	unsigned char *d = data + pos;
+	if (mode != m_hash) {
+	    store_be32(ctr + 12, ++c);
+	    encrypt_block(ctr, ks);
+	    for (int i = 0; i < n; ++i)
+		d[i] ^= ks[i];
+	}
+	if (mode != m_decrypt) {
+	    for (int i = 0; i < n; ++i)
+		x[i] ^= d[i];
+	    gmult(x);
+	}
+    }
+    if (mode == m_decrypt)
+	return;
+
+    unsigned char lens[16];
+    store_be64(lens, (uint64_t) aadlen * 8);
+    store_be64(lens + 8, (uint64_t) len * 8);
+    ghash(x, lens, 16);
+    encrypt_block(j0, ks);
+    for (int i = 0; i < 16; ++i)
+	tag[i] = ks[i] ^ x[i];
+}
+
+#if HAVE_AESGCM_X86
+# define AESGCM_TARGET __attribute__((target("aes,pclmul,ssse3,sse4.1")))
+
+// Carry-less multiply without reduction, in GHASH's bit-reflected byte
+// order; products may be summed before one reduction.
+AESGCM_TARGET static inline void
+clmul(__m128i a, __m128i b, __m128i &lo, __m128i &hi)
+{
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+			       _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+    hi = _mm_xor_si128(hi, _mm_xor_si128(t2, _mm_srli_si128(t1, 8)));
+}
+
+// Reduce a 256-bit product modulo the GCM polynomial.
+AESGCM_TARGET static inline __m128i
+gfreduce(__m128i lo, __m128i hi)
+{
+    // shift the product left one bit
+    __m128i c0 = _mm_srli_epi32(lo, 31), c1 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i c2 = _mm_srli_si128(c0, 12);
+    c1 = _mm_slli_si128(c1, 4);
+    c0 = _mm_slli_si128(c0, 4);
+    lo = _mm_or_si128(lo, c0);
+    hi = _mm_or_si128(_mm_or_si128(hi, c1), c2);
+
+    __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31),
+					    _mm_slli_epi32(lo, 30)),
+			      _mm_slli_epi32(lo, 25));
+    __m128i u = _mm_srli_si128(t, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+    __m128i v = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1),
+					    _mm_srli_epi32(lo, 2)),
+			      _mm_xor_si128(_mm_srli_epi32(lo, 7), u));
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, v));
+}
+
+AESGCM_TARGET static inline __m128i
+gfmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    clmul(a, b, lo, hi);
+    return gfreduce(lo, hi);
+}
+
+AESGCM_TARGET static inline __m128i
+bswap128(__m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+					    10, 11, 12, 13, 14, 15));
+}
+
+// Hash up to 16 bytes, zero-padded, into x.
+AESGCM_TARGET static inline __m128i
+ghash_partial(__m128i x, const unsigned char *data, int n, __m128i h)
+{
+    unsigned char buf[16];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, data, n);
+    x = _mm_xor_si128(x, bswap128(_mm_loadu_si128((const __m128i *) buf)));
+    return gfmul(x, h);
+}
+
+AESGCM_TARGET void
+AESGCM::init_x86()
+{
+    // powers H^1 .. H^8, so eight blocks share one reduction
+    unsigned char zero[16];
+    memset(zero, 0, sizeof(zero));
+    unsigned char hb[16];
+    encrypt_block(zero, hb);
+    __m128i h = bswap128(_mm_loadu_si128((const __m128i *) hb));
+    __m128i p = h;
+    for (int i = 0; i < 8; ++i) {
+	_mm_store_si128((__m128i *) _hpow[i], p);
+	p = gfmul(p, h);
+    }
+}
+
+AESGCM_TARGET void
+AESGCM::crypt_x86(const unsigned char *j0, const unsigned char *aad,
+		  int aadlen, unsigned char *data, int len,
+		  unsigned char *tag, Mode mode) const
+{
+    enum { STRIDE = 8 };
+    __m128i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; ++r)
+	rk[r] = _mm_load_si128((const __m128i *) _rkb[r]);
+    const __m128i h = _mm_load_si128((const __m128i *) _hpow[0]);
+
+    __m128i x = _mm_setzero_si128();
+    if (mode != m_decrypt)
+	for (int pos = 0; pos < aadlen; pos += 16)
+	    x = ghash_partial(x, aad + pos, aadlen - pos < 16 ? aadlen - pos : 16, h);
+
+    __m128i base = _mm_loadu_si128((const __m128i *) j0);
+    uint32_t c = load_be32(j0 + 12);
+    unsigned char *d = data;
+    int left = len;
+
+    // eight counter blocks in flight through the AES pipeline
+    while (left >= 16 * STRIDE) {
+	__m128i in[STRIDE];
+	if (mode != m_hash) {
+	    __m128i b[STRIDE];
+	    for (int i = 0; i < STRIDE; ++i)
+		b[i] = _mm_xor_si128(_mm_insert_epi32(base, __builtin_bswap32(c + 1 + i), 3), rk[0]);
+	    c += STRIDE;
+	    for (int r = 1; r < ROUNDS; ++r)
+		for (int i = 0; i < STRIDE; ++i)
+		    b[i] = _mm_aesenc_si128(b[i], rk[r]);
+	    for (int i = 0; i < STRIDE; ++i) {
+		b[i] = _mm_aesenclast_si128(b[i], rk[ROUNDS]);
+		in[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (d + 16 * i)), b[i]);
+		_mm_storeu_si128((__m128i *) (d + 16 * i), in[i]);
+	    }
+	} else
+	    for (int i = 0; i < STRIDE; ++i)
+		in[i] = _mm_loadu_si128((const __m128i *) (d + 16 * i));
+	if (mode != m_decrypt) {
+	    // X = (X + C1) H^8 + C2 H^7 + ... + C8 H
+	    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+	    clmul(_mm_xor_si128(x, bswap128(in[0])),
+		  _mm_load_si128((const __m128i *) _hpow[STRIDE - 1]), lo, hi);
+	    for (int i = 1; i < STRIDE; ++i)
+		clmul(bswap128(in[i]),
+		      _mm_load_si128((const __m128i *) _hpow[STRIDE - 1 - i]), lo, hi);
+	    x = gfreduce(lo, hi);
+	}
+	d += 16 * STRIDE;
+	left -= 16 * STRIDE;
+    }
+
+    while (left > 0) {
+	int n = left < 16 ? left : 16;
+	if (mode != m_hash) {
+	    __m128i b = _mm_xor_si128(_mm_insert_epi32(base, __builtin_bswap32(++c), 3), rk[0]);
+	    for (int r = 1; r < ROUNDS; ++r)
+		b = _mm_aesenc_si128(b, rk[r]);
+	    b = _mm_aesenclast_si128(b, rk[ROUNDS]);
+	    unsigned char ks[16];
+	    _mm_storeu_si128((__m128i *) ks, b);
+	    for (int i = 0; i < n; ++i)
+		d[i] ^= ks[i];
+	}
+	if (mode != m_decrypt)
+	    x = ghash_partial(x, d, n, h);
+	d += n;
+	left -= n;
+    }
+    if (mode == m_decrypt)
+	return;
+
+    unsigned char lens[16];
+    store_be64(lens, (uint64_t) aadlen * 8);
+    store_be64(lens + 8, (uint64_t) len * 8);
+    x = ghash_partial(x, lens, 16, h);
+
+    __m128i e = _mm_xor_si128(base, rk[0]);
+    for (int r = 1; r < ROUNDS; ++r)
+	e = _mm_aesenc_si128(e, rk[r]);
+    e = _mm_aesenclast_si128(e, rk[ROUNDS]);
+    _mm_storeu_si128((__m128i *) tag, _mm_xor_si128(e, bswap128(x)));
+}
+#endif
+
+void
+AESGCM::crypt(const unsigned char *iv, const unsigned char *aad, int aadlen,
+	      unsigned char *data, int len, unsigned char *tag,
+	      Mode mode) const
+{
+    // 96-bit IV: J0 = IV || 0^31 || 1
+    unsigned char j0[16];
+    memcpy(j0, iv, IV_LEN);
+    store_be32(j0 + IV_LEN, 1);
+#if HAVE_AESGCM_X86
+    if (_accel) {
+	crypt_x86(j0, aad, aadlen, data, len, tag, mode);
+	return;
+    }
+#endif
+    crypt_portable(j0, aad, aadlen, data, len, tag, mode);
+}
+
+bool
+AESGCM::open(const unsigned char *iv, const unsigned char *aad, int aadlen,
+	     unsigned char *data, int len, const unsigned char *tag,
+	     int taglen) const
+{
+    if (taglen <= 0 || taglen > TAG_LEN)
+	return false;
+    // Authenticate the ciphertext before decrypting any of it.
+    unsigned char computed[TAG_LEN];
+    crypt(iv, aad, aadlen, data, len, computed, m_hash);
+    unsigned char diff = 0;
+    for (int i = 0; i < taglen; ++i)
+	diff |= computed[i] ^ tag[i];
+    if (diff != 0)
+	return false;
+    crypt(iv, aad, aadlen, data, len, 0, m_decrypt);
+    return true;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(AESGCM)
@@ -0,0 +1,101 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSEC_GCM_HH
+#define CLICK_IPSEC_GCM_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+ * gcm.{cc,hh} -- AES-128-GCM authenticated encryption
+ *
+ * AESGCM holds an expanded AES-128 key and the GHASH key derived from it.
+ * It seals messages in one pass: each block is encrypted in counter mode
+ * and hashed as it goes by.  Opening takes two passes, so that no plaintext
+ * is produced from a forged message: GHASH over the ciphertext first, then,
+ * if the tag matches, counter-mode decryption.  On x86-64 user-level builds, it
+ * uses AES-NI and PCLMULQDQ when the processor has them, running eight
+ * counter blocks through the AES pipeline at a time and folding eight
+ * blocks into GHASH per reduction.  Otherwise it uses portable table-driven
+ * code.  Both produce identical output.
+ */
+
+#if CLICK_USERLEVEL && defined(__x86_64__) && defined(__GNUC__)
+# define HAVE_AESGCM_X86 1
+#endif
+
+class AESGCM { public:
+
+    enum { KEY_LEN = 16, SALT_LEN = 4, IV_LEN = 12, TAG_LEN = 16,
+	   ROUNDS = 10 };
+
+    AESGCM()
+	: _accel(false) {
+    }
+
+    /** @brief Set the AES-128 key.
+     * @param key KEY_LEN bytes
+     * @param accelerate use AES-NI and PCLMULQDQ if available */
+    void set_key(const unsigned char *key, bool accelerate = true);
+
+    /** @brief Return true iff this key uses the hardware path. */
+    bool accelerated() const {
+	return _accel;
+    }
+
+    /** @brief Return true iff the processor supports the hardware path. */
+    static bool hardware_available();
+
+    /** @brief Encrypt @a data in place and compute its tag.
+     * @param iv IV_LEN-byte nonce
+     * @param aad additional authenticated data
+     * @param tag receives TAG_LEN bytes */
+    void seal(const unsigned char *iv, const unsigned char *aad, int aadlen,
+	      unsigned char *data, int len, unsigned char *tag) const {
+	crypt(iv, aad, aadlen, data, len, tag, m_seal);
+    }
+
+    /** @brief Verify @a data's tag and decrypt it in place.
+     * @param tag expected tag, of which the first @a taglen bytes are
+     * checked
+     * @return true iff the tag matched; if it did not, @a data is left
+     * unchanged
+     *
+     * The tag is checked, in constant time, before any data is
+     * decrypted. */
+    bool open(const unsigned char *iv, const unsigned char *aad, int aadlen,
+	      unsigned char *data, int len, const unsigned char *tag,
+	      int taglen = TAG_LEN) const;
+
+  private:
+
+    uint32_t _rk[4 * (ROUNDS + 1)];
+    uint64_t _htable[16][2];
+#if HAVE_AESGCM_X86
+    unsigned char _rkb[ROUNDS + 1][16] CLICK_ALIGNED(16);
+    unsigned char _hpow[8][16] CLICK_ALIGNED(16);
+#endif
+    bool _accel;
+
+    // m_seal encrypts and hashes the ciphertext, m_hash only hashes data,
+    // and m_decrypt only runs counter mode and computes no tag.
+    enum Mode { m_seal, m_hash, m_decrypt };
+
+    void crypt(const unsigned char *iv, const unsigned char *aad, int aadlen,
+	       unsigned char *data, int len, unsigned char *tag,
+	       Mode mode) const;
+    void encrypt_block(const unsigned char *in, unsigned char *out) const;
+    void gmult(unsigned char *x) const;
+    void ghash(unsigned char *x, const unsigned char *data, int len) const;
+    void crypt_portable(const unsigned char *j0, const unsigned char *aad,
+			int aadlen, unsigned char *data, int len,
+			unsigned char *tag, Mode mode) const;
+#if HAVE_AESGCM_X86
+    void init_x86();
+    void crypt_x86(const unsigned char *j0, const unsigned char *aad,
+		   int aadlen, unsigned char *data, int len,
+		   unsigned char *tag, Mode mode) const;
+#endif
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -83,6 +83,7 @@ IPsecAuthHMACSHA1::simple_action(Packet *p)
       if (_drops == 0)
 	click_chatter("Invalid SHA1 authentication digest");
       _drops++;
+      SADataTuple::release_anno(p);
       if (noutputs() > 1)
 	output(1).push(p);
       else
@@ -29,6 +29,7 @@
 #include <click/packet_anno.hh>
 #include <click/glue.hh>
 #include <click/standard/alignmentinfo.hh>
+#include "sadatatuple.hh"
 CLICK_DECLS
 
 IPsecEncap::IPsecEncap()
@@ -123,6 +124,8 @@ IPsecEncap::initialize(ErrorHandler *)
 Packet *
 IPsecEncap::simple_action(Packet *p_in)
 {
+  // IPsec processing is done with the SA
+  SADataTuple::release_anno(p_in);
    WritablePacket *p = p_in->push(sizeof(click_ip));
   if (!p) return 0;
 
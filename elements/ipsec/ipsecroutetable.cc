@@ -39,16 +39,41 @@
 
 CLICK_DECLS
 
+// Parse 'SPI ENCRYPT_KEY AUTH_KEY REPLAY OOSIZE' into a new SADataTuple.
+static SADataTuple *
+cp_ipsec_sa(Vector<String> &words, uint32_t &spi, Element *context, ErrorHandler *errh)
+{
+    String enc_key, auth_key;
+    uint32_t replay;
+    uint16_t oowin;
+    if (Args(words, context, errh)
+	.read_mp("SPI", spi)
+	.read_mp("ENCRYPT_KEY", enc_key)
+	.read_mp("AUTH_KEY", auth_key)
+	.read_mp("REPLAY", replay)
+	.read_mp("OOSIZE", oowin)
+	.complete() < 0)
+	return 0;
+    if (enc_key.length() != KEY_SIZE || auth_key.length() != KEY_SIZE) {
+	errh->error("key has bad length");
+	return 0;
+    }
+    if (!spi) {
+	errh->error("SPI must be nonzero");
+	return 0;
+    }
+    if (oowin > SADataTuple::MAX_REPLAY_WINDOW) {
+	errh->error("OOSIZE must be at most %d", SADataTuple::MAX_REPLAY_WINDOW);
+	return 0;
+    }
+    return new SADataTuple(enc_key.data(), auth_key.data(), replay, oowin);
+}
+
 //changed to support IPsec extensions
 bool
 cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *context)
 {
     IPsecRoute r;
-    //Data to initialize the SADataTuple
-    unsigned int replay;
-    uint8_t  oowin;
-
-    SADataTuple * sa_data;
 
     if (!IPPrefixArg(true).parse(cp_shift_spacevec(s), r.addr, r.mask, context))
 	return false;
@@ -70,8 +95,7 @@ cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *contex
 
     if (!word) {
 	//no further arguments found so no ipsec extensions need to be added for this route
-	r.spi = SPI(0);
-	r.sa_data = NULL;
+	r.spi = 0;
 	//store routing table
         *r_store = r;
 	return true;
@@ -80,25 +104,12 @@ cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *contex
     Vector<String> words;
     words.push_back(word);
     cp_spacevec(s, words);
-    String enc_key, auth_key;
-    if (Args(words, context, ErrorHandler::default_handler())
-	.read_mp("SPI", r.spi)
-	.read_mp("ENCRYPT_KEY", enc_key)
-	.read_mp("AUTH_KEY", auth_key)
-	.read_mp("REPLAY", replay)
-	.read_mp("OOSIZE", oowin)
-	.complete() < 0)
+    // Create new Security Association Table entry, replacing any SA with
+    // the same SPI
+    SADataTuple *sa_data = cp_ipsec_sa(words, r.spi, context, ErrorHandler::default_handler());
+    if (!sa_data)
 	return false;
-    if (enc_key.length() != 16 || auth_key.length() != 16) {
-	click_chatter("key has bad length");
-	return false;
-    }
-
-    // Create new Security Association Table entry
-    sa_data = new SADataTuple(enc_key.data(), auth_key.data(), replay, oowin);
-    ((IPsecRouteTable*)context)->_sa_table.insert(SPI(r.spi),*sa_data);
-    //Set Tuple reference in the Routing entry
-    r.sa_data = sa_data;
+    ((IPsecRouteTable*)context)->_sa_table.insert(SPI(r.spi), sa_data);
     //store routing table
     *r_store = r;
     return true;
@@ -124,11 +135,8 @@ IPsecRoute::unparse(StringAccum& sa, bool tabs) const
 	sa << "-1";
     else
 	sa << port;
-    if(spi != 0) {
-	sa << "  |TUNNELED CONNECTION| \n|SPI| |ENC KEY| |AUTH KEY| ||\n";
-	sa << " |" <<spi<<"|";
-	sa << sa_data->unparse_entries().c_str() <<"\n";
-    }
+    if (spi != 0)
+	sa << tab << "spi " << spi;
     return sa;
 }
 
@@ -164,6 +172,13 @@ IPsecRouteTable::configure(Vector<String> &conf, ErrorHandler *errh)
     return errh->nerrors() ? -1 : 0;
 }
 
+int
+IPsecRouteTable::initialize(ErrorHandler *)
+{
+    _sa_table.attach(this);
+    return 0;
+}
+
 int
 IPsecRouteTable::add_route(const IPsecRoute&, bool, IPsecRoute*, ErrorHandler *errh)
 {
@@ -179,7 +194,7 @@ IPsecRouteTable::remove_route(const IPsecRoute&, IPsecRoute*, ErrorHandler *errh
 }
 
 int
-IPsecRouteTable::lookup_route(IPAddress, IPAddress &, unsigned int&, SADataTuple*&) const
+IPsecRouteTable::lookup_route(IPAddress, IPAddress &, uint32_t &) const
 {
     return -1;			// by default, route lookups fail
 }
@@ -199,18 +214,21 @@ IPsecRouteTable::push(int, Packet *p)
     SADataTuple * sa_data;
     const click_ip *ip = reinterpret_cast< const click_ip *>(p->data());
 
-    int port = lookup_route(p->dst_ip_anno(), gw, spi, sa_data);
+    int port = lookup_route(p->dst_ip_anno(), gw, spi);
 
     if (port >= 0) {
 	switch(port) {
 	  case 1: {
 	   //This packet should be sent over a tunneled connection
-	   //so set proper annotations with references to Security Data to be used by IPsec modules
-           if((spi == 0) || (sa_data == NULL)) {
+	   //so set proper annotations with references to Security Data to be used by IPsec modules.
+	   //The SA is looked up by SPI on every packet, so rekeying takes effect at once.
+	   if (spi == 0 || !(sa_data = _sa_table.lookup(SPI(spi)))) {
 	       click_chatter("No Ipsec tunnel for %s. Wrong tunnel setup", p->dst_ip_anno().unparse().c_str());
+	       p->kill();
+	       return;
 	   }
+	   sa_data->use();
 	   SET_IPSEC_SPI_ANNO(p,(uint32_t)spi);
-	   //ISSUE: This is 32-bit architecture specific passing a pointer to next module through annotations!!
 	   SET_IPSEC_SA_DATA_REFERENCE_ANNO(p, (uintptr_t)sa_data);
 	   break;
 	 }
@@ -221,17 +239,18 @@ IPsecRouteTable::push(int, Packet *p)
 	      /*This not an IPSEC packet and it should be delivered to the host's linux network stack
                 In a typical setup one would send anything that is directed to port 2 to Linux */
                 port = 2;
+		break;
             }
             // This is an ipsec packet and belongs to a tunneled connection
 	    // so we set the proper annotation with reference to Security Data Table to be used by IPsec modules
-            // Careful this enhancement is 32-bit architecture specific!!
             struct esp_new * esp =(struct esp_new *)(p->data()+sizeof(click_ip));
             sa_data = _sa_table.lookup(SPI(ntohl(esp->esp_spi)));
 	    if(sa_data == NULL) {
 		click_chatter("Invalid SPI %d, Dropping packet",ntohl(esp->esp_spi));
-	p->kill();
-                return;
-           }
+		p->kill();
+		return;
+	    }
+	   sa_data->use();
 	   SET_IPSEC_SA_DATA_REFERENCE_ANNO(p, (uintptr_t)sa_data);
 	   break;
 	 }
@@ -356,6 +375,32 @@ IPsecRouteTable::table_handler(Element *e, void *)
     return r->dump_routes();
 }
 
+int
+IPsecRouteTable::sa_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
+    Vector<String> words;
+    cp_spacevec(cp_uncomment(str), words);
+    if (thunk) {
+	uint32_t spi;
+	if (words.size() != 1 || !IntArg().parse(words[0], spi))
+	    return errh->error("expected SPI");
+	return table->_sa_table.remove(spi) < 0 ? errh->error("no SA with SPI %u", spi) : 0;
+    }
+    uint32_t spi;
+    SADataTuple *sa_data = cp_ipsec_sa(words, spi, table, errh);
+    if (!sa_data)
+	return -1;
+    return table->_sa_table.insert(SPI(spi), sa_data);
+}
+
+String
+IPsecRouteTable::sa_table_handler(Element *e, void *)
+{
+    IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
+    return table->_sa_table.print_sa_data();
+}
+
 int
 IPsecRouteTable::lookup_handler(int, String& s, Element* e, const Handler*, ErrorHandler* errh)
 {
@@ -364,8 +409,7 @@ IPsecRouteTable::lookup_handler(int, String& s, Element* e, const Handler*, Erro
     if (IPAddressArg().parse(cp_uncomment(s), a, table)) {
 	IPAddress gw;
 	uint32_t spi;
-	SADataTuple * sa_data;
-	int port = table->lookup_route(a, gw,spi,sa_data);
+	int port = table->lookup_route(a, gw, spi);
 	if (gw)
 	    s = String(port) + " " + gw.unparse();
 	else
@@ -383,6 +427,9 @@ IPsecRouteTable::add_handlers()
     add_write_handler("remove", remove_route_handler, 0);
     add_write_handler("ctrl", ctrl_handler, 0);
     add_read_handler("table", table_handler, 0);
+    add_write_handler("sa_set", sa_handler, 0);
+    add_write_handler("sa_remove", sa_handler, 1);
+    add_read_handler("sa_table", sa_table_handler, 0);
     set_handler("lookup", Handler::OP_READ | Handler::READ_PARAM, lookup_handler);
 }
 
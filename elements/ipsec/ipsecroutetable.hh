@@ -104,11 +104,12 @@ C<errh>.  Should return 0 on success and negative on failure.  The default
 implementation reports an error "cannot delete routes from this routing
 table".
 
-=item C<int B<lookup_route>(IPAddress dst, IPAddress &gw_return) const>
+=item C<int B<lookup_route>(IPAddress dst, IPAddress &gw_return, uint32_t &spi_return) const>
 
 Looks up the route associated with address C<dst>. Should set C<gw_return> to
-the resulting gateway and return the relevant output port (or negative if
-there is no route). The default implementation returns -1.
+the resulting gateway and C<spi_return> to the route's SPI (0 if it is not a
+tunnel route), and return the relevant output port (or negative if there is
+no route). The default implementation returns -1.
 
 =item C<String B<dump_routes>()>
 
@@ -166,6 +167,13 @@ tunneled traffic accordingly. All the routing table entries that refer to an IPS
 |SPI| |128-BIT ENCRYPTION_KEY| |128-BIT AUTHENTICATION_KEY| |REPLAY PROTECTION COUNTER| |OUT-OF-ORDER REPLAY WINDOW|
 The encryption and authentication keys will generally be specified using
 syntax such as C<\E<lt>0183 A947 1ABE 01FF FA04 103B B102<gt>>.
+The out-of-order replay window may be up to 1024 packets.
+ Security associations are kept in an SATable keyed by SPI, which tunnel
+routes and incoming ESP packets both consult on every packet.  SATable
+lookups take no locks, and the C<sa_set> and C<sa_remove> handlers install,
+rekey and delete SAs without stopping traffic.  Each packet sent to the IPsec
+modules holds a reference to its SA until IPsecESPUnencap or IPsecEncap is
+done with it, so a replaced SA outlives the packets still using it.
  This module uses 4 and 5 annotation space integers to pass Security Association Data between IPsec modules.
 
 =a RadixIPLookup, RangeIPsecLookup */
@@ -180,9 +188,8 @@ struct IPsecRoute {
     int32_t extra;
     /*IPsec extensions*/
     uint32_t spi;
-    SADataTuple * sa_data;
 
-    IPsecRoute()			: port(-1) { }
+    IPsecRoute()			: port(-1), spi(0) { }
 
     inline bool real() const	{ return port > (int32_t) -0x80000000; }
     inline void kill()		{ addr = 0; mask = 0xFFFFFFFFU; port = -0x80000000; }
@@ -203,11 +210,12 @@ class IPsecRouteTable : public Element { public:
 
     void* cast(const char*);
     int configure(Vector<String>&, ErrorHandler*) CLICK_COLD;
+    int initialize(ErrorHandler*) CLICK_COLD;
     void add_handlers() CLICK_COLD;
 
     virtual int add_route(const IPsecRoute& route, bool allow_replace, IPsecRoute* replaced_route, ErrorHandler* errh);
     virtual int remove_route(const IPsecRoute& route, IPsecRoute* removed_route, ErrorHandler* errh);
-    virtual int lookup_route(IPAddress dest, IPAddress &gw, unsigned int &spi, SADataTuple * &sa_data) const = 0;
+    virtual int lookup_route(IPAddress dest, IPAddress &gw, uint32_t &spi) const = 0;
     virtual String dump_routes();
 
     void push(int port, Packet* p);
@@ -217,6 +225,8 @@ class IPsecRouteTable : public Element { public:
     static int ctrl_handler(const String&, Element*, void*, ErrorHandler*);
     static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
     static String table_handler(Element*, void*);
+    static int sa_handler(const String&, Element*, void*, ErrorHandler*);
+    static String sa_table_handler(Element*, void*);
     /*IPSEC extension: The security association database entry*/
     SATable _sa_table;
 
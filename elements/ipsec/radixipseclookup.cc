@@ -211,13 +211,12 @@ RadixIPsecLookup::remove_route(const IPsecRoute& route, IPsecRoute* old_route, E
 }
 
 int
-RadixIPsecLookup::lookup_route(IPAddress addr, IPAddress &gw, unsigned int &spi, SADataTuple* &sa_data) const
+RadixIPsecLookup::lookup_route(IPAddress addr, IPAddress &gw, uint32_t &spi) const
 {
     int key = Radix::lookup(_radix, _default_key, ntohl(addr.addr()));
     if (key >= 0 && _v[key].contains(addr)) {
 	gw = _v[key].gw;
 	spi = _v[key].spi;
-	sa_data = _v[key].sa_data;
 	return _v[key].port;
     } else {
 	gw = 0;
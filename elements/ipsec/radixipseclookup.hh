@@ -61,8 +61,28 @@ add a route, and `C<remove ADDR/MASK>' to remove a route. You can supply
 multiple commands, one per line; all commands are executed as one atomic
 operation.
 
+=h sa_set write-only
+
+Installs a security association.  Format is `C<SPI ENCRYPT_KEY AUTH_KEY
+REPLAY OOSIZE>', as in a tunnel route.  An existing SA with the same SPI is
+replaced, which rekeys it for both tunneled routes and incoming ESP packets.
+
+=h sa_remove write-only
+
+Removes the security association with the given SPI.
+
+=h sa_table read-only
+
+Outputs the security associations: SPI, keys, next outbound sequence number,
+highest inbound sequence number, and anti-replay window size.
+
 =n
 
+SA lookups take no locks, so RadixIPsecLookup may run on several threads at
+once, and the SA handlers may be used while traffic flows.  Route updates
+are not synchronized with lookups.
+
+
 See IPsecRouteTable for a performance comparison of the various IP routing
 elements.
 
@@ -83,7 +103,7 @@ class RadixIPsecLookup : public IPsecRouteTable { public:
 
     int add_route(const IPsecRoute&, bool, IPsecRoute*, ErrorHandler *);
     int remove_route(const IPsecRoute&, IPsecRoute*, ErrorHandler *);
-    int lookup_route(IPAddress, IPAddress&, unsigned int&, SADataTuple*&) const;
+    int lookup_route(IPAddress, IPAddress&, uint32_t&) const;
     String dump_routes();
 
   private:
@@ -5,6 +5,9 @@
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <click/packet_anno.hh>
 CLICK_DECLS
 
 /*
@@ -68,38 +71,78 @@ class SPI {
  };
 
 // Security Association Data Tuple
+//
+// Packets carry a pointer to their SADataTuple in an annotation, so one SA
+// is used by many threads at once.  The keys are constant for the SA's
+// lifetime; rekeying installs a new SADataTuple in the SATable.  Outbound
+// sequence numbers come from an atomic counter, and the inbound anti-replay
+// window is a ring of 64-bit words, after RFC 6479, guarded by a spinlock.
+//
+// An SA is reference counted.  The SATable holds one reference while the SA
+// is installed.  IPsecRouteTable takes another for each packet it points at
+// the SA, and release_anno() drops it where IPsec processing ends
+// (IPsecESPUnencap, IPsecEncap) or where an IPsec element drops the packet.
+// A packet dropped elsewhere keeps its SA alive rather than freeing it
+// early.  Don't clone packets between those points: clones share one
+// reference.
 class SADataTuple {
   public:
 
+    enum { REPLAY_WORDS = 32, MAX_REPLAY_WINDOW = 1024 };
+
     //SA Data must be added here...
     uint8_t Encryption_key[KEY_SIZE]; // The Data key
     uint8_t Authentication_key[KEY_SIZE];//The Authentication key
     /*These fields below deal with replay protection*/
     uint32_t replay_start_counter;
-    uint32_t cur_rpl;
-    uint8_t  ooowin;	/* out-of-order window size */
-    uint32_t bitmap;	/* Support out-of-order receive support */
-    uint32_t lastseq;	/* in host order */
-
-    SADataTuple() {
-	memset(this, 0, sizeof(*this));
-    }
-
-    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint8_t o_oowin)
+    atomic_uint32_t cur_rpl;	/* next outbound sequence number */
+    uint16_t ooowin;		/* out-of-order window size */
+    uint32_t lastseq;		/* in host order */
+    uint64_t bitmap[REPLAY_WORDS]; /* seen sequence numbers, by seq % 2048 */
+    SimpleSpinlock replay_lock;
+    atomic_uint32_t refcount;
+
+    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint16_t o_oowin)
      {
-		memset(this, 0, sizeof(*this));
 		memcpy(Encryption_key, enc_key, KEY_SIZE);
 		memcpy(Authentication_key, Auth_key, KEY_SIZE);
-		replay_start_counter = counter;
-		ooowin = o_oowin;
-	        bitmap=0;
-		lastseq=cur_rpl=counter;
+		// sequence number 0 is never sent
+		replay_start_counter = counter ? counter : 1;
+		ooowin = o_oowin < MAX_REPLAY_WINDOW ? o_oowin : MAX_REPLAY_WINDOW;
+		memset(bitmap, 0, sizeof(bitmap));
+		lastseq = replay_start_counter;
+		cur_rpl = replay_start_counter;
+		refcount = 1;
      }
 
-     operator bool() const
-     {
-         return ((cur_rpl != 0));
-     }
+    void use()
+    {
+	refcount++;
+    }
+
+    void unuse()
+    {
+	if (refcount.dec_and_test())
+	    delete this;
+    }
+
+    /* Drop the reference held by p's SA annotation, if any, and clear it. */
+    static inline void release_anno(Packet *p);
+
+    /* Return the next outbound sequence number.  If the counter rolls
+       over, it restarts at the agreed start value. */
+    uint32_t next_sequence()
+    {
+	uint32_t seq;
+	while ((seq = cur_rpl.fetch_and_add(1)) == 0)
+	    cur_rpl.compare_swap(1, replay_start_counter);
+	return seq;
+    }
+
+    /* Check inbound sequence number seq against the anti-replay window and
+       mark it seen.  Returns 1 if the packet is acceptable, 0 if it is a
+       replay (-1) or too old (-2). */
+    inline int check_replay(uint32_t seq);
 
 String unparse_entries() const
      {
@@ -118,11 +161,54 @@ String unparse_entries() const
     }
 };
 
-
 inline hashcode_t SPI::hashcode() const
 {
     return _spi;
 }
 
+inline void
+SADataTuple::release_anno(Packet *p)
+{
+    if (SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p)) {
+	SET_IPSEC_SA_DATA_REFERENCE_ANNO(p, 0);
+	sa->unuse();
+    }
+}
+
+inline int
+SADataTuple::check_replay(uint32_t seq)
+{
+    if (seq == 0)
+	return -2;		/* first == 0 or wrapped */
+    int r = 1;
+    replay_lock.acquire();
+    /* The sender restarts at replay_start_counter when its counter rolls
+       over; accept that only once the window is near the top of the
+       sequence space, or replaying the first packet would reset it. */
+    if (seq == replay_start_counter && lastseq - seq >= 0x80000000U) {
+	memset(bitmap, 0, sizeof(bitmap));
+	lastseq = seq;
+    } else if (seq > lastseq) {
+	/* new larger sequence number: clear the words it skips over */
+	uint32_t top = lastseq >> 6, diff = (seq >> 6) - top;
+	if (diff > REPLAY_WORDS)
+	    diff = REPLAY_WORDS;
+	for (uint32_t i = 1; i <= diff; ++i)
+	    bitmap[(top + i) % REPLAY_WORDS] = 0;
+	lastseq = seq;
+    } else if (lastseq - seq >= ooowin)
+	r = -2;			/* too old or wrapped */
+    if (r > 0) {
+	uint64_t &word = bitmap[(seq >> 6) % REPLAY_WORDS];
+	uint64_t bit = (uint64_t) 1 << (seq & 63);
+	if (word & bit)
+	    r = -1;		/* this packet already seen */
+	else
+	    word |= bit;
+    }
+    replay_lock.release();
+    return r;
+}
+
 CLICK_ENDDECLS
 #endif
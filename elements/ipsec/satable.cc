@@ -20,6 +20,7 @@
 #include <click/confparse.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/master.hh>
 #include <click/straccum.hh>
 #include <clicknet/ether.h>
 #include "satable.hh"
@@ -28,38 +29,160 @@
 CLICK_DECLS
 
 SATable::SATable()
+  : _snap(make_snapshot(0)), _master(0), _reclaim_timer(reclaim_timer_hook, this)
 {
 }
 
 SATable::~SATable()
 {
+  for (uint32_t i = 0; i <= _snap->mask; i++)
+    if (_snap->slot[i].sa)
+      _snap->slot[i].sa->unuse();
+  free_snapshot(_snap);
+  reclaim(true);
 }
 
-/*Get a reference to SA Data*/
-SADataTuple *
-SATable::lookup(SPI this_spi)
+/* Release retired memory from a timer on owner, which must be initialized.
+   Call from owner's initialize(). */
+void
+SATable::attach(Element *owner)
 {
-  if (!this_spi) {
-    click_chatter("%s: lookup called with NULL spi!\n", name().c_str());
-    return NULL;
+  _master = owner->master();
+  _reclaim_timer.initialize(owner);
+}
+
+SATable::Snapshot *
+SATable::make_snapshot(int n)
+{
+  // keep the load factor at most 1/2 so probes stay short and always
+  // reach an empty slot
+  uint32_t cap = 2;
+  while (cap < (uint32_t) 2 * n + 1)
+    cap <<= 1;
+  Snapshot *s = new Snapshot;
+  s->mask = cap - 1;
+  s->n = 0;
+  s->slot = new Slot[cap];
+  memset(s->slot, 0, sizeof(Slot) * cap);
+  return s;
+}
+
+void
+SATable::free_snapshot(Snapshot *s)
+{
+  if (s) {
+    delete[] s->slot;
+    delete s;
+  }
+}
+
+/* Return a copy of the current snapshot with spi mapped to sa, or with spi
+   removed if sa is null.  The SA previously mapped is stored in old_sa. */
+SATable::Snapshot *
+SATable::rebuild(uint32_t spi, SADataTuple *sa, SADataTuple *&old_sa)
+{
+  Snapshot *o = _snap;
+  old_sa = lookup(SPI(spi));
+  Snapshot *s = make_snapshot(o->n + (sa && !old_sa ? 1 : 0));
+  for (uint32_t j = 0; j <= o->mask + 1; j++) {
+    uint32_t k;
+    SADataTuple *v;
+    if (j <= o->mask) {
+      k = o->slot[j].spi;
+      v = o->slot[j].sa;
+      if (!k || k == spi)
+	continue;
+    } else if (sa) {
+      k = spi;
+      v = sa;
+    } else
+      break;
+    uint32_t i = hash(k) & s->mask;
+    while (s->slot[i].spi)
+      i = (i + 1) & s->mask;
+    s->slot[i].spi = k;
+    s->slot[i].sa = v;
+    s->n++;
+  }
+  return s;
+}
+
+void
+SATable::release(Vector<Retired> &v)
+{
+  for (int i = 0; i < v.size(); i++) {
+    free_snapshot(v[i].snap);
+    if (v[i].sa)
+      v[i].sa->unuse();
+  }
+  v.clear();
+}
+
+/* Called with _lock held, after the new snapshot is published. */
+void
+SATable::retire(Snapshot *snap, SADataTuple *sa)
+{
+  Retired r = { snap, sa };
+  _retired.push_back(r);
+  reclaim(false);
+  if (_master && !_reclaim_timer.scheduled())
+    _reclaim_timer.schedule_after_msec(RECLAIM_INTERVAL);
+}
+
+/* Release _waiting once every thread has passed a quiescent point since
+   its grace period started, then start a grace period for _retired.  With
+   all, release everything. */
+void
+SATable::reclaim(bool all)
+{
+  if (!all) {
+    if (!_master)
+      return;
+    for (int i = 0; i < _wait_epochs.size(); i++)
+      if (!_master->thread(i - 1)->quiescent_since(_wait_epochs[i]))
+	return;
+  }
+  release(_waiting);
+  _waiting.swap(_retired);
+  if (all)
+    release(_waiting);
+  else if (_waiting.size()) {
+    click_fence();
+    _wait_epochs.resize(_master->nthreads() + 1);
+    for (int i = 0; i < _wait_epochs.size(); i++)
+      _wait_epochs[i] = _master->thread(i - 1)->quiescent_epoch();
   }
-  //retrieve security association
-  SADataTuple  *dat = _table.findp(this_spi);
-  return dat;
+}
+
+void
+SATable::reclaim_timer_hook(Timer *timer, void *user_data)
+{
+  SATable *t = static_cast<SATable *>(user_data);
+  t->_lock.acquire();
+  t->reclaim(false);
+  if (t->_waiting.size() || t->_retired.size())
+    timer->reschedule_after_msec(RECLAIM_INTERVAL);
+  t->_lock.release();
 }
 
 /*Eventually this will be called from userspace Internet Key Exchange transactions*/
+/*Installs SA_data for spi, replacing (rekeying) any existing SA. The table
+  takes ownership of SA_data.*/
 int
-SATable::insert(SPI spi , SADataTuple SA_data)
+SATable::insert(SPI spi, SADataTuple *SA_data)
 {
   if ((!spi) || (!SA_data)) {
-    click_chatter("SATable %s: Attempt to insert data failed. Invalid arguments\n",name().c_str());
+    click_chatter("SATable: Attempt to insert data failed. Invalid arguments\n");
+    delete SA_data;
     return -1;
   }
-  SADataTuple * dat = _table.findp(spi);
-  if (!dat) {
-    _table.insert(spi, SA_data);
-  }
+  _lock.acquire();
+  SADataTuple *old_sa;
+  Snapshot *o = _snap, *s = rebuild(spi.getValue(), SA_data, old_sa);
+  click_write_fence();
+  _snap = s;
+  retire(o, old_sa);
+  _lock.release();
   return 0;
 }
 
@@ -71,15 +194,21 @@ SATable::remove(unsigned int spi)
 	click_chatter("Invalid SPI parameter");
 	return -1;
   }
-  SADataTuple  *dat = _table.findp(spi);
-  if(!dat) {
-	click_chatter("No such entry");
-	return -1;
+  _lock.acquire();
+  SADataTuple *old_sa;
+  Snapshot *o = _snap, *s = 0;
+  int r = -1;
+  if (lookup(SPI(spi))) {
+    s = rebuild(spi, 0, old_sa);
+    click_write_fence();
+    _snap = s;
+    retire(o, old_sa);
+    r = 0;
   }
-  delete dat;
-  _table.remove(SPI(spi));
-
-  return 0;
+  _lock.release();
+  if (r < 0)
+    click_chatter("No such entry");
+  return r;
 }
 
 /*Return data to user space file*/
@@ -87,17 +216,15 @@ String
 SATable::print_sa_data()
 {
   StringAccum sa;
-  int k;
-  for (SIter iter = _table.begin(); iter.live(); iter++) {
-    SADataTuple n = iter.value();
-    sa << "\nNew Entry\n";
-    for(k=0; k< 16;k++)
-	{sa << n.Encryption_key[k];}
-    sa <<" ";
-    for(k=0; k< 16;k++)
-        {sa << n.Authentication_key[k];}
-    sa << " ";
-  }
+  _lock.acquire();
+  const Snapshot *s = _snap;
+  for (uint32_t i = 0; i <= s->mask; i++)
+    if (const SADataTuple *n = s->slot[i].sa) {
+      sa << s->slot[i].spi << n->unparse_entries() << " |"
+	 << n->cur_rpl.value() << "| |" << n->lastseq << "| |"
+	 << n->ooowin << "|\n";
+    }
+  _lock.release();
   return sa.take_string();
 }
 
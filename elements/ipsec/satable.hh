@@ -3,12 +3,28 @@
 #include <click/element.hh>
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
-#include <click/bighashmap.hh>
 #include <click/glue.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
 #include "sadatatuple.hh"
 
 CLICK_DECLS
 
+/*
+ * The SA table maps SPIs to SADataTuples.  Lookups take no locks and may
+ * run on any number of threads concurrently with updates.  The table is an
+ * immutable open-addressed snapshot; insert() and remove() build a new
+ * snapshot under a lock and publish it with one pointer store.  Old
+ * snapshots, and the table's references to replaced SAs, are retired and
+ * released once every RouterThread has passed a quiescent point, since
+ * lookups never hold them across a task run.  Packets carry their own SA
+ * references (see SADataTuple), so a replaced SA lives until the last
+ * packet using it is done.  A timer on the element passed to attach()
+ * releases retired memory; a table with no owner releases it when
+ * destroyed.
+ */
+
 class SATable : public Element { public:
 
   SATable() CLICK_COLD;
@@ -16,17 +32,63 @@ class SATable : public Element { public:
 
   const char *class_name() const		{ return "SATable"; }
   String print_sa_data();
-  int insert(SPI this_spi , SADataTuple SA_data) ;
+  int insert(SPI this_spi, SADataTuple *SA_data);
   int remove(unsigned int spi);
-  SADataTuple * lookup(SPI this_spi);
+  inline SADataTuple *lookup(SPI this_spi) const;
+  int size() const				{ return _snap->n; }
+  void attach(Element *owner);
+
+  enum { RECLAIM_INTERVAL = 100 };	// msec
 
 private:
-  //Defines a click hashmap object the SA table in our case
-  typedef HashMap<SPI,SADataTuple> STable;
-  typedef STable::const_iterator SIter;
-  STable _table;
+
+  struct Slot {
+    uint32_t spi;
+    SADataTuple *sa;
+  };
+  struct Snapshot {
+    uint32_t mask;
+    int n;
+    Slot *slot;
+  };
+  struct Retired {
+    Snapshot *snap;
+    SADataTuple *sa;
+  };
+
+  Snapshot * volatile _snap;
+  Spinlock _lock;
+  Vector<Retired> _retired;	// waiting for a grace period to start
+  Vector<Retired> _waiting;	// waiting for _wait_epochs to pass
+  Vector<uint32_t> _wait_epochs;
+  Master *_master;
+  Timer _reclaim_timer;
+
+  static inline uint32_t hash(uint32_t spi) {
+    spi *= 0x9E3779B1U;
+    return spi ^ (spi >> 16);
+  }
+  static Snapshot *make_snapshot(int n);
+  static void free_snapshot(Snapshot *s);
+  Snapshot *rebuild(uint32_t spi, SADataTuple *sa, SADataTuple *&old_sa);
+  void retire(Snapshot *snap, SADataTuple *sa);
+  static void release(Vector<Retired> &v);
+  void reclaim(bool all);
+  static void reclaim_timer_hook(Timer *timer, void *user_data);
 
 };
 
+inline SADataTuple *
+SATable::lookup(SPI this_spi) const
+{
+  uint32_t spi = this_spi.getValue();
+  const Snapshot *s = _snap;
+  click_read_fence();
+  for (uint32_t i = hash(spi) & s->mask; s->slot[i].spi; i = (i + 1) & s->mask)
+    if (s->slot[i].spi == spi)
+      return s->slot[i].sa;
+  return 0;
+}
+
 CLICK_ENDDECLS
 #endif
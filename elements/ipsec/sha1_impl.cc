@@ -57,6 +57,11 @@
  */
 #include <click/config.h>
 #include "sha1_impl.hh"
+#if CLICK_USERLEVEL && defined(__x86_64__) && defined(__GNUC__)
+# include <cpuid.h>
+# include <immintrin.h>
+# define HAVE_SHA1_SHANI 1
+#endif
 CLICK_DECLS
 
 
@@ -478,12 +483,140 @@ SHA1_transform (SHA1_ctx *c, unsigned char *b)
 
 #ifndef SHA1_ASM
 
+#if HAVE_SHA1_SHANI
+/* -1 until checked, then whether the processor has the SHA extensions */
+static int sha1_shani = -1;
+
+static int
+sha1_shani_check (void)
+{
+  unsigned a, b, c, d;
+  if (!__get_cpuid (1, &a, &b, &c, &d)
+      || !(c & (1 << 9)) || !(c & (1 << 19)))	/* SSSE3, SSE4.1 */
+    return 0;
+  if (__get_cpuid_max (0, 0) < 7)
+    return 0;
+  __cpuid_count (7, 0, a, b, c, d);
+  return (b & (1 << 29)) != 0;			/* SHA */
+}
+
+/* Four rounds.  Ea accumulates the next E, Eb takes the old state; M0 holds
+ * the current message words, and M1..M3 the next, in schedule order. */
+#define SHA1_SHANI_ROUNDS(f, Ea, Eb, M0, M1, M2, M3) \
+	Ea = _mm_sha1nexte_epu32 (Ea, M0); \
+	Eb = ABCD; \
+	M1 = _mm_sha1msg2_epu32 (M1, M0); \
+	ABCD = _mm_sha1rnds4_epu32 (ABCD, Ea, f); \
+	M3 = _mm_sha1msg1_epu32 (M3, M0); \
+	M2 = _mm_xor_si128 (M2, M0);
+
+__attribute__((target("sha,ssse3,sse4.1"))) static void
+sha1_block_shani (SHA1_ctx *c, const unsigned long *W, int num)
+{
+  __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1, MSG0, MSG1, MSG2, MSG3;
+
+  ABCD = _mm_set_epi32 (c->h0, c->h1, c->h2, c->h3);
+  E0 = _mm_set_epi32 (c->h4, 0, 0, 0);
+
+  for (; num > 0; num -= 64, W += 16)
+    {
+      ABCD_SAVE = ABCD;
+      E0_SAVE = E0;
+
+      /* W holds the block's big-endian words already in host order */
+      MSG0 = _mm_set_epi32 (W[0], W[1], W[2], W[3]);
+      MSG1 = _mm_set_epi32 (W[4], W[5], W[6], W[7]);
+      MSG2 = _mm_set_epi32 (W[8], W[9], W[10], W[11]);
+      MSG3 = _mm_set_epi32 (W[12], W[13], W[14], W[15]);
+
+      /* rounds 0-15 */
+      E0 = _mm_add_epi32 (E0, MSG0);
+      E1 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 0);
+
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 0);
+      MSG0 = _mm_sha1msg1_epu32 (MSG0, MSG1);
+
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 0);
+      MSG1 = _mm_sha1msg1_epu32 (MSG1, MSG2);
+      MSG0 = _mm_xor_si128 (MSG0, MSG2);
+
+      SHA1_SHANI_ROUNDS (0, E1, E0, MSG3, MSG0, MSG1, MSG2);
+
+      /* rounds 16-67 */
+      SHA1_SHANI_ROUNDS (0, E0, E1, MSG0, MSG1, MSG2, MSG3);
+      SHA1_SHANI_ROUNDS (1, E1, E0, MSG1, MSG2, MSG3, MSG0);
+      SHA1_SHANI_ROUNDS (1, E0, E1, MSG2, MSG3, MSG0, MSG1);
+      SHA1_SHANI_ROUNDS (1, E1, E0, MSG3, MSG0, MSG1, MSG2);
+      SHA1_SHANI_ROUNDS (1, E0, E1, MSG0, MSG1, MSG2, MSG3);
+      SHA1_SHANI_ROUNDS (1, E1, E0, MSG1, MSG2, MSG3, MSG0);
+      SHA1_SHANI_ROUNDS (2, E0, E1, MSG2, MSG3, MSG0, MSG1);
+      SHA1_SHANI_ROUNDS (2, E1, E0, MSG3, MSG0, MSG1, MSG2);
+      SHA1_SHANI_ROUNDS (2, E0, E1, MSG0, MSG1, MSG2, MSG3);
+      SHA1_SHANI_ROUNDS (2, E1, E0, MSG1, MSG2, MSG3, MSG0);
+      SHA1_SHANI_ROUNDS (2, E0, E1, MSG2, MSG3, MSG0, MSG1);
+      SHA1_SHANI_ROUNDS (3, E1, E0, MSG3, MSG0, MSG1, MSG2);
+      SHA1_SHANI_ROUNDS (3, E0, E1, MSG0, MSG1, MSG2, MSG3);
+
+      /* rounds 68-79 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      MSG2 = _mm_sha1msg2_epu32 (MSG2, MSG1);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 3);
+      MSG3 = _mm_xor_si128 (MSG3, MSG1);
+
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      MSG3 = _mm_sha1msg2_epu32 (MSG3, MSG2);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 3);
+
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 3);
+
+      E0 = _mm_sha1nexte_epu32 (E0, E0_SAVE);
+      ABCD = _mm_add_epi32 (ABCD, ABCD_SAVE);
+    }
+
+  c->h0 = (uint32_t) _mm_extract_epi32 (ABCD, 3);
+  c->h1 = (uint32_t) _mm_extract_epi32 (ABCD, 2);
+  c->h2 = (uint32_t) _mm_extract_epi32 (ABCD, 1);
+  c->h3 = (uint32_t) _mm_extract_epi32 (ABCD, 0);
+  c->h4 = (uint32_t) _mm_extract_epi32 (E0, 3);
+}
+#undef SHA1_SHANI_ROUNDS
+#endif
+
+int
+SHA1_accelerated (void)
+{
+#if HAVE_SHA1_SHANI
+  if (sha1_shani < 0)
+    sha1_shani = sha1_shani_check ();
+  return sha1_shani;
+#else
+  return 0;
+#endif
+}
+
 void
 sha1_block (SHA1_ctx *c, register unsigned long *W, int num)
 {
   register ULONG A, B, C, D, E, T;
   ULONG X[16];
 
+#if HAVE_SHA1_SHANI
+  if (SHA1_accelerated ())
+    {
+      sha1_block_shani (c, W, num);
+      return;
+    }
+#endif
+
   A = c->h0;
   B = c->h1;
   C = c->h2;
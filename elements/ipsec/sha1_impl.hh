@@ -79,6 +79,8 @@ void SHA1_init (SHA1_ctx * c);
 void SHA1_update (SHA1_ctx * c, unsigned char *data, unsigned long len);
 void SHA1_final (unsigned char *md, SHA1_ctx * c);
 void SHA1_transform (SHA1_ctx * c, unsigned char *data);
+/* Returns nonzero if SHA1 uses the processor's SHA extensions. */
+int SHA1_accelerated (void);
 
 CLICK_ENDDECLS
 #endif
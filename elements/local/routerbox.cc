@@ -2,17 +2,19 @@
 #include <click/args.hh>
 #include "routerbox.hh"
 #include <click/router.hh>
+#include <click/straccum.hh>
 #include "elements/standard/fullnotequeue.hh"
 #include "elements/standard/unqueue.hh"
 #include "elements/analysis/timestampaccum.hh"
 #include "elements/standard/strideswitch.hh"
+#include "elements/json/json.hh"
 #include <iostream>
 #include <queue>
 #include <unistd.h>
 CLICK_DECLS
 
 RouterBox::RouterBox()
-    : _task_id(0)
+    : _task_id(0), _fuse(false)
 {}
 
 RouterBox::~RouterBox()
@@ -43,6 +45,7 @@ RouterBox::setup2(Vector<String> &conf, ErrorHandler *errh)
         .read_p("TIME", time)
         .read_p("INTERVAL", interval)
         .read_p("DROP_DIFF", diff)
+        .read("FUSE", _fuse)
         .complete() < 0)
         return -1;
     router()->set_router_info(this);
@@ -59,6 +62,66 @@ RouterBox::setup2(Vector<String> &conf, ErrorHandler *errh)
     return 0;
 }
 
+int
+RouterBox::initialize(ErrorHandler *)
+{
+    if (_fuse)
+        setup_fusion();
+    return 0;
+}
+
+// Fuse every Queue with the Unqueue that pulls from it.  The Queue checks
+// on each push that its pusher shares the Unqueue's thread, so fusion
+// follows later move_thread()s without our help.
+void
+RouterBox::setup_fusion() {
+    Router *r = Element::router();
+    for (int i = 0; i < r->nelements(); i++) {
+        Element *e = r->element(i);
+        if (strcmp(e->class_name(), "Unqueue") != 0)
+            continue;
+        Element *up = e->input(0).element();
+        if (!up || strcmp(up->class_name(), "Queue") != 0)
+            continue;
+        FullNoteQueue *q = static_cast<FullNoteQueue *>(up->cast("FullNoteQueue"));
+        Unqueue *u = static_cast<Unqueue *>(e);
+        q->set_fused(u);
+        _fused_queue.push_back(q);
+        _fused_unqueue.push_back(u);
+    }
+
+    std::cout << "fused queue:";
+    for (int i = 0; i < _fused_queue.size(); i++) {
+        std::cout << " " << _fused_queue[i]->name().c_str();
+    }
+    std::cout << std::endl;
+}
+
+// One line per fused queue: queue, unqueue, unqueue thread, fused packets,
+// then cycles saved per fused packet and in total.  A queued packet costs a
+// queue push plus the Unqueue's pull and push; a fused one costs the push
+// alone.  This leaves out the Unqueue's scheduling, so it underestimates.
+// Savings read "?" until both costs have been measured.
+String
+RouterBox::fusion_handler() {
+    StringAccum sa;
+    for (int i = 0; i < _fused_queue.size(); i++) {
+        FullNoteQueue *q = _fused_queue[i];
+        Unqueue *u = _fused_unqueue[i];
+        uint32_t fused = u->fused_count();
+        sa << q->name() << ' ' << u->name() << ' '
+           << u->task_thread() << ' ' << fused;
+        int queued = q->queued_push_cycles() + u->pull_cycle();
+        if (q->queued_push_cycles() && u->pull_cycle() && u->fused_cycle()) {
+            int saved = queued - u->fused_cycle();
+            sa << ' ' << saved << ' ' << (int64_t) saved * fused;
+        } else
+            sa << " ? ?";
+        sa << '\n';
+    }
+    return sa.take_string();
+}
+
 void
 RouterBox::setup_chain() {
      int i = 0;
@@ -1080,8 +1143,19 @@ RouterBox::update_info() {
         const Vector<int> &input = _task_input_cycle[name];
         const Vector<String> &output_queue = _task_output[name];
         const Vector<int> &output = _task_output_cycle[name];
-		_tasks[i]->cycles();
 		_raw_task_cycles[i] = _tasks[i]->cycles();
+#if HAVE_TASK_PROFILE
+        // Prefer the task's profile: per-packet service time, net of queue
+        // overhead and of runs that found no work.
+        Task::Profile prof = _tasks[i]->profile();
+        const Task::ProfileSummary &b = prof.baseline;
+        if (b.packets) {
+            _pull_cycles[i] = b.pull_cycles / b.packets;
+            _push_cycles[i] = b.push_cycles / b.packets;
+            _cycles[i] = b.mean;
+            continue;
+        }
+#endif
         _pull_cycles[i] = 0;
         for(int j=0; j<input.size(); ++j) {
             _pull_cycles[i] += 1.0 * input[j] / input.size();
@@ -1091,8 +1165,9 @@ RouterBox::update_info() {
             int k = _task_id[_input_to_task[output_queue[j]]];
             _push_cycles[i] += 1.0 * output[j] * _weight[tid][k];
         }
-        // _cycles[i] = _raw_task_cycles[i] - _pull_cycles[i] - _push_cycles[i];
-        _cycles[i] = _raw_task_cycles[i];
+        _cycles[i] = _raw_task_cycles[i] - _pull_cycles[i] - _push_cycles[i];
+        if (_cycles[i] < 0)
+            _cycles[i] = 0;
     }
 
     std::cout << "cycle information" << std::endl;
@@ -1139,7 +1214,62 @@ RouterBox::task_cycle() {
     return _cycles;
 }
 
-enum { H_TASK_THREAD, H_TASK_CALL, H_TASK_COST };
+enum { H_TASK_THREAD, H_TASK_CALL, H_TASK_COST, H_PROFILE, H_FUSION };
+
+#if HAVE_TASK_PROFILE
+static Json
+profile_json(const Task::ProfileSummary &s)
+{
+    uint64_t busy = s.busy_runs();
+    Json j = Json::make_object();
+    j.set("runs", s.runs)
+        .set("idle_runs", s.idle_runs)
+        .set("idle_fraction", s.runs ? (double) s.idle_runs / s.runs : 0.0)
+        .set("packets", s.packets)
+        .set("packets_per_run", s.runs ? (double) s.packets / s.runs : 0.0)
+        .set("service_cycles", s.mean)
+        .set("service_stddev", s.stddev())
+        .set("service_ci95", s.ci95())
+        .set("pull_cycles", s.packets ? s.pull_cycles / s.packets : 0.0)
+        .set("push_cycles", s.packets ? s.push_cycles / s.packets : 0.0)
+        .set("idle_cycles", s.idle_runs ? s.idle_cycles / s.idle_runs : 0.0)
+        .set("busy_cycles", busy ? (s.service_cycles + s.pull_cycles + s.push_cycles) / busy : 0.0);
+    return j;
+}
+#endif
+
+String
+RouterBox::profile_handler(Router *r)
+{
+    Json j = Json::make_object();
+    j.set("router", _router_name);
+    j.set("window_msec", (int) Task::STATS_WINDOW_MSEC);
+    Json tasks = Json::make_array();
+    unsigned window = Task::stats_window() - 1;
+    for (int i = 0; i < r->_tasks.size(); ++i) {
+        Task *t = r->_tasks[i];
+        Json tj = Json::make_object();
+        tj.set("name", t->element() ? t->element()->name() : String("?"));
+        tj.set("thread", t->home_thread_id());
+#if HAVE_MULTITHREAD
+        Task::Stats st;
+        bool fresh = t->stats(window, st);
+        tj.set("rate", fresh ? st.rate : 0);
+        tj.set("cycles", fresh ? st.cycles : t->cycles());
+#endif
+#if HAVE_TASK_PROFILE
+        Task::Profile prof = t->profile();
+        tj.set("periods", prof.periods);
+        tj.set("drifts", prof.drifts);
+        tj.set("drifted", prof.drifted);
+        tj.set("period", profile_json(prof.period));
+        tj.set("baseline", profile_json(prof.baseline));
+#endif
+        tasks.push_back(std::move(tj));
+    }
+    j.set("tasks", std::move(tasks));
+    return j.unparse(Json::indent_depth(2), true);
+}
 
 String
 RouterBox::read_handler(Element *e, void *thunk)
@@ -1178,6 +1308,10 @@ RouterBox::read_handler(Element *e, void *thunk)
         }
         return ret;
       }
+      case H_PROFILE:
+        return rb->profile_handler(r);
+      case H_FUSION:
+        return rb->fusion_handler();
       default:
         return "<error>";
     }
@@ -1199,7 +1333,13 @@ RouterBox::add_handlers()
     add_read_handler("task_thread", read_handler, H_TASK_THREAD);
     add_read_handler("task_call", read_handler, H_TASK_CALL);
     add_read_handler("task_cost", read_handler, H_TASK_COST);
+    // JSON model of each task: rate, per-packet service and queue cycles
+    // with a 95% confidence interval, idle runs, and drift state.
+    add_read_handler("profile", read_handler, H_PROFILE, Handler::f_expensive);
+    // Queue -> Unqueue fusion: packets fused and cycles saved.
+    add_read_handler("fusion", read_handler, H_FUSION);
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(Json)
 EXPORT_ELEMENT(RouterBox)
@@ -6,6 +6,8 @@
 #include <click/hashmap.hh>
 #include <click/string.hh>
 #include "elements/standard/simplequeue.hh"
+class FullNoteQueue;
+class Unqueue;
 
 class RouterBox : public Element, public RouterInfo {
 public:
@@ -16,6 +18,8 @@ public:
 
     int configure(Vector<String>&, ErrorHandler*) CLICK_COLD;
 
+    int initialize(ErrorHandler*) CLICK_COLD;
+
     String router_name();
 
     void update_info();
@@ -101,6 +105,18 @@ private:
 
     void topology_sort();
 
+    // fuse Queue -> Unqueue hops whose ends share a thread
+    bool _fuse;
+
+    // fused queues and the Unqueues that pull from them
+    Vector<FullNoteQueue*> _fused_queue;
+
+    Vector<Unqueue*> _fused_unqueue;
+
+    void setup_fusion();
+
+    String fusion_handler() CLICK_COLD;
+
 public:
     // set up chain
     // cpu frequence
@@ -194,6 +210,8 @@ public:
     void move_task(int tid1, int c1, int tid2, int c2);
 
     static String read_handler(Element*, void*) CLICK_COLD;
+
+    String profile_handler(Router *r) CLICK_COLD;
 };
 
 #endif
@@ -0,0 +1,232 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flowdispatch.{cc,hh} -- dispatch IP flows across outputs by Toeplitz hash
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowdispatch.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/master.hh>
+#include <click/router.hh>
+#include <click/routervisitor.hh>
+#include <click/straccum.hh>
+#include <click/task.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+// Microsoft RSS verification key.
+static const uint8_t default_key[] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+FlowDispatch::FlowDispatch()
+    : _active(0), _counts_stride(0)
+{
+}
+
+void
+FlowDispatch::set_key(const String &key)
+{
+    // _table[i][b] is the Toeplitz hash contribution of byte value b at
+    // input offset i: the XOR, over each set bit of b, of the 32-bit key
+    // window that starts at that bit.
+    const uint8_t *k = reinterpret_cast<const uint8_t *>(key.data());
+    for (int i = 0; i < 12; ++i) {
+	uint64_t window = ((uint64_t) k[i] << 32) | ((uint64_t) k[i+1] << 24)
+	    | ((uint64_t) k[i+2] << 16) | ((uint64_t) k[i+3] << 8) | k[i+4];
+	uint32_t bitkey[8];
+	for (int bit = 0; bit < 8; ++bit)
+	    bitkey[bit] = (uint32_t) (window >> (8 - bit));
+	for (int b = 0; b < 256; ++b) {
+	    uint32_t h = 0;
+	    for (int bit = 0; bit < 8; ++bit)
+		if (b & (0x80 >> bit))
+		    h ^= bitkey[bit];
+	    _table[i][b] = h;
+	}
+    }
+}
+
+int
+FlowDispatch::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int active = noutputs();
+    String key(reinterpret_cast<const char *>(default_key), sizeof(default_key));
+    if (Args(conf, this, errh)
+	.read("ACTIVE", active)
+	.read("KEY", key)
+	.complete() < 0)
+	return -1;
+    if (active < 1 || active > noutputs())
+	return errh->error("ACTIVE must be between 1 and %d", noutputs());
+    if (key.length() < key_min_len)
+	return errh->error("KEY must be at least %d bytes", (int) key_min_len);
+    _active = active;
+    set_key(key);
+    int per_line = CLICK_CACHE_LINE_SIZE / sizeof(uint64_t);
+    _counts_stride = (noutputs() + per_line - 1) / per_line * per_line;
+    _counts.assign(click_max_cpu_ids() * _counts_stride, 0);
+    return 0;
+}
+
+uint32_t
+FlowDispatch::flow_hash(Packet *p) const
+{
+    if (!p->has_network_header())
+	return 0;
+    const click_ip *iph = p->ip_header();
+    const uint8_t *a = reinterpret_cast<const uint8_t *>(&iph->ip_src);
+    uint32_t h = 0;
+    for (int i = 0; i < 8; ++i)
+	h ^= _table[i][a[i]];
+    if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+	&& IP_FIRSTFRAG(iph) && p->transport_length() >= 4) {
+	const uint8_t *ports = p->transport_header();
+	for (int i = 0; i < 4; ++i)
+	    h ^= _table[8 + i][ports[i]];
+    }
+    return h;
+}
+
+/** @brief Return the jump consistent hash bucket of @a key in [0, @a n).
+ *
+ * See Lamping and Veach, "A Fast, Minimal Memory, Consistent Hash
+ * Algorithm".  Growing @a n by one moves keys only into the new bucket. */
+int
+FlowDispatch::jump_hash(uint64_t key, int n)
+{
+    int64_t b = -1, j = 0;
+    while (j < n) {
+	b = j;
+	key = key * 2862933555777941757ULL + 1;
+	j = (int64_t) (((uint64_t) (b + 1) << 31) / ((key >> 33) + 1));
+    }
+    return (int) b;
+}
+
+void
+FlowDispatch::push(int, Packet *p)
+{
+    // Spread the 32-bit hash over 64 bits so jump_hash's LCG mixes well.
+    uint64_t h = flow_hash(p);
+    int port = jump_hash(h | (h << 32), _active);
+    unsigned cpu = click_current_cpu_id();
+    if (cpu >= click_max_cpu_ids())
+	cpu = 0;
+    ++_counts[cpu * _counts_stride + port];
+    output(port).push(p);
+}
+
+/** @brief Return the task of the pipeline replica fed by output @a port.
+ *
+ * Looks at most two connections downstream, which covers the usual
+ * FlowDispatch -> Queue -> Unqueue arrangement. */
+Task *
+FlowDispatch::replica_task(int port) const
+{
+    ElementNeighborhoodTracker tracker(router(), 2);
+    router()->visit_downstream(const_cast<FlowDispatch *>(this), port, &tracker);
+    const Vector<Task *> &tasks = router()->_tasks;
+    for (int i = 0; i < tracker.size(); ++i)
+	for (int j = 0; j < tasks.size(); ++j)
+	    if (tasks[j]->element() == tracker[i])
+		return tasks[j];
+    return 0;
+}
+
+enum { h_active, h_counts, h_replicate, h_replica_load };
+
+String
+FlowDispatch::read_handler(Element *e, void *thunk)
+{
+    FlowDispatch *fd = static_cast<FlowDispatch *>(e);
+    switch ((intptr_t) thunk) {
+    case h_active:
+	return String(fd->_active);
+    case h_counts: {
+	StringAccum sa;
+	for (int i = 0; i < fd->noutputs(); ++i) {
+	    uint64_t n = 0;
+	    for (int j = i; j < fd->_counts.size(); j += fd->_counts_stride)
+		n += fd->_counts[j];
+	    sa << n << '\n';
+	}
+	return sa.take_string();
+    }
+    case h_replica_load: {
+	double load = 0;
+#if HAVE_MULTITHREAD
+	unsigned window = Task::stats_window() - 1;
+	Task::Stats s;
+	for (int i = 0; i < fd->_active; ++i)
+	    if (Task *t = fd->replica_task(i))
+		if (t->stats(window, s)) {
+		    double l = (double) s.cycles * s.rate;
+		    if (l > load)
+			load = l;
+		}
+#endif
+	return String(load);
+    }
+    default:
+	return String();
+    }
+}
+
+int
+FlowDispatch::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    FlowDispatch *fd = static_cast<FlowDispatch *>(e);
+    switch ((intptr_t) thunk) {
+    case h_active: {
+	int active;
+	if (!IntArg().parse(str, active) || active < 1 || active > fd->noutputs())
+	    return errh->error("expected integer between 1 and %d", fd->noutputs());
+	fd->_active = active;
+	return 0;
+    }
+    case h_replicate: {
+	int thread;
+	if (!IntArg().parse(str, thread) || thread < 0
+	    || thread >= fd->master()->nthreads())
+	    return errh->error("expected thread ID");
+	if (fd->_active >= fd->noutputs())
+	    return errh->error("all outputs already active");
+	if (Task *t = fd->replica_task(fd->_active))
+	    t->move_thread(thread);
+	++fd->_active;
+	return 0;
+    }
+    default:
+	return -1;
+    }
+}
+
+void
+FlowDispatch::add_handlers()
+{
+    add_read_handler("active", read_handler, h_active);
+    add_write_handler("active", write_handler, h_active);
+    add_read_handler("counts", read_handler, h_counts);
+    add_write_handler("replicate", write_handler, h_replicate);
+    add_read_handler("replica_load", read_handler, h_replica_load);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(FlowDispatch)
+ELEMENT_MT_SAFE(FlowDispatch)
@@ -0,0 +1,133 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWDISPATCH_HH
+#define CLICK_FLOWDISPATCH_HH
+#include <click/element.hh>
+CLICK_DECLS
+class Task;
+
+/*
+=c
+
+FlowDispatch([I<keywords> ACTIVE, KEY])
+
+=s classification
+
+dispatches IP flows across outputs by Toeplitz hash
+
+=d
+
+Expects IP packets with their IP header annotations set.  Computes the
+Toeplitz hash of each packet's flow, as a NIC doing receive-side scaling
+(RSS) would, and emits the packet on an output selected by that hash.  All
+packets of a flow are emitted on the same output, so per-flow order is
+preserved as long as each output feeds a single FIFO path.
+
+For TCP and UDP packets that are not later fragments, the hash covers the
+source and destination addresses and ports; for all other packets it covers
+only the addresses.  Hash input and key layout match the Microsoft RSS
+specification, so with the default key FlowDispatch agrees with the hash a
+NIC reports for the same packet.
+
+Only the first ACTIVE outputs receive packets.  The hash is mapped onto the
+active outputs with jump consistent hashing: when ACTIVE grows from N to N+1,
+only about 1/(N+1) of the flows move, and all of them move to the new output;
+shrinking reverses the process.  Packets in flight on the old output during a
+resize may be reordered relative to packets on the new one.
+
+Each output is normally connected to a SimpleQueue (a single-producer,
+single-consumer queue when FlowDispatch is its only pusher) drained by its
+own Unqueue or other pulling element, one replica of the pipeline stage per
+output.  FlowDispatch finds the task of each replica by looking up to two
+connections downstream of the output.  The C<replicate> handler activates
+the next output and moves that replica's task to a given thread; the
+C<replicate> balancer command uses it to split a heavy stage across threads
+instead of only moving it.
+
+Keyword arguments are:
+
+=over 8
+
+=item ACTIVE
+
+Integer.  The number of active outputs, between 1 and the number of outputs.
+Default is the number of outputs.
+
+=item KEY
+
+String.  The Toeplitz key, at least 16 bytes long.  Hexadecimal string syntax
+is convenient here, as in "KEY \<6d5a56da...>".  Default is the 40-byte key
+from the Microsoft RSS specification.
+
+=back
+
+=h active read/write
+
+Returns or sets the number of active outputs.
+
+=h counts read-only
+
+Returns the number of packets emitted on each output, one per line.
+
+=h replicate write-only
+
+Takes a thread ID.  Moves the task downstream of the first inactive output
+to that thread, then activates the output.  Fails if every output is already
+active.
+
+=h replica_load read-only
+
+Returns the largest load (cycles per run times run rate) of the tasks
+downstream of the active outputs.
+
+=e
+
+This configuration spreads flows over up to four replicas of a CPU-heavy
+stage, of which two start active:
+
+  fd :: FlowDispatch(ACTIVE 2);
+  FromDevice(eth0) -> Strip(14) -> CheckIPHeader -> fd;
+  fd[0] -> Queue -> Unqueue -> Stage -> q :: ThreadSafeQueue -> ToDevice(eth1);
+  fd[1] -> Queue -> Unqueue -> Stage -> q;
+  fd[2] -> Queue -> Unqueue -> Stage -> q;
+  fd[3] -> Queue -> Unqueue -> Stage -> q;
+
+=a
+
+HashSwitch, CPUSwitch, RoundRobinSwitch, SimpleQueue, Unqueue */
+
+class FlowDispatch : public Element { public:
+
+    FlowDispatch() CLICK_COLD;
+
+    const char *class_name() const	{ return "FlowDispatch"; }
+    const char *port_count() const	{ return "1/1-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *);
+
+    uint32_t flow_hash(Packet *p) const;
+    static int jump_hash(uint64_t key, int n);
+    Task *replica_task(int port) const;
+
+    enum { key_min_len = 16 };
+
+  private:
+
+    int _active;
+    uint32_t _table[12][256];
+    // Per-CPU rows of per-output counts, each row padded to a cache line
+    // so concurrent pushers don't share lines; summed by "counts".
+    Vector<uint64_t> _counts;
+    int _counts_stride;
+
+    void set_key(const String &key);
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -126,7 +126,7 @@ FrontDropQueue::push(int, Packet *p)
     int s = size();
     if (s > _highwater_length)
 	_highwater_length = s;
-    if (s == 1 && !_empty_note.active())
+    if (wake_due(s) && !_empty_note.active())
 	_empty_note.wake();
 }
 
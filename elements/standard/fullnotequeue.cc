@@ -18,9 +18,13 @@
 
 #include <click/config.h>
 #include "fullnotequeue.hh"
+#include <click/master.hh>
+#include <click/task.hh>
+#include "unqueue.hh"
 CLICK_DECLS
 
 FullNoteQueue::FullNoteQueue()
+    : _fused(0), _fused_pushes(0), _queued_pushes(0)
 {
 }
 
@@ -52,21 +56,76 @@ FullNoteQueue::live_reconfigure(Vector<String> &conf, ErrorHandler *errh)
     return r;
 }
 
-void
-FullNoteQueue::push(int, Packet *p)
+inline void
+FullNoteQueue::enqueue(Packet *p)
 {
     // Code taken from SimpleQueue::push().
     Storage::index_type h = head(), t = tail(), nt = next_i(t);
 
-    if (nt != h)
+    if (nt != h) {
 	push_success(h, t, nt, p);
-    else
+	_push_rate.hit(master()->_stats_tick);
+    } else
 	push_failure(p);
 }
 
+void
+FullNoteQueue::push(int, Packet *p)
+{
+    // An empty fused queue on its Unqueue's thread cannot reorder packets,
+    // so skip it.  Otherwise enqueue, which also wakes the Unqueue.  One
+    // packet in PROBE_INTERVAL is queued anyway to keep the queued cost
+    // measured.  Fused packets count as pushed and pulled, so balancers
+    // reading the rates still see the hop's traffic.
+    bool probe = false;
+    if (_fused && head() == tail() && _fused->fuse_here()) {
+	if (++_fused_pushes % PROBE_INTERVAL != 0) {
+	    _push_rate.hit(master()->_stats_tick);
+	    _pull_rate.hit(master()->_stats_tick);
+	    _fused->fused_push(p);
+	    return;
+	}
+	probe = true;
+    }
+
+#if HAVE_TASK_PROFILE
+    // During a profiled task run, account this push's cost separately from
+    // the task's own service time.
+    click_cycles_t cycles = 0;
+    bool profile = TaskProfile::active();
+    if (unlikely(profile))
+	cycles = click_get_cycles();
+#endif
+
+    // While fused, sample what queueing costs for RouterBox's report.
+    click_cycles_t sample = 0;
+    if (_fused && (probe || ++_queued_pushes % 16 == 0))
+	sample = click_get_cycles();
+
+    enqueue(p);
+
+    if (sample)
+	_queued_push_cycles.update(click_get_cycles() - sample);
+
+#if HAVE_TASK_PROFILE
+    if (unlikely(profile)) {
+	cycles = click_get_cycles() - cycles;
+	_push_cycles.update(cycles);
+	TaskProfile::add_push(cycles);
+    }
+#endif
+}
+
 Packet *
 FullNoteQueue::pull(int)
 {
+#if HAVE_TASK_PROFILE
+    click_cycles_t cycles = 0;
+    bool profile = TaskProfile::active();
+    if (unlikely(profile))
+	cycles = click_get_cycles();
+#endif
+
     // Code taken from SimpleQueue::deq.
     Storage::index_type h = head(), t = tail(), nh = next_i(h);
 
@@ -74,27 +133,71 @@ FullNoteQueue::pull(int)
 
     if (h != t) {
 	p = pull_success(h, nh);
+	_pull_rate.hit(master()->_stats_tick);
     } else
 	p = pull_failure();
+
+#if HAVE_TASK_PROFILE
+    if (unlikely(profile)) {
+	cycles = click_get_cycles() - cycles;
+	if (p)
+	    _pull_cycles.update(cycles);
+	TaskProfile::add_pull(cycles, p);
+    }
+#endif
     return p;
 }
 
-#if CLICK_DEBUG_SCHEDULING
+void
+FullNoteQueue::RateCounter::publish(unsigned window)
+{
+    // the count covers the windows since the last publication; the first
+    // tick a side sees only starts its count
+    if (!_stats_window || !PASS_GT(window, _stats_window)) {
+	_stats_count = _count;
+	_stats_window = window;
+	return;
+    }
+    RateStats s;
+    s.window = window;
+    s.rate = (_count - _stats_count) * (1000 / Task::STATS_WINDOW_MSEC)
+	/ (window - _stats_window);
+    _stats.publish(s);
+    _stats_count = _count;
+    _stats_window = window;
+}
+
+enum { h_push_rate, h_pull_rate, h_notifier_state };
+
 String
-FullNoteQueue::read_handler(Element *e, void *)
+FullNoteQueue::read_handler(Element *e, void *user_data)
 {
     FullNoteQueue *fq = static_cast<FullNoteQueue *>(e);
-    return "nonempty " + fq->_empty_note.unparse(fq->router())
-	+ "\nnonfull " + fq->_full_note.unparse(fq->router());
+    switch ((intptr_t) user_data) {
+    case h_push_rate:
+	return String(fq->push_rate());
+    case h_pull_rate:
+	return String(fq->pull_rate());
+#if CLICK_DEBUG_SCHEDULING
+    case h_notifier_state:
+	return "nonempty " + fq->_empty_note.unparse(fq->router())
+	    + "\nnonfull " + fq->_full_note.unparse(fq->router());
+#endif
+    default:
+	return String();
+    }
 }
 
 void
 FullNoteQueue::add_handlers()
 {
     NotifierQueue::add_handlers();
-    add_read_handler("notifier_state", read_handler, 0);
-}
+    add_read_handler("push_rate", read_handler, h_push_rate);
+    add_read_handler("pull_rate", read_handler, h_pull_rate);
+#if CLICK_DEBUG_SCHEDULING
+    add_read_handler("notifier_state", read_handler, h_notifier_state);
 #endif
+}
 
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(NotifierQueue)
@@ -2,7 +2,10 @@
 #ifndef CLICK_FULLNOTEQUEUE_HH
 #define CLICK_FULLNOTEQUEUE_HH
 #include "notifierqueue.hh"
+#include <click/task.hh>
+#include <click/sync.hh>
 CLICK_DECLS
+class Unqueue;
 
 /*
 =c
@@ -31,6 +34,10 @@ exactly like SimpleQueue.
 
 You may also use the old element name "FullNoteQueue".
 
+A RouterBox with FUSE true may fuse a Queue with the Unqueue that pulls from
+it.  A fused Queue passes packets directly to the Unqueue's output while it is
+empty and both run on the same thread.  See Unqueue.
+
 B<Multithreaded Click note:> Queue is designed to be used in an environment
 with at most one concurrent pusher and at most one concurrent puller.  Thus,
 at most one thread pushes to the Queue at a time and at most one thread pulls
@@ -62,6 +69,17 @@ When written, resets the C<drops> and C<highwater_length> counters.
 
 When written, drops all packets in the queue.
 
+=h push_rate read-only
+
+Returns the number of packets pushed per second, as published by the pushing
+thread.  Rates are published at most once per statistics window (100ms), and
+a side that has not published for a whole window reads as 0, so a stopped
+source's rate falls to 0 within two windows.
+
+=h pull_rate read-only
+
+Returns the number of packets pulled per second.  See C<push_rate>.
+
 =a ThreadSafeQueue, QuickNoteQueue, SimpleQueue, NotifierQueue, MixedQueue,
 FrontDropQueue */
 
@@ -74,9 +92,7 @@ class FullNoteQueue : public NotifierQueue { public:
 
     int configure(Vector<String> &conf, ErrorHandler *) CLICK_COLD;
     int live_reconfigure(Vector<String> &conf, ErrorHandler *errh);
-#if CLICK_DEBUG_SCHEDULING
     void add_handlers() CLICK_COLD;
-#endif
 
     void push(int port, Packet *p);
     Packet *pull(int port);
@@ -89,17 +105,40 @@ class FullNoteQueue : public NotifierQueue { public:
 
     DirectEWMA _pull_cycles;
 
-#ifdef HAVE_INT64_TYPES
-    // Reduce bits of fraction for byte rate to avoid overflow
-    typedef RateEWMAX<RateEWMAXParameters<4, 10, uint64_t, int64_t> > rate_t;
-#else
-    typedef RateEWMAX<RateEWMAXParameters<4, 10> > rate_t;
-#endif
-
-    rate_t _push_rate;
-
-    rate_t _pull_rate;
-
+    // Each side counts its own packets and publishes its rate through a
+    // seqlock, so readers on other threads see a consistent value and need
+    // not write to the queue.  Each packet compares the master's statistics
+    // tick, which the threads advance at every window, so a side publishes
+    // on its first packet of each window without reading the clock.
+    struct RateStats {
+	unsigned window;
+	int rate;
+    };
+    class RateCounter { public:
+	RateCounter()
+	    : _count(0), _stats_count(0), _stats_window(0) {
+	}
+	inline void hit(unsigned tick);
+	inline int rate() const;
+      private:
+	uint32_t _count;
+	uint32_t _stats_count;
+	unsigned _stats_window;
+	SeqlockValue<RateStats> _stats;
+	void publish(unsigned window);
+    };
+
+    RateCounter _push_rate CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    RateCounter _pull_rate CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    enum { PROBE_INTERVAL = 1024 };
+    Unqueue *_fused;
+    uint32_t _fused_pushes;
+    uint32_t _queued_pushes;
+    DirectEWMA _queued_push_cycles;
+
+    inline void enqueue(Packet *p);
     inline void push_success(Storage::index_type h, Storage::index_type t,
 			     Storage::index_type nt, Packet *p);
     inline void push_failure(Packet *p);
@@ -107,36 +146,65 @@ class FullNoteQueue : public NotifierQueue { public:
 				Storage::index_type nh);
     inline Packet *pull_failure();
 
-#if CLICK_DEBUG_SCHEDULING
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
-#endif
 
   public:
-    inline int push_cycles();
-    inline int pull_cycles();
-    inline int push_rate();
-    inline int pull_rate();
+    inline int push_cycles() const;
+    inline int pull_cycles() const;
+    inline int push_rate() const;
+    inline int pull_rate() const;
+
+    /** @brief Fuse this queue with @a u, its downstream Unqueue, or unfuse
+     * it if @a u is null.
+     *
+     * Call during router initialization, before packets flow; RouterBox
+     * does so from its initialize(). */
+    void set_fused(Unqueue *u)			{ _fused = u; }
+    Unqueue *fused() const			{ return _fused; }
+    /** @brief Return the average cycles per queued push, sampled while
+     * fused. */
+    int queued_push_cycles() const {
+	return _queued_push_cycles.unscaled_average();
+    }
 };
 
 inline int
-FullNoteQueue::push_cycles() {
+FullNoteQueue::push_cycles() const {
     return _push_cycles.unscaled_average();
 }
 
 inline int
-FullNoteQueue::pull_cycles() {
+FullNoteQueue::pull_cycles() const {
     return _pull_cycles.unscaled_average();
 }
 
+inline void
+FullNoteQueue::RateCounter::hit(unsigned tick)
+{
+    ++_count;
+    if (unlikely(tick != _stats_window))
+	publish(tick);
+}
+
+inline int
+FullNoteQueue::RateCounter::rate() const
+{
+    // a side that has not published for a whole window is idle
+    RateStats s = _stats.read();
+    return PASS_GT(Task::stats_window() - 1, s.window) ? 0 : s.rate;
+}
+
+/** @brief Return the packets pushed per second, as last published by the
+ * pushing side.
+ *
+ * Any thread may call this function; it never writes to the queue. */
 inline int
-FullNoteQueue::push_rate() {
-    _push_rate.update(0);
+FullNoteQueue::push_rate() const {
     return _push_rate.rate();
 }
 
 inline int
-FullNoteQueue::pull_rate() {
-    _pull_rate.update(0);
+FullNoteQueue::pull_rate() const {
     return _pull_rate.rate();
 }
 
@@ -151,7 +219,8 @@ FullNoteQueue::push_success(Storage::index_type h, Storage::index_type t,
     if (s > _highwater_length)
 	_highwater_length = s;
 
-    _empty_note.wake();
+    if (wake_due(s))
+	_empty_note.wake();
 
     if (s == capacity()) {
 	_full_note.sleep();
@@ -0,0 +1,246 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * latencyhistogram.{cc,hh} -- record a histogram of packet latencies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "latencyhistogram.hh"
+#include "latencystamp.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+LatencyHistogram::LatencyHistogram()
+    : _hist(0), _base(0)
+{
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+}
+
+int
+LatencyHistogram::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _anno = PERFCTR_ANNO_OFFSET;
+    _active = true;
+    _restamp = false;
+    if (Args(conf, this, errh)
+	.read("ANNO", AnnoArg(8), _anno)
+	.read("ACTIVE", _active)
+	.read("RESTAMP", _restamp)
+	.complete() < 0)
+	return -1;
+    return LatencyStamp::check_anno(this, _anno, errh);
+}
+
+int
+LatencyHistogram::initialize(ErrorHandler *errh)
+{
+    _nhist = click_max_cpu_ids();
+    if (!(_hist = new Hist[_nhist]) || !(_base = new Hist))
+	return errh->error("out of memory!");
+    memset(_hist, 0, sizeof(Hist) * _nhist);
+    memset(_base, 0, sizeof(Hist));
+    return 0;
+}
+
+void
+LatencyHistogram::cleanup(CleanupStage)
+{
+    delete[] _hist;
+    delete _base;
+    _hist = _base = 0;
+}
+
+Packet *
+LatencyHistogram::simple_action(Packet *p)
+{
+    if (_active) {
+	click_cycles_t now = click_get_cycles();
+	uint64_t then = p->anno_u64(_anno);
+	if (then && then <= now) {
+	    uint64_t v = now - then;
+	    Hist &h = _hist[click_current_cpu_id()];
+	    ++h.count[bucket(v)];
+	    h.sum += v;
+	    if (v > h.max)
+		h.max = v;
+	}
+	if (_restamp)
+	    p->set_anno_u64(_anno, now);
+    }
+    return p;
+}
+
+void
+LatencyHistogram::merge(Hist &m, const Hist *base) const
+{
+    // Counts and sums only grow, so subtracting the snapshot taken at the
+    // last reset gives the totals since then.
+    memset(&m, 0, sizeof(Hist));
+    for (unsigned i = 0; i < _nhist; i++) {
+	const Hist &h = _hist[i];
+	m.sum += h.sum;
+	if (h.max > m.max)
+	    m.max = h.max;
+	for (int b = 0; b < NBUCKETS; b++)
+	    m.count[b] += h.count[b];
+    }
+    if (base) {
+	m.sum -= base->sum;
+	for (int b = 0; b < NBUCKETS; b++)
+	    m.count[b] -= base->count[b];
+    }
+}
+
+uint64_t
+LatencyHistogram::percentile(const Hist &m, uint64_t total, uint32_t thousandths)
+{
+    if (!total)
+	return 0;
+    // smallest latency with at least this fraction of packets at or below it
+    uint64_t rank = int_divide(total * thousandths + 99999, 100000);
+    if (rank == 0)
+	rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < NBUCKETS; b++) {
+	seen += m.count[b];
+	if (seen >= rank)
+	    return bucket_high(b) < m.max ? bucket_high(b) : m.max;
+    }
+    return m.max;
+}
+
+enum { H_COUNT, H_AVERAGE, H_MAX, H_PERCENTILES, H_HISTOGRAM,
+       H_ACTIVE, H_RESTAMP, H_RESET };
+
+String
+LatencyHistogram::read_handler(Element *e, void *thunk)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    int which = reinterpret_cast<intptr_t>(thunk);
+    if (which == H_ACTIVE)
+	return String(lh->_active);
+    else if (which == H_RESTAMP)
+	return String(lh->_restamp);
+    else if (!lh->_hist)
+	return String();
+
+    Hist *m = new Hist;
+    lh->merge(*m, lh->_base);
+    uint64_t total = 0;
+    for (int b = 0; b < NBUCKETS; b++)
+	total += m->count[b];
+
+    StringAccum sa;
+    switch (which) {
+    case H_COUNT:
+	sa << total;
+	break;
+    case H_AVERAGE:
+	sa << (total ? int_divide(m->sum, total) : 0);
+	break;
+    case H_MAX:
+	sa << m->max;
+	break;
+    case H_PERCENTILES: {
+	static const uint32_t ps[] = { 50000, 90000, 99000, 99900 };
+	static const char * const names[] = { "50", "90", "99", "99.9" };
+	for (int i = 0; i < 4; i++)
+	    sa << names[i] << ' ' << percentile(*m, total, ps[i]) << '\n';
+	sa << "100 " << m->max << '\n';
+	break;
+    }
+    case H_HISTOGRAM:
+	for (int b = 0; b < NBUCKETS; b++)
+	    if (m->count[b])
+		sa << bucket_low(b) << ' ' << bucket_high(b) << ' '
+		   << m->count[b] << '\n';
+	break;
+    }
+    delete m;
+    return sa.take_string();
+}
+
+int
+LatencyHistogram::percentile_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    uint32_t thousandths;
+    if (!DecimalFixedPointArg(3).parse(s, thousandths) || thousandths > 100000)
+	return errh->error("expected percentage between 0 and 100");
+    if (!lh->_hist) {
+	s = String();
+	return 0;
+    }
+    Hist *m = new Hist;
+    lh->merge(*m, lh->_base);
+    uint64_t total = 0;
+    for (int b = 0; b < NBUCKETS; b++)
+	total += m->count[b];
+    s = String(percentile(*m, total, thousandths));
+    delete m;
+    return 0;
+}
+
+int
+LatencyHistogram::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+    case H_ACTIVE:
+    case H_RESTAMP: {
+	bool x;
+	if (!BoolArg().parse(str, x))
+	    return errh->error("expected boolean");
+	if (reinterpret_cast<intptr_t>(thunk) == H_ACTIVE)
+	    lh->_active = x;
+	else
+	    lh->_restamp = x;
+	return 0;
+    }
+    case H_RESET:
+	if (lh->_hist) {
+	    lh->merge(*lh->_base, 0);
+	    for (unsigned i = 0; i < lh->_nhist; i++)
+		lh->_hist[i].max = 0;
+	}
+	return 0;
+    default:
+	return 0;
+    }
+}
+
+void
+LatencyHistogram::add_handlers()
+{
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("average", read_handler, H_AVERAGE);
+    add_read_handler("max", read_handler, H_MAX);
+    add_read_handler("percentiles", read_handler, H_PERCENTILES);
+    add_read_handler("histogram", read_handler, H_HISTOGRAM, Handler::f_expensive);
+    set_handler("percentile", Handler::f_read | Handler::f_read_param, percentile_handler);
+    add_read_handler("active", read_handler, H_ACTIVE, Handler::f_checkbox);
+    add_write_handler("active", write_handler, H_ACTIVE);
+    add_read_handler("restamp", read_handler, H_RESTAMP, Handler::f_checkbox);
+    add_write_handler("restamp", write_handler, H_RESTAMP);
+    add_write_handler("reset", write_handler, H_RESET, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64 LatencyStamp)
+EXPORT_ELEMENT(LatencyHistogram)
+ELEMENT_MT_SAFE(LatencyHistogram)
@@ -0,0 +1,182 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_LATENCYHISTOGRAM_HH
+#define CLICK_LATENCYHISTOGRAM_HH
+#include <click/element.hh>
+#include <click/integers.hh>
+CLICK_DECLS
+
+/*
+=c
+
+LatencyHistogram([I<keywords> ANNO, ACTIVE, RESTAMP])
+
+=s counters
+
+records a histogram of packet latencies
+
+=d
+
+For each passing packet, LatencyHistogram measures the cycles elapsed since
+the cycle count stored in the packet's annotation, normally by LatencyStamp,
+and counts that latency in a log-bucketed histogram.  Buckets are exact below
+64 cycles; above that, each power of two is split into 32 buckets, so a
+reported latency is within about 3% of the true value.  Latencies of 2^40
+cycles or more all land in the last bucket.  Packets whose annotation is 0
+or lies in the future are passed through without being counted.
+
+Each thread records into its own histogram, so the per-packet cost is one
+cycle counter read and a few increments with no synchronization.  Read
+handlers merge the threads' histograms.
+
+A chain of LatencyHistogram elements with RESTAMP true breaks a packet's
+latency down by stage.  For example, a histogram after a Queue's Unqueue
+measures time spent queued plus that Unqueue's processing, and a histogram
+before the next Queue measures the processing in between.
+
+Keyword arguments are:
+
+=over 8
+
+=item ANNO
+
+Annotation offset holding the cycle count.  Default is the performance
+counter annotation (offset 40), as used by LatencyStamp.  As with
+LatencyStamp, configurations containing IPsec elements must choose another
+offset on 64-bit builds.
+
+=item ACTIVE
+
+Boolean.  If false, pass packets through without measuring them.  Default is
+true.
+
+=item RESTAMP
+
+Boolean.  If true, store the current cycle count in the annotation after
+measuring, so the next LatencyHistogram measures from here.  Default is
+false.
+
+=back
+
+=h count read-only
+
+Returns the number of packets measured.
+
+=h average read-only
+
+Returns the mean latency in cycles.
+
+=h max read-only
+
+Returns the largest latency in cycles.
+
+=h percentile read-only with parameter
+
+Returns the latency, in cycles, at or below which the given percentage of
+packets fall.  For example, "percentile 99.9".
+
+=h percentiles read-only
+
+Returns the 50th, 90th, 99th, and 99.9th percentile latencies and the
+maximum, one per line, as "PERCENTILE CYCLES".
+
+=h histogram read-only
+
+Returns the nonempty buckets, one per line, as "LOW HIGH COUNT", where LOW
+and HIGH are the smallest and largest latencies in the bucket.
+
+=h active read/write
+
+Returns or sets the ACTIVE setting.
+
+=h restamp read/write
+
+Returns or sets the RESTAMP setting.
+
+=h reset write-only
+
+Clears the histogram.  Reset takes a snapshot that later reports subtract,
+so the measuring threads are not disturbed and no packet is lost or counted
+twice; only the maximum may still reflect a packet measured during the
+reset.
+
+=a LatencyStamp, CycleCountAccum, TimestampAccum */
+
+class LatencyHistogram : public Element { public:
+
+    LatencyHistogram() CLICK_COLD;
+    ~LatencyHistogram() CLICK_COLD;
+
+    const char *class_name() const	{ return "LatencyHistogram"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+    enum { PRECISION = 6, MAXBITS = 40,
+	   SUB = 1 << PRECISION, HALF = SUB / 2,
+	   NBUCKETS = SUB + (MAXBITS - PRECISION) * HALF };
+
+    static inline int bucket(uint64_t v);
+    static inline uint64_t bucket_low(int b);
+    static inline uint64_t bucket_high(int b);
+
+  private:
+
+    struct Hist {
+	uint64_t sum;
+	uint64_t max;
+	uint64_t count[NBUCKETS];
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    Hist *_hist;
+    Hist *_base;
+    unsigned _nhist;
+    int _anno;
+    bool _active;
+    bool _restamp;
+
+    void merge(Hist &, const Hist *base) const;
+    static uint64_t percentile(const Hist &, uint64_t total, uint32_t thousandths);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    static int percentile_handler(int, String &, Element *, const Handler *, ErrorHandler *) CLICK_COLD;
+
+};
+
+inline int
+LatencyHistogram::bucket(uint64_t v)
+{
+    if (v < SUB)
+	return v;
+    int width = 65 - ffs_msb(v);
+    if (width > MAXBITS)
+	return NBUCKETS - 1;
+    int shift = width - PRECISION;
+    return SUB + (shift - 1) * HALF + (int) (v >> shift) - HALF;
+}
+
+inline uint64_t
+LatencyHistogram::bucket_low(int b)
+{
+    if (b < SUB)
+	return b;
+    int shift = (b - SUB) / HALF + 1;
+    return (uint64_t) (HALF + (b - SUB) % HALF) << shift;
+}
+
+inline uint64_t
+LatencyHistogram::bucket_high(int b)
+{
+    if (b < SUB)
+	return b;
+    int shift = (b - SUB) / HALF + 1;
+    return ((uint64_t) (HALF + (b - SUB) % HALF + 1) << shift) - 1;
+}
+
+CLICK_ENDDECLS
+#endif
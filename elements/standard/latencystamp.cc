@@ -0,0 +1,68 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * latencystamp.{cc,hh} -- store cycle count for latency tracing
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "latencystamp.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/router.hh>
+CLICK_DECLS
+
+LatencyStamp::LatencyStamp()
+{
+}
+
+int
+LatencyStamp::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _anno = PERFCTR_ANNO_OFFSET;
+    if (Args(conf, this, errh)
+	.read("ANNO", AnnoArg(8), _anno)
+	.complete() < 0)
+	return -1;
+    return check_anno(this, _anno, errh);
+}
+
+int
+LatencyStamp::check_anno(Element *e, int anno, ErrorHandler *errh)
+{
+#ifdef IPSEC_SA_DATA_REFERENCE_ANNO_OFFSET
+    // The IPsec elements keep a pointer in this annotation between them.
+    if (anno < IPSEC_SA_DATA_REFERENCE_ANNO_OFFSET + IPSEC_SA_DATA_REFERENCE_ANNO_SIZE
+	&& anno + 8 > IPSEC_SA_DATA_REFERENCE_ANNO_OFFSET)
+	for (int i = 0; i < e->router()->nelements(); i++) {
+	    Element *x = e->router()->element(i);
+	    if (strncmp(x->class_name(), "IPsec", 5) == 0
+		|| strcmp(x->class_name(), "RadixIPsecLookup") == 0)
+		return errh->error("ANNO %d overlaps the SA annotation used by %p{element}", anno, x);
+	}
+#else
+    (void) e, (void) anno, (void) errh;
+#endif
+    return 0;
+}
+
+Packet *
+LatencyStamp::simple_action(Packet *p)
+{
+    p->set_anno_u64(_anno, click_get_cycles());
+    return p;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(LatencyStamp)
+ELEMENT_MT_SAFE(LatencyStamp)
@@ -0,0 +1,57 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_LATENCYSTAMP_HH
+#define CLICK_LATENCYSTAMP_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+LatencyStamp([I<keywords> ANNO])
+
+=s counters
+
+stores cycle count in annotation for latency tracing
+
+=d
+
+Stores the current cycle counter in an 8-byte annotation of each passing
+packet.  LatencyHistogram elements further along the configuration record
+the cycles elapsed since this stamp.
+
+Keyword arguments are:
+
+=over 8
+
+=item ANNO
+
+Annotation offset.  Default is the performance counter annotation (offset
+40).  LatencyHistogram must use the same offset.  On 64-bit builds the
+default overlaps the IPsec elements' SA annotation, so configurations that
+contain IPsec elements must choose another offset.
+
+=back
+
+=a LatencyHistogram, SetCycleCount, CycleCountAccum */
+
+class LatencyStamp : public Element { public:
+
+    LatencyStamp() CLICK_COLD;
+
+    const char *class_name() const	{ return "LatencyStamp"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+    static int check_anno(Element *e, int anno, ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    int _anno;
+
+};
+
+CLICK_ENDDECLS
+#endif
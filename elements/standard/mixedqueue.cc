@@ -66,7 +66,7 @@ MixedQueue::push(int port, Packet *p)
     int s = size();
     if (s > _highwater_length)
 	_highwater_length = s;
-    if (s == 1 && !_empty_note.active())
+    if (wake_due(s) && !_empty_note.active())
 	_empty_note.wake();
 
     if (oldp)
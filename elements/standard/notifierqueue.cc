@@ -22,7 +22,7 @@
 CLICK_DECLS
 
 NotifierQueue::NotifierQueue()
-    : _sleepiness(0)
+    : _sleepiness(0), _wake_threshold(1)
 {
 }
 
@@ -58,7 +58,8 @@ NotifierQueue::push(int, Packet *p)
 	if (s > _highwater_length)
 	    _highwater_length = s;
 
-	_empty_note.wake();
+	if (wake_due(s))
+	    _empty_note.wake();
 
     } else {
 	if (_drops == 0 && _capacity > 0)
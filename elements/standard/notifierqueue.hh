@@ -28,6 +28,14 @@ some time after the queue goes empty, to prevent thrashing for queues that
 hover around 1 or 2 packets long. In all other respects, NotifierQueue behaves
 like SimpleQueue.
 
+A downstream element may ask NotifierQueue to coalesce wakeups: after it
+calls defer_wake(), the queue wakes it again only once a threshold number of
+packets is queued.  Unqueue does this when given BATCH.  The threshold and
+the deferred wakeup apply to every task listening on the queue's empty
+notifier, not just the element that set them; an element that sets a
+threshold should be the queue's only listener, as Unqueue is when connected
+directly to the queue.
+
 B<Multithreaded Click note:> NotifierQueue is designed to be used in an
 environment with at most one concurrent pusher and at most one concurrent
 puller.  Thus, at most one thread pushes to the NotifierQueue at a time and at
@@ -84,12 +92,23 @@ class NotifierQueue : public SimpleQueue { public:
     void add_handlers() CLICK_COLD;
 #endif
 
+    // Shared by all listeners of _empty_note; see defer_wake().
+    void set_wake_threshold(int n)	{ _wake_threshold = n; }
+    inline void defer_wake();
+
   protected:
 
     enum { SLEEPINESS_TRIGGER = 9 };
     int _sleepiness;
+    int _wake_threshold;
     ActiveNotifier _empty_note;
 
+    // A push wakes listeners on the first packet, and after defer_wake()
+    // once _wake_threshold packets are queued.
+    inline bool wake_due(int size) const {
+	return size == 1 || size >= _wake_threshold;
+    }
+
     friend class MixedQueue;
     friend class InOrderQueue;
     friend class ECNQueue;
@@ -100,5 +119,20 @@ class NotifierQueue : public SimpleQueue { public:
 
 };
 
+/** @brief Put listeners to sleep until the wake threshold is reached.
+ *
+ * Called by the downstream puller when it decides to wait for more packets.
+ * Pushes wake it again once set_wake_threshold() packets are queued. */
+inline void
+NotifierQueue::defer_wake()
+{
+    _empty_note.sleep();
+#if HAVE_MULTITHREAD
+    // As in pull(): a push may have just missed the sleep.
+    if (size() >= _wake_threshold)
+	_empty_note.wake();
+#endif
+}
+
 CLICK_ENDDECLS
 #endif
@@ -23,10 +23,12 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/standard/scheduleinfo.hh>
+#include "notifierqueue.hh"
 CLICK_DECLS
 
 Unqueue::Unqueue()
-    : _task(this)
+    : _task(this), _queue(0), _timer(&_task), _fusing(false),
+      _fused_count(0), _stats_published(0)
 {
 }
 
@@ -36,10 +38,14 @@ Unqueue::configure(Vector<String> &conf, ErrorHandler *errh)
     _burst = 1;
     _limit = -1;
     _active = true;
+    _batch = 1;
+    _latency = Timestamp::make_msec(1);
     return Args(conf, this, errh)
 	.read_p("BURST", _burst)
 	.read("ACTIVE", _active)
-	.read("LIMIT", _limit).complete();
+	.read("LIMIT", _limit)
+	.read("BATCH", _batch)
+	.read("LATENCY", _latency).complete();
 }
 
 int
@@ -52,14 +58,44 @@ Unqueue::initialize(ErrorHandler *errh)
 	_burst = 0x7FFFFFFFU;
     else if (_burst == 0)
 	errh->warning("BURST size 0, no packets will be pulled");
+    if (_batch > 1) {
+	_queue = static_cast<NotifierQueue *>(input(0).element()->cast("NotifierQueue"));
+	if (!_queue)
+	    return errh->error("BATCH requires an upstream Queue");
+	_queue->set_wake_threshold(_batch);
+	_timer.initialize(this);
+    }
     return 0;
 }
 
+bool
+Unqueue::batch_ready()
+{
+    if (_queue->size() >= _batch
+	|| (_deadline && Timestamp::now_steady() >= _deadline)) {
+	if (_deadline) {
+	    _deadline = Timestamp();
+	    _timer.unschedule();
+	}
+	return true;
+    }
+    // The queue wakes us on its first packet and once the batch is full;
+    // the timer bounds how long the first packet waits.
+    _queue->defer_wake();
+    if (!_deadline && _queue->size()) {
+	_deadline = Timestamp::now_steady() + _latency;
+	_timer.schedule_at_steady(_deadline);
+    }
+    return false;
+}
+
 bool
 Unqueue::run_task(Task *)
 {
     if (!_active)
 	return false;
+    if (_queue && !batch_ready())
+	return false;
 
     int worked = 0, limit = _burst;
     if (_limit >= 0 && _count + limit >= (uint32_t) _limit) {
@@ -86,9 +122,38 @@ Unqueue::run_task(Task *)
 
     _task.fast_reschedule();
   out:
+    if (unlikely(_stats_published != _task.thread()->stats_window()))
+	publish_stats();
     return worked > 0;
 }
 
+void
+Unqueue::fused_push(Packet *p)
+{
+    _fusing = true;
+    ++_count;
+    _pull_rate.update(1);
+    if (++_fused_count % 16 == 0) {
+	click_cycles_t cycles = click_get_cycles();
+	output(0).push(p);
+	_fused_cycles.update(click_get_cycles() - cycles);
+    } else
+	output(0).push(p);
+    _fusing = false;
+}
+
+void
+Unqueue::publish_stats()
+{
+    _stats_published = _task.thread()->stats_window();
+    _pull_rate.update(0);
+    PullStats s;
+    s.window = _stats_published;
+    s.cycles = _pull_cycles.unscaled_average();
+    s.rate = _pull_rate.rate();
+    _pull_stats.publish(s);
+}
+
 #if 0 && defined(CLICK_LINUXMODULE)
 #if __i386__ && HAVE_INTEL_CPU
 /* Old prefetching code from run_task(). */
@@ -130,7 +195,7 @@ Unqueue::write_param(const String &conf, Element *e, void *user_data,
     return 0;
 }
 
-enum { H_RATE, H_CYCLE };
+enum { H_RATE, H_CYCLE, H_FUSED_CYCLE };
 
 String
 Unqueue::read_handler(Element *e, void *thunk)
@@ -141,6 +206,8 @@ Unqueue::read_handler(Element *e, void *thunk)
     return String(c->pull_rate());
       case H_CYCLE:
     return String(c->pull_cycle());
+      case H_FUSED_CYCLE:
+    return String(c->fused_cycle());
       default:
     return "<error>";
     }
@@ -153,6 +220,9 @@ Unqueue::add_handlers()
     add_data_handlers("count", Handler::f_read, &_count);
     add_data_handlers("burst", Handler::f_read, &_burst);
     add_data_handlers("limit", Handler::f_read, &_limit);
+    add_data_handlers("batch", Handler::f_read, &_batch);
+    add_data_handlers("latency", Handler::f_read, &_latency, true);
+    add_data_handlers("fused", Handler::f_read, &_fused_count);
     add_write_handler("active", write_param, h_active);
     add_write_handler("reset", write_param, h_reset, Handler::f_button);
     add_write_handler("reset_counts", write_param, h_reset, Handler::f_button | Handler::f_uncommon);
@@ -161,6 +231,7 @@ Unqueue::add_handlers()
     add_task_handlers(&_task, &_signal);
     add_read_handler("rate", read_handler, H_RATE);
     add_read_handler("cycle", read_handler, H_CYCLE);
+    add_read_handler("fused_cycle", read_handler, H_FUSED_CYCLE);
 }
 
 CLICK_ENDDECLS
@@ -2,13 +2,15 @@
 #define CLICK_UNQUEUE_HH
 #include <click/element.hh>
 #include <click/task.hh>
+#include <click/timer.hh>
 #include <click/notifier.hh>
 CLICK_DECLS
+class NotifierQueue;
 
 /*
 =c
 
-Unqueue([I<keywords> ACTIVE, LIMIT, BURST])
+Unqueue([I<keywords> ACTIVE, LIMIT, BURST, BATCH, LATENCY])
 
 =s shaping
 
@@ -37,8 +39,34 @@ The default value is true.
 If positive, then at most LIMIT packets are pulled.  The default is -1, which
 means there is no limit.
 
+=item BATCH
+
+Integer.  If greater than 1, Unqueue sleeps until at least BATCH packets are
+waiting in its upstream queue, rather than waking up for each packet.  The
+input must be connected directly to a Queue or NotifierQueue.  BURST should
+usually be at least BATCH.  The default is 1.
+
+=item LATENCY
+
+Timestamp.  With BATCH, the longest time a packet may wait for its batch to
+fill; after LATENCY, Unqueue pulls whatever is queued.  Expiring LATENCY costs
+a timer, so it should exceed the usual time to fill a batch.  The default is 1
+millisecond.
+
 =back
 
+When idle, Unqueue's thread blocks until the upstream queue becomes nonempty
+(or, with BATCH, fills).  Cross-thread wakeups are coalesced, so a busy
+producer does not signal the Unqueue's thread once per packet.
+
+A RouterBox with FUSE true fuses each Queue with the Unqueue that pulls from
+it.  While the Queue is empty and its pusher runs on the Unqueue's home
+thread, packets skip the Queue and the Unqueue's task, and go straight out
+the Unqueue's output; one packet in 1024 still goes through the Queue, to
+measure what fusion saves.  Fused packets still count in the Queue's and
+the Unqueue's rates.  Moving either task to another thread restores the Queue
+without reordering packets.
+
 =h count read-only
 
 Returns the count of packets that have passed through Unqueue.
@@ -60,6 +88,36 @@ Same as the LIMIT keyword.
 
 Same as the BURST keyword.
 
+=h batch read-only
+
+Same as the BATCH keyword.
+
+=h latency read-only
+
+Same as the LATENCY keyword.
+
+=h fused read-only
+
+Returns the number of packets that bypassed the upstream Queue because of
+fusion.  These are included in "count".
+
+=h fused_cycle read-only
+
+Returns the average number of cycles spent per fused packet, sampled every
+16 packets.
+
+=h rate read-only
+
+Returns the number of packets pulled per second, as published by the
+Unqueue's thread at the start of its latest statistics window, or 0 if it
+has not run since the previous window.  Reading it does not disturb the
+thread.
+
+=h cycle read-only
+
+Returns the average number of cycles spent per packet, published along with
+"rate".
+
 =a RatedUnqueue, BandwidthRatedUnqueue
 */
 
@@ -77,6 +135,14 @@ class Unqueue : public Element { public:
 
     bool run_task(Task *);
 
+    inline bool fuse_here() const;
+    void fused_push(Packet *);
+    uint32_t fused_count() const		{ return _fused_count; }
+    int task_thread() const			{ return _task.home_thread_id(); }
+    int fused_cycle() const {
+	return _fused_cycles.unscaled_average();
+    }
+
   private:
 
     bool _active;
@@ -86,6 +152,18 @@ class Unqueue : public Element { public:
     Task _task;
     NotifierSignal _signal;
 
+    int32_t _batch;
+    Timestamp _latency;
+    Timestamp _deadline;
+    NotifierQueue *_queue;
+    Timer _timer;
+
+    bool batch_ready();
+
+    bool _fusing;
+    uint32_t _fused_count;
+    DirectEWMA _fused_cycles;
+
     enum {
 	h_active, h_reset, h_burst, h_limit
     };
@@ -99,24 +177,48 @@ class Unqueue : public Element { public:
 #endif
 
     public:
-        inline int pull_cycle();
-        inline int pull_rate();
+        inline int pull_cycle() const;
+        inline int pull_rate() const;
 
         DirectEWMA _pull_cycles;
         rate_t _pull_rate;
 
         static String read_handler(Element *, void *) CLICK_COLD;
+
+    private:
+        struct PullStats {
+            unsigned window;
+            int cycles;
+            int rate;
+        };
+        // published by the task's thread once per statistics window
+        unsigned _stats_published;
+        SeqlockValue<PullStats> _pull_stats CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+        void publish_stats();
 };
 
+/** @brief Return true iff a fused Queue may hand a packet to fused_push().
+ *
+ * The caller must run on the Unqueue's home thread, so the Unqueue cannot
+ * pull concurrently; see Task::home_thread_is_current(). */
+inline bool
+Unqueue::fuse_here() const
+{
+    return _active && _limit < 0 && !_fusing
+	&& _task.home_thread_is_current();
+}
+
 inline int
-Unqueue::pull_cycle() {
-    return _pull_cycles.unscaled_average();
+Unqueue::pull_cycle() const {
+    return _pull_stats.read().cycles;
 }
 
 inline int
-Unqueue::pull_rate() {
-    _pull_rate.update(0);
-    return _pull_rate.rate();
+Unqueue::pull_rate() const {
+    // an Unqueue that has not run for a whole window is idle
+    PullStats s = _pull_stats.read();
+    return PASS_GT(Task::stats_window() - 1, s.window) ? 0 : s.rate;
 }
 
 
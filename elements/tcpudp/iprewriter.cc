@@ -29,8 +29,9 @@
 CLICK_DECLS
 
 IPRewriter::IPRewriter()
-    : _udp_map(0)
 {
+    // TCP and UDP flows share each shard's allocator
+    _flow_size = sizeof(TCPFlow) > sizeof(UDPFlow) ? sizeof(TCPFlow) : sizeof(UDPFlow);
 }
 
 IPRewriter::~IPRewriter()
@@ -80,7 +81,7 @@ IPRewriter::get_entry(int ip_p, const IPFlowID &flowid, int input)
 	return TCPRewriter::get_entry(ip_p, flowid, input);
     if (ip_p != IP_PROTO_UDP)
 	return 0;
-    IPRewriterEntry *m = _udp_map.get(flowid);
+    IPRewriterEntry *m = local_shard().udp_map.get(flowid);
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
 	IPRewriterInput &is = _input_specs[input];
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
@@ -98,7 +99,8 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	return TCPRewriter::add_flow(ip_p, flowid, rewritten_flowid, input);
 
     void *data;
-    if (!(data = _udp_allocator.allocate()))
+    IPRewriterShard &shard = local_shard();
+    if (!(data = shard.allocator.allocate()))
 	return 0;
 
     IPRewriterInput *rwinput = &_input_specs[input];
@@ -106,7 +108,7 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	(rwinput, flowid, rewritten_flowid, ip_p,
 	 !!_udp_timeouts[1], click_jiffies() + relevant_timeout(_udp_timeouts));
 
-    return store_flow(flow, input, _udp_map, &reply_udp_map(rwinput));
+    return store_flow(flow, input, shard.udp_map, &reply_udp_map(rwinput, flow->shard()));
 }
 
 void
@@ -128,7 +130,8 @@ IPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    HashContainer<IPRewriterEntry> *map = (iph->ip_p == IP_PROTO_TCP ? &_map : &_udp_map);
+    IPRewriterShard &shard = local_shard();
+    HashContainer<IPRewriterEntry> *map = (iph->ip_p == IP_PROTO_TCP ? &shard.map : &shard.udp_map);
     IPRewriterEntry *m = map->get(flowid);
 
     if (!m) {			// create new mapping
@@ -150,16 +153,16 @@ IPRewriter::push(int port, Packet *p_in)
 	TCPFlow *tcpmf = static_cast<TCPFlow *>(mf);
 	tcpmf->apply(p, m->direction(), _annos);
 	if (_timeouts[1])
-	    tcpmf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	    tcpmf->change_expiry(shard.heap, true, now_j + _timeouts[1]);
 	else
-	    tcpmf->change_expiry(_heap, false, now_j + tcp_flow_timeout(tcpmf));
+	    tcpmf->change_expiry(shard.heap, false, now_j + tcp_flow_timeout(tcpmf));
     } else {
 	UDPFlow *udpmf = static_cast<UDPFlow *>(mf);
 	udpmf->apply(p, m->direction(), _annos);
 	if (_udp_timeouts[1])
-	    udpmf->change_expiry(_heap, true, now_j + _udp_timeouts[1]);
+	    udpmf->change_expiry(shard.heap, true, now_j + _udp_timeouts[1]);
 	else
-	    udpmf->change_expiry(_heap, false, now_j + udp_flow_timeout(udpmf));
+	    udpmf->change_expiry(shard.heap, false, now_j + udp_flow_timeout(udpmf));
     }
 
     output(m->output()).push(p);
@@ -171,9 +174,14 @@ IPRewriter::udp_mappings_handler(Element *e, void *)
     IPRewriter *rw = (IPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_udp_map.begin(); iter.live(); ++iter) {
-	iter->flow()->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.udp_map.begin(); iter.live(); ++iter) {
+	    iter->flow()->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
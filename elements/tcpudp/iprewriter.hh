@@ -164,6 +164,18 @@ Set the maximum number of mappings this rewriter can hold to I<capacity>.
 I<Capacity> can either be an integer or the name of another rewriter-like
 element, in which case this element will share the other element's capacity.
 
+=item SHARDS I<n>
+
+Split the flow table into I<n> shards, one per thread group.  A packet
+handled on thread I<t> uses shard I<t> mod I<n>, which that thread looks up
+and updates without locks.  Each shard gets an equal slice of the mapping
+capacity and of every pattern's port (or address) range, so reply traffic
+must be steered back to the thread that owns the rewritten port, for example
+by an RSS-style dispatcher.  Each shard's own thread reaps its expired
+mappings, and carries out the C<clear> handler.  Elements sharing a
+MAPPING_CAPACITY must use the same I<n>.  With more than one shard, the
+patterns cannot be changed at run time.  Default is 1 (a single table).
+
 =item DST_ANNO
 
 Boolean. If true, then set the destination IP address annotation on passing
@@ -229,11 +241,12 @@ class IPRewriter : public TCPRewriter { public:
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
     IPRewriterEntry *get_entry(int ip_p, const IPFlowID &flowid, int input);
-    HashContainer<IPRewriterEntry> *get_map(int mapid) {
+    using IPRewriterBase::get_map;
+    HashContainer<IPRewriterEntry> *get_map(int mapid, int shard) {
 	if (mapid == IPRewriterInput::mapid_default)
-	    return &_map;
+	    return &_shards[shard].map;
 	else if (mapid == IPRewriterInput::mapid_iprewriter_udp)
-	    return &_udp_map;
+	    return &_shards[shard].udp_map;
 	else
 	    return 0;
     }
@@ -253,8 +266,6 @@ class IPRewriter : public TCPRewriter { public:
 
   private:
 
-    Map _udp_map;
-    SizedHashAllocator<sizeof(UDPFlow)> _udp_allocator;
     uint32_t _udp_timeouts[2];
     uint32_t _udp_streaming_timeout;
 
@@ -265,9 +276,9 @@ class IPRewriter : public TCPRewriter { public:
 	    return _udp_timeouts[0];
     }
 
-    static inline Map &reply_udp_map(IPRewriterInput *rwinput) {
+    static inline Map &reply_udp_map(IPRewriterInput *rwinput, int shard) {
 	IPRewriter *x = static_cast<IPRewriter *>(rwinput->reply_element);
-	return x->_udp_map;
+	return x->_shards[shard].udp_map;
     }
     static String udp_mappings_handler(Element *e, void *user_data);
 
@@ -280,9 +291,10 @@ IPRewriter::destroy_flow(IPRewriterFlow *flow)
     if (flow->ip_p() == IP_PROTO_TCP)
 	TCPRewriter::destroy_flow(flow);
     else {
-	unmap_flow(flow, _udp_map, &reply_udp_map(flow->owner()));
+	IPRewriterShard &shard = flow_shard(flow);
+	unmap_flow(flow, shard.udp_map, &reply_udp_map(flow->owner(), flow->shard()));
 	flow->~IPRewriterFlow();
-	_udp_allocator.deallocate(flow);
+	shard.allocator.deallocate(flow);
     }
 }
 
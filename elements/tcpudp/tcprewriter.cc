@@ -236,6 +236,7 @@ TCPRewriter::TCPFlow::unparse(StringAccum &sa, bool direction, click_jiffies_t n
 
 TCPRewriter::TCPRewriter()
 {
+    _flow_size = sizeof(TCPFlow);
 }
 
 TCPRewriter::~TCPRewriter()
@@ -286,14 +287,15 @@ TCPRewriter::add_flow(int /*ip_p*/, const IPFlowID &flowid,
 		      const IPFlowID &rewritten_flowid, int input)
 {
     void *data;
-    if (!(data = _allocator.allocate()))
+    IPRewriterShard &shard = local_shard();
+    if (!(data = shard.allocator.allocate()))
 	return 0;
 
     TCPFlow *flow = new(data) TCPFlow
 	(&_input_specs[input], flowid, rewritten_flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard.map);
 }
 
 void
@@ -315,7 +317,8 @@ TCPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -335,9 +338,9 @@ TCPRewriter::push(int port, Packet *p_in)
 
     click_jiffies_t now_j = click_jiffies();
     if (_timeouts[1])
-	mf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	mf->change_expiry(shard.heap, true, now_j + _timeouts[1]);
     else
-	mf->change_expiry(_heap, false, now_j + tcp_flow_timeout(mf));
+	mf->change_expiry(shard.heap, false, now_j + tcp_flow_timeout(mf));
 
     output(m->output()).push(p);
 }
@@ -349,10 +352,15 @@ TCPRewriter::tcp_mappings_handler(Element *e, void *)
     TCPRewriter *rw = (TCPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); ++iter) {
-	TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.map.begin(); iter.live(); ++iter) {
+	    TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
@@ -372,18 +380,23 @@ TCPRewriter::tcp_lookup_handler(int, String &str, Element *e, const Handler *, E
 	.complete() < 0)
 	return -1;
 
-    HashContainer<IPRewriterEntry> *map = rw->get_map(IPRewriterInput::mapid_default);
-    if (!map)
-	return errh->error("no map!");
-
     StringAccum sa;
     IPFlowID flow(saddr, htons(sport), daddr, htons(dport));
-    if (Map::iterator iter = map->find(flow)) {
-	TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
-	const IPFlowID &flowid = f->entry(iter->direction()).rewritten_flowid();
-
-	sa << flowid.saddr() << " " << ntohs(flowid.sport()) << " "
-	   << flowid.daddr() << " " << ntohs(flowid.dport());
+    for (int s = 0; s < rw->_nshards && !sa; ++s) {
+	HashContainer<IPRewriterEntry> *map = rw->get_map(IPRewriterInput::mapid_default, s);
+	if (!map)
+	    return errh->error("no map!");
+
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	if (Map::iterator iter = map->find(flow)) {
+	    TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
+	    const IPFlowID &flowid = f->entry(iter->direction()).rewritten_flowid();
+
+	    sa << flowid.saddr() << " " << ntohs(flowid.sport()) << " "
+	       << flowid.daddr() << " " << ntohs(flowid.dport());
+	}
+	shard.lock.release();
     }
 
     str = sa.take_string();
@@ -68,6 +68,7 @@ UDPRewriter::UDPFlow::apply(WritablePacket *p, bool direction, unsigned annos)
 
 UDPRewriter::UDPRewriter()
 {
+    _flow_size = sizeof(UDPFlow);
 }
 
 UDPRewriter::~UDPRewriter()
@@ -117,14 +118,15 @@ UDPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 		      const IPFlowID &rewritten_flowid, int input)
 {
     void *data;
-    if (!(data = _allocator.allocate()))
+    IPRewriterShard &shard = local_shard();
+    if (!(data = shard.allocator.allocate()))
 	return 0;
 
     UDPFlow *flow = new(data) UDPFlow
 	(&_input_specs[input], flowid, rewritten_flowid, ip_p,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts));
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard.map);
 }
 
 void
@@ -149,7 +151,8 @@ UDPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterShard &shard = local_shard();
+    IPRewriterEntry *m = shard.map.get(flowid);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -169,9 +172,9 @@ UDPRewriter::push(int port, Packet *p_in)
 
     click_jiffies_t now_j = click_jiffies();
     if (_timeouts[1])
-	mf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	mf->change_expiry(shard.heap, true, now_j + _timeouts[1]);
     else
-	mf->change_expiry(_heap, false, now_j + udp_flow_timeout(mf));
+	mf->change_expiry(shard.heap, false, now_j + udp_flow_timeout(mf));
 
     output(m->output()).push(p);
 }
@@ -183,9 +186,14 @@ UDPRewriter::dump_mappings_handler(Element *e, void *)
     UDPRewriter *rw = (UDPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); ++iter) {
-	iter->flow()->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	IPRewriterShard &shard = rw->_shards[s];
+	shard.lock.acquire();
+	for (Map::iterator iter = shard.map.begin(); iter.live(); ++iter) {
+	    iter->flow()->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	shard.lock.release();
     }
     return sa.take_string();
 }
@@ -145,6 +145,18 @@ Set the maximum number of mappings this rewriter can hold to I<capacity>.
 I<Capacity> can either be an integer or the name of another rewriter-like
 element, in which case this element will share the other element's capacity.
 
+=item SHARDS I<n>
+
+Split the flow table into I<n> shards, one per thread group.  A packet
+handled on thread I<t> uses shard I<t> mod I<n>, which that thread looks up
+and updates without locks.  Each shard gets an equal slice of the mapping
+capacity and of every pattern's port (or address) range, so reply traffic
+must be steered back to the thread that owns the rewritten port, for example
+by an RSS-style dispatcher.  Each shard's own thread reaps its expired
+mappings, and carries out the C<clear> handler.  Elements sharing a
+MAPPING_CAPACITY must use the same I<n>.  With more than one shard, the
+patterns cannot be changed at run time.  Default is 1 (a single table).
+
 =item DST_ANNO
 
 Boolean. If true, then set the destination IP address annotation on passing
@@ -200,7 +212,6 @@ class UDPRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(UDPFlow)> _allocator;
     unsigned _annos;
     uint32_t _udp_streaming_timeout;
 
@@ -221,9 +232,10 @@ class UDPRewriter : public IPRewriterBase { public:
 inline void
 UDPRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    unmap_flow(flow, _map);
+    IPRewriterShard &shard = flow_shard(flow);
+    unmap_flow(flow, shard.map);
     flow->~IPRewriterFlow();
-    _allocator.deallocate(flow);
+    shard.allocator.deallocate(flow);
 }
 
 CLICK_ENDDECLS
@@ -0,0 +1,157 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * buckethashtabletest.{cc,hh} -- regression test element for
+ * BucketHashTable<K, V>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "buckethashtabletest.hh"
+#include <click/buckethashtable.hh>
+#include <click/hashtable.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+#include <click/algorithm.hh>
+CLICK_DECLS
+
+BucketHashTableTest::BucketHashTableTest()
+    : _benchmark(0)
+{
+}
+
+int
+BucketHashTableTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.complete();
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test %<%s%> failed", __FILE__, __LINE__, #x);
+
+// Spread keys out so that neighboring integers don't hash alike.
+static inline uint32_t
+bench_key(uint32_t i)
+{
+    return i * 2654435761U;
+}
+
+template <typename T> void
+BucketHashTableTest::benchmark(const char *name, uint32_t n,
+			       ErrorHandler *errh)
+{
+    // Look keys up in random order; probing in insertion order would
+    // favor the chained table, whose nodes are allocated sequentially.
+    Vector<uint32_t> order(n, 0);
+    for (uint32_t i = 0; i < n; ++i)
+	order[i] = i;
+    for (uint32_t i = n - 1; i > 0; --i)
+	click_swap(order[i], order[click_random(0, i)]);
+
+    T table;
+    uint32_t sum = 0;
+    Timestamp t0 = Timestamp::now_steady();
+    for (uint32_t i = 0; i < n; ++i)
+	table.set(bench_key(i), i);
+    Timestamp t1 = Timestamp::now_steady();
+    for (uint32_t i = 0; i < n; ++i)
+	sum += table.get(bench_key(order[i]));
+    Timestamp t2 = Timestamp::now_steady();
+    for (uint32_t i = 0; i < n; ++i)
+	sum += table.get(bench_key(n + order[i]));
+    Timestamp t3 = Timestamp::now_steady();
+
+    errh->message("%s %u: insert %.1f ns, hit %.1f ns, miss %.1f ns (%u)",
+		  name, n, (t1 - t0).doubleval() * 1e9 / n,
+		  (t2 - t1).doubleval() * 1e9 / n,
+		  (t3 - t2).doubleval() * 1e9 / n, sum);
+}
+
+int
+BucketHashTableTest::initialize(ErrorHandler *errh)
+{
+    {
+	BucketHashTable<String, int> h(-1);
+	CHECK(h.empty());
+	CHECK(h.get("A") == -1);
+	CHECK(h.set("A", 1));
+	CHECK(h.set("B", 2));
+	CHECK(!h.set("B", 3));
+	h["C"] = 4;
+	CHECK(h.size() == 3);
+	CHECK(h.get("A") == 1 && h.get("B") == 3 && h.get("C") == 4);
+	CHECK(h.count("B") == 1 && h.count("D") == 0);
+	CHECK(h.get_pointer("D") == 0);
+	CHECK(h.find("C").value() == 4);
+	CHECK(!h.find("D"));
+	CHECK(h.erase("B") == 1 && h.erase("B") == 0);
+	CHECK(h.size() == 2 && h.get("B") == -1);
+
+	int n = 0, total = 0;
+	for (BucketHashTable<String, int>::const_iterator it = h.begin(); it; ++it)
+	    ++n, total += it.value();
+	CHECK(n == 2 && total == 5);
+
+	BucketHashTable<String, int> h2(h);
+	h.clear();
+	CHECK(h.empty() && h.get("A") == -1);
+	CHECK(h2.size() == 2 && h2.get("C") == 4);
+    }
+
+    // Grow through several incremental resizes, checking against HashTable.
+    {
+	BucketHashTable<uint32_t, uint32_t> h;
+	HashTable<uint32_t, uint32_t> ref;
+	for (uint32_t i = 0; i < 100000; ++i) {
+	    uint32_t k = click_random(0, 200000);
+	    if (click_random(0, 3) == 0) {
+		CHECK(h.erase(k) == ref.erase(k));
+	    } else {
+		CHECK(h.set(k, i) == ref.set(k, i));
+	    }
+	    CHECK(h.size() == ref.size());
+	}
+	for (HashTable<uint32_t, uint32_t>::iterator it = ref.begin(); it; ++it)
+	    CHECK(h.get(it.key()) == it.value());
+	size_t n = 0;
+	for (BucketHashTable<uint32_t, uint32_t>::iterator it = h.begin(); it; ++it, ++n)
+	    CHECK(ref.get(it.key()) == it.value());
+	CHECK(n == h.size());
+
+	// Erasing while iterating visits every element exactly once.
+	n = 0;
+	for (BucketHashTable<uint32_t, uint32_t>::iterator it = h.begin(); it; ++n)
+	    if (it.key() & 1)
+		it = h.erase(it);
+	    else
+		++it;
+	CHECK(n == ref.size());
+	for (HashTable<uint32_t, uint32_t>::iterator it = ref.begin(); it; ++it)
+	    CHECK(h.count(it.key()) == !(it.key() & 1));
+
+	h.rehash(10);
+	for (HashTable<uint32_t, uint32_t>::iterator it = ref.begin(); it; ++it)
+	    CHECK(h.count(it.key()) == !(it.key() & 1));
+    }
+
+    errh->message("All tests pass!");
+
+    for (uint32_t n = 1000; n && n <= _benchmark; n *= 10) {
+	benchmark<HashTable<uint32_t, uint32_t> >("HashTable", n, errh);
+	benchmark<BucketHashTable<uint32_t, uint32_t> >("BucketHashTable", n, errh);
+    }
+    return 0;
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(BucketHashTableTest)
@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_BUCKETHASHTABLETEST_HH
+#define CLICK_BUCKETHASHTABLETEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+BucketHashTableTest([I<keywords> BENCHMARK])
+
+=s test
+
+runs regression tests for BucketHashTable<K, V>
+
+=d
+
+BucketHashTableTest runs BucketHashTable regression tests at initialization
+time. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Integer.  If positive, after the regression tests, time insertions, hits,
+and misses in BucketHashTable<uint32_t, uint32_t> and
+HashTable<uint32_t, uint32_t> at table sizes from 1000 up to BENCHMARK,
+growing by factors of 10, and report nanoseconds per operation.  Default is
+0 (don't benchmark).
+
+=back
+
+=a
+
+HashTableTest
+*/
+
+class BucketHashTableTest : public Element { public:
+
+    BucketHashTableTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "BucketHashTableTest"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+  private:
+
+    uint32_t _benchmark;
+
+    template <typename T> void benchmark(const char *name, uint32_t n,
+					 ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
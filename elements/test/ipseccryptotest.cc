@@ -0,0 +1,174 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipseccryptotest.{cc,hh} -- regression test element for IPsec crypto
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipseccryptotest.hh"
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include "elements/ipsec/gcm.hh"
+#include "elements/ipsec/hmac.hh"
+CLICK_DECLS
+
+IPsecCryptoTest::IPsecCryptoTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test %<%s%> failed", __FILE__, __LINE__, #x);
+
+static String
+unhex(const char *s)
+{
+    StringAccum sa;
+    for (; s[0] && s[1]; s += 2) {
+	int hi = s[0] <= '9' ? s[0] - '0' : s[0] - 'a' + 10;
+	int lo = s[1] <= '9' ? s[1] - '0' : s[1] - 'a' + 10;
+	sa << (char) ((hi << 4) | lo);
+    }
+    return sa.take_string();
+}
+
+static inline unsigned char *
+udata(String &s)
+{
+    return reinterpret_cast<unsigned char *>(s.mutable_data());
+}
+
+// Test vectors from McGrew and Viega, "The Galois/Counter Mode of Operation
+// (GCM)", test cases 1-4.
+static const struct {
+    const char *key, *iv, *pt, *aad, *ct, *tag;
+} gcm_vectors[] = {
+    { "00000000000000000000000000000000", "000000000000000000000000",
+      "", "", "", "58e2fccefa7e3061367f1d57a4e7455a" },
+    { "00000000000000000000000000000000", "000000000000000000000000",
+      "00000000000000000000000000000000", "",
+      "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+      "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255", "",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+      "4d5c2af327cd64a62cf35abd2ba6fab4" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+      "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+      "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+      "5bc94fbc3221a5db94fae95ae7121a47" }
+};
+
+static int
+gcm_vector_test(bool accelerate, ErrorHandler *errh)
+{
+    for (unsigned i = 0; i < sizeof(gcm_vectors) / sizeof(gcm_vectors[0]); ++i) {
+	String key = unhex(gcm_vectors[i].key), iv = unhex(gcm_vectors[i].iv),
+	    pt = unhex(gcm_vectors[i].pt), aad = unhex(gcm_vectors[i].aad),
+	    ct = unhex(gcm_vectors[i].ct), tag = unhex(gcm_vectors[i].tag);
+	AESGCM gcm;
+	gcm.set_key(udata(key), accelerate);
+	String data = pt;
+	unsigned char *d = udata(data), out[AESGCM::TAG_LEN];
+	gcm.seal(udata(iv), udata(aad), aad.length(), d, data.length(), out);
+	CHECK(data == ct);
+	CHECK(memcmp(out, tag.data(), AESGCM::TAG_LEN) == 0);
+	CHECK(gcm.open(udata(iv), udata(aad), aad.length(), d, data.length(), out));
+	CHECK(data == pt);
+	if (data.length()) {
+	    gcm.seal(udata(iv), udata(aad), aad.length(), d, data.length(), out);
+	    d[0] ^= 1;
+	    CHECK(!gcm.open(udata(iv), udata(aad), aad.length(), d, data.length(), out));
+	    d[0] ^= 1;
+	    CHECK(data == ct);
+	}
+    }
+    return 0;
+}
+
+// The two implementations must agree on every length, including the
+// eight-block stride and partial blocks.
+static int
+gcm_cross_test(ErrorHandler *errh)
+{
+    AESGCM sw, hw;
+    unsigned char key[AESGCM::KEY_LEN], iv[AESGCM::IV_LEN], aad[8];
+    for (int i = 0; i < AESGCM::KEY_LEN; ++i)
+	key[i] = click_random();
+    for (int i = 0; i < AESGCM::IV_LEN; ++i)
+	iv[i] = click_random();
+    for (int i = 0; i < 8; ++i)
+	aad[i] = click_random();
+    sw.set_key(key, false);
+    hw.set_key(key, true);
+    CHECK(!sw.accelerated());
+    CHECK(hw.accelerated() == AESGCM::hardware_available());
+    unsigned char a[600], b[600], ta[AESGCM::TAG_LEN], tb[AESGCM::TAG_LEN];
+    for (int len = 0; len <= 600; len += (len < 300 ? 1 : 37)) {
+	for (int i = 0; i < len; ++i)
+	    a[i] = b[i] = click_random();
+	sw.seal(iv, aad, sizeof(aad), a, len, ta);
+	hw.seal(iv, aad, sizeof(aad), b, len, tb);
+	CHECK(memcmp(a, b, len) == 0);
+	CHECK(memcmp(ta, tb, sizeof(ta)) == 0);
+	CHECK(hw.open(iv, aad, sizeof(aad), a, len, ta, 12));
+	CHECK(sw.open(iv, aad, sizeof(aad), b, len, tb, 8));
+	CHECK(memcmp(a, b, len) == 0);
+    }
+    return 0;
+}
+
+// RFC 2202 test cases 1-3
+static int
+hmac_sha1_test(ErrorHandler *errh)
+{
+    static const struct {
+	const char *key, *data, *digest;
+    } vectors[] = {
+	{ "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b", "4869205468657265",
+	  "b617318655057264e28bc0b6fb378c8ef146be00" },
+	{ "4a656665", "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+	  "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79" },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+	  "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+	  "dddddddddddddddddddddddddddddddddddd",
+	  "125d7342b9ac11cd91a39af48aa17b4f63f175d3" }
+    };
+    for (unsigned i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+	String key = unhex(vectors[i].key), data = unhex(vectors[i].data),
+	    digest = unhex(vectors[i].digest);
+	unsigned char md[SHA_DIGEST_LENGTH];
+	unsigned len = SHA_DIGEST_LENGTH;
+	HMAC(key.mutable_data(), key.length(), udata(data),
+	     data.length(), md, &len);
+	CHECK(memcmp(md, digest.data(), SHA_DIGEST_LENGTH) == 0);
+    }
+    return 0;
+}
+
+int
+IPsecCryptoTest::initialize(ErrorHandler *errh)
+{
+    if (gcm_vector_test(false, errh) < 0
+	|| gcm_vector_test(true, errh) < 0
+	|| gcm_cross_test(errh) < 0
+	|| hmac_sha1_test(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM IPsecAuthHMACSHA1)
+EXPORT_ELEMENT(IPsecCryptoTest)
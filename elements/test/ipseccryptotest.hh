@@ -0,0 +1,37 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSECCRYPTOTEST_HH
+#define CLICK_IPSECCRYPTOTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+IPsecCryptoTest()
+
+=s test
+
+runs regression tests for IPsec cryptography
+
+=d
+
+IPsecCryptoTest runs regression tests for the AES-GCM and HMAC-SHA1 code
+used by the IPsec elements at initialization time.  AES-GCM is checked
+against the test vectors from the GCM specification, and the portable and
+hardware implementations are checked against each other.  It does not route
+packets.
+
+*/
+
+class IPsecCryptoTest : public Element { public:
+
+    IPsecCryptoTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "IPsecCryptoTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
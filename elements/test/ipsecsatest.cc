@@ -0,0 +1,234 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipsecsatest.{cc,hh} -- regression test element for IPsec SAs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipsecsatest.hh"
+#include <click/error.hh>
+#include "elements/ipsec/satable.hh"
+#include "elements/ipsec/sadatatuple.hh"
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
+CLICK_DECLS
+
+IPsecSATest::IPsecSATest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test %<%s%> failed", __FILE__, __LINE__, #x);
+
+// An SA whose keys are filled with byte k, so readers can tell a valid SA.
+static SADataTuple *
+make_sa(uint8_t k, uint32_t counter = 1, uint16_t window = 64)
+{
+    uint8_t key[KEY_SIZE];
+    memset(key, k, sizeof(key));
+    return new SADataTuple(key, key, counter, window);
+}
+
+static int
+replay_test(ErrorHandler *errh)
+{
+    SADataTuple *sa = make_sa(1, 1, 64);
+
+    // in-window, duplicate and too-old
+    CHECK(sa->check_replay(0) == -2);
+    CHECK(sa->check_replay(1) == 1);
+    CHECK(sa->check_replay(1) == -1);
+    CHECK(sa->check_replay(5) == 1);
+    CHECK(sa->check_replay(3) == 1);
+    CHECK(sa->check_replay(3) == -1);
+    CHECK(sa->check_replay(5) == -1);
+
+    // far ahead: the whole ring is cleared
+    CHECK(sa->check_replay(100000) == 1);
+    CHECK(sa->check_replay(100000 - 63) == 1);
+    CHECK(sa->check_replay(100000 - 64) == -2);
+    CHECK(sa->check_replay(5) == -2);
+    CHECK(sa->check_replay(100000) == -1);
+    // 100000 - 2048 shares a ring bit with 100000 but is too old
+    CHECK(sa->check_replay(100000 - 2048) == -2);
+    // 100000 + 2048 shares a ring bit with 100000 and is new
+    CHECK(sa->check_replay(100000 + 2048) == 1);
+    CHECK(sa->check_replay(100000 + 2048) == -1);
+
+    // replaying the first sequence number does not reset the window
+    CHECK(sa->check_replay(1) == -2);
+    CHECK(sa->check_replay(100000 + 2048) == -1);
+    delete sa;
+
+    // in-order traffic across the 32 x 64-bit ring boundary, with the
+    // largest window
+    sa = make_sa(2, 1, SADataTuple::MAX_REPLAY_WINDOW);
+    for (uint32_t seq = 1; seq < 2048; ++seq)
+	CHECK(sa->check_replay(seq) == 1);
+    // 2048 maps to word 0, which still holds 1..63
+    CHECK(sa->check_replay(2048) == 1);
+    CHECK(sa->check_replay(2048) == -1);
+    CHECK(sa->check_replay(2047) == -1);
+    CHECK(sa->check_replay(2048 - 1023) == -1);
+    CHECK(sa->check_replay(2048 - 1024) == -2);
+    // skip ahead within the ring: skipped sequence numbers are new, even
+    // though their ring bits were set on the previous lap
+    CHECK(sa->check_replay(2048 + 700) == 1);
+    for (uint32_t seq = 2049; seq < 2048 + 700; ++seq)
+	CHECK(sa->check_replay(seq) == 1);
+    for (uint32_t seq = 2048 + 700 - 1023; seq <= 2048 + 700; ++seq)
+	CHECK(sa->check_replay(seq) == -1);
+    // out of order within the window, across the boundary again
+    CHECK(sa->check_replay(4096 + 10) == 1);
+    CHECK(sa->check_replay(4096 - 10) == 1);
+    CHECK(sa->check_replay(4096) == 1);
+    CHECK(sa->check_replay(4096 - 10) == -1);
+    CHECK(sa->check_replay(4096 + 10 - 1024) == -2);
+    delete sa;
+    return 0;
+}
+
+static int
+sequence_test(ErrorHandler *errh)
+{
+    SADataTuple *sa = make_sa(3, 5);
+    CHECK(sa->next_sequence() == 5);
+    CHECK(sa->next_sequence() == 6);
+    // rollover restarts at the start value and never sends 0
+    sa->cur_rpl = 0xFFFFFFFFU;
+    CHECK(sa->next_sequence() == 0xFFFFFFFFU);
+    CHECK(sa->next_sequence() == 5);
+    CHECK(sa->next_sequence() == 6);
+    delete sa;
+
+    // a start value of 0 becomes 1
+    sa = make_sa(3, 0);
+    CHECK(sa->next_sequence() == 1);
+    CHECK(sa->check_replay(1) == 1);
+    delete sa;
+    return 0;
+}
+
+static int
+table_test(ErrorHandler *errh)
+{
+    SATable *t = new SATable;
+    SADataTuple *a = make_sa(10), *b = make_sa(11);
+    CHECK(t->lookup(SPI(7)) == 0);
+    CHECK(t->insert(SPI(7), a) == 0);
+    CHECK(t->lookup(SPI(7)) == a);
+    CHECK(t->size() == 1);
+
+    // replacing keeps the old SA alive for packets that hold it
+    a->use();
+    CHECK(t->insert(SPI(7), b) == 0);
+    CHECK(t->lookup(SPI(7)) == b);
+    CHECK(t->size() == 1);
+    CHECK(a->Encryption_key[0] == 10 && a->Authentication_key[KEY_SIZE - 1] == 10);
+
+    for (uint32_t spi = 100; spi < 400; ++spi)
+	CHECK(t->insert(SPI(spi), make_sa(spi)) == 0);
+    CHECK(t->size() == 301);
+    for (uint32_t spi = 100; spi < 400; ++spi) {
+	SADataTuple *sa = t->lookup(SPI(spi));
+	CHECK(sa && sa->Encryption_key[0] == (uint8_t) spi);
+    }
+    for (uint32_t spi = 100; spi < 400; spi += 2)
+	CHECK(t->remove(spi) == 0);
+    CHECK(t->size() == 151);
+    for (uint32_t spi = 100; spi < 400; ++spi)
+	CHECK((t->lookup(SPI(spi)) != 0) == (spi % 2 == 1));
+
+    CHECK(t->remove(7) == 0);
+    CHECK(t->lookup(SPI(7)) == 0);
+    CHECK(b->Encryption_key[0] == 11);
+    delete t;
+    CHECK(a->refcount.value() == 1 && a->Encryption_key[0] == 10);
+    a->unuse();
+    return 0;
+}
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+namespace {
+struct LookupThread {
+    SATable *table;
+    volatile bool stop;
+    unsigned lookups;
+    unsigned found;
+    unsigned bad;
+};
+}
+
+static void *
+lookup_thread(void *arg)
+{
+    LookupThread *lt = static_cast<LookupThread *>(arg);
+    while (!lt->stop) {
+	for (uint32_t spi = 7; spi <= 8; ++spi) {
+	    ++lt->lookups;
+	    if (SADataTuple *sa = lt->table->lookup(SPI(spi))) {
+		++lt->found;
+		uint8_t k = sa->Encryption_key[0];
+		if (k == 0 || sa->Authentication_key[KEY_SIZE - 1] != k)
+		    ++lt->bad;
+	    }
+	}
+    }
+    return 0;
+}
+
+// Replace and remove SAs while another thread looks them up.
+static int
+concurrent_test(ErrorHandler *errh)
+{
+    LookupThread lt;
+    lt.table = new SATable;
+    lt.stop = false;
+    lt.lookups = lt.found = lt.bad = 0;
+    CHECK(lt.table->insert(SPI(7), make_sa(1)) == 0);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, 0, lookup_thread, &lt) == 0);
+    for (int i = 0; i < 20000; ++i) {
+	lt.table->insert(SPI(7), make_sa(1 + i % 255));
+	if (i % 2)
+	    lt.table->remove(8);
+	else
+	    lt.table->insert(SPI(8), make_sa(1 + i % 251));
+	CHECK(lt.table->lookup(SPI(7))->Encryption_key[0] == 1 + i % 255);
+    }
+    lt.stop = true;
+    pthread_join(thread, 0);
+    CHECK(lt.bad == 0);
+    CHECK(lt.found >= lt.lookups / 2);
+    delete lt.table;
+    return 0;
+}
+#endif
+
+int
+IPsecSATest::initialize(ErrorHandler *errh)
+{
+    if (replay_test(errh) < 0
+	|| sequence_test(errh) < 0
+	|| table_test(errh) < 0)
+	return -1;
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    if (concurrent_test(errh) < 0)
+	return -1;
+#endif
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(SATable)
+EXPORT_ELEMENT(IPsecSATest)
@@ -0,0 +1,39 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSECSATEST_HH
+#define CLICK_IPSECSATEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+IPsecSATest()
+
+=s test
+
+runs regression tests for IPsec security associations
+
+=d
+
+IPsecSATest runs regression tests for SADataTuple and SATable at
+initialization time.  It checks the anti-replay window with in-window,
+duplicate, too-old and far-ahead sequence numbers, including wraps at the
+replay ring's boundary; outbound sequence number rollover; and SATable
+insertion, replacement and removal.  At user level with multithreading, a
+second thread looks SAs up while the first replaces and removes them.  It
+does not route packets.
+
+*/
+
+class IPsecSATest : public Element { public:
+
+    IPsecSATest() CLICK_COLD;
+
+    const char *class_name() const		{ return "IPsecSATest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
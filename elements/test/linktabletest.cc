@@ -0,0 +1,266 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * linktabletest.{cc,hh} -- check and time LinkTable route computation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "linktabletest.hh"
+#include <click/algorithm.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/heap.hh>
+#include <click/straccum.hh>
+#include <click/userutils.hh>
+#include <elements/wifi/linktable.hh>
+CLICK_DECLS
+
+LinkTableTest::LinkTableTest()
+    : _lt(0), _nnodes(100), _degree(4), _nchanges(1000), _check_interval(1),
+      _seq(0), _nchecks(0)
+{
+}
+
+int
+LinkTableTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *e;
+    if (Args(conf, this, errh)
+	.read_mp("TABLE", e)
+	.read("NODES", _nnodes)
+	.read("DEGREE", _degree)
+	.read("CHANGES", _nchanges)
+	.read("TRACE", FilenameArg(), _trace)
+	.read("CHECK_INTERVAL", _check_interval)
+	.complete() < 0)
+	return -1;
+    if (!(_lt = (LinkTable *) e->cast("LinkTable")))
+	return errh->error("TABLE must be a LinkTable");
+    if (_nnodes < 2 || _degree < 1 || _check_interval < 1)
+	return errh->error("bad NODES, DEGREE, or CHECK_INTERVAL");
+    return 0;
+}
+
+int
+LinkTableTest::node(IPAddress ip)
+{
+    if (int *x = _index.findp(ip))
+	return *x;
+    _index.insert(ip, _ip.size());
+    _ip.push_back(ip);
+    _out.push_back(Vector<Adjacent>());
+    _in.push_back(Vector<Adjacent>());
+    return _ip.size() - 1;
+}
+
+static bool
+set_metric(Vector<LinkTableTest::Adjacent> &v, int node, uint32_t metric)
+{
+    for (int i = 0; i < v.size(); ++i)
+	if (v[i].node == node) {
+	    v[i].metric = metric;
+	    return false;
+	}
+    LinkTableTest::Adjacent a = { node, metric };
+    v.push_back(a);
+    return true;
+}
+
+int
+LinkTableTest::change(int from, int to, uint32_t metric, ErrorHandler *errh)
+{
+    if (set_metric(_out[from], to, metric))
+	_links.push_back(make_pair(from, to));
+    set_metric(_in[to], from, metric);
+    _lt->update_link(_ip[from], _ip[to], ++_seq, 0, metric);
+
+    Timestamp t0 = Timestamp::now();
+    _lt->dijkstra(true);
+    _lt->dijkstra(false);
+    _incremental_time += Timestamp::now() - t0;
+
+    if (_seq % _check_interval == 0)
+	return check(errh);
+    return 0;
+}
+
+namespace {
+struct dist_less {
+    bool operator()(const Pair<uint32_t, int> &a,
+		    const Pair<uint32_t, int> &b) const {
+	return a.first < b.first;
+    }
+};
+}
+
+void
+LinkTableTest::shortest_paths(bool from_me, Vector<uint32_t> &dist)
+{
+    dist.assign(_ip.size(), 0xFFFFFFFFU);
+    Vector<Pair<uint32_t, int> > heap;
+    dist_less less;
+    dist[0] = 0;
+    heap.push_back(make_pair(0U, 0));
+    while (heap.size()) {
+	pop_heap(heap.begin(), heap.end(), less);
+	Pair<uint32_t, int> x = heap.back();
+	heap.pop_back();
+	if (x.first != dist[x.second])
+	    continue;
+	const Vector<Adjacent> &next = from_me ? _out[x.second] : _in[x.second];
+	for (int i = 0; i < next.size(); ++i)
+	    if (x.first + next[i].metric < dist[next[i].node]) {
+		dist[next[i].node] = x.first + next[i].metric;
+		heap.push_back(make_pair(dist[next[i].node], next[i].node));
+		push_heap(heap.begin(), heap.end(), less);
+	    }
+    }
+}
+
+int
+LinkTableTest::check(ErrorHandler *errh)
+{
+    Vector<uint32_t> dist[2];
+    Timestamp t0 = Timestamp::now();
+    shortest_paths(true, dist[0]);
+    shortest_paths(false, dist[1]);
+    _full_time += Timestamp::now() - t0;
+    ++_nchecks;
+
+    for (int dir = 0; dir < 2; ++dir)
+	for (int v = 1; v < _ip.size(); ++v) {
+	    uint32_t want = (dist[dir][v] == 0xFFFFFFFFU ? 0 : dist[dir][v]);
+	    uint32_t got = dir ? _lt->get_host_metric_to_me(_ip[v])
+		: _lt->get_host_metric_from_me(_ip[v]);
+	    if (got != want)
+		return errh->error("change %u: %s metric %s %s is %u, expected %u", _seq, _ip[v].unparse().c_str(), dir ? "to" : "from", _ip[0].unparse().c_str(), got, want);
+	    if (want) {
+		Vector<IPAddress> route = _lt->best_route(_ip[v], !dir);
+		if (route.size() < 2
+		    || route[0] != (dir ? _ip[v] : _ip[0])
+		    || route.back() != (dir ? _ip[0] : _ip[v])
+		    || _lt->get_route_metric(route) != want)
+		    return errh->error("change %u: bad route %s %s %s", _seq, dir ? "to" : "from", _ip[0].unparse().c_str(), _ip[v].unparse().c_str());
+	    }
+	}
+    return 0;
+}
+
+int
+LinkTableTest::replay_trace(ErrorHandler *errh)
+{
+    String text = file_string(_trace, errh);
+    if (!text)
+	return -1;
+    int lineno = 0;
+    for (const char *s = text.begin(); s != text.end(); ) {
+	const char *eol = find(s, text.end(), '\n');
+	String line = cp_uncomment(text.substring(s, eol));
+	s = (eol == text.end() ? eol : eol + 1);
+	++lineno;
+	if (!line)
+	    continue;
+	IPAddress from, to;
+	uint32_t metric;
+	if (Args(this, errh).push_back_words(line)
+	    .read_mp("FROM", from)
+	    .read_mp("TO", to)
+	    .read_mp("METRIC", metric)
+	    .complete() < 0 || !from || !to || !metric)
+	    return errh->error("%s:%d: expected %<FROM TO METRIC%>", _trace.c_str(), lineno);
+	if (change(node(from), node(to), metric, errh) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int
+LinkTableTest::random_changes(ErrorHandler *errh)
+{
+    for (int i = 1; i < _nnodes; ++i)
+	node(IPAddress(htonl(ntohl(_ip[0].addr()) + i)));
+
+    for (int i = 0; i < _nnodes; ++i)
+	for (int j = 0; j < _degree; ++j) {
+	    int to = click_random(0, _nnodes - 2);
+	    if (change(i, to + (to >= i), click_random(100, 5000), errh) < 0)
+		return -1;
+	}
+
+    for (int n = 0; n < _nchanges; ++n) {
+	int r = click_random(0, 9);
+	int from, to;
+	uint32_t metric;
+	if (r == 0) {
+	    from = click_random(0, _nnodes - 1);
+	    to = click_random(0, _nnodes - 2);
+	    to += (to >= from);
+	    metric = click_random(100, 5000);
+	} else {
+	    Pair<int, int> l = _links[click_random(0, _links.size() - 1)];
+	    from = l.first;
+	    to = l.second;
+	    metric = _lt->get_link_metric(_ip[from], _ip[to]);
+	    if (r == 1)
+		metric *= 20;
+	    else
+		metric = metric * click_random(50, 200) / 100;
+	    metric = (metric < 1 ? 1 : (metric > 1000000 ? 1000000 : metric));
+	}
+	if (change(from, to, metric, errh) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int
+LinkTableTest::initialize(ErrorHandler *errh)
+{
+    Vector<IPAddress> hosts = _lt->get_hosts();
+    if (hosts.size() != 1)
+	return errh->error("TABLE must start empty");
+    node(hosts[0]);
+
+    if ((_trace ? replay_trace(errh) : random_changes(errh)) < 0)
+	return -1;
+    if (_seq % _check_interval && check(errh) < 0)
+	return -1;
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+String
+LinkTableTest::read_handler(Element *e, void *thunk)
+{
+    LinkTableTest *ltt = static_cast<LinkTableTest *>(e);
+    switch ((uintptr_t) thunk) {
+    case 0:
+	return ltt->_incremental_time.unparse();
+    case 1:
+	return ltt->_full_time.unparse();
+    default:
+	return String(ltt->_nchecks);
+    }
+}
+
+void
+LinkTableTest::add_handlers()
+{
+    add_read_handler("incremental_time", read_handler, 0);
+    add_read_handler("full_time", read_handler, 1);
+    add_read_handler("checks", read_handler, 2);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel LinkTable)
+EXPORT_ELEMENT(LinkTableTest)
@@ -0,0 +1,125 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_LINKTABLETEST_HH
+#define CLICK_LINKTABLETEST_HH
+#include <click/element.hh>
+#include <click/hashmap.hh>
+#include <click/ipaddress.hh>
+#include <click/pair.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+class LinkTable;
+
+/*
+=c
+
+LinkTableTest(TABLE, I<keywords>)
+
+=s test
+
+checks and times LinkTable's incremental route computation
+
+=d
+
+LinkTableTest feeds a sequence of link metric changes to TABLE, an empty
+LinkTable, at initialization time.  After each change it calls TABLE's
+dijkstra() in both directions, and every CHECK_INTERVAL changes it checks
+each host's metric and best route against a full shortest-path computation
+of its own.  It does not route packets.
+
+By default the changes are random: a mesh of NODES hosts, each with DEGREE
+links to random neighbors, followed by CHANGES updates that mostly scale an
+existing link's metric up or down, and sometimes add a link or make one
+very expensive.  Alternatively, TRACE names a file of changes to replay,
+one "FROM TO METRIC" line per change.
+
+Keyword arguments are:
+
+=over 8
+
+=item NODES
+
+Integer.  Number of hosts in the random mesh.  Default is 100.
+
+=item DEGREE
+
+Integer.  Links per host in the random mesh.  Default is 4.
+
+=item CHANGES
+
+Integer.  Number of random changes after the mesh is built.  Default is
+1000.
+
+=item TRACE
+
+Filename.  Replay this trace instead of generating random changes.
+
+=item CHECK_INTERVAL
+
+Integer.  Check routes after every CHECK_INTERVAL changes.  Default is 1.
+
+=back
+
+=h incremental_time read-only
+
+Returns the total time TABLE spent in dijkstra().
+
+=h full_time read-only
+
+Returns the total time LinkTableTest spent computing routes from scratch.
+
+=h checks read-only
+
+Returns the number of full computations LinkTableTest compared against.
+
+=a LinkTable
+
+*/
+
+class LinkTableTest : public Element { public:
+
+    LinkTableTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "LinkTableTest"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    struct Adjacent {
+	int node;
+	uint32_t metric;
+    };
+
+  private:
+
+    LinkTable *_lt;
+    int _nnodes;
+    int _degree;
+    int _nchanges;
+    String _trace;
+    int _check_interval;
+
+    HashMap<IPAddress, int> _index;
+    Vector<IPAddress> _ip;
+    Vector<Vector<Adjacent> > _out;
+    Vector<Vector<Adjacent> > _in;
+    Vector<Pair<int, int> > _links;
+    uint32_t _seq;
+
+    Timestamp _incremental_time;
+    Timestamp _full_time;
+    int _nchecks;
+
+    int node(IPAddress ip);
+    int change(int from, int to, uint32_t metric, ErrorHandler *errh);
+    void shortest_paths(bool from_me, Vector<uint32_t> &dist);
+    int check(ErrorHandler *errh);
+    int replay_trace(ErrorHandler *errh);
+    int random_changes(ErrorHandler *errh);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
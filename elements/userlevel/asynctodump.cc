@@ -0,0 +1,448 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * asynctodump.{cc,hh} -- element writes packets to tcpdump-like file from a
+ * dedicated writer thread
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include "asynctodump.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/machine.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/packet_anno.hh>
+#include "fakepcap.hh"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+CLICK_DECLS
+
+AsyncToDump::AsyncToDump()
+    : _ring(0), _tail(0), _thread_started(false), _running(false),
+      _active(false), _fd(-1), _buf(0), _buflen(0), _file_bytes(0),
+      _nfiles(0), _task(this)
+{
+    _head = 0;
+    _drops = 0;
+    _count = 0;
+    _bytes = 0;
+}
+
+AsyncToDump::~AsyncToDump()
+{
+}
+
+int
+AsyncToDump::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String encap_type;
+    _snaplen = 2000;
+    _extra_length = true;
+    _nano = Timestamp::subsec_per_sec == Timestamp::nsec_per_sec;
+    _capacity = 65536;
+    _bufsize = 1 << 20;
+    _rotate_size = 0;
+    _rotate_interval = Timestamp();
+
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read_p("SNAPLEN", _snaplen)
+	.read_p("ENCAP", WordArg(), encap_type)
+	.read("EXTRA_LENGTH", _extra_length)
+	.read("NANO", _nano)
+	.read("CAPACITY", _capacity)
+	.read("BUFFER", _bufsize)
+	.read("ROTATE_SIZE", _rotate_size)
+	.read("ROTATE_INTERVAL", _rotate_interval)
+	.complete() < 0)
+	return -1;
+
+    if (_snaplen == 0)
+	_snaplen = 0xFFFFFFFFU;
+    if (!encap_type)
+	_linktype = FAKE_DLT_EN10MB;
+    else if ((_linktype = fake_pcap_parse_dlt(encap_type)) < 0)
+	return errh->error("bad encapsulation type");
+    if (_capacity < 2 || _capacity > 0x40000000U)
+	return errh->error("CAPACITY out of range");
+    if (_bufsize < 65536)
+	return errh->error("BUFFER must be at least 65536");
+    if (_filename == "-" && (_rotate_size || _rotate_interval))
+	return errh->error("cannot rotate the standard output");
+
+    // round up to a power of two so slot lookup is a mask
+    uint32_t cap = 2;
+    while (cap < _capacity)
+	cap <<= 1;
+    _capacity = cap;
+    _mask = cap - 1;
+    return 0;
+}
+
+int
+AsyncToDump::open_file(ErrorHandler *errh)
+{
+    String name;
+    if (_filename == "-") {
+	_fd = STDOUT_FILENO;
+	name = "<stdout>";
+    } else {
+	if (_rotate_size || _rotate_interval)
+	    name = _filename + "." + String(_nfiles);
+	else
+	    name = _filename;
+	_fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (_fd < 0) {
+	    if (errh)
+		return errh->error("%s: %s", name.c_str(), strerror(errno));
+	    click_chatter("%p{element}: %s: %s", this, name.c_str(), strerror(errno));
+	    return -1;
+	}
+    }
+
+    _name_lock.acquire();
+    _cur_filename = name;
+    _name_lock.release();
+    ++_nfiles;
+
+    struct fake_pcap_file_header h;
+    h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
+    h.version_major = FAKE_PCAP_VERSION_MAJOR;
+    h.version_minor = FAKE_PCAP_VERSION_MINOR;
+    h.thiszone = 0;		// timestamps are in GMT
+    h.sigfigs = 0;
+    h.snaplen = _snaplen;
+    h.linktype = _linktype;
+
+    assert(_buflen == 0);
+    memcpy(_buf, &h, sizeof(h));
+    _buflen = sizeof(h);
+    _bytes += sizeof(h);
+    _file_bytes = sizeof(h);
+    _file_opened = Timestamp::now_steady();
+    return 0;
+}
+
+int
+AsyncToDump::initialize(ErrorHandler *errh)
+{
+    _ring = new Slot[_capacity];
+    if (posix_memalign((void **) &_buf, 4096, _bufsize) != 0)
+	_buf = 0;
+    if (!_ring || !_buf)
+	return errh->error("out of memory");
+    for (uint32_t i = 0; i < _capacity; ++i)
+	_ring[i].seq = i;
+
+    if (open_file(errh) < 0)
+	return -1;
+
+    _running = _active = true;
+    if (int err = pthread_create(&_thread, 0, writer_thread, this)) {
+	_running = _active = false;
+	return errh->error("cannot create writer thread: %s", strerror(err));
+    }
+    _thread_started = true;
+
+    if (input_is_pull(0) && noutputs() == 0) {
+	ScheduleInfo::join_scheduler(this, &_task, errh);
+	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    }
+    return 0;
+}
+
+void
+AsyncToDump::cleanup(CleanupStage)
+{
+    // The writer thread drains the ring and flushes before it exits.
+    _active = false;
+    if (_thread_started) {
+	_running = false;
+	pthread_join(_thread, 0);
+	_thread_started = false;
+    }
+    if (_fd >= 0 && _fd != STDOUT_FILENO)
+	close(_fd);
+    _fd = -1;
+    delete[] _ring;
+    _ring = 0;
+    free(_buf);
+    _buf = 0;
+}
+
+inline void
+AsyncToDump::enqueue(Packet *p)
+{
+    uint32_t len = p->length() + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+    if (p->length() > _snaplen)
+	p->take(p->length() - _snaplen);
+    Timestamp ts = p->timestamp_anno();
+    if (!ts)
+	ts = Timestamp::now();
+
+    // Bounded multi-producer ring: a slot is free for position pos when its
+    // sequence number equals pos, and holds a record when it equals pos + 1.
+    uint32_t pos = _head;
+    Slot *s;
+    while (1) {
+	s = &_ring[pos & _mask];
+	int32_t dif = (int32_t) (s->seq - pos);
+	if (dif == 0) {
+	    uint32_t actual = _head.compare_swap(pos, pos + 1);
+	    if (actual == pos)
+		break;
+	    pos = actual;
+	} else if (dif < 0) {
+	    ++_drops;
+	    p->kill();
+	    return;
+	} else
+	    pos = _head;
+    }
+
+    s->p = p;
+    s->len = len;
+    s->ts = ts;
+    click_write_fence();
+    s->seq = pos + 1;
+}
+
+void
+AsyncToDump::push(int, Packet *p)
+{
+    if (!_active)
+	checked_output_push(0, p);
+    else if (noutputs() == 0)
+	enqueue(p);
+    else {
+	if (Packet *q = p->clone())
+	    enqueue(q);
+	else
+	    ++_drops;
+	output(0).push(p);
+    }
+}
+
+Packet *
+AsyncToDump::pull(int)
+{
+    Packet *p = input(0).pull();
+    if (p && _active) {
+	if (Packet *q = p->clone())
+	    enqueue(q);
+	else
+	    ++_drops;
+    }
+    return p;
+}
+
+bool
+AsyncToDump::run_task(Task *)
+{
+    if (!_active)
+	return false;
+    int n;
+    for (n = 0; n < 32; ++n) {
+	Packet *p = input(0).pull();
+	if (!p)
+	    break;
+	enqueue(p);
+    }
+    if (n || _signal)
+	_task.fast_reschedule();
+    return n != 0;
+}
+
+void
+AsyncToDump::fail(const char *what)
+{
+    click_chatter("%p{element}: %s: %s", this, what, strerror(errno));
+    _active = false;
+    if (_fd >= 0 && _fd != STDOUT_FILENO)
+	close(_fd);
+    _fd = -1;
+    _buflen = 0;
+}
+
+bool
+AsyncToDump::flush()
+{
+    uint32_t off = 0;
+    while (off < _buflen) {
+	ssize_t w = write(_fd, _buf + off, _buflen - off);
+	if (w < 0 && errno != EINTR) {
+	    fail("write");
+	    return false;
+	} else if (w > 0)
+	    off += w;
+    }
+    _buflen = 0;
+    return true;
+}
+
+bool
+AsyncToDump::drain()
+{
+    bool any = false;
+    uint32_t hdrlen = sizeof(fake_pcap_pkthdr);
+
+    while (1) {
+	Slot *s = &_ring[_tail & _mask];
+	if (s->seq != _tail + 1)
+	    break;
+	click_read_fence();
+	Packet *p = s->p;
+	uint32_t caplen = p->length();
+	uint32_t need = hdrlen + caplen;
+
+	if (_fd >= 0 && _rotate_size && _file_bytes + need > _rotate_size
+	    && _file_bytes > sizeof(fake_pcap_file_header)) {
+	    if (flush()) {
+		close(_fd);
+		open_file(0);
+	    }
+	}
+
+	if (_fd >= 0) {
+	    if (_buflen + need > _bufsize)
+		flush();
+	    if (_fd >= 0) {
+		fake_pcap_pkthdr ph;
+		ph.ts.tv.tv_sec = s->ts.sec();
+		ph.ts.tv.tv_usec = _nano ? s->ts.nsec() : s->ts.usec();
+		ph.caplen = caplen;
+		ph.len = s->len;
+		if (need <= _bufsize) {
+		    memcpy(_buf + _buflen, &ph, hdrlen);
+		    memcpy(_buf + _buflen + hdrlen, p->data(), caplen);
+		    _buflen += need;
+		} else {
+		    // record larger than the staging buffer: write through
+		    memcpy(_buf, &ph, hdrlen);
+		    _buflen = hdrlen;
+		    if (flush()) {
+			ssize_t w;
+			uint32_t off = 0;
+			while (off < caplen
+			       && ((w = write(_fd, p->data() + off, caplen - off)) > 0
+				   || (w < 0 && errno == EINTR)))
+			    if (w > 0)
+				off += w;
+			if (off < caplen)
+			    fail("write");
+		    }
+		}
+		_file_bytes += need;
+		_bytes += need;
+		++_count;
+	    }
+	}
+
+	p->kill();
+	// finish with the slot before handing it back to producers
+	click_fence();
+	s->seq = _tail + _capacity;
+	++_tail;
+	any = true;
+    }
+    return any;
+}
+
+void *
+AsyncToDump::writer_thread(void *arg)
+{
+    AsyncToDump *td = static_cast<AsyncToDump *>(arg);
+    while (1) {
+	bool running = td->_running;
+	if (td->_fd >= 0 && td->_rotate_interval
+	    && td->_file_bytes > sizeof(fake_pcap_file_header)
+	    && Timestamp::now_steady() - td->_file_opened >= td->_rotate_interval) {
+	    if (td->flush()) {
+		close(td->_fd);
+		td->open_file(0);
+	    }
+	}
+	bool any = td->drain();
+	if (!any) {
+	    // The ring is dry: push what we have to the kernel and nap.
+	    if (td->_buflen && td->_fd >= 0)
+		td->flush();
+	    if (!running)
+		break;
+	    struct timespec ts = { 0, 200000 };
+	    nanosleep(&ts, 0);
+	}
+    }
+    return 0;
+}
+
+enum { h_count, h_drops, h_bytes, h_queue, h_files, h_filename, h_reset };
+
+String
+AsyncToDump::read_handler(Element *e, void *thunk)
+{
+    AsyncToDump *td = static_cast<AsyncToDump *>(e);
+    switch ((uintptr_t) thunk) {
+    case h_count:
+	return String(td->_count.value());
+    case h_drops:
+	return String(td->_drops.value());
+    case h_bytes:
+	return String(td->_bytes.value());
+    case h_queue: {
+	uint32_t head = td->_head, tail = td->_tail;
+	return String(head - tail);
+    }
+    case h_files:
+	return String(td->_nfiles);
+    case h_filename: {
+	td->_name_lock.acquire();
+	String s = td->_cur_filename;
+	td->_name_lock.release();
+	return s;
+    }
+    default:
+	return "<error>";
+    }
+}
+
+int
+AsyncToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    AsyncToDump *td = static_cast<AsyncToDump *>(e);
+    td->_count = 0;
+    td->_bytes = 0;
+    td->_drops = 0;
+    return 0;
+}
+
+void
+AsyncToDump::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("bytes", read_handler, h_bytes);
+    add_read_handler("queue", read_handler, h_queue);
+    add_read_handler("files", read_handler, h_files);
+    add_read_handler("filename", read_handler, h_filename);
+    add_write_handler("reset_counts", write_handler, h_reset, Handler::BUTTON);
+    if (input_is_pull(0) && noutputs() == 0)
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel umultithread FakePcap)
+EXPORT_ELEMENT(AsyncToDump)
+ELEMENT_MT_SAFE(AsyncToDump)
@@ -0,0 +1,215 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_ASYNCTODUMP_HH
+#define CLICK_ASYNCTODUMP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <pthread.h>
+CLICK_DECLS
+
+/*
+=c
+
+AsyncToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, EXTRA_LENGTH, NANO, CAPACITY, BUFFER, ROTATE_SIZE, ROTATE_INTERVAL])
+
+=s traces
+
+writes packets to a tcpdump file from a separate thread
+
+=d
+
+Writes incoming packets to FILENAME in `tcpdump -w' format, like ToDump, but
+without doing file I/O on the thread that handles packets.  ToDump writes
+each packet with stdio as it arrives.  A slow disk therefore stalls the
+forwarding path.  AsyncToDump instead truncates each packet to SNAPLEN,
+timestamps it, and places a reference to it in a lock-free ring.  A
+dedicated writer thread drains the ring.  It copies records into a
+page-aligned staging buffer of BUFFER bytes, writes the buffer out with one
+system call when it fills or when the ring runs dry, and then frees the
+packets.  Any number of Click threads may push to AsyncToDump at once.
+
+If the ring is full, the packet is not recorded, and the C<drops> counter is
+incremented.  The packet is still emitted on the output.  Capture never
+back-pressures the data path.
+
+If AsyncToDump has an output, it emits every received packet on that output,
+and queues a clone for the writer thread.  Clones share packet data, so
+elements downstream that modify the packet copy it first.  Without an output,
+AsyncToDump queues the packet itself.  It schedules itself on the task list
+if it is used as a pull element with no outputs.
+
+With ROTATE_SIZE or ROTATE_INTERVAL, output is split across files
+FILENAME.0, FILENAME.1, and so on, each with its own file header.
+
+Keyword arguments are:
+
+=over 8
+
+=item SNAPLEN
+
+Integer.  Writes at most SNAPLEN bytes of each packet.  Truncation happens
+when the packet is queued.  Zero means no limit.  Default is 2000.
+
+=item ENCAP
+
+The encapsulation type to store in the dump, as for ToDump.  Default is
+C<ETHER>.
+
+=item EXTRA_LENGTH
+
+Boolean.  Set to true to store any extra length recorded in packets' extra
+length annotations.  Default is true.
+
+=item NANO
+
+Boolean.  Set to true to write nanosecond-precision timestamps.  Default
+depends on the timestamp precision Click was built with.
+
+=item CAPACITY
+
+Integer.  Number of packets the ring can hold, rounded up to a power of two.
+Default is 65536.
+
+=item BUFFER
+
+Integer.  Size of the writer thread's staging buffer in bytes.  Default is
+1 MB.
+
+=item ROTATE_SIZE
+
+Integer.  Start a new file before one would exceed this many bytes.  Zero
+means no limit.  Default is 0.
+
+=item ROTATE_INTERVAL
+
+Time.  Start a new file after this much time.  Zero means never.  Default is
+0.
+
+=back
+
+This element is only available at user level, with multithreading support.
+
+=h count read-only
+
+Returns the number of packets written.
+
+=h drops read-only
+
+Returns the number of packets not recorded because the ring was full.
+
+=h bytes read-only
+
+Returns the number of bytes written, across all files.
+
+=h queue read-only
+
+Returns the number of packets waiting in the ring.
+
+=h files read-only
+
+Returns the number of files opened.
+
+=h filename read-only
+
+Returns the name of the file currently being written.
+
+=h reset_counts write-only
+
+Resets "count", "drops", and "bytes" to 0.
+
+=e
+
+Record traffic to 100 MB files without slowing down forwarding:
+
+  ... -> AsyncToDump(/var/tmp/capture.pcap, SNAPLEN 128, ROTATE_SIZE 100000000) -> ...
+
+=a
+
+ToDump, FromDump, ReplayDump, tcpdump(1) */
+
+class AsyncToDump : public Element { public:
+
+    AsyncToDump() CLICK_COLD;
+    ~AsyncToDump() CLICK_COLD;
+
+    const char *class_name() const	{ return "AsyncToDump"; }
+    const char *port_count() const	{ return "1/0-1"; }
+    const char *flags() const		{ return "S2"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    Packet *pull(int);
+    bool run_task(Task *);
+
+  private:
+
+    struct Slot {
+	volatile uint32_t seq;
+	uint32_t len;		// original length, including extra length
+	Packet *p;
+	Timestamp ts;
+    };
+
+    Slot *_ring;
+    uint32_t _capacity;
+    uint32_t _mask;
+    atomic_uint32_t _head;	// next slot to fill
+    uint32_t _tail;		// next slot to drain; writer thread only
+
+    String _filename;
+    unsigned _snaplen;
+    int _linktype;
+    bool _extra_length;
+    bool _nano;
+    uint32_t _bufsize;
+    uint64_t _rotate_size;
+    Timestamp _rotate_interval;
+
+    pthread_t _thread;
+    bool _thread_started;
+    volatile bool _running;
+    volatile bool _active;
+
+    // writer thread state
+    int _fd;
+    unsigned char *_buf;
+    uint32_t _buflen;
+    uint64_t _file_bytes;
+    Timestamp _file_opened;
+    String _cur_filename;	// protected by _name_lock
+    SimpleSpinlock _name_lock;
+    uint32_t _nfiles;
+
+    // Updated by the writer thread, read and reset by handlers.
+    atomic_uint32_t _drops;
+#if HAVE_INT64_TYPES
+    atomic_uint64_t _count;
+    atomic_uint64_t _bytes;
+#else
+    atomic_uint32_t _count;
+    atomic_uint32_t _bytes;
+#endif
+
+    Task _task;
+    NotifierSignal _signal;
+
+    inline void enqueue(Packet *p);
+    static void *writer_thread(void *);
+    bool drain();
+    int open_file(ErrorHandler *errh);
+    bool flush();
+    void fail(const char *what);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -26,6 +26,7 @@
 #include <click/router.hh>
 #include <click/master.hh>
 #include <click/straccum.hh>
+#include <click/integers.hh>
 #include <click/llrpc.h>
 #include <click/msgqueue.hh>
 #include <unistd.h>
@@ -36,7 +37,7 @@
 #include <cmath>
 CLICK_DECLS
 
-const char ControlSocket::protocol_version[] = "1.3";
+const char ControlSocket::protocol_version[] = "1.4";
 
 class ControlSocketErrorHandler : public ErrorHandler { public:
 
@@ -86,7 +87,8 @@ ControlSocketErrorHandler::account(int level)
 
 
 ControlSocket::ControlSocket()
-  : _socket_fd(-1), _proxy(0), _full_proxy(0), _retry_timer(0)
+  : _socket_fd(-1), _proxy(0), _full_proxy(0), _next_sub_id(1),
+    _retry_timer(0)
 {
 }
 
@@ -313,6 +315,15 @@ ControlSocket::take_state(Element *e, ErrorHandler *errh)
 	if (*it && !(*it)->out_closed)
 	    add_select((*it)->fd, SELECT_WRITE);
     }
+
+    // carry subscriptions over to our timers
+    _next_sub_id = cs->_next_sub_id;
+    for (subscription **it = cs->_subs.begin(); it != cs->_subs.end(); ++it) {
+	subscription *sub = new subscription(this, (*it)->fd, (*it)->id, (*it)->binary, (*it)->interval, (*it)->patterns);
+	sub->timer.initialize(this);
+	sub->timer.schedule_after_msec(sub->interval);
+	_subs.push_back(sub);
+    }
 }
 
 void
@@ -338,6 +349,9 @@ ControlSocket::cleanup(CleanupStage)
 	    close((*it)->fd);
 	    delete *it;
 	}
+    for (subscription **it = _subs.begin(); it != _subs.end(); ++it)
+	delete *it;
+    _subs.clear();
     if (_retry_timer) {
 	delete _retry_timer;
 	_retry_timer = 0;
@@ -451,7 +465,7 @@ ControlSocket::proxied_handler_name(const String &n) const
 }
 
 const Handler*
-ControlSocket::parse_handler(connection &conn, const String &full_name, Element **es)
+ControlSocket::find_handler(const String &full_name, Element **es, int &code, String &msg)
 {
 
   Router *r;
@@ -460,21 +474,24 @@ ControlSocket::parse_handler(connection &conn, const String &full_name, Element
 
   const char *rdot = find(full_name, '.');
   if(rdot==full_name.begin()) {
-    conn.message(CSERR_SYNTAX, "Syntax error: no router name");
+    code = CSERR_SYNTAX;
+    msg = "Syntax error: no router name";
     return 0;
   }
   String rname = full_name.substring(full_name.begin(), rdot);
 
   r = router()->master()->get_router(rname);
   if(!r) {
-    conn.message(CSERR_NO_SUCH_ROUTER, "No router named '" + rname + "'");
+    code = CSERR_NO_SUCH_ROUTER;
+    msg = "No router named '" + rname + "'";
     return 0;
   }
 
   String left_name = full_name.substring(rdot+1, full_name.end());
   const char *edot = find(left_name, '.');
   if(edot!=left_name.end() && edot==left_name.begin()) {
-    conn.message(CSERR_SYNTAX, "Syntax error: not element name");
+    code = CSERR_SYNTAX;
+    msg = "Syntax error: not element name";
     return 0;
   }
   if (edot != left_name.end()) {
@@ -486,7 +503,8 @@ ControlSocket::parse_handler(connection &conn, const String &full_name, Element
 	     e = r->element(num - 1);
     }
     if (!e) {
-      conn.message(CSERR_NO_SUCH_ELEMENT, "No element named '" + ename + "'");
+      code = CSERR_NO_SUCH_ELEMENT;
+      msg = "No element named '" + ename + "'";
       return 0;
     }
     hname = left_name.substring(edot + 1, left_name.end());
@@ -501,11 +519,23 @@ ControlSocket::parse_handler(connection &conn, const String &full_name, Element
     *es = e;
     return h;
   } else {
-    conn.message(CSERR_NO_SUCH_HANDLER, "No handler named '" + full_name + "'");
+    code = CSERR_NO_SUCH_HANDLER;
+    msg = "No handler named '" + full_name + "'";
     return 0;
   }
 }
 
+const Handler*
+ControlSocket::parse_handler(connection &conn, const String &full_name, Element **es)
+{
+  int code;
+  String msg;
+  const Handler *h = find_handler(full_name, es, code, msg);
+  if (!h)
+    conn.message(code, msg);
+  return h;
+}
+
 int
 ControlSocket::read_command(connection &conn, const String &handlername, String param)
 {
@@ -674,6 +704,247 @@ ControlSocket::llrpc_command(connection &conn, const String &llrpcname, String d
   return 0;
 }
 
+static bool
+is_glob(const String &s)
+{
+    for (const char *x = s.begin(); x != s.end(); ++x)
+	if (*x == '*' || *x == '?' || *x == '[')
+	    return true;
+    return false;
+}
+
+void
+ControlSocket::expand_handlers(const String &pattern, Vector<batch_item> &items)
+{
+    batch_item item;
+    if (!is_glob(pattern)) {
+	item.name = pattern;
+	item.e = 0;
+	if ((item.h = find_handler(pattern, &item.e, item.code, item.msg))
+	    && !item.h->read_visible()) {
+	    item.h = 0;
+	    item.code = CSERR_PERMISSION;
+	    item.msg = "Handler '" + pattern + "' write-only";
+	}
+	items.push_back(item);
+	return;
+    }
+
+    const char *rdot = find(pattern, '.');
+    String rpat = pattern.substring(pattern.begin(), rdot);
+    String rest = pattern.substring(rdot + (rdot != pattern.end()), pattern.end());
+    const char *edot = find(rest, '.');
+    String epat, hpat = rest;
+    if (edot != rest.end()) {
+	epat = rest.substring(rest.begin(), edot);
+	hpat = rest.substring(edot + 1, rest.end());
+    }
+
+    Master *master = router()->master();
+    Vector<String> all, rnames;
+    master->router_names(all);
+    for (String *rn = all.begin(); rn != all.end(); ++rn)
+	if (rn->glob_match(rpat))
+	    rnames.push_back(*rn);
+    click_qsort(rnames.begin(), rnames.size());
+
+    Vector<int> hindexes;
+    for (String *rn = rnames.begin(); rn != rnames.end(); ++rn) {
+	Router *r = master->get_router(*rn);
+	for (int ei = (epat ? 0 : -1); ei < (epat ? r->nelements() : 0); ++ei) {
+	    Element *e = (ei >= 0 ? r->element(ei) : r->root_element());
+	    if (ei >= 0 && !e->name().glob_match(epat))
+		continue;
+	    hindexes.clear();
+	    Router::element_hindexes(e, hindexes);
+	    for (int *hi = hindexes.begin(); hi != hindexes.end(); ++hi) {
+		const Handler *h = Router::handler(r, *hi);
+		if (h && h->read_visible() && !(h->flags() & Handler::f_expensive)
+		    && h->name().glob_match(hpat)) {
+		    item.name = *rn + "." + (ei >= 0 ? e->name() + "." : String()) + h->name();
+		    item.e = e;
+		    item.h = h;
+		    items.push_back(item);
+		}
+	    }
+	}
+    }
+}
+
+static void
+append_net16(StringAccum &sa, uint16_t x)
+{
+    x = htons(x);
+    sa.append(reinterpret_cast<const char *>(&x), 2);
+}
+
+static void
+append_net32(StringAccum &sa, uint32_t x)
+{
+    x = htonl(x);
+    sa.append(reinterpret_cast<const char *>(&x), 4);
+}
+
+static void
+append_net64(StringAccum &sa, uint64_t x)
+{
+    x = host_to_net_order(x);
+    sa.append(reinterpret_cast<const char *>(&x), 8);
+}
+
+static void
+append_binary_value(StringAccum &sa, const String &data)
+{
+    String t = data.trim_space();
+    int64_t i;
+    uint64_t u;
+    double d;
+    if (t && t[0] == '-' && IntArg().parse(t, i)) {
+	sa << 'i';
+	append_net64(sa, i);
+    } else if (t && IntArg().parse(t, u)) {
+	sa << 'u';
+	append_net64(sa, u);
+    } else if (t && DoubleArg().parse(t, d)) {
+	sa << 'd';
+	memcpy(&u, &d, 8);
+	append_net64(sa, u);
+    } else {
+	sa << 's';
+	append_net32(sa, data.length());
+	sa << data;
+    }
+}
+
+String
+ControlSocket::read_batch(const Vector<String> &patterns, bool binary, int &count)
+{
+    Master *master = router()->master();
+    StringAccum sa;
+    Vector<batch_item> items;
+
+    // hold off router installs and removals while we use their elements
+    master->lock_read();
+    for (const String *p = patterns.begin(); p != patterns.end(); ++p)
+	expand_handlers(*p, items);
+
+    for (batch_item *it = items.begin(); it != items.end(); ++it) {
+	String data;
+	if (it->h) {
+	    ControlSocketErrorHandler errh;
+	    _proxied_handler = it->h->name();
+	    _proxied_errh = &errh;
+	    data = it->h->call_read(it->e, String(), &errh);
+	    _proxied_errh = 0;
+	    if (errh.nerrors() > 0) {
+		it->code = (errh.error_code() == CSERR_OK ? CSERR_HANDLER_ERROR : errh.error_code());
+		it->msg = errh.messages().size() ? errh.messages().back() : String("Read handler '" + it->name + "' error");
+		it->h = 0;
+	    }
+	}
+
+	if (binary) {
+	    append_net16(sa, it->name.length());
+	    sa << it->name;
+	    if (it->h)
+		append_binary_value(sa, data);
+	    else {
+		sa << 'e';
+		append_net16(sa, it->code);
+		append_net32(sa, it->msg.length());
+		sa << it->msg;
+	    }
+	} else if (it->h)
+	    sa << it->name << ' ' << (int) CSERR_OK << ' ' << data.length() << '\r' << '\n' << data;
+	else
+	    sa << it->name << ' ' << it->code << ' ' << it->msg.length() << '\r' << '\n' << it->msg;
+    }
+    master->unlock_rw();
+
+    count = items.size();
+    return sa.take_string();
+}
+
+int
+ControlSocket::read_many_command(connection &conn, const Vector<String> &patterns, bool binary)
+{
+  int count;
+  String data = read_batch(patterns, binary, count);
+  conn.message(CSERR_OK, "Read " + String(count) + " handlers OK");
+  conn.out_text << "DATA " << data.length() << '\r' << '\n' << data;
+  return 0;
+}
+
+ControlSocket::subscription::subscription(ControlSocket *cs_, int fd_, int id_, bool binary_,
+					  uint32_t interval_, const Vector<String> &patterns_)
+    : cs(cs_), fd(fd_), id(id_), binary(binary_), interval(interval_),
+      patterns(patterns_), timer(subscription_hook, this)
+{
+}
+
+int
+ControlSocket::subscribe_command(connection &conn, const Vector<String> &words, bool binary)
+{
+  uint32_t interval;
+  if (words.size() < 3)
+    return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+  if (!IntArg().parse(words[1], interval) || interval < MIN_SUBSCRIBE_INTERVAL)
+    return conn.message(CSERR_SYNTAX, "Interval must be at least " + String(MIN_SUBSCRIBE_INTERVAL) + " msec");
+
+  Vector<String> patterns;
+  for (const String *w = words.begin() + 2; w != words.end(); ++w)
+    patterns.push_back(*w);
+  subscription *sub = new subscription(this, conn.fd, _next_sub_id++, binary, interval, patterns);
+  sub->timer.initialize(this);
+  sub->timer.schedule_after_msec(interval);
+  _subs.push_back(sub);
+  return conn.message(CSERR_OK, "Subscription " + String(sub->id) + " OK");
+}
+
+int
+ControlSocket::unsubscribe_command(connection &conn, const String &idstr)
+{
+  int id;
+  if (!IntArg().parse(idstr, id))
+    return conn.message(CSERR_SYNTAX, "Syntax error in 'unsubscribe'");
+  for (int i = 0; i < _subs.size(); i++)
+    if (_subs[i]->id == id && _subs[i]->fd == conn.fd) {
+      delete _subs[i];
+      _subs[i] = _subs.back();
+      _subs.pop_back();
+      return conn.message(CSERR_OK, "Unsubscribed " + idstr);
+    }
+  return conn.message(CSERR_SYNTAX, "No subscription " + idstr);
+}
+
+void
+ControlSocket::remove_subscriptions(int fd)
+{
+  for (int i = 0; i < _subs.size(); )
+    if (_subs[i]->fd == fd) {
+      delete _subs[i];
+      _subs[i] = _subs.back();
+      _subs.pop_back();
+    } else
+      ++i;
+}
+
+void
+ControlSocket::subscription_hook(Timer *t, void *thunk)
+{
+  subscription *sub = static_cast<subscription *>(thunk);
+  ControlSocket *cs = sub->cs;
+  connection *conn = (sub->fd < cs->_conns.size() ? cs->_conns[sub->fd] : 0);
+  if (conn && !conn->out_closed
+      && conn->out_text.length() - conn->outpos < MAX_PUSH_BACKLOG) {
+    int count;
+    String data = cs->read_batch(sub->patterns, sub->binary, count);
+    conn->out_text << "PUSH " << sub->id << ' ' << data.length() << '\r' << '\n' << data;
+    conn->flush_write(cs, conn->inpos < conn->in_text.length());
+  }
+  t->reschedule_after_msec(sub->interval);
+}
+
 int
 ControlSocket::parse_command(connection &conn, const String &line)
 {
@@ -767,6 +1038,22 @@ ControlSocket::parse_command(connection &conn, const String &line)
 	return r;
     return llrpc_command(conn, words[1], data);
 
+  } else if (command == "READMANY" || command == "READMANYBIN") {
+    if (words.size() < 2)
+      return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+    Vector<String> patterns;
+    for (String *w = words.begin() + 1; w != words.end(); ++w)
+      patterns.push_back(*w);
+    return read_many_command(conn, patterns, command.length() > 8);
+
+  } else if (command == "SUBSCRIBE" || command == "SUBSCRIBEBIN") {
+    return subscribe_command(conn, words, command.length() > 9);
+
+  } else if (command == "UNSUBSCRIBE") {
+    if (words.size() != 2)
+      return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+    return unsubscribe_command(conn, words[1]);
+
   } else if (command == "CLOSE" || command == "QUIT") {
     if (words.size() != 1)
       conn.message(CSERR_SYNTAX, "Bad command syntax");
@@ -814,6 +1101,11 @@ ControlSocket::parse_command(connection &conn, const String &line)
     conn.message(CSERR_OK, "CHECKREAD handler       check if read handler is valid", true);
     conn.message(CSERR_OK, "CHECKWRITE handler      check if write handler is valid", true);
     conn.message(CSERR_OK, "LLRPC elt#number [len]  call LLRPC, pass len data bytes, return DATA", true);
+    conn.message(CSERR_OK, "READMANY pattern...     call matching read handlers, return DATA", true);
+    conn.message(CSERR_OK, "READMANYBIN pattern...  same, with binary-encoded values", true);
+    conn.message(CSERR_OK, "SUBSCRIBE msec pattern... push READMANY results every msec", true);
+    conn.message(CSERR_OK, "SUBSCRIBEBIN msec pattern... push READMANYBIN results every msec", true);
+    conn.message(CSERR_OK, "UNSUBSCRIBE id          cancel subscription", true);
     conn.message(CSERR_OK, "QUIT                    close connection");
     return 0;
 
@@ -879,9 +1171,13 @@ ControlSocket::selected(int fd, int)
 	}
 
     // parse commands
-    // 16.Jun.2004: process only one command each time through
+    // Handle pipelined commands several at a time, but only a bounded number,
+    // so one busy connection doesn't starve the others.
     bool blocked = false;
-    if (conn->in_text.length()) {
+    for (int ncommands = 0;
+	 !blocked && conn->inpos < conn->in_text.length()
+	     && ncommands < MAX_COMMANDS_PER_SELECT;
+	 ++ncommands) {
 	const char *in_text = conn->in_text.begin() + conn->inpos;
 	const char *in_end = conn->in_text.end();
 	const char *line_end = in_text;
@@ -906,12 +1202,12 @@ ControlSocket::selected(int fd, int)
 		// more data to come, so wait
 		conn->inpos = oldpos;
 		blocked = true;
-	    } else
-		connection::contract(conn->in_text, conn->inpos);
+	    }
 	} else
 	    // 12.Jul.2006, Cliff Frey: write incomplete, so we are blocked
 	    blocked = true;
     }
+    connection::contract(conn->in_text, conn->inpos);
 
     // write data until blocked
     // The 2nd argument causes write events to remain selected when commands
@@ -926,6 +1222,7 @@ ControlSocket::selected(int fd, int)
 	if (_verbose)
 	    click_chatter("%s: closed connection %d", declaration().c_str(), fd);
 	_conns[conn->fd] = 0;
+	remove_subscriptions(conn->fd);
 	delete conn;
     }
 }
@@ -937,7 +1234,8 @@ ControlSocket::proxy_error_function(const String &h, void *thunk)
     return (h == cs->_proxied_handler ? cs->_proxied_errh : 0);
 }
 
-enum { H_ROUTER_NUM, H_ELEMENT_NUM, H_THREAD_NUMBER, H_ELEMENT_PER_THREAD, H_LOAD_PER_THREAD };
+enum { H_ROUTER_NUM, H_ELEMENT_NUM, H_THREAD_NUMBER, H_ELEMENT_PER_THREAD, H_LOAD_PER_THREAD,
+       H_CPU_SHARES, H_ROUTER_USAGE };
 
 void
 ControlSocket::add_handlers()
@@ -951,6 +1249,8 @@ ControlSocket::add_handlers()
   add_read_handler("thread_num", read_handler, H_THREAD_NUMBER);
   add_read_handler("element_per_thread", read_handler, H_ELEMENT_PER_THREAD);
   add_read_handler("load_per_thread", read_handler, H_LOAD_PER_THREAD);
+  add_read_handler("cpu_shares", read_handler, H_CPU_SHARES);
+  add_read_handler("router_usage", read_handler, H_ROUTER_USAGE);
 }
 
 int
@@ -1011,15 +1311,18 @@ ControlSocket::read_handler(Element *e, void *thunk)
         int nthread = master->run_nthreads();
         Vector<double> load(nthread+1, 0);
         String ret;
+        // published statistics from the last complete window: consistent
+        // across tasks, and reading them does not disturb the datapath
+        unsigned window = Task::stats_window() - 1;
         master->lock_read();
         HashMap<String, Router*>& routers = master->_router_map;
         for(HashMap<String, Router*>::iterator i = routers.begin(); i.live(); i++) {
           Router* r = i.value();
           for(int j=0; j<r->_tasks.size(); ++j) {
             int t = r->_tasks[j]->home_thread_id();
-            int cycle = r->_tasks[j]->cycles();
-            int rate = r->_tasks[j]->rates();
-            load[t] += (double)cycle * (double)rate;
+            Task::Stats s;
+            if (r->_tasks[j]->stats(window, s) && t >= 0 && t <= nthread)
+              load[t] += (double)s.cycles * (double)s.rate;
           }
         }
         master->unlock_rw();
@@ -1037,6 +1340,59 @@ ControlSocket::read_handler(Element *e, void *thunk)
         ret += String("average:") + String(sum/nthread/sq);
         return ret;
       }
+      case H_CPU_SHARES: {
+        StringAccum sa;
+        sa << "budget " << (master->_budget_sched ? "on" : "off")
+           << " quantum " << master->_budget_quantum << '\n';
+        master->lock_read();
+        HashMap<String, Router*>& routers = master->_router_map;
+        for(HashMap<String, Router*>::iterator i = routers.begin(); i.live(); i++) {
+          Router* r = i.value();
+          if (!r->_cpu_share)
+            continue;
+          sa << i.key() << ' ' << (r->_cpu_share / 10) << '.' << (r->_cpu_share % 10)
+             << "% threads " << r->_cpu_share_first << '-';
+          if (r->_cpu_share_last >= 0)
+            sa << r->_cpu_share_last;
+          else
+            sa << master->run_nthreads();
+          sa << '\n';
+        }
+        master->unlock_rw();
+        return sa.take_string();
+      }
+      case H_ROUTER_USAGE: {
+        StringAccum sa;
+        int nthread = master->run_nthreads();
+        double hz = master->cycles_hz();
+        double scale = (hz > 0 ? 100 / hz : 0);
+        unsigned window = Task::stats_window() - 1;
+        master->lock_read();
+        HashMap<String, Router*>& routers = master->_router_map;
+        for(HashMap<String, Router*>::iterator i = routers.begin(); i.live(); i++) {
+          Router* r = i.value();
+          if (i.key() == "sys")
+            continue;
+          Vector<double> per_thread(nthread + 1, 0);
+          double usage = r->cpu_usage(window, &per_thread);
+          sa << i.key() << ' ' << (uint64_t) usage << " cycles/s ";
+          sa.snprintf(16, "%.1f%%", usage * scale);
+          for(int k=1; k<=nthread; ++k)
+            if (per_thread[k] > 0)
+              sa.snprintf(24, " %d:%.1f%%", k, per_thread[k] * scale);
+          if (r->_soft_quota)
+            sa << " soft " << (r->_soft_quota / 10) << '.' << (r->_soft_quota % 10) << '%';
+          if (r->_hard_quota)
+            sa << " hard " << (r->_hard_quota / 10) << '.' << (r->_hard_quota % 10) << '%';
+          if (r->_quota_scale < 1000)
+            sa << " tickets " << (r->_quota_scale / 10) << '.' << (r->_quota_scale % 10) << '%';
+          if (r->_quota_throttled)
+            sa << " throttled";
+          sa << '\n';
+        }
+        master->unlock_rw();
+        return sa.take_string();
+      }
       default:
         return "<error>";
     }
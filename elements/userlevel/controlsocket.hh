@@ -2,10 +2,10 @@
 #define CLICK_CONTROLSOCKET_HH
 #include "elements/userlevel/handlerproxy.hh"
 #include <click/straccum.hh>
+#include <click/timer.hh>
 #include <unordered_map>
 CLICK_DECLS
 class ControlSocketErrorHandler;
-class Timer;
 class Handler;
 class MsgQueue;
 
@@ -41,8 +41,8 @@ The server will accept lines terminated by CR, LF, or CRLF. Its response
 lines are always terminated by CRLF.
 
 When a connection is opened, the server responds by stating its protocol
-version number with a line like "Click::ControlSocket/1.3". The current
-version number is 1.3. Changes in minor version number will only add commands
+version number with a line like "Click::ControlSocket/1.4". The current
+version number is 1.4. Changes in minor version number will only add commands
 and functionality to this specification, not change existing functionality.
 
 ControlSocket supports hot-swapping, meaning you can change configurations
@@ -177,12 +177,59 @@ ControlSocket will not call an LLRPC unless it can determine (from the command
 number) how much data the LLRPC expects and returns. (Only "flat" LLRPCs may
 be called; they are declared using the _CLICK_IOC_[RWS]F macros.)
 
+=item READMANY I<pattern...>
+
+Call many read handlers in one request.  Each I<pattern> is a handler name,
+which may contain shell-style wildcards (C<*>, C<?>, C<[...]>) in its router,
+element, and handler components.  For example, C<*.*.count> names the
+C<count> handler of every element of every router, and C<nf1.q*.length> the
+C<length> handlers of nf1's elements whose names start with "q".  Wildcards
+skip handlers marked expensive, such as C<config>.  Names without wildcards
+are called even if they do not exist, and report an error record.
+
+Returns the results with "DATA I<n>" as in the READ command.  The data holds
+one record per handler, in order: a line "I<name> I<code> I<len>" followed
+by I<len> bytes of handler output, or of error message when I<code> is not
+200.  Introduced in version 1.4 of the ControlSocket protocol.
+
+=item READMANYBIN I<pattern...>
+
+Like READMANY, but the data holds binary records, with multibyte integers in
+network byte order: a 2-byte name length, the name, and a 1-byte type.
+Numeric values are decoded on the server.  Type "u" is followed by an 8-byte
+unsigned integer, "i" by an 8-byte signed integer, and "d" by an 8-byte IEEE
+double.  Type "s" is followed by a 4-byte length and the handler output.
+Type "e" is followed by a 2-byte error code, a 4-byte length, and the error
+message.  Introduced in version 1.4 of the ControlSocket protocol.
+
+=item SUBSCRIBE I<msec> I<pattern...>
+
+=item SUBSCRIBEBIN I<msec> I<pattern...>
+
+Ask for the handlers matching the I<patterns> to be read every I<msec>
+milliseconds (at least 10) and sent without further requests.  Responds with
+a line like "200 Subscription I<id> OK".  Then, every I<msec> milliseconds,
+the server sends a line "PUSH I<id> I<n>" followed by I<n> bytes of data in
+READMANY format (for SUBSCRIBE) or READMANYBIN format (for SUBSCRIBEBIN).
+Patterns are expanded anew each time, so routers that are added later are
+included.  PUSH lines can arrive between a command and its response, but
+never inside a response.  If the client falls more than a megabyte behind,
+pushes are skipped until it catches up.  Introduced in version 1.4 of the
+ControlSocket protocol.
+
+=item UNSUBSCRIBE I<id>
+
+Cancel subscription I<id>.
+
 =item QUIT
 
 Close the connection.
 
 =back
 
+Clients may send several commands without waiting for their responses.
+The server answers them in order.
+
 The server's response codes follow this pattern.
 
 =over 5
@@ -222,6 +269,25 @@ Returns the ControlSocket's port number.  Only available for TYPE TCP.
 Returns the ControlSocket's UNIX socket filename.  Only available for TYPE
 UNIX.
 
+=h cpu_shares r
+
+Returns the scheduler's cycle-budget mode and quantum, followed by one line
+per router that has a CPU share: its name, percentage, and thread range.
+The mode is set with "MANAGE budget on [QUANTUM]" or "MANAGE budget off",
+and shares with "MANAGE share ROUTER PERCENT [FIRST[-LAST]]".  Shares only
+take effect in budget mode.
+
+=h router_usage r
+
+Returns one line per router with its CPU usage over the last statistics
+window: cycles per second, the percentage of one thread that represents,
+and the percentage on each thread it ran on.  Lines also show the router's
+soft and hard quotas, if any; its tickets, if the soft quota has scaled
+them down; and "throttled" if the hard quota is holding back its source
+tasks.  Quotas are percentages of one thread, set with "MANAGE addnf FILE
+[SOFT PERCENT] [HARD PERCENT]", "MANAGE quota ROUTER [SOFT PERCENT] [HARD
+PERCENT]", or "MANAGE quota ROUTER off".
+
 =a ChatterSocket, KernelHandlerProxy */
 
 class ControlSocket : public Element { public:
@@ -294,10 +360,34 @@ class ControlSocket : public Element { public:
     String _proxied_handler;
     ErrorHandler *_proxied_errh;
 
+    struct batch_item {
+	String name;
+	Element *e;
+	const Handler *h;	// null on error
+	int code;
+	String msg;
+    };
+
+    struct subscription {
+	ControlSocket *cs;
+	int fd;
+	int id;
+	bool binary;
+	uint32_t interval;	// milliseconds
+	Vector<String> patterns;
+	Timer timer;
+	subscription(ControlSocket *cs_, int fd_, int id_, bool binary_,
+		     uint32_t interval_, const Vector<String> &patterns_);
+    };
+    Vector<subscription *> _subs;
+    int _next_sub_id;
+
     int _retries;
     Timer *_retry_timer;
 
     enum { READ_CLOSED = 1, WRITE_CLOSED = 2, ANY_ERR = -1 };
+    enum { MAX_COMMANDS_PER_SELECT = 64, MAX_PUSH_BACKLOG = 1 << 20,
+	   MIN_SUBSCRIBE_INTERVAL = 10 };
 
     static const char protocol_version[];
 
@@ -307,11 +397,19 @@ class ControlSocket : public Element { public:
     void initialize_connection(int fd);
 
     String proxied_handler_name(const String &) const;
+    const Handler* find_handler(const String &, Element **, int &code, String &msg);
     const Handler* parse_handler(connection &conn, const String &, Element **);
+    void expand_handlers(const String &, Vector<batch_item> &);
+    String read_batch(const Vector<String> &, bool binary, int &count);
     int read_command(connection &conn, const String &, String);
     int write_command(connection &conn, const String &, String);
     int check_command(connection &conn, const String &, bool write);
     int llrpc_command(connection &conn, const String &, String);
+    int read_many_command(connection &conn, const Vector<String> &, bool binary);
+    int subscribe_command(connection &conn, const Vector<String> &, bool binary);
+    int unsubscribe_command(connection &conn, const String &);
+    void remove_subscriptions(int fd);
+    static void subscription_hook(Timer *, void *);
     int parse_command(connection &conn, const String &);
 
     static ErrorHandler *proxy_error_function(const String &, void *);
@@ -57,6 +57,7 @@ FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
     _headroom = Packet::default_headroom;
     _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
     _mtu_out = DEFAULT_MTU;
+    _burst = 1;
 
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _dev_name)
@@ -69,6 +70,7 @@ FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("ETHER", _macaddr)
 	.read("HEADROOM", _headroom)
 	.read("MTU", _mtu_out)
+	.read("BURST", _burst)
 	.complete() < 0)
 	return -1;
 
@@ -78,6 +80,8 @@ FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("must specify device name");
     if (_headroom > 8192)
 	return errh->error("HEADROOM too large");
+    if (_burst < 1)
+	return errh->error("BURST must be >= 1");
     return 0;
 }
 
@@ -223,10 +227,23 @@ FromHost::selected(int fd, int)
     if (fd != _fd)
 	return;
 
+    for (unsigned n = _burst; n > 0 && _nonfull_signal; --n)
+	if (!one_selected())
+	    break;
+
+    if (!_nonfull_signal) {
+	remove_select(_fd, SELECT_READ);
+	return;
+    }
+}
+
+bool
+FromHost::one_selected()
+{
     WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
     if (!p) {
 	click_chatter("out of memory!");
-	return;
+	return false;
     }
 
     int cc = read(_fd, p->data(), _mtu_in);
@@ -240,17 +257,13 @@ FromHost::selected(int fd, int)
 	p->set_ip_header(ip, ip->ip_hl << 2);
 	p->timestamp_anno().assign_now();
 	output(0).push(p);
+	return true;
     } else {
 	p->kill();
-	perror("FromHost read");
-    }
-
-    if (!_nonfull_signal) {
-	remove_select(_fd, SELECT_READ);
-	return;
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+	    perror("FromHost read");
+	return false;
     }
-
-
 }
 
 bool
@@ -63,6 +63,12 @@ CLICK_DECLS
  * interface's local (i.e., kernel) IPv6 address and netmask.  Both DST and
  * DST6 may be specified.
  *
+ * =item BURST
+ *
+ * Integer.  The maximum number of packets to read each time the device
+ * becomes readable.  FromHost stops early if its downstream Queue fills.
+ * Default is 1.
+ *
  * =back
  *
  * =n
@@ -139,9 +145,11 @@ class FromHost : public Element { public:
 #endif
 
     unsigned _headroom;
+    unsigned _burst;
     Task _task;
     NotifierSignal _nonfull_signal;
 
+    bool one_selected();
     int try_linux_universal(ErrorHandler *);
     int try_tun(const String &, ErrorHandler *);
     int alloc_tun(ErrorHandler *);
@@ -25,6 +25,7 @@
 #include <click/args.hh>
 #include <click/straccum.hh>
 #include <click/glue.hh>
+#include <click/master.hh>
 #include <clicknet/ether.h>
 #include <click/standard/scheduleinfo.hh>
 #include <unistd.h>
@@ -70,12 +71,13 @@ CLICK_DECLS
 KernelTun::KernelTun()
     : _fd(-1), _tap(false), _task(this), _ignore_q_errs(false),
       _printed_write_err(false), _printed_read_err(false),
-      _selected_calls(0), _packets(0)
+      _queues(0), _nqueues(1)
 {
 }
 
 KernelTun::~KernelTun()
 {
+    delete[] _queues;
 }
 
 void *
@@ -108,6 +110,7 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 #if KERNELTUN_LINUX
 	.read("DEV_NAME", Args::deprecated, _dev_name)
 	.read("DEVNAME", _dev_name)
+	.read("QUEUES", _nqueues)
 #endif
 	.complete() < 0)
 	return -1;
@@ -116,6 +119,18 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("bad GATEWAY");
     if (_burst < 1)
 	return errh->error("BURST must be >= 1");
+    if (_nqueues < 1)
+	return errh->error("QUEUES must be >= 1");
+#if !defined(IFF_MULTI_QUEUE)
+    if (_nqueues > 1)
+	return errh->error("QUEUES requires multiqueue tun support");
+#endif
+    if (!(_queues = new TunQueue[_nqueues]))
+	return errh->error("out of memory!");
+    for (unsigned i = 0; i < _nqueues; ++i) {
+	_queues[i].fd = _queues[i].thread = -1;
+	_queues[i].selected_calls = _queues[i].packets = 0;
+    }
     if (_mtu_out < (int) sizeof(click_ip))
 	return errh->error("MTU must be greater than %d", sizeof(click_ip));
     if (_headroom > 8192)
@@ -135,6 +150,10 @@ KernelTun::try_linux_universal()
     struct ifreq ifr;
     memset(&ifr, 0, sizeof(ifr));
     ifr.ifr_flags = (_tap ? IFF_TAP : IFF_TUN);
+#ifdef IFF_MULTI_QUEUE
+    if (_nqueues > 1)
+	ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif
     if (_dev_name)
 	// Setting ifr_name allows us to select an arbitrary interface name.
 	strncpy(ifr.ifr_name, _dev_name.c_str(), sizeof(ifr.ifr_name));
@@ -145,8 +164,20 @@ KernelTun::try_linux_universal()
     }
 
     _dev_name = ifr.ifr_name;
-    _fd = fd;
+    _fd = _queues[0].fd = fd;
     _type = LINUX_UNIVERSAL;
+
+    // attach the remaining queues to the same device
+    for (unsigned i = 1; i < _nqueues; ++i) {
+	if ((fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK)) < 0
+	    || ioctl(fd, TUNSETIFF, (void *)&ifr) < 0) {
+	    err = -errno;
+	    if (fd >= 0)
+		close(fd);
+	    return err;
+	}
+	_queues[i].fd = fd;
+    }
     return 0;
 }
 #endif
@@ -160,7 +191,7 @@ KernelTun::try_tun(const String &dev_name, ErrorHandler *)
 	return -errno;
 
     _dev_name = dev_name;
-    _fd = fd;
+    _fd = _queues[0].fd = fd;
     return 0;
 }
 
@@ -189,6 +220,8 @@ KernelTun::alloc_tun(ErrorHandler *errh)
 	    saved_message = "\n(Perhaps you need to enable tun in your kernel or load the 'tun' module.)";
     }
     tried << "/dev/net/tun, ";
+    if (_nqueues > 1)
+	return errh->error("/dev/net/tun: %s%s\n(QUEUES requires the Linux Universal TUN/TAP driver.)", strerror(-error), saved_message.c_str());
 #endif
 
     String dev_prefix;
@@ -475,35 +508,103 @@ KernelTun::initialize(ErrorHandler *errh)
 	else
 	    _headroom += (4 - _headroom % 4) % 4; // default 4/0 alignment
     }
-    add_select(_fd, SELECT_READ);
+    place_queues();
     return 0;
 }
 
 void
 KernelTun::cleanup(CleanupStage)
 {
-    if (_fd >= 0) {
-	if (_type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
-	    updown(0, ~0, ErrorHandler::default_handler());
-	close(_fd);
-	remove_select(_fd, SELECT_READ);
+    if (_fd >= 0 && _type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
+	updown(0, ~0, ErrorHandler::default_handler());
+    for (unsigned i = 0; _queues && i < _nqueues; ++i)
+	if (_queues[i].fd >= 0) {
+	    if (_queues[i].thread >= 0)
+		master()->thread(_queues[i].thread)->select_set().remove_select(_queues[i].fd, this, SELECT_READ);
+	    close(_queues[i].fd);
+	    _queues[i].fd = _queues[i].thread = -1;
+	}
+}
+
+/** @brief Return the thread queue 0 is read on: the task's thread if
+ * KernelTun has a pull input, since the task may move, else the home
+ * thread. */
+int
+KernelTun::base_thread() const
+{
+    if (input_is_pull(0))
+	return _task.home_thread_id();
+    return home_thread()->thread_id();
+}
+
+/** @brief Return the thread that reads queue @a i.
+ *
+ * Queues are spread over consecutive threads starting at base_thread(). */
+int
+KernelTun::queue_thread(unsigned i) const
+{
+    int home = base_thread();
+    if (i == 0 || home < 0 || home >= master()->nthreads())
+	return home;
+    return (home + i) % master()->nthreads();
+}
+
+/** @brief Move each queue's select to the thread that should read it.
+ *
+ * Called at initialization, and again whenever the task has moved since
+ * the queues were placed. */
+void
+KernelTun::place_queues()
+{
+    _queues_lock.acquire();
+    for (unsigned i = 0; i < _nqueues; ++i) {
+	TunQueue &q = _queues[i];
+	int want = queue_thread(i);
+	if (q.fd < 0 || q.thread == want)
+	    continue;
+	if (q.thread >= 0)
+	    master()->thread(q.thread)->select_set().remove_select(q.fd, this, SELECT_READ);
+	master()->thread(want)->select_set().add_select(q.fd, this, SELECT_READ);
+	q.thread = want;
     }
+    _queues_lock.release();
+}
+
+/** @brief Return the file descriptor for the queue read by this thread.
+ *
+ * Writing to that queue keeps a flow's packets on one queue in both
+ * directions. */
+inline int
+KernelTun::write_fd() const
+{
+    if (_nqueues > 1) {
+	unsigned i = (click_current_cpu_id() - base_thread() + master()->nthreads())
+	    % master()->nthreads();
+	if (i < _nqueues)
+	    return _queues[i].fd;
+    }
+    return _fd;
 }
 
 void
 KernelTun::selected(int fd, int)
 {
     Timestamp now = Timestamp::now();
-    if (fd != _fd)
+    TunQueue *q = _queues;
+    while (q != _queues + _nqueues && q->fd != fd)
+	++q;
+    if (q == _queues + _nqueues)
 	return;
-    ++_selected_calls;
+    if (unlikely(_queues[0].thread != base_thread()))
+	place_queues();
+    ++q->selected_calls;
     unsigned n = _burst;
-    while (n > 0 && one_selected(now))
+    while (n > 0 && one_selected(*q, now))
 	--n;
 }
 
 bool
-KernelTun::one_selected(const Timestamp &now)
+KernelTun::one_selected(TunQueue &q, const Timestamp &now)
 {
     WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
     if (!p) {
@@ -511,9 +612,9 @@ KernelTun::one_selected(const Timestamp &now)
 	return false;
     }
 
-    int cc = read(_fd, p->data(), _mtu_in);
+    int cc = read(q.fd, p->data(), _mtu_in);
     if (cc > 0) {
-	++_packets;
+	++q.packets;
 	p->take(_mtu_in - cc);
 	bool ok = false;
 
@@ -574,6 +675,8 @@ KernelTun::one_selected(const Timestamp &now)
 bool
 KernelTun::run_task(Task *)
 {
+    if (unlikely(_queues[0].thread != _task.home_thread_id()))
+	place_queues();
     Packet *p = input(0).pull();
     if (p)
 	push(0, p);
@@ -663,7 +766,7 @@ KernelTun::push(int, Packet *p)
     }
 
     if (p) {
-	int w = write(_fd, p->data(), p->length());
+	int w = write(write_fd(), p->data(), p->length());
 	if (w != (int) p->length() && (errno != ENOBUFS || !_ignore_q_errs || !_printed_write_err)) {
 	    _printed_write_err = true;
 	    click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(errno));
@@ -673,14 +776,27 @@ KernelTun::push(int, Packet *p)
 	click_chatter("%s(%s): out of memory", class_name(), _dev_name.c_str());
 }
 
+enum { h_selected_calls, h_packets };
+
+String
+KernelTun::read_handler(Element *e, void *thunk)
+{
+    KernelTun *kt = static_cast<KernelTun *>(e);
+    click_uint_large_t sum = 0;
+    for (unsigned i = 0; i < kt->_nqueues; ++i)
+	sum += (reinterpret_cast<intptr_t>(thunk) == h_selected_calls
+		? kt->_queues[i].selected_calls : kt->_queues[i].packets);
+    return String(sum);
+}
+
 void
 KernelTun::add_handlers()
 {
     if (input_is_pull(0))
 	add_task_handlers(&_task);
     add_data_handlers("dev_name", Handler::OP_READ, &_dev_name);
-    add_data_handlers("selected_calls", Handler::OP_READ, &_selected_calls);
-    add_data_handlers("packets", Handler::OP_READ, &_packets);
+    add_read_handler("selected_calls", read_handler, h_selected_calls);
+    add_read_handler("packets", read_handler, h_packets);
 }
 
 CLICK_ENDDECLS
@@ -73,6 +73,18 @@ String. If specified, try to alloc a tun device with name DEVNAME.
 Otherwise, we'll just take the first virtual device we find. This option
 only works with the Linux Universal TUN/TAP driver.
 
+=item QUEUES
+
+Integer. The number of device queues to open. With more than one queue, the
+device is created as a multiqueue device (IFF_MULTI_QUEUE), and the kernel
+spreads flows across the queues. Queue I<i> is read on thread
+(I<home> + I<i>) mod I<nthreads>, where I<home> is KernelTun's home thread,
+so several threads can receive from the device at once; packets pushed to
+KernelTun are written to the queue read by the current thread. If
+KernelTun's task moves to another thread, the queues move with it. This
+option only works with the Linux Universal TUN/TAP driver; without it,
+more than one queue is an error. Default is 1.
+
 =back
 
 =n
@@ -100,6 +112,15 @@ and C<ping> should print Click's responses.
 This element differs from KernelTap in that it produces and expects IP
 packets, not IP-in-Ethernet packets.
 
+=h selected_calls read-only
+
+Returns the number of times KernelTun's file descriptors became readable,
+summed over all queues.
+
+=h packets read-only
+
+Returns the number of packets read, summed over all queues.
+
 =a
 
 FromDevice.u, ToDevice.u, KernelTap, ifconfig(8) */
@@ -133,7 +154,7 @@ class KernelTun : public Element { public:
     enum Type { LINUX_UNIVERSAL, LINUX_ETHERTAP, BSD_TUN, BSD_TAP, OSX_TUN,
 		NETBSD_TUN, NETBSD_TAP };
 
-    int _fd;
+    int _fd;			// == _queues[0].fd
     int _mtu_in;
     int _mtu_out;
     Type _type;
@@ -153,8 +174,16 @@ class KernelTun : public Element { public:
     bool _printed_read_err;
     bool _adjust_headroom;
 
-    click_uint_large_t _selected_calls;
-    click_uint_large_t _packets;
+    // one per device queue; each is read on a single thread
+    struct TunQueue {
+	int fd;
+	int thread;		// whose select set holds fd, or -1
+	click_uint_large_t selected_calls;
+	click_uint_large_t packets;
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    TunQueue *_queues;
+    unsigned _nqueues;
+    Spinlock _queues_lock;
 
 #if HAVE_LINUX_IF_TUN_H
     int try_linux_universal();
@@ -163,7 +192,13 @@ class KernelTun : public Element { public:
     int alloc_tun(ErrorHandler *);
     int setup_tun(ErrorHandler *);
     int updown(IPAddress, IPAddress, ErrorHandler *);
-    bool one_selected(const Timestamp &now);
+    bool one_selected(TunQueue &q, const Timestamp &now);
+    int base_thread() const;
+    int queue_thread(unsigned i) const;
+    void place_queues();
+    inline int write_fd() const;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
 
     friend class KernelTap;
 
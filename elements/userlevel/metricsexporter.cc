@@ -0,0 +1,464 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * metricsexporter.{cc,hh} -- serve router statistics in OpenMetrics format
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "metricsexporter.hh"
+#include <click/args.hh>
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/master.hh>
+#include <click/task.hh>
+#include <click/ipaddress.hh>
+#include <click/timestamp.hh>
+#include "elements/standard/counter.hh"
+#include "elements/standard/simplequeue.hh"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+CLICK_DECLS
+
+MetricsExporter::MetricsExporter()
+    : _socket_fd(-1), _router_map_version(0), _cached(false), _nseries(0),
+      _nscrapes(0)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+}
+
+int
+MetricsExporter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _localhost = true;
+    _verbose = false;
+    _prefix = "click_";
+    return Args(conf, this, errh)
+	.read_mp("PORT", IPPortArg(IP_PROTO_TCP), _port)
+	.read("LOCALHOST", _localhost)
+	.read("PREFIX", _prefix)
+	.read("VERBOSE", _verbose)
+	.complete();
+}
+
+int
+MetricsExporter::initialize(ErrorHandler *errh)
+{
+    _socket_fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (_socket_fd < 0)
+	return errh->error("socket: %s", strerror(errno));
+    int sockopt = 1;
+    if (setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEADDR, (void *) &sockopt, sizeof(sockopt)) < 0)
+	errh->warning("setsockopt: %s", strerror(errno));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(_port);
+    sa.sin_addr.s_addr = htonl(_localhost ? INADDR_LOOPBACK : INADDR_ANY);
+    if (bind(_socket_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+	return errh->error("bind: %s", strerror(errno));
+    if (listen(_socket_fd, 8) < 0)
+	return errh->error("listen: %s", strerror(errno));
+
+    fcntl(_socket_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_socket_fd, F_SETFD, FD_CLOEXEC);
+    add_select(_socket_fd, SELECT_READ);
+    return 0;
+}
+
+void
+MetricsExporter::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _conns.size(); i++)
+	if (_conns[i]) {
+	    close(_conns[i]->fd);
+	    delete _conns[i];
+	}
+    _conns.clear();
+    if (_socket_fd >= 0) {
+	close(_socket_fd);
+	_socket_fd = -1;
+    }
+    for (int i = 0; i < _routers.size(); i++)
+	delete _routers[i];
+    _routers.clear();
+}
+
+
+// SERIES CACHE
+
+static void
+append_label_value(StringAccum &sa, const String &s)
+{
+    for (const char *x = s.begin(); x != s.end(); ++x)
+	if (*x == '\\' || *x == '"')
+	    sa << '\\' << *x;
+	else if (*x == '\n')
+	    sa << "\\n";
+	else
+	    sa << *x;
+}
+
+static String
+series_labels(const String &router_name, Element *e)
+{
+    StringAccum sa;
+    sa << "router=\"";
+    append_label_value(sa, router_name);
+    sa << "\",element=\"";
+    append_label_value(sa, e->name());
+    sa << '"';
+    return sa.take_string();
+}
+
+MetricsExporter::RouterEntry *
+MetricsExporter::make_entry(const String &name, Router *router)
+{
+    RouterEntry *re = new RouterEntry;
+    re->name = name;
+    re->router = router;
+    for (int i = 0; i < router->nelements(); i++) {
+	Element *e = router->element(i);
+	Series s;
+	s.e = e;
+	s.t = 0;
+	if (e->cast("Counter")) {
+	    s.labels = series_labels(name, e);
+	    re->counters.push_back(s);
+	}
+	if (e->cast("SimpleQueue")) {
+	    s.labels = series_labels(name, e);
+	    re->queues.push_back(s);
+	}
+    }
+    for (int i = 0; i < router->_tasks.size(); i++)
+	if (Element *e = router->_tasks[i]->element()) {
+	    Series s;
+	    s.e = e;
+	    s.t = router->_tasks[i];
+	    s.labels = series_labels(name, e);
+	    re->tasks.push_back(s);
+	}
+    return re;
+}
+
+/** @brief Bring the series cache up to date with the router map.
+ *
+ * Called with the master's router map locked.  Only routers added since the
+ * last call are walked; entries for routers still present are reused. */
+void
+MetricsExporter::refresh(Master *master)
+{
+    if (_cached && _router_map_version == master->_router_map_version)
+	return;
+
+    Vector<RouterEntry *> old;
+    old.swap(_routers);
+    _nseries = 0;
+    for (HashMap<String, Router *>::iterator it = master->_router_map.begin();
+	 it.live(); it++) {
+	RouterEntry *re = 0;
+	for (int i = 0; i < old.size() && !re; i++)
+	    if (old[i] && old[i]->router == it.value() && old[i]->name == it.key()) {
+		re = old[i];
+		old[i] = 0;
+	    }
+	if (!re)
+	    re = make_entry(it.key(), it.value());
+	_routers.push_back(re);
+	_nseries += 2 * re->counters.size() + 4 * re->queues.size()
+	    + 2 * re->tasks.size();
+    }
+    for (int i = 0; i < old.size(); i++)
+	delete old[i];
+
+    _router_map_version = master->_router_map_version;
+    _cached = true;
+}
+
+
+// SCRAPING
+
+void
+MetricsExporter::family(StringAccum &sa, const char *name, const char *type,
+			const char *help, bool openmetrics) const
+{
+    // OpenMetrics names a counter family without its "_total" suffix;
+    // the Prometheus text format names it after its samples.
+    const char *suffix = "";
+    if (!openmetrics && strcmp(type, "counter") == 0)
+	suffix = "_total";
+    sa << "# HELP " << _prefix << name << suffix << ' ' << help << '\n'
+       << "# TYPE " << _prefix << name << suffix << ' ' << type << '\n';
+}
+
+String
+MetricsExporter::scrape(bool openmetrics)
+{
+    Timestamp start = Timestamp::now_steady();
+    Master *master = router()->master();
+    StringAccum sa;
+
+    _lock.acquire();
+    master->lock_read();
+    refresh(master);
+
+    family(sa, "counter_packets", "counter", "Packets counted by Counter elements.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->counters.begin(); s != (*rp)->counters.end(); ++s)
+	    sa << _prefix << "counter_packets_total{" << s->labels << "} "
+	       << static_cast<Counter *>(s->e)->count() << '\n';
+    family(sa, "counter_bytes", "counter", "Bytes counted by Counter elements.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->counters.begin(); s != (*rp)->counters.end(); ++s)
+	    sa << _prefix << "counter_bytes_total{" << s->labels << "} "
+	       << static_cast<Counter *>(s->e)->byte_count() << '\n';
+
+    family(sa, "queue_length", "gauge", "Packets in the queue.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->queues.begin(); s != (*rp)->queues.end(); ++s)
+	    sa << _prefix << "queue_length{" << s->labels << "} "
+	       << static_cast<SimpleQueue *>(s->e)->size() << '\n';
+    family(sa, "queue_capacity", "gauge", "Queue capacity in packets.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->queues.begin(); s != (*rp)->queues.end(); ++s)
+	    sa << _prefix << "queue_capacity{" << s->labels << "} "
+	       << static_cast<SimpleQueue *>(s->e)->capacity() << '\n';
+    family(sa, "queue_highwater_length", "gauge", "Largest queue length seen.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->queues.begin(); s != (*rp)->queues.end(); ++s)
+	    sa << _prefix << "queue_highwater_length{" << s->labels << "} "
+	       << static_cast<SimpleQueue *>(s->e)->highwater_length() << '\n';
+    family(sa, "queue_drops", "counter", "Packets dropped by the queue.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->queues.begin(); s != (*rp)->queues.end(); ++s)
+	    sa << _prefix << "queue_drops_total{" << s->labels << "} "
+	       << static_cast<SimpleQueue *>(s->e)->drops() << '\n';
+
+#if HAVE_MULTITHREAD
+    // every task's statistics from the same complete window
+    unsigned window = Task::stats_window() - 1;
+    Vector<double> load(master->nthreads(), 0);
+    family(sa, "task_cycles", "gauge", "Average cycles per task run.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->tasks.begin(); s != (*rp)->tasks.end(); ++s) {
+	    Task::Stats ts;
+	    if (!s->t->stats(window, ts))
+		ts.cycles = ts.rate = 0;
+	    int tid = s->t->home_thread_id();
+	    sa << _prefix << "task_cycles{" << s->labels << ",thread=\""
+	       << tid << "\"} " << ts.cycles << '\n';
+	    if (tid >= 0 && tid < load.size())
+		load[tid] += (double) ts.cycles * ts.rate;
+	}
+    family(sa, "task_rate", "gauge", "Task runs per second.", openmetrics);
+    for (RouterEntry **rp = _routers.begin(); rp != _routers.end(); ++rp)
+	for (Series *s = (*rp)->tasks.begin(); s != (*rp)->tasks.end(); ++s) {
+	    Task::Stats ts;
+	    if (!s->t->stats(window, ts))
+		ts.rate = 0;
+	    sa << _prefix << "task_rate{" << s->labels << ",thread=\""
+	       << s->t->home_thread_id() << "\"} " << ts.rate << '\n';
+	}
+    family(sa, "thread_load", "gauge", "Sum of task cycles per run times runs per second.", openmetrics);
+    for (int tid = 0; tid < load.size(); tid++)
+	sa << _prefix << "thread_load{thread=\"" << tid << "\"} " << load[tid] << '\n';
+#endif
+
+    family(sa, "routers", "gauge", "Routers in this process.", openmetrics);
+    sa << _prefix << "routers " << _routers.size() << '\n';
+    master->unlock_rw();
+    ++_nscrapes;
+    _lock.release();
+
+#if HAVE_CLICK_PACKET_POOL
+    Packet::PoolStats ps;
+    Packet::pool_stats(ps);
+    family(sa, "packet_pool_free_packets", "gauge", "Free packets in packet pools.", openmetrics);
+    sa << _prefix << "packet_pool_free_packets{pool=\"thread\"} " << ps.packets << '\n'
+       << _prefix << "packet_pool_free_packets{pool=\"global\"} " << ps.global_packets << '\n';
+    family(sa, "packet_pool_free_buffers", "gauge", "Free data buffers in packet pools.", openmetrics);
+    sa << _prefix << "packet_pool_free_buffers{pool=\"thread\"} " << ps.buffers << '\n'
+       << _prefix << "packet_pool_free_buffers{pool=\"global\"} " << ps.global_buffers << '\n';
+#endif
+
+    family(sa, "scrape_duration_seconds", "gauge", "Time spent producing this scrape.", openmetrics);
+    sa << _prefix << "scrape_duration_seconds "
+       << (Timestamp::now_steady() - start).doubleval() << '\n';
+    if (openmetrics)
+	sa << "# EOF\n";
+    return sa.take_string();
+}
+
+
+// HTTP
+
+void
+MetricsExporter::respond(Connection *conn)
+{
+    String req = conn->in.take_string();
+    String lreq = req.lower();
+    int eol = req.find_left('\n');
+    String line = req.substring(0, eol < 0 ? req.length() : eol).trim_space();
+
+    String method = cp_shift_spacevec(line);
+    String path = cp_shift_spacevec(line);
+    int q = path.find_left('?');
+    if (q >= 0)
+	path = path.substring(0, q);
+
+    const char *status = "200 OK";
+    String type = "text/plain; charset=utf-8";
+    String body;
+    if (eol < 0 || !line.starts_with("HTTP/"))
+	status = "400 Bad Request";
+    else if (method != "GET" && method != "HEAD")
+	status = "405 Method Not Allowed";
+    else if (path != "/metrics" && path != "/")
+	status = "404 Not Found";
+    else {
+	bool openmetrics = lreq.find_left("application/openmetrics-text") >= 0;
+	body = scrape(openmetrics);
+	if (openmetrics)
+	    type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+	else
+	    type = "text/plain; version=0.0.4; charset=utf-8";
+    }
+    if (status[0] != '2')
+	body = String(status) + "\n";
+
+    StringAccum sa;
+    sa << "HTTP/1.1 " << status << "\r\n"
+       << "Content-Type: " << type << "\r\n"
+       << "Content-Length: " << body.length() << "\r\n"
+       << "Connection: close\r\n\r\n";
+    if (method != "HEAD")
+	sa << body;
+    conn->out = sa.take_string();
+    conn->outpos = 0;
+}
+
+void
+MetricsExporter::close_connection(Connection *conn)
+{
+    remove_select(conn->fd, SELECT_READ | SELECT_WRITE);
+    close(conn->fd);
+    if (_verbose)
+	click_chatter("%s: closed connection %d", declaration().c_str(), conn->fd);
+    _conns[conn->fd] = 0;
+    delete conn;
+}
+
+void
+MetricsExporter::selected(int fd, int mask)
+{
+    if (fd == _socket_fd) {
+	struct sockaddr_in sa;
+	socklen_t sa_len = sizeof(sa);
+	int new_fd = accept(_socket_fd, (struct sockaddr *) &sa, &sa_len);
+	if (new_fd < 0) {
+	    if (errno != EAGAIN)
+		click_chatter("%s: accept: %s", declaration().c_str(), strerror(errno));
+	    return;
+	}
+	if (_verbose)
+	    click_chatter("%s: opened connection %d from %s.%d", declaration().c_str(), new_fd, IPAddress(sa.sin_addr).unparse().c_str(), ntohs(sa.sin_port));
+	fcntl(new_fd, F_SETFL, O_NONBLOCK);
+	fcntl(new_fd, F_SETFD, FD_CLOEXEC);
+	if (_conns.size() <= new_fd)
+	    _conns.resize(new_fd + 1, 0);
+	_conns[new_fd] = new Connection(new_fd);
+	add_select(new_fd, SELECT_READ);
+	return;
+    }
+
+    if (fd >= _conns.size() || !_conns[fd])
+	return;
+    Connection *conn = _conns[fd];
+
+    if ((mask & SELECT_READ) && !conn->out) {
+	char *buf = conn->in.reserve(2048);
+	ssize_t r = buf ? read(fd, buf, 2048) : -1;
+	if (r > 0)
+	    conn->in.adjust_length(r);
+	else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+	    close_connection(conn);
+	    return;
+	}
+	String so_far(conn->in.begin(), conn->in.length());
+	if (so_far.find_left("\r\n\r\n") >= 0 || so_far.find_left("\n\n") >= 0
+	    || conn->in.length() > MAX_REQUEST) {
+	    remove_select(fd, SELECT_READ);
+	    respond(conn);
+	}
+    }
+
+    if (conn->out) {
+	while (conn->outpos < conn->out.length()) {
+	    ssize_t w = write(fd, conn->out.data() + conn->outpos,
+			      conn->out.length() - conn->outpos);
+	    if (w > 0)
+		conn->outpos += w;
+	    else if (w < 0 && (errno == EAGAIN || errno == EINTR))
+		break;
+	    else {
+		close_connection(conn);
+		return;
+	    }
+	}
+	if (conn->outpos == conn->out.length())
+	    close_connection(conn);
+	else
+	    add_select(fd, SELECT_WRITE);
+    }
+}
+
+
+// HANDLERS
+
+String
+MetricsExporter::read_handler(Element *e, void *thunk)
+{
+    MetricsExporter *me = static_cast<MetricsExporter *>(e);
+    switch ((intptr_t) thunk) {
+    case h_port:
+	return String(me->_port);
+    case h_metrics:
+	return me->scrape(true);
+    case h_series:
+	return String(me->_nseries);
+    case h_scrapes:
+	return String(me->_nscrapes);
+    default:
+	return String();
+    }
+}
+
+void
+MetricsExporter::add_handlers()
+{
+    add_read_handler("port", read_handler, h_port);
+    add_read_handler("metrics", read_handler, h_metrics, Handler::f_expensive);
+    add_read_handler("series", read_handler, h_series);
+    add_read_handler("scrapes", read_handler, h_scrapes);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel Counter SimpleQueue)
+EXPORT_ELEMENT(MetricsExporter)
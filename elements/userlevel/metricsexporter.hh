@@ -0,0 +1,188 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_METRICSEXPORTER_HH
+#define CLICK_METRICSEXPORTER_HH
+#include <click/element.hh>
+#include <click/straccum.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class Task;
+
+/*
+=c
+
+MetricsExporter(PORT [, I<keywords> LOCALHOST, PREFIX, VERBOSE])
+
+=s control
+
+serves router statistics to Prometheus over HTTP
+
+=d
+
+Listens for HTTP connections on TCP port PORT and answers each GET of
+C</metrics> with the statistics of every router in the process, in the
+OpenMetrics text format (or the older Prometheus text format, if the client
+does not ask for OpenMetrics).  MetricsExporter is meant to run in the
+control router, next to ControlSocket; the B<--metrics-port> option to
+B<click> adds one there.
+
+The exported families, all prefixed with PREFIX, are:
+
+=over 8
+
+=item counter_packets, counter_bytes
+
+Counters: each Counter element's packet and byte counts.
+
+=item queue_length, queue_capacity, queue_highwater_length
+
+Gauges: each queue's current length, capacity, and highwater length.
+
+=item queue_drops
+
+Counter: packets dropped by each queue.
+
+=item task_cycles, task_rate
+
+Gauges: each task's average cycles per run and runs per second, as
+published by its thread for the last complete statistics window.
+
+=item thread_load
+
+Gauge: the sum, over each thread's tasks, of cycles per run times runs per
+second for that window.
+
+=item packet_pool_free_packets, packet_pool_free_buffers
+
+Gauges: free packets and data buffers held by the packet pools, labeled by
+C<pool="thread"> or C<pool="global">.
+
+=item routers, scrape_duration_seconds
+
+Gauges: the number of routers, and how long this scrape took so far.
+
+=back
+
+Samples carry C<router>, C<element> and, for tasks, C<thread> labels.
+
+A scrape never writes to datapath state.  It reads element counters
+directly and task statistics from the snapshots that each thread publishes
+once per window, so it does not disturb the threads.  The list of series is
+cached and rebuilt only for routers that were added, removed or hotswapped
+since the previous scrape.
+
+Keyword arguments are:
+
+=over 8
+
+=item LOCALHOST
+
+Boolean.  If true, accept connections only from the local host.  Default is
+true.
+
+=item PREFIX
+
+String.  Prefix for metric names.  Default is "click_".
+
+=item VERBOSE
+
+Boolean.  If true, print a message for every connection.  Default is false.
+
+=back
+
+=h port read-only
+
+Returns the port number.
+
+=h metrics read-only
+
+Returns the current statistics in OpenMetrics text format.
+
+=h series read-only
+
+Returns the number of cached series.
+
+=h scrapes read-only
+
+Returns the number of scrapes served, including reads of "metrics".
+
+=e
+
+  MetricsExporter(9100);
+
+Then point Prometheus at C<http://localhost:9100/metrics>.
+
+=a ControlSocket, Counter, Queue */
+
+class MetricsExporter : public Element { public:
+
+    MetricsExporter() CLICK_COLD;
+    ~MetricsExporter() CLICK_COLD;
+
+    const char *class_name() const	{ return "MetricsExporter"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void selected(int fd, int mask);
+
+    String scrape(bool openmetrics);
+
+  private:
+
+    struct Series {
+	Element *e;
+	Task *t;
+	String labels;		// router="R",element="E"
+    };
+
+    struct RouterEntry {
+	String name;
+	Router *router;
+	Vector<Series> counters;
+	Vector<Series> queues;
+	Vector<Series> tasks;
+    };
+
+    struct Connection {
+	int fd;
+	StringAccum in;
+	String out;
+	int outpos;
+	Connection(int fd_)
+	    : fd(fd_), outpos(0) {
+	}
+    };
+
+    int _socket_fd;
+    uint16_t _port;
+    bool _localhost;
+    bool _verbose;
+    String _prefix;
+
+    Vector<Connection *> _conns;
+
+    SimpleSpinlock _lock;
+    Vector<RouterEntry *> _routers;
+    unsigned _router_map_version;
+    bool _cached;
+    int _nseries;
+    uint64_t _nscrapes;
+
+    enum { MAX_REQUEST = 8192 };
+
+    void refresh(Master *master);
+    RouterEntry *make_entry(const String &name, Router *router);
+    void family(StringAccum &sa, const char *name, const char *type,
+		const char *help, bool openmetrics) const;
+    void respond(Connection *conn);
+    void close_connection(Connection *conn);
+
+    enum { h_port, h_metrics, h_series, h_scrapes };
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
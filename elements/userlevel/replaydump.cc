@@ -0,0 +1,565 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * replaydump.{cc,hh} -- element replays a preloaded tcpdump file
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "replaydump.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include "fakepcap.hh"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef ALLOW_MMAP
+#include <sys/mman.h>
+#endif
+CLICK_DECLS
+
+#define	SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+#define	SWAPSHORT(y) \
+	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
+
+ReplayDump::ReplayDump()
+    : _trace(0), _data(0), _size(0)
+{
+    _nactive = 0;
+}
+
+ReplayDump::~ReplayDump()
+{
+}
+
+int
+ReplayDump::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _timing = true;
+    _rewrite = _hugepages = _force_ip = _stop = false;
+    _preload = _active = true;
+    _speed = 1;
+    _loop = 1;
+    _burst = 32;
+    String threads;
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read("TIMING", _timing)
+	.read("SPEED", _speed)
+	.read("LOOP", _loop)
+	.read("REWRITE", _rewrite)
+	.read("BURST", _burst)
+	.read("PRELOAD", _preload)
+	.read("HUGEPAGES", _hugepages)
+	.read("FORCE_IP", _force_ip)
+	.read("THREADS", AnyArg(), threads)
+	.read("STOP", _stop)
+	.read("ACTIVE", _active)
+	.complete() < 0)
+	return -1;
+    if (_speed <= 0)
+	return errh->error("SPEED must be positive");
+    if (_burst < 1)
+	return errh->error("BURST must be positive");
+    Vector<String> words;
+    cp_spacevec(threads, words);
+    _threads.assign(words.size(), 0);
+    for (int i = 0; i < words.size(); ++i)
+	if (!IntArg().parse(words[i], _threads[i]) || _threads[i] < 0)
+	    return errh->error("THREADS should be a list of thread IDs");
+    if (_threads.size() && _threads.size() != noutputs())
+	return errh->error("THREADS needs one thread per output");
+    return 0;
+}
+
+void
+ReplayDump::Trace::unuse()
+{
+    if (refcount.dec_and_test()) {
+#ifdef ALLOW_MMAP
+	if (mapped)
+	    munmap(data, size);
+	else
+#endif
+	    delete[] data;
+	delete this;
+    }
+}
+
+void
+ReplayDump::trace_destructor(unsigned char *, size_t, void *argument)
+{
+    static_cast<Trace *>(argument)->unuse();
+}
+
+int
+ReplayDump::load(ErrorHandler *errh)
+{
+    int fd = open(_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    }
+    _size = st.st_size;
+    _trace = new Trace;
+    _trace->data = 0;
+    _trace->size = _size;
+    _trace->mapped = false;
+    _trace->refcount = 1;
+    bool mapped = false;
+
+#ifdef ALLOW_MMAP
+    if (!_preload) {
+	int flags = MAP_PRIVATE;
+# ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+# endif
+	void *m = mmap(0, _size, PROT_READ, flags, fd, 0);
+	if (m != MAP_FAILED) {
+	    _data = reinterpret_cast<unsigned char *>(m);
+	    mapped = true;
+	}
+    } else {
+	void *m = mmap(0, _size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m != MAP_FAILED) {
+	    _data = reinterpret_cast<unsigned char *>(m);
+	    mapped = true;
+	}
+    }
+# if defined(MADV_HUGEPAGE)
+    if (mapped && _hugepages)
+	(void) madvise(_data, _size, MADV_HUGEPAGE);
+# endif
+#endif
+
+    // Fall back to the heap if mapping failed or is unavailable.
+    bool must_read = !mapped || _preload;
+    if (!_data && !(_data = new unsigned char[_size])) {
+	close(fd);
+	return errh->error("%s: out of memory", _filename.c_str());
+    }
+    _trace->data = _data;
+    _trace->mapped = mapped;
+    for (size_t pos = 0; must_read && pos < _size; ) {
+	ssize_t r = read(fd, _data + pos, _size - pos);
+	if (r < 0 && errno == EINTR)
+	    continue;
+	else if (r <= 0) {
+	    close(fd);
+	    return errh->error("%s: %s", _filename.c_str(), r ? strerror(errno) : "short read");
+	}
+	pos += r;
+    }
+    close(fd);
+    return 0;
+}
+
+int
+ReplayDump::find_ip(const unsigned char *data, uint32_t caplen, int linktype)
+{
+    int off;
+    if (linktype == FAKE_DLT_RAW)
+	off = 0;
+    else if (linktype == FAKE_DLT_EN10MB && caplen >= sizeof(click_ether)) {
+	uint16_t type = (data[12] << 8) | data[13];
+	off = sizeof(click_ether);
+	if (type == ETHERTYPE_8021Q && caplen >= sizeof(click_ether) + 4) {
+	    type = (data[16] << 8) | data[17];
+	    off += 4;
+	}
+	if (type != ETHERTYPE_IP)
+	    return -1;
+    } else
+	return -1;
+    if (caplen < off + sizeof(click_ip) || (data[off] >> 4) != 4
+	|| (data[off] & 0xF) < 5)
+	return -1;
+    return off;
+}
+
+int
+ReplayDump::index(ErrorHandler *errh)
+{
+    fake_pcap_file_header fh;
+    if (_size < sizeof(fh))
+	return errh->error("%s: not a tcpdump file (too short)", _filename.c_str());
+    memcpy(&fh, _data, sizeof(fh));
+    bool swapped = false;
+    if (fh.magic != FAKE_PCAP_MAGIC && fh.magic != FAKE_PCAP_MAGIC_NANO
+	&& fh.magic != FAKE_MODIFIED_PCAP_MAGIC) {
+	swapped = true;
+	fh.magic = SWAPLONG(fh.magic);
+	fh.version_major = SWAPSHORT(fh.version_major);
+	fh.version_minor = SWAPSHORT(fh.version_minor);
+	fh.linktype = SWAPLONG(fh.linktype);
+    }
+    if (fh.magic != FAKE_PCAP_MAGIC && fh.magic != FAKE_PCAP_MAGIC_NANO
+	&& fh.magic != FAKE_MODIFIED_PCAP_MAGIC)
+	return errh->error("%s: not a tcpdump file (bad magic number)", _filename.c_str());
+    if (fh.version_major != FAKE_PCAP_VERSION_MAJOR)
+	return errh->error("%s: unknown major version %d", _filename.c_str(), fh.version_major);
+    size_t extra = 0;
+    if (fh.magic == FAKE_MODIFIED_PCAP_MAGIC)
+	extra = sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr);
+    bool nano = fh.magic == FAKE_PCAP_MAGIC_NANO;
+    int minor_version = fh.version_minor;
+    _linktype = fake_pcap_canonical_dlt(fh.linktype, true);
+    if (_force_ip && _linktype != FAKE_DLT_RAW && _linktype != FAKE_DLT_EN10MB)
+	return errh->error("%s: unknown linktype %d; can't force IP packets", _filename.c_str(), _linktype);
+
+    _records.clear();
+    Timestamp first;
+    size_t pos = sizeof(fh);
+    while (pos + sizeof(fake_pcap_pkthdr) + extra <= _size) {
+	fake_pcap_pkthdr ph;
+	memcpy(&ph, _data + pos, sizeof(ph));
+	if (swapped) {
+	    ph.ts.tv.tv_sec = SWAPLONG(ph.ts.tv.tv_sec);
+	    ph.ts.tv.tv_usec = SWAPLONG(ph.ts.tv.tv_usec);
+	    ph.caplen = SWAPLONG(ph.caplen);
+	    ph.len = SWAPLONG(ph.len);
+	}
+	// Same caplen/len handling as FromDump.
+	uint32_t len = ph.len, caplen = ph.caplen, skiplen = 0;
+	if (minor_version < 3 || (minor_version == 3 && ph.caplen > ph.len))
+	    len = ph.caplen, caplen = ph.len;
+	if (caplen > 65535) {
+	    errh->warning("%s: bad packet header at offset %lu; ignoring the rest", _filename.c_str(), (unsigned long) pos);
+	    break;
+	} else if (caplen > len) {
+	    skiplen = caplen - len;
+	    caplen = len;
+	}
+	pos += sizeof(ph) + extra;
+	if (pos + caplen + skiplen > _size)
+	    break;
+
+	Record r;
+	r.offset = pos;
+	r.caplen = caplen;
+	r.len = len;
+	r.ts = fake_bpf_timeval_union::make_timestamp(&ph.ts, nano);
+	if (_records.empty())
+	    first = r.ts;
+	r.ts -= first;
+	r.ip_offset = find_ip(_data + pos, caplen, _linktype);
+	_records.push_back(r);
+	pos += caplen + skiplen;
+    }
+    _first_ts = first;
+
+    // One loop lasts from the first packet to one average gap after the
+    // last.
+    if (_records.size() > 1) {
+	Timestamp span = _records.back().ts;
+	_duration = span + span / (double) (_records.size() - 1);
+    } else
+	_duration = Timestamp();
+    return 0;
+}
+
+uint32_t
+ReplayDump::flow_hash(const Record &r) const
+{
+    if (r.ip_offset < 0)
+	return 0;
+    const unsigned char *d = _data + r.offset + r.ip_offset;
+    const click_ip *iph = reinterpret_cast<const click_ip *>(d);
+    uint32_t src, dst, ports = 0;
+    memcpy(&src, &iph->ip_src, 4);
+    memcpy(&dst, &iph->ip_dst, 4);
+    unsigned hlen = iph->ip_hl << 2;
+    if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+	&& IP_FIRSTFRAG(iph) && r.caplen >= r.ip_offset + hlen + 4)
+	memcpy(&ports, d + hlen, 4);
+    uint32_t h = (src ^ (dst * 0x9E3779B1U)) * 0x85EBCA6BU;
+    h ^= (h >> 13) ^ ports ^ iph->ip_p;
+    h *= 0xC2B2AE35U;
+    return h ^ (h >> 16);
+}
+
+int
+ReplayDump::initialize(ErrorHandler *errh)
+{
+    if (load(errh) < 0 || index(errh) < 0)
+	return -1;
+
+    _shards.resize(noutputs());
+    for (int i = 0; i < _records.size(); ++i) {
+	int s = _shards.size() > 1 ? flow_hash(_records[i]) % _shards.size() : 0;
+	_shards[s].records.push_back(i);
+    }
+    for (int i = 0; i < _shards.size(); ++i) {
+	Shard &s = _shards[i];
+	s.owner = this;
+	s.index = i;
+	s.task = new Task(run_shard_task, &s);
+	ScheduleInfo::initialize_task(this, s.task, false, errh);
+	if (_threads.size())
+	    s.task->move_thread(_threads[i]);
+	s.timer = new Timer(s.task);
+	s.timer->initialize(this);
+    }
+    if (_active)
+	start();
+    return 0;
+}
+
+void
+ReplayDump::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _shards.size(); ++i) {
+	delete _shards[i].timer;
+	delete _shards[i].task;
+    }
+    _shards.clear();
+    // Packets still downstream keep the trace alive until they die.
+    if (_trace)
+	_trace->unuse();
+    _trace = 0;
+    _data = 0;
+}
+
+void
+ReplayDump::start()
+{
+    // Live packets may still reference _data, so the trace stays loaded;
+    // only the replay position is reset.
+    _nactive = _shards.size();
+    _start = Timestamp::now_steady();
+    _end = Timestamp();
+    for (int i = 0; i < _shards.size(); ++i) {
+	Shard &s = _shards[i];
+	s.pos = 0;
+	s.loop = 0;
+	s.count = 0;
+	s.task->reschedule();
+    }
+}
+
+inline Timestamp
+ReplayDump::due(const Record &r, int loop) const
+{
+    return _start + Timestamp((r.ts.doubleval() + _duration.doubleval() * loop) / _speed);
+}
+
+Packet *
+ReplayDump::make_packet(const Record &r, int loop)
+{
+    WritablePacket *wp = Packet::make(_data + r.offset, r.caplen, trace_destructor, _trace);
+    if (!wp)
+	return 0;
+    _trace->use();
+    // A clone is shared(), so writers downstream copy before writing and
+    // the trace is left alone.
+    Packet *p = wp->clone();
+    wp->kill();
+    if (!p)
+	return 0;
+
+    p->set_timestamp_anno(_first_ts + r.ts);
+    SET_EXTRA_LENGTH_ANNO(p, r.len - r.caplen);
+    p->set_mac_header(p->data());
+    int ip_offset = r.ip_offset;
+    if (_force_ip) {
+	if (ip_offset < 0) {
+	    p->kill();
+	    return 0;
+	}
+	p->pull(ip_offset);
+	ip_offset = 0;
+	const click_ip *iph = reinterpret_cast<const click_ip *>(p->data());
+	p->set_ip_header(iph, iph->ip_hl << 2);
+    }
+
+    if (_rewrite && loop > 0 && ip_offset >= 0) {
+	WritablePacket *q = p->uniqueify();
+	if (!q)
+	    return 0;
+	click_ip *iph = reinterpret_cast<click_ip *>(q->data() + ip_offset);
+	uint16_t old_hw[2], new_hw[2];
+	memcpy(old_hw, &iph->ip_src, 4);
+	uint32_t src = iph->ip_src.s_addr ^ htonl(loop);
+	memcpy(&iph->ip_src, &src, 4);
+	memcpy(new_hw, &iph->ip_src, 4);
+	uint16_t *csum = &iph->ip_sum;
+	click_update_in_cksum(csum, old_hw[0], new_hw[0]);
+	click_update_in_cksum(csum, old_hw[1], new_hw[1]);
+
+	// The transport checksum covers the source address too.
+	unsigned hlen = iph->ip_hl << 2;
+	uint32_t tlen = q->length() - ip_offset - hlen;
+	unsigned char *th = q->data() + ip_offset + hlen;
+	bool tcp = iph->ip_p == IP_PROTO_TCP, udp = iph->ip_p == IP_PROTO_UDP;
+	if (!IP_FIRSTFRAG(iph) || !(tcp || udp) || tlen < 4)
+	    return q;
+	csum = 0;
+	if (tcp && tlen >= 18)
+	    csum = reinterpret_cast<uint16_t *>(th + 16);
+	else if (udp && tlen >= 8 && (th[6] | th[7]))
+	    csum = reinterpret_cast<uint16_t *>(th + 6);
+	if (csum) {
+	    click_update_in_cksum(csum, old_hw[0], new_hw[0]);
+	    click_update_in_cksum(csum, old_hw[1], new_hw[1]);
+	}
+
+	// Rewrite the ports as well, so flows stay distinct even when
+	// addresses are not what identifies them.
+	uint16_t *ports = reinterpret_cast<uint16_t *>(th);
+	for (int i = 0; i < 2; ++i) {
+	    uint16_t old_port = ports[i];
+	    ports[i] ^= htons((uint16_t) loop);
+	    if (csum)
+		click_update_in_cksum(csum, old_port, ports[i]);
+	}
+	if (csum && udp && *csum == 0)
+	    *csum = 0xFFFF;
+	return q;
+    }
+    return p;
+}
+
+bool
+ReplayDump::run_shard_task(Task *, void *user_data)
+{
+    Shard *s = static_cast<Shard *>(user_data);
+    return s->owner->run_shard(*s);
+}
+
+bool
+ReplayDump::run_shard(Shard &s)
+{
+    if (!_active)
+	return false;
+    Timestamp now = _timing ? Timestamp::now_steady() : Timestamp();
+    int n = 0;
+
+    while (n < _burst) {
+	if (s.pos == (uint32_t) s.records.size()) {
+	    s.pos = 0;
+	    ++s.loop;
+	    // LOOP <= 0 replays forever.
+	    if ((_loop > 0 && s.loop >= _loop) || s.records.empty()) {
+		if (_nactive.dec_and_test()) {
+		    _end = Timestamp::now_steady();
+		    if (_stop)
+			router()->please_stop_driver();
+		}
+		return n > 0;
+	    }
+	}
+	const Record &r = _records[s.records[s.pos]];
+	if (_timing) {
+	    Timestamp t = due(r, s.loop);
+	    if (t > now) {
+		// Sleep on the timer if the next packet is far off;
+		// otherwise poll, since timers are too coarse.
+		if (t - now > Timestamp::make_msec(0, 1)) {
+		    s.timer->schedule_at_steady(t - Timer::adjustment());
+		    return n > 0;
+		}
+		break;
+	    }
+	}
+	++s.pos;
+	if (Packet *p = make_packet(r, s.loop)) {
+	    output(s.index).push(p);
+	    ++s.count;
+	    ++n;
+	}
+    }
+
+    s.task->fast_reschedule();
+    return n > 0;
+}
+
+enum { h_count, h_shard_counts, h_rate, h_target_rate, h_npackets, h_active };
+
+String
+ReplayDump::read_handler(Element *e, void *thunk)
+{
+    ReplayDump *rd = static_cast<ReplayDump *>(e);
+    uint64_t count = 0;
+    for (int i = 0; i < rd->_shards.size(); ++i)
+	count += rd->_shards[i].count;
+    switch ((intptr_t) thunk) {
+    case h_count:
+	return String(count);
+    case h_shard_counts: {
+	StringAccum sa;
+	for (int i = 0; i < rd->_shards.size(); ++i)
+	    sa << rd->_shards[i].count << '\n';
+	return sa.take_string();
+    }
+    case h_rate: {
+	Timestamp end = rd->_end ? rd->_end : Timestamp::now_steady();
+	double elapsed = (end - rd->_start).doubleval();
+	return String(elapsed > 0 ? count / elapsed : 0.);
+    }
+    case h_target_rate:
+	if (!rd->_timing || !rd->_duration)
+	    return String(0);
+	return String(rd->_records.size() * rd->_speed / rd->_duration.doubleval());
+    case h_npackets:
+	return String(rd->_records.size());
+    case h_active:
+	return BoolArg::unparse(rd->_active);
+    default:
+	return String();
+    }
+}
+
+int
+ReplayDump::write_handler(const String &str, Element *e, void *, ErrorHandler *errh)
+{
+    ReplayDump *rd = static_cast<ReplayDump *>(e);
+    bool active;
+    if (!BoolArg().parse(str, active))
+	return errh->error("type mismatch");
+    bool was_active = rd->_active;
+    rd->_active = active;
+    if (active && (!was_active || rd->_nactive == 0)) {
+	if (rd->_nactive == 0)
+	    rd->start();
+	else
+	    for (int i = 0; i < rd->_shards.size(); ++i)
+		rd->_shards[i].task->reschedule();
+    }
+    return 0;
+}
+
+void
+ReplayDump::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("shard_counts", read_handler, h_shard_counts);
+    add_read_handler("rate", read_handler, h_rate);
+    add_read_handler("target_rate", read_handler, h_target_rate);
+    add_read_handler("npackets", read_handler, h_npackets);
+    add_read_handler("active", read_handler, h_active, Handler::f_checkbox);
+    add_write_handler("active", write_handler, h_active);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FakePcap)
+EXPORT_ELEMENT(ReplayDump)
@@ -0,0 +1,236 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_REPLAYDUMP_HH
+#define CLICK_REPLAYDUMP_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ReplayDump(FILENAME [, I<keywords> TIMING, SPEED, LOOP, REWRITE, BURST, PRELOAD, HUGEPAGES, FORCE_IP, THREADS, STOP, ACTIVE])
+
+=s traces
+
+replays a tcpdump file from memory at high speed
+
+=d
+
+Loads a whole file produced by `tcpdump -w FILENAME' or ToDump into memory,
+and then replays its packets, optionally several times over.  FromDump reads
+the file incrementally and copies each packet.  ReplayDump does all parsing
+at initialization and indexes every record up front.  Emitted packets
+reference the loaded file directly, so there is no per-packet copy.  The
+packets are marked shared, so an element that modifies one first takes its
+own copy, as uniqueify() requires, and the loaded trace is never changed.
+Compressed files are not supported.
+
+ReplayDump has one push output per shard.  At initialization each packet is
+assigned to shard (output) I<hash> mod I<n> by a hash of its IP 5-tuple, so
+all packets of a flow leave on the same output, in order.  Non-IP packets go
+to shard 0.  Each shard has its own task, which can run on its own thread
+(see THREADS).  With TIMING, every shard paces its packets against a common
+start time, so inter-packet timing is kept across shards.
+
+Keyword arguments are:
+
+=over 8
+
+=item TIMING
+
+Boolean.  If true, emit packets at the times recorded in the file, scaled by
+SPEED.  If false, emit them as fast as possible.  Default is true.
+
+=item SPEED
+
+Real number.  With TIMING, replay this many times faster than recorded.
+Default is 1.
+
+=item LOOP
+
+Integer.  Replay the file this many times.  Zero or negative means forever.
+Default is 1.  With TIMING, each loop starts one average inter-packet gap
+after the previous loop's last packet.
+
+=item REWRITE
+
+Boolean.  If true, on loop I<k> (counting from 0), XOR the IP source address
+of every IPv4 packet with I<k>, and its TCP or UDP source and destination
+ports with the low 16 bits of I<k>, updating IP, TCP, and UDP checksums
+incrementally.  Every loop then carries distinct flows.  Rewritten packets
+are copied.  Default is false.
+
+=item BURST
+
+Integer.  Maximum number of packets a shard emits per task run.  Default is
+32.
+
+=item PRELOAD
+
+Boolean.  If true, read the file into anonymous memory.  If false, map the
+file itself and pre-fault its pages.  Default is true.
+
+=item HUGEPAGES
+
+Boolean.  If true, ask the kernel to back the loaded trace with transparent
+huge pages.  This is a hint and is most effective with PRELOAD.  Default is
+false.
+
+=item FORCE_IP
+
+Boolean.  If true, emit only IPv4 packets, with the link header stripped and
+the IP header annotation set.  Default is false.
+
+=item THREADS
+
+Space-separated list of thread IDs, one per output.  Shard I<i>'s task is
+moved to thread I<i>.  By default all shards run on ReplayDump's home thread.
+
+=item STOP
+
+Boolean.  If true, stop the driver when every shard has finished.  Default
+is false.
+
+=item ACTIVE
+
+Boolean.  If false, do not emit packets until the C<active> handler is set.
+Default is true.
+
+=back
+
+=h count read-only
+
+Returns the number of packets emitted, summed over shards.
+
+=h shard_counts read-only
+
+Returns the number of packets emitted by each shard, one per line.
+
+=h rate read-only
+
+Returns the achieved emission rate in packets per second since replay
+started.
+
+=h target_rate read-only
+
+Returns the rate the file's timestamps call for, scaled by SPEED, in packets
+per second.  Returns 0 without TIMING.
+
+=h npackets read-only
+
+Returns the number of packets in the file.
+
+=h active read/write
+
+Returns or sets the ACTIVE parameter.  Setting it to true after replay has
+finished starts the replay over.
+
+=e
+
+Replay a trace 10 times at 4x speed over two threads, keeping flows on one
+thread each:
+
+  rd :: ReplayDump(trace.pcap, SPEED 4, LOOP 10, REWRITE true, THREADS 1 2);
+  rd[0] -> ...;
+  rd[1] -> ...;
+
+=a
+
+FromDump, ToDump, FromFile, StaticThreadSched */
+
+class ReplayDump : public Element { public:
+
+    ReplayDump() CLICK_COLD;
+    ~ReplayDump() CLICK_COLD;
+
+    const char *class_name() const		{ return "ReplayDump"; }
+    const char *port_count() const		{ return "0/1-"; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    struct Record {
+	size_t offset;		// of packet data in _data
+	uint32_t caplen;
+	uint32_t len;
+	Timestamp ts;		// relative to the first record
+	int ip_offset;		// -1 if not IPv4
+    };
+
+    struct Shard {
+	ReplayDump *owner;
+	int index;
+	Task *task;
+	Timer *timer;
+	Vector<uint32_t> records;
+	uint32_t pos;
+	int loop;
+	uint64_t count;
+	Shard() : owner(0), index(0), task(0), timer(0), pos(0), loop(0), count(0) { }
+    };
+
+    // The loaded trace.  Emitted packets point into it, so it is freed
+    // when the element and the last such packet have both let go.
+    struct Trace {
+	unsigned char *data;
+	size_t size;
+	bool mapped;
+	atomic_uint32_t refcount;
+	void use() {
+	    refcount++;
+	}
+	void unuse();
+    };
+
+    String _filename;
+    Trace *_trace;
+    unsigned char *_data;	// _trace->data
+    size_t _size;
+
+    Vector<Record> _records;
+    Vector<Shard> _shards;
+    Vector<int> _threads;
+    int _linktype;
+
+    bool _timing;
+    bool _rewrite;
+    bool _preload;
+    bool _hugepages;
+    bool _force_ip;
+    bool _stop;
+    bool _active;
+    double _speed;
+    int _loop;
+    int _burst;
+
+    Timestamp _first_ts;
+    Timestamp _duration;	// one loop, unscaled
+    Timestamp _start;
+    Timestamp _end;
+    atomic_uint32_t _nactive;
+
+    int load(ErrorHandler *errh);
+    int index(ErrorHandler *errh);
+    static int find_ip(const unsigned char *data, uint32_t caplen, int linktype);
+    uint32_t flow_hash(const Record &r) const;
+    Timestamp due(const Record &r, int loop) const;
+    Packet *make_packet(const Record &r, int loop);
+    void start();
+    bool run_shard(Shard &s);
+
+    static bool run_shard_task(Task *, void *);
+    static void trace_destructor(unsigned char *, size_t, void *);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
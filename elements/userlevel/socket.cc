@@ -30,6 +30,7 @@
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <fcntl.h>
 #include "socket.hh"
 
@@ -45,8 +46,15 @@ Socket::Socket()
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
     _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
-    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0)
+    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0),
+    _burst(1),
+    _gso(false), _gro(false),
+    _rx_packets(0), _rx_syscalls(0), _tx_packets(0), _tx_syscalls(0)
 {
+#if HAVE_SOCKET_MMSG
+  memset(_rqv, 0, sizeof(_rqv));
+  _nwqv = 0;
+#endif
 }
 
 Socket::~Socket()
@@ -76,9 +84,18 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("PROPER", _proper)
       .read("ALLOW", allow)
       .read("DENY", deny)
+      .read("BURST", _burst)
+      .read("GSO", _gso)
+      .read("GRO", _gro)
       .consume() < 0)
     return -1;
 
+  if (_burst < 1 || _burst > MAX_BURST)
+    return errh->error("BURST must be between 1 and %d", MAX_BURST);
+#if !HAVE_SOCKET_MMSG
+  _burst = 1;
+#endif
+
   if (allow && !(_allow = (IPRouteTable *)allow->cast("IPRouteTable")))
     return errh->error("%s is not an IPRouteTable", allow->name().c_str());
 
@@ -119,6 +136,13 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+  if ((_gso || _gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO require a UDP socket");
+#if !HAVE_SOCKET_MMSG || !defined(UDP_SEGMENT) || !defined(UDP_GRO)
+  if (_gso || _gro)
+    return errh->error("GSO and GRO are not supported on this platform");
+#endif
+
   return 0;
 }
 
@@ -189,6 +213,15 @@ Socket::initialize(ErrorHandler *errh)
     if (setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_rcvbuf, sizeof(_rcvbuf)) < 0)
       return initialize_socket_error(errh, "setsockopt(SO_RCVBUF)");
 
+#if HAVE_SOCKET_MMSG && defined(UDP_GRO)
+  // let the kernel coalesce received datagrams
+  if (_gro) {
+    int one = 1;
+    if (setsockopt(_fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_GRO)");
+  }
+#endif
+
   // if a server, then the first arguments should be interpreted as
   // the address/port/file to bind() to, not to connect() to
   if (!_client) {
@@ -264,6 +297,14 @@ Socket::cleanup(CleanupStage)
     _rq->kill();
   if (_wq)
     _wq->kill();
+#if HAVE_SOCKET_MMSG
+  for (int i = 0; i < MAX_BURST; i++)
+    if (_rqv[i])
+      _rqv[i]->kill();
+  for (int i = 0; i < _nwqv; i++)
+    _wqv[i]->kill();
+  _nwqv = 0;
+#endif
   if (_fd >= 0) {
     // shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -346,6 +387,21 @@ Socket::selected(int fd, int)
       add_select(_active, SELECT_READ);
     }
 
+#if HAVE_SOCKET_MMSG
+    // read a batch of datagrams
+    if (_socktype == SOCK_DGRAM && (_burst > 1 || _gro)) {
+      if (read_datagrams() < 0) {
+	if (_verbose)
+	  click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+	close_active();
+	return;
+      }
+      if (ninputs() && input_is_pull(0))
+	run_task(0);
+      return;
+    }
+#endif
+
     // read data from socket
     if (!_rq)
       _rq = Packet::make(_headroom, 0, _snaplen, 0);
@@ -370,8 +426,11 @@ Socket::selected(int fd, int)
 	}
       }
 
+      _rx_syscalls++;
+
       // this segment OK
       if (len > 0) {
+	_rx_packets++;
 	if (len > _snaplen) {
 	  // truncate packet to max length (should never happen)
 	  assert(_rq->length() == (uint32_t)_snaplen);
@@ -404,6 +463,110 @@ Socket::selected(int fd, int)
     run_task(0);
 }
 
+#if HAVE_SOCKET_MMSG
+// Receive up to _burst datagrams with one recvmmsg() and push them.
+// Returns the number of datagrams received, 0 if none were waiting, or -1
+// on a fatal error.
+int
+Socket::read_datagrams()
+{
+  struct mmsghdr msg[MAX_BURST];
+  struct iovec iov[MAX_BURST];
+  union { struct sockaddr_in in; struct sockaddr_un un; } from[MAX_BURST];
+  union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } control[MAX_BURST];
+  // with GRO, one buffer may hold up to 64KB of coalesced datagrams
+  int bufsize = _gro ? 65535 : _snaplen;
+
+  unsigned n;
+  for (n = 0; n < _burst; n++) {
+    if (!_rqv[n] && !(_rqv[n] = Packet::make(_headroom, 0, bufsize, 0)))
+      break;
+    iov[n].iov_base = _rqv[n]->data();
+    iov[n].iov_len = bufsize;
+    memset(&msg[n].msg_hdr, 0, sizeof(msg[n].msg_hdr));
+    msg[n].msg_hdr.msg_iov = &iov[n];
+    msg[n].msg_hdr.msg_iovlen = 1;
+    if (!_client) {
+      msg[n].msg_hdr.msg_name = &from[n];
+      msg[n].msg_hdr.msg_namelen = sizeof(from[n]);
+    }
+    if (_gro) {
+      msg[n].msg_hdr.msg_control = control[n].buf;
+      msg[n].msg_hdr.msg_controllen = sizeof(control[n].buf);
+    }
+  }
+  if (n == 0)
+    return 0;
+
+  int r = recvmmsg(_active, msg, n, MSG_TRUNC, 0);
+  _rx_syscalls++;
+  if (r <= 0)
+    return (r == 0 || errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+  Timestamp now;
+  if (_timestamp)
+    now.assign_now();
+
+  for (int i = 0; i < r; i++) {
+    WritablePacket *p = _rqv[i];
+    int len = msg[i].msg_len;
+
+    // datagram server, find out who we are talking to
+    if (!_client) {
+      if (_family == AF_INET && !allowed(IPAddress(from[i].in.sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(from[i].in.sin_addr).unparse().c_str(), ntohs(from[i].in.sin_port));
+	continue;
+      }
+      memcpy(&_remote, &from[i], msg[i].msg_hdr.msg_namelen);
+      _remote_len = msg[i].msg_hdr.msg_namelen;
+    }
+
+    int segsize = 0;
+#ifdef UDP_GRO
+    if (_gro)
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg[i].msg_hdr); cm;
+	   cm = CMSG_NXTHDR(&msg[i].msg_hdr, cm))
+	if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO)
+	  memcpy(&segsize, CMSG_DATA(cm), sizeof(segsize));
+#endif
+
+    if (_gro) {
+      // copy each datagram out of the coalesced buffer; the buffer is reused
+      if (len > bufsize)
+	len = bufsize;
+      if (segsize <= 0)
+	segsize = len;
+      for (int off = 0; off < len; off += segsize) {
+	int seglen = len - off < segsize ? len - off : segsize;
+	WritablePacket *q = Packet::make(_headroom, p->data() + off, seglen, 0);
+	if (!q)
+	  break;
+	if (_timestamp)
+	  q->timestamp_anno() = now;
+	_rx_packets++;
+	output(0).push(q);
+      }
+      continue;
+    }
+
+    _rqv[i] = 0;
+    if (len > _snaplen) {
+      // truncate packet to max length
+      SET_EXTRA_LENGTH_ANNO(p, len - _snaplen);
+    } else
+      p->take(_snaplen - len);
+    if (_timestamp)
+      p->timestamp_anno() = now;
+    _rx_packets++;
+    output(0).push(p);
+  }
+
+  return r;
+}
+#endif
+
 int
 Socket::write_packet(Packet *p)
 {
@@ -424,6 +587,7 @@ Socket::write_packet(Packet *p)
     else
       len = sendto(_active, p->data(), p->length(), 0,
 		   (struct sockaddr *)&_remote, _remote_len);
+    _tx_syscalls++;
 
     // error
     if (len < 0) {
@@ -447,10 +611,120 @@ Socket::write_packet(Packet *p)
       p->pull(len);
   }
 
+  _tx_packets++;
   p->kill();
   return 0;
 }
 
+#if HAVE_SOCKET_MMSG
+// Send up to _burst datagrams with one sendmmsg(), starting with any left
+// over from last time. With GSO, runs of equal-sized packets to the same
+// destination share one message. Returns -1 if the socket would block, with
+// the unsent packets saved in _wqv, and 0 otherwise.
+int
+Socket::write_datagrams(bool &any)
+{
+  Packet *pkt[MAX_BURST];
+  int npkt = _nwqv;
+  memcpy(pkt, _wqv, sizeof(Packet *) * _nwqv);
+  _nwqv = 0;
+  while (npkt < (int) _burst && (pkt[npkt] = input(0).pull()))
+    npkt++;
+  if (npkt == 0)
+    return 0;
+  any = true;
+
+  struct mmsghdr msg[MAX_BURST];
+  struct iovec iov[MAX_BURST];
+  union { struct sockaddr_in in; struct sockaddr_un un; } to[MAX_BURST];
+  union { char buf[CMSG_SPACE(sizeof(uint16_t))]; struct cmsghdr align; } control[MAX_BURST];
+  int first[MAX_BURST + 1];	// index of each message's first packet
+  bool dst_anno = !IPAddress(_remote_ip) && _client && _family == AF_INET;
+  int nmsg = 0, total = 0;
+
+  for (int i = 0; i < npkt; i++) {
+    Packet *p = pkt[i];
+    iov[i].iov_base = const_cast<unsigned char *>(p->data());
+    iov[i].iov_len = p->length();
+
+    // add to the current message if GSO can carry it
+    if (_gso && nmsg > 0) {
+      struct msghdr &h = msg[nmsg - 1].msg_hdr;
+      int nseg = i - first[nmsg - 1];
+      unsigned segsize = iov[first[nmsg - 1]].iov_len;
+      if (nseg < 64
+	  && iov[i - 1].iov_len == segsize
+	  && p->length() <= segsize
+	  && total + p->length() <= 65000
+	  && (!dst_anno || to[nmsg - 1].in.sin_addr.s_addr == p->dst_ip_anno().addr())) {
+	h.msg_iovlen++;
+	total += p->length();
+	continue;
+      }
+    }
+
+    first[nmsg] = i;
+    memset(&msg[nmsg].msg_hdr, 0, sizeof(msg[nmsg].msg_hdr));
+    memcpy(&to[nmsg], &_remote, _remote_len);
+    // If the IP address specified when the element was created is 0.0.0.0,
+    // send the packet to its IP destination annotation address
+    if (dst_anno)
+      to[nmsg].in.sin_addr = p->dst_ip_anno();
+    msg[nmsg].msg_hdr.msg_name = &to[nmsg];
+    msg[nmsg].msg_hdr.msg_namelen = _remote_len;
+    msg[nmsg].msg_hdr.msg_iov = &iov[i];
+    msg[nmsg].msg_hdr.msg_iovlen = 1;
+    total = p->length();
+    nmsg++;
+  }
+  first[nmsg] = npkt;
+
+#ifdef UDP_SEGMENT
+  // tell the kernel how to segment messages that carry several packets
+  for (int m = 0; m < nmsg; m++)
+    if (msg[m].msg_hdr.msg_iovlen > 1) {
+      struct msghdr &h = msg[m].msg_hdr;
+      h.msg_control = control[m].buf;
+      h.msg_controllen = sizeof(control[m].buf);
+      struct cmsghdr *cm = CMSG_FIRSTHDR(&h);
+      cm->cmsg_level = IPPROTO_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segsize = h.msg_iov[0].iov_len;
+      memcpy(CMSG_DATA(cm), &segsize, sizeof(segsize));
+    }
+#endif
+
+  int sent = 0;
+  while (sent < nmsg) {
+    int r = sendmmsg(_active, msg + sent, nmsg - sent, 0);
+    _tx_syscalls++;
+    if (r > 0)
+      sent += r;
+    else if (errno == EINTR)
+      continue;
+    else if (errno == ENOBUFS || errno == EAGAIN) {
+      // queue the rest for writing when socket becomes available
+      for (int i = first[sent]; i < npkt; i++)
+	_wqv[_nwqv++] = pkt[i];
+      npkt = first[sent];
+      break;
+    } else {
+      // connection probably terminated or other fatal error
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+      break;
+    }
+  }
+
+  for (int i = 0; i < npkt; i++)
+    pkt[i]->kill();
+  _tx_packets += first[sent];
+  return _nwqv ? -1 : 0;
+}
+#endif
+
 void
 Socket::push(int, Packet *p)
 {
@@ -491,6 +765,22 @@ Socket::run_task(Task *)
     Packet *p = 0;
     int err = 0;
 
+#if HAVE_SOCKET_MMSG
+    if (_socktype == SOCK_DGRAM && (_burst > 1 || _gso)) {
+      // write one batch; the task runs again if there is more
+      err = write_datagrams(any);
+      if (_active < 0)
+	return any;
+      if (err < 0)
+	add_select(_active, SELECT_WRITE);
+      else if (_signal)
+	_task.reschedule();
+      else
+	remove_select(_active, SELECT_WRITE);
+      return any;
+    }
+#endif
+
     // write as much as we can
     do {
       p = _wq ? _wq : input(0).pull();
@@ -523,6 +813,10 @@ void
 Socket::add_handlers()
 {
   add_task_handlers(&_task);
+  add_data_handlers("rx_packets", Handler::OP_READ, &_rx_packets);
+  add_data_handlers("rx_syscalls", Handler::OP_READ, &_rx_syscalls);
+  add_data_handlers("tx_packets", Handler::OP_READ, &_tx_packets);
+  add_data_handlers("tx_syscalls", Handler::OP_READ, &_tx_syscalls);
 }
 
 CLICK_ENDDECLS
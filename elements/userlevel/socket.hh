@@ -7,8 +7,13 @@
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
 #include <sys/un.h>
+#include <sys/socket.h>
 CLICK_DECLS
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+# define HAVE_SOCKET_MMSG 1
+#endif
+
 /*
 =c
 
@@ -141,8 +146,45 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BURST
+
+Integer. Datagram sockets only. The maximum number of datagrams to receive
+per system call, and, for a pull input, to send per system call. On Linux,
+Socket uses recvmmsg(2) and sendmmsg(2) to move up to BURST datagrams at
+once. Default is 1, which uses plain recvfrom(2) and sendto(2); the maximum
+is 64.
+
+=item GSO
+
+Boolean. UDP only (Linux). If true, runs of pulled packets that have the
+same length and destination are sent as a single UDP_SEGMENT buffer of up to
+64 datagrams and 64KB, which the kernel segments. The last packet in a run
+may be shorter. Packets must not exceed the path MTU. Default is false.
+
+=item GRO
+
+Boolean. UDP only (Linux). If true, enables UDP_GRO on the socket, so the
+kernel may coalesce several received datagrams into one buffer; Socket splits
+them into packets again. Default is false.
+
 =back
 
+=h rx_packets read-only
+
+Returns the number of packets received.
+
+=h rx_syscalls read-only
+
+Returns the number of receive system calls made.
+
+=h tx_packets read-only
+
+Returns the number of packets sent.
+
+=h tx_syscalls read-only
+
+Returns the number of send system calls made.
+
 =e
 
   // A server socket
@@ -192,6 +234,10 @@ class Socket : public Element { public:
   bool allowed(IPAddress);
   void close_active(void);
   int write_packet(Packet*);
+#if HAVE_SOCKET_MMSG
+  int read_datagrams();
+  int write_datagrams(bool &any);
+#endif
 
 protected:
   Task _task;
@@ -235,6 +281,21 @@ private:
   IPRouteTable *_allow;		// lookup table of good hosts
   IPRouteTable *_deny;		// lookup table of bad hosts
 
+  enum { MAX_BURST = 64 };
+  unsigned _burst;		// datagrams per recvmmsg()/sendmmsg()
+  bool _gso;			// send with UDP_SEGMENT
+  bool _gro;			// receive with UDP_GRO
+#if HAVE_SOCKET_MMSG
+  WritablePacket *_rqv[MAX_BURST]; // receive buffers for recvmmsg()
+  Packet *_wqv[MAX_BURST];	// packets sendmmsg() could not send yet
+  int _nwqv;
+#endif
+
+  click_uint_large_t _rx_packets;
+  click_uint_large_t _rx_syscalls;
+  click_uint_large_t _tx_packets;
+  click_uint_large_t _tx_syscalls;
+
   int initialize_socket_error(ErrorHandler *, const char *);
 
 };
@@ -23,11 +23,14 @@
 #include <click/glue.hh>
 #include <elements/wifi/path.hh>
 #include <click/straccum.hh>
+#include <click/heap.hh>
 CLICK_DECLS
 
 LinkTable::LinkTable()
-  : _timer(this)
+  : _timer(this), _recompute_interval(0), _recompute_timer(this),
+    _nfull(0), _nincremental(0), _nchanges(0), _ntouched(0)
 {
+  _spt[0].full = _spt[1].full = true;
 }
 
 
@@ -42,12 +45,18 @@ LinkTable::initialize (ErrorHandler *)
 {
   _timer.initialize(this);
   _timer.schedule_now();
+  _recompute_timer.initialize(this);
   return 0;
 }
 
 void
-LinkTable::run_timer(Timer *)
+LinkTable::run_timer(Timer *t)
 {
+  if (t == &_recompute_timer) {
+    recompute(0, true);
+    recompute(1, true);
+    return;
+  }
   clear_stale();
   dijkstra(true);
   dijkstra(false);
@@ -69,6 +78,7 @@ LinkTable::configure (Vector<String> &conf, ErrorHandler *errh)
   ret = Args(conf, this, errh)
       .read("IP", _ip)
       .read("STALE", stale_period)
+      .read("RECOMPUTE_INTERVAL", _recompute_interval)
       .complete();
 
   if (!_ip)
@@ -77,6 +87,7 @@ LinkTable::configure (Vector<String> &conf, ErrorHandler *errh)
   _stale_timeout.assign(stale_period, 0);
 
   _hosts.insert(_ip, HostInfo(_ip));
+  reset_graph();
   return ret;
 }
 
@@ -88,6 +99,7 @@ LinkTable::take_state(Element *e, ErrorHandler *) {
 
   _hosts = q->_hosts;
   _links = q->_links;
+  reset_graph();
   dijkstra(true);
   dijkstra(false);
 }
@@ -137,7 +149,7 @@ LinkTable::clear()
 {
   _hosts.clear();
   _links.clear();
-
+  reset_graph();
 }
 bool
 LinkTable::update_link(IPAddress from, IPAddress to,
@@ -168,10 +180,16 @@ LinkTable::update_link(IPAddress from, IPAddress to,
 
   IPPair p = IPPair(from, to);
   LinkInfo *lnfo = _links.findp(p);
+  unsigned old_metric = 0;
   if (!lnfo) {
     _links.insert(p, LinkInfo(from, to, seq, age, metric));
   } else {
+    old_metric = lnfo->_metric;
     lnfo->update(seq, age, metric);
+    metric = lnfo->_metric;
+  }
+  if (metric != old_metric) {
+    set_edge(node_index(from), node_index(to), metric);
   }
   return true;
 }
@@ -464,6 +482,7 @@ LinkTable::clear_stale() {
     if ((unsigned) _stale_timeout.sec() >= nfo.age()) {
       links.insert(IPPair(nfo._from, nfo._to), nfo);
     } else {
+      set_edge(node_index(nfo._from), node_index(nfo._to), 0);
       if (0) {
 	click_chatter("%p{element} :: %s removing link %s -> %s metric %d seq %d age %d\n",
 		      this,
@@ -485,6 +504,17 @@ LinkTable::clear_stale() {
 
 }
 
+String
+LinkTable::print_dijkstra_stats()
+{
+  StringAccum sa;
+  sa << "full " << _nfull << "\n";
+  sa << "incremental " << _nincremental << "\n";
+  sa << "changes " << _nchanges << "\n";
+  sa << "hosts_updated " << _ntouched << "\n";
+  return sa.take_string();
+}
+
 Vector<IPAddress>
 LinkTable::get_neighbors(IPAddress ip)
 {
@@ -511,116 +541,278 @@ LinkTable::get_neighbors(IPAddress ip)
 
   return neighbors;
 }
-void
-LinkTable::dijkstra(bool from_me)
+int
+LinkTable::node_index(IPAddress ip)
 {
-  Timestamp start = Timestamp::now();
-  IPAddress src = _ip;
-
-  typedef HashMap<IPAddress, bool> IPMap;
-  IPMap ip_addrs;
+  int *ip_index = _node_index.findp(ip);
+  if (ip_index) {
+    return *ip_index;
+  }
+  int n = _nodes.size();
+  _node_index.insert(ip, n);
+  _nodes.push_back(Node());
+  _nodes.back().ip = ip;
+  for (int dir = 0; dir < 2; dir++) {
+    _spt[dir].dist.push_back(INFINITE_METRIC);
+    _spt[dir].prev.push_back(-1);
+  }
+  return n;
+}
 
-  for (HTIter iter = _hosts.begin(); iter.live(); iter++) {
-    ip_addrs.insert(iter.value()._ip, true);
+uint32_t
+LinkTable::edge_metric(int from, int to) const
+{
+  const Vector<Edge> &out = _nodes[from].out;
+  for (int i = 0; i < out.size(); i++) {
+    if (out[i].node == to) {
+      return out[i].metric;
+    }
   }
+  return INFINITE_METRIC;
+}
 
-  for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-    /* clear them all initially */
-    HostInfo *n = _hosts.findp(i.key());
-    n->clear(from_me);
+void
+LinkTable::set_adjacent(Vector<Edge> &v, int node, uint32_t metric)
+{
+  for (int i = 0; i < v.size(); i++) {
+    if (v[i].node == node) {
+      if (metric) {
+	v[i].metric = metric;
+      } else {
+	v[i] = v.back();
+	v.pop_back();
+      }
+      return;
+    }
+  }
+  if (metric) {
+    Edge e = { node, metric };
+    v.push_back(e);
   }
-  HostInfo *root_info = _hosts.findp(src);
+}
 
+/* A metric of 0 removes the link. */
+void
+LinkTable::set_edge(int from, int to, uint32_t metric)
+{
+  set_adjacent(_nodes[from].out, to, metric);
+  set_adjacent(_nodes[to].in, from, metric);
+  Change c = { from, to };
+  for (int dir = 0; dir < 2; dir++) {
+    if (!_spt[dir].full) {
+      _spt[dir].pending.push_back(c);
+    }
+  }
+}
 
-  assert(root_info);
+void
+LinkTable::reset_graph()
+{
+  _node_index.clear();
+  _nodes.clear();
+  for (int dir = 0; dir < 2; dir++) {
+    _spt[dir].dist.clear();
+    _spt[dir].prev.clear();
+    _spt[dir].pending.clear();
+    _spt[dir].full = true;
+  }
+  node_index(_ip);
+  for (HTIter iter = _hosts.begin(); iter.live(); iter++) {
+    node_index(iter.key());
+  }
+  for (LTIter iter = _links.begin(); iter.live(); iter++) {
+    const LinkInfo &nfo = iter.value();
+    if (nfo._metric) {
+      int from = node_index(nfo._from), to = node_index(nfo._to);
+      set_adjacent(_nodes[from].out, to, nfo._metric);
+      set_adjacent(_nodes[to].in, from, nfo._metric);
+    }
+  }
+}
 
-  if (from_me) {
-    root_info->_prev_from_me = root_info->_ip;
-    root_info->_metric_from_me = 0;
-  } else {
-    root_info->_prev_to_me = root_info->_ip;
-    root_info->_metric_to_me = 0;
+struct LinkTableHeapLess {
+  bool operator()(const Pair<uint32_t, int> &a,
+		  const Pair<uint32_t, int> &b) const {
+    return a.first < b.first;
   }
+};
 
-  IPAddress current_min_ip = root_info->_ip;
+/* Direction 0 computes paths from me, walking links forward; direction 1
+ * computes paths to me, walking them backward.  Either way prev[] points
+ * one hop closer to me. */
+void
+LinkTable::propagate(int dir, Vector<Pair<uint32_t, int> > &heap,
+		     Vector<int> &touched)
+{
+  SPT &t = _spt[dir];
+  LinkTableHeapLess less;
+  while (heap.size()) {
+    pop_heap(heap.begin(), heap.end(), less);
+    uint32_t d = heap.back().first;
+    int v = heap.back().second;
+    heap.pop_back();
+    if (d != t.dist[v]) {
+      continue;			/* stale entry */
+    }
+    const Vector<Edge> &next = dir ? _nodes[v].in : _nodes[v].out;
+    for (int i = 0; i < next.size(); i++) {
+      int w = next[i].node;
+      uint64_t nd = (uint64_t) d + next[i].metric;
+      if (nd < t.dist[w]) {
+	t.dist[w] = nd;
+	t.prev[w] = v;
+	touched.push_back(w);
+	heap.push_back(make_pair((uint32_t) nd, w));
+	push_heap(heap.begin(), heap.end(), less);
+      }
+    }
+  }
+}
 
-  while (current_min_ip) {
-    HostInfo *current_min = _hosts.findp(current_min_ip);
-    assert(current_min);
-    if (from_me) {
-      current_min->_marked_from_me = true;
+void
+LinkTable::publish(int dir, const Vector<int> &touched)
+{
+  SPT &t = _spt[dir];
+  int root = 0;			/* _ip is always node 0 */
+  for (int i = 0; i < touched.size(); i++) {
+    int v = touched[i];
+    HostInfo *nfo = _hosts.findp(_nodes[v].ip);
+    if (!nfo) {
+      continue;
+    }
+    nfo->clear(dir == 0);
+    if (t.dist[v] == INFINITE_METRIC) {
+      continue;
+    }
+    IPAddress prev = (v == root ? nfo->_ip : _nodes[t.prev[v]].ip);
+    if (dir == 0) {
+      nfo->_metric_from_me = t.dist[v];
+      nfo->_prev_from_me = prev;
+      nfo->_marked_from_me = true;
     } else {
-      current_min->_marked_to_me = true;
+      nfo->_metric_to_me = t.dist[v];
+      nfo->_prev_to_me = prev;
+      nfo->_marked_to_me = true;
     }
+  }
+}
 
+void
+LinkTable::recompute(int dir, bool force)
+{
+  SPT &t = _spt[dir];
+  if (!t.full && !t.pending.size()) {
+    return;
+  }
 
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *neighbor = _hosts.findp(i.key());
-      assert(neighbor);
-      bool marked = neighbor->_marked_to_me;
-      if (from_me) {
-	marked = neighbor->_marked_from_me;
+  Timestamp start = Timestamp::now();
+  if (_recompute_interval && !force) {
+    Timestamp next = t.last + Timestamp::make_msec(_recompute_interval);
+    if (start < next) {
+      if (_recompute_timer.initialized() && !_recompute_timer.scheduled()) {
+	_recompute_timer.schedule_at(next);
       }
+      return;
+    }
+  }
 
-      if (marked) {
-	continue;
-      }
+  int root = 0;
+  Vector<Pair<uint32_t, int> > heap;
+  Vector<int> touched;
+  LinkTableHeapLess less;
 
-      IPPair pair = IPPair(neighbor->_ip, current_min_ip);
-      if (from_me) {
-	pair = IPPair(current_min_ip, neighbor->_ip);
+  if (t.full || t.pending.size() * FULL_THRESHOLD > _nodes.size()) {
+    for (int v = 0; v < _nodes.size(); v++) {
+      t.dist[v] = INFINITE_METRIC;
+      t.prev[v] = -1;
+      touched.push_back(v);
+    }
+    t.dist[root] = 0;
+    t.prev[root] = root;
+    heap.push_back(make_pair(0U, root));
+    _nfull++;
+  } else {
+    /* Each pending change is a link whose metric differs from the one the
+     * current tree was built with.  First drop every host whose best path
+     * crossed a link that got dearer or disappeared, along with the hosts
+     * routed through it. */
+    Vector<int> stack;
+    for (int i = 0; i < t.pending.size(); i++) {
+      const Change &c = t.pending[i];
+      int a = dir ? c.to : c.from, b = dir ? c.from : c.to;
+      if (b != root && t.prev[b] == a
+	  && t.dist[b] < (uint64_t) t.dist[a] + edge_metric(c.from, c.to)) {
+	stack.push_back(b);
       }
-      LinkInfo *lnfo = _links.findp(pair);
-      if (!lnfo || !lnfo->_metric) {
+    }
+    int first_affected = touched.size();
+    while (stack.size()) {
+      int v = stack.back();
+      stack.pop_back();
+      if (t.dist[v] == INFINITE_METRIC) {
 	continue;
       }
-      uint32_t neighbor_metric = neighbor->_metric_to_me;
-      uint32_t current_metric = current_min->_metric_to_me;
-
-      if (from_me) {
-	neighbor_metric = neighbor->_metric_from_me;
-	current_metric = current_min->_metric_from_me;
+      t.dist[v] = INFINITE_METRIC;
+      t.prev[v] = -1;
+      touched.push_back(v);
+      const Vector<Edge> &next = dir ? _nodes[v].in : _nodes[v].out;
+      for (int j = 0; j < next.size(); j++) {
+	if (t.prev[next[j].node] == v && next[j].node != root) {
+	  stack.push_back(next[j].node);
+	}
       }
+    }
 
-
-      uint32_t adjusted_metric = current_metric + lnfo->_metric;
-      if (!neighbor_metric ||
-	  adjusted_metric < neighbor_metric) {
-	if (from_me) {
-	  neighbor->_metric_from_me = adjusted_metric;
-	  neighbor->_prev_from_me = current_min_ip;
-	} else {
-	  neighbor->_metric_to_me = adjusted_metric;
-	  neighbor->_prev_to_me = current_min_ip;
+    /* Reattach them through their best remaining neighbor. */
+    for (int i = first_affected; i < touched.size(); i++) {
+      int v = touched[i];
+      const Vector<Edge> &back = dir ? _nodes[v].out : _nodes[v].in;
+      for (int j = 0; j < back.size(); j++) {
+	int u = back[j].node;
+	if (t.dist[u] != INFINITE_METRIC
+	    && (uint64_t) t.dist[u] + back[j].metric < t.dist[v]) {
+	  t.dist[v] = t.dist[u] + back[j].metric;
+	  t.prev[v] = u;
 	}
-
+      }
+      if (t.dist[v] != INFINITE_METRIC) {
+	heap.push_back(make_pair(t.dist[v], v));
+	push_heap(heap.begin(), heap.end(), less);
       }
     }
 
-    current_min_ip = IPAddress();
-    uint32_t  min_metric = ~0;
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *nfo = _hosts.findp(i.key());
-      uint32_t metric = nfo->_metric_to_me;
-      bool marked = nfo->_marked_to_me;
-      if (from_me) {
-	metric = nfo->_metric_from_me;
-	marked = nfo->_marked_from_me;
-      }
-      if (!marked && metric &&
-	  metric < min_metric) {
-        current_min_ip = nfo->_ip;
-        min_metric = metric;
+    /* Then relax the links that got cheaper or appeared. */
+    for (int i = 0; i < t.pending.size(); i++) {
+      const Change &c = t.pending[i];
+      int a = dir ? c.to : c.from, b = dir ? c.from : c.to;
+      uint32_t m = edge_metric(c.from, c.to);
+      if (t.dist[a] != INFINITE_METRIC && m != INFINITE_METRIC
+	  && (uint64_t) t.dist[a] + m < t.dist[b]) {
+	t.dist[b] = t.dist[a] + m;
+	t.prev[b] = a;
+	touched.push_back(b);
+	heap.push_back(make_pair(t.dist[b], b));
+	push_heap(heap.begin(), heap.end(), less);
       }
     }
+    _nincremental++;
+  }
 
+  propagate(dir, heap, touched);
+  publish(dir, touched);
 
-  }
+  _nchanges += t.pending.size();
+  _ntouched += touched.size();
+  t.pending.clear();
+  t.full = false;
+  t.last = Timestamp::now();
+  dijkstra_time = t.last - start;
+}
 
-  dijkstra_time = Timestamp::now() - start;
-  //StringAccum sa;
-  //sa << "dijstra took " << finish - start;
-  //click_chatter("%s: %s\n", name().c_str(), sa.take_string().c_str());
+void
+LinkTable::dijkstra(bool from_me, bool force)
+{
+  recompute(from_me ? 0 : 1, force);
 }
 
 
@@ -635,7 +827,8 @@ enum {H_BLACKLIST,
       H_HOSTS,
       H_CLEAR,
       H_DIJKSTRA,
-      H_DIJKSTRA_TIME};
+      H_DIJKSTRA_TIME,
+      H_DIJKSTRA_STATS};
 
 static String
 LinkTable_read_param(Element *e, void *thunk)
@@ -663,6 +856,7 @@ LinkTable_read_param(Element *e, void *thunk)
       sa << td->dijkstra_time << "\n";
       return sa.take_string();
     }
+    case H_DIJKSTRA_STATS: return td->print_dijkstra_stats();
     default:
       return String();
     }
@@ -693,7 +887,7 @@ LinkTable_write_param(const String &in_s, Element *e, void *vparam,
     break;
   }
   case H_CLEAR: f->clear(); break;
-  case H_DIJKSTRA: f->dijkstra(true); f->dijkstra(false); break;
+  case H_DIJKSTRA: f->dijkstra(true, true); f->dijkstra(false, true); break;
   }
   return 0;
 }
@@ -709,6 +903,7 @@ LinkTable::add_handlers() {
   add_read_handler("hosts", LinkTable_read_param, H_HOSTS);
   add_read_handler("blacklist", LinkTable_read_param, H_BLACKLIST);
   add_read_handler("dijkstra_time", LinkTable_read_param, H_DIJKSTRA_TIME);
+  add_read_handler("dijkstra_stats", LinkTable_read_param, H_DIJKSTRA_STATS);
 
   add_write_handler("clear", LinkTable_write_param, H_CLEAR);
   add_write_handler("blacklist_clear", LinkTable_write_param, H_BLACKLIST_CLEAR);
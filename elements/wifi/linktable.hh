@@ -6,17 +6,33 @@
 #include <click/element.hh>
 #include <click/bighashmap.hh>
 #include <click/hashmap.hh>
+#include <click/pair.hh>
 #include "path.hh"
 CLICK_DECLS
 
 /*
  * =c
- * LinkTable(IP Address, [STALE timeout])
+ * LinkTable(IP Address, [STALE timeout, RECOMPUTE_INTERVAL msec])
  * =s Wifi
  * Keeps a Link state database and calculates Weighted Shortest Path
  * for other elements
  * =d
  * Runs dijkstra's algorithm occasionally.
+ *
+ * Shortest paths are maintained incrementally.  Link changes are queued,
+ * and the next dijkstra() applies them together: a cheaper link relaxes
+ * paths from its head outward, and a dearer or removed link recomputes only
+ * the hosts whose best path used it.  dijkstra() returns immediately if
+ * nothing has changed, and falls back to a full computation when many
+ * links changed at once.  If RECOMPUTE_INTERVAL is nonzero, dijkstra()
+ * applies changes at most once per RECOMPUTE_INTERVAL milliseconds; changes
+ * arriving in between are applied together when the interval expires.
+ * Default RECOMPUTE_INTERVAL is 0.
+ *
+ * =h dijkstra_stats read-only
+ * Returns the number of full and incremental computations, the number of
+ * link changes they applied, and the number of hosts whose routes they
+ * updated.
  * =a ARPTable
  *
  */
@@ -70,6 +86,7 @@ public:
   String print_routes(bool, bool);
   String print_links();
   String print_hosts();
+  String print_dijkstra_stats();
 
   static int static_update_link(const String &arg, Element *e,
 				void *, ErrorHandler *errh);
@@ -93,7 +110,7 @@ public:
   bool valid_route(const Vector<IPAddress> &route);
   unsigned get_route_metric(const Vector<IPAddress> &route);
   Vector<IPAddress> get_neighbors(IPAddress ip);
-  void dijkstra(bool);
+  void dijkstra(bool from_me, bool force = false);
   void clear_stale();
   Vector<IPAddress> best_route(IPAddress dst, bool from_me);
 
@@ -236,6 +253,51 @@ protected:
   IPAddress _ip;
   Timestamp _stale_timeout;
   Timer _timer;
+
+  /* shortest path state; direction 0 is from me, 1 is to me */
+  enum { INFINITE_METRIC = 0xFFFFFFFFU, FULL_THRESHOLD = 4 };
+
+  struct Edge {
+    int node;			/* the host at the other end */
+    uint32_t metric;
+  };
+  struct Node {
+    IPAddress ip;
+    Vector<Edge> out;		/* links from this host */
+    Vector<Edge> in;		/* links to this host */
+  };
+  struct Change {
+    int from;
+    int to;
+  };
+  struct SPT {
+    Vector<uint32_t> dist;
+    Vector<int> prev;
+    Vector<Change> pending;
+    bool full;			/* recompute from scratch */
+    Timestamp last;
+  };
+
+  HashMap<IPAddress, int> _node_index;
+  Vector<Node> _nodes;
+  SPT _spt[2];
+  uint32_t _recompute_interval;
+  Timer _recompute_timer;
+  uint32_t _nfull;
+  uint32_t _nincremental;
+  uint32_t _nchanges;
+  uint32_t _ntouched;
+
+  static void set_adjacent(Vector<Edge> &v, int node, uint32_t metric);
+  int node_index(IPAddress ip);
+  uint32_t edge_metric(int from, int to) const;
+  void set_edge(int from, int to, uint32_t metric);
+  void reset_graph();
+  void recompute(int dir, bool force);
+  void propagate(int dir, Vector<Pair<uint32_t, int> > &heap,
+		 Vector<int> &touched);
+  void publish(int dir, const Vector<int> &touched);
+
 };
 
 
@@ -29,7 +29,7 @@ CLICK_CXX_UNPROTECT
 #endif
 
 /** @file <click/atomic.hh>
- * @brief An atomic 32-bit integer.
+ * @brief Atomic 32-bit and 64-bit integers.
  */
 
 /** @class atomic_uint32_t
@@ -648,5 +648,99 @@ operator<=(const atomic_uint32_t &a, const atomic_uint32_t &b)
 
 typedef atomic_uint32_t uatomic32_t;
 
+#if HAVE_INT64_TYPES && !CLICK_LINUXMODULE
+/** @class atomic_uint64_t
+ * @brief A 64-bit integer with support for atomic operations.
+ *
+ * The atomic_uint64_t class represents a 64-bit counter that several threads
+ * may update and read at once.  Only assignment, addition, and reading are
+ * supported.  As with atomic_uint32_t, there are no constructors; use
+ * operator= to set the value.  It is truly atomic only with
+ * --enable-multithread. */
+class atomic_uint64_t { public:
+
+    inline uint64_t value() const;
+    inline operator uint64_t() const;
+
+    inline atomic_uint64_t &operator=(uint64_t x);
+    inline atomic_uint64_t &operator+=(uint64_t delta);
+    inline void operator++();
+    inline void operator++(int);
+
+  private:
+
+#if HAVE_MULTITHREAD
+    volatile uint64_t _val __attribute__((aligned(8)));
+#else
+    uint64_t _val;
+#endif
+
+};
+
+/** @brief  Return the value. */
+inline uint64_t
+atomic_uint64_t::value() const
+{
+#if HAVE_MULTITHREAD && !defined(__x86_64__)
+    // a 64-bit load may tear on 32-bit machines
+    return __sync_fetch_and_add(const_cast<volatile uint64_t *>(&_val), 0);
+#else
+    return _val;
+#endif
+}
+
+/** @brief  Return the value. */
+inline
+atomic_uint64_t::operator uint64_t() const
+{
+    return value();
+}
+
+/** @brief  Set the value to @a x. */
+inline atomic_uint64_t &
+atomic_uint64_t::operator=(uint64_t x)
+{
+#if HAVE_MULTITHREAD && !defined(__x86_64__)
+    uint64_t old = _val;
+    while (__sync_val_compare_and_swap(&_val, old, x) != old)
+	old = _val;
+#else
+    _val = x;
+#endif
+    return *this;
+}
+
+/** @brief  Atomically add @a delta to the value. */
+inline atomic_uint64_t &
+atomic_uint64_t::operator+=(uint64_t delta)
+{
+#if CLICK_ATOMIC_X86 && defined(__x86_64__)
+    asm volatile (CLICK_ATOMIC_LOCK "addq %1,%0"
+		  : "=m" (_val)
+		  : "r" (delta), "m" (_val)
+		  : "cc");
+#elif HAVE_MULTITHREAD
+    __sync_fetch_and_add(&_val, delta);
+#else
+    _val += delta;
+#endif
+    return *this;
+}
+
+/** @brief  Atomically increment the value. */
+inline void
+atomic_uint64_t::operator++()
+{
+    *this += 1;
+}
+
+/** @brief  Atomically increment the value. */
+inline void
+atomic_uint64_t::operator++(int)
+{
+    *this += 1;
+}
+#endif
+
 CLICK_ENDDECLS
 #endif
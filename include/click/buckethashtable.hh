@@ -0,0 +1,779 @@
+#ifndef CLICK_BUCKETHASHTABLE_HH
+#define CLICK_BUCKETHASHTABLE_HH
+/*
+ * buckethashtable.hh -- open-addressing HashTable variant
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software")
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <click/glue.hh>
+#include <click/pair.hh>
+#include <click/integers.hh>
+#include <click/algorithm.hh>
+#if defined(__SSE2__) && CLICK_USERLEVEL
+# include <emmintrin.h>
+# define CLICK_BUCKETHASHTABLE_SSE2 1
+#endif
+CLICK_DECLS
+
+/** @file <click/buckethashtable.hh>
+ * @brief Open-addressing hash table with cache-line-sized buckets.
+ */
+
+template <typename K, typename V> class BucketHashTable;
+template <typename K, typename V> class BucketHashTable_const_iterator;
+template <typename K, typename V> class BucketHashTable_iterator;
+
+/** @class BucketHashTable
+  @brief Open-addressing hash table template.
+
+  BucketHashTable<K, V> maps keys of type K to values of type V, like
+  HashTable<K, V>, but stores elements inline instead of in separately
+  allocated chain nodes.  Elements live in buckets of eight slots.  Each
+  bucket keeps a 16-bit fingerprint ("tag") per slot in a 16-byte word, so a
+  lookup compares all eight tags at once (with SSE2 where available) and
+  touches the element array only on a tag match.
+
+  Every key has two candidate buckets (bucketized cuckoo hashing), so a
+  lookup reads at most two tag words.  Inserting into two full buckets
+  displaces an existing element to its alternate bucket.
+
+  The table grows incrementally.  When the load factor passes 7/8, a table
+  twice as large is allocated, and each later insertion moves a couple of
+  buckets from the old table into the new one; lookups consult both tables
+  until the move completes.  Only an overlong displacement chain forces a
+  synchronous rebuild, which is rare at these load factors.
+
+  Most of the HashTable<K, V> interface is supported, so a user can switch
+  with a typedef.  The main difference is that insertions may move existing
+  elements: an insertion invalidates all iterators and element pointers.
+  Erasing an element does not move any others, so erase(iterator) is safe
+  while iterating. */
+template <typename K, typename V>
+class BucketHashTable {
+
+    enum { bucket_ways = 8, max_kicks = 64, drain_per_insert = 2 };
+
+    struct bucket {
+	uint16_t tag[bucket_ways];
+    };
+
+  public:
+
+    /** @brief Key type. */
+    typedef K key_type;
+
+    /** @brief Const reference to key type. */
+    typedef const K &key_const_reference;
+
+    /** @brief Value type. */
+    typedef V mapped_type;
+
+    /** @brief Pair of key type and value type. */
+    typedef Pair<K, V> value_type;
+
+    /** @brief Type of sizes. */
+    typedef size_t size_type;
+
+    typedef BucketHashTable_const_iterator<K, V> const_iterator;
+    typedef BucketHashTable_iterator<K, V> iterator;
+
+
+    /** @brief Construct an empty hash table with normal default value. */
+    BucketHashTable()
+	: _default_value() {
+	initialize(2);
+    }
+
+    /** @brief Construct an empty hash table with default value @a d. */
+    explicit BucketHashTable(const mapped_type &d)
+	: _default_value(d) {
+	initialize(2);
+    }
+
+    /** @brief Construct an empty hash table with room for at least @a n
+     * elements.
+     * @param d default value
+     * @param n minimum capacity */
+    BucketHashTable(const mapped_type &d, size_type n)
+	: _default_value(d) {
+	initialize(buckets_for(n));
+    }
+
+    /** @brief Construct a hash table as a copy of @a x. */
+    BucketHashTable(const BucketHashTable<K, V> &x)
+	: _default_value(x._default_value) {
+	initialize(buckets_for(x.size()));
+	copy_elements(x);
+    }
+
+    /** @brief Destroy this hash table, freeing its memory. */
+    ~BucketHashTable() {
+	destroy_table(_old);
+	destroy_table(_t);
+    }
+
+
+    /** @brief Return the number of elements in the hash table. */
+    inline size_type size() const {
+	return _t.size + _old.size;
+    }
+
+    /** @brief Return true iff size() == 0. */
+    inline bool empty() const {
+	return size() == 0;
+    }
+
+    /** @brief Return the number of element slots in the hash table. */
+    inline size_type bucket_count() const {
+	return (size_type) (_t.mask + 1) * bucket_ways;
+    }
+
+    /** @brief Return the hash table's default value. */
+    inline const mapped_type &default_value() const {
+	return _default_value;
+    }
+
+
+    /** @brief Return an iterator for the first element in the table. */
+    inline iterator begin();
+    /** @overload */
+    inline const_iterator begin() const;
+
+    /** @brief Return an iterator for the end of the table. */
+    inline iterator end();
+    /** @overload */
+    inline const_iterator end() const;
+
+
+    /** @brief Return 1 if an element with key @a key exists, 0 if not. */
+    inline size_type count(key_const_reference key) const {
+	return lookup(key) ? 1 : 0;
+    }
+
+    /** @brief Return an iterator for the element with key @a key, if any.
+     *
+     * Returns end() if no such element exists. */
+    inline iterator find(key_const_reference key);
+    /** @overload */
+    inline const_iterator find(key_const_reference key) const;
+
+    /** @brief Return the value for @a key.
+     *
+     * If no element for @a key currently exists, returns default_value(). */
+    const mapped_type &get(key_const_reference key) const {
+	if (const value_type *p = lookup(key))
+	    return p->second;
+	else
+	    return _default_value;
+    }
+
+    /** @brief Return a pointer to the value for @a key.
+     *
+     * If no element for @a key currently exists, returns a null pointer. */
+    mapped_type *get_pointer(key_const_reference key) {
+	value_type *p = lookup(key);
+	return p ? &p->second : 0;
+    }
+    /** @overload */
+    const mapped_type *get_pointer(key_const_reference key) const {
+	const value_type *p = lookup(key);
+	return p ? &p->second : 0;
+    }
+
+    /** @brief Return a reference to the value for @a key.
+     *
+     * If no element for @a key exists, one is inserted with value
+     * default_value().  This may invalidate existing iterators. */
+    inline mapped_type &operator[](key_const_reference key) {
+	return insert(key, _default_value, false)->second;
+    }
+
+    /** @brief Ensure an element with key @a key and return its iterator.
+     *
+     * If no element for @a key exists, one is inserted with value
+     * default_value().  This may invalidate existing iterators. */
+    inline iterator find_insert(key_const_reference key);
+
+    /** @brief Set the mapping for @a key to @a value.
+     * @return true if a new element was added, false if an existing element
+     * was replaced
+     *
+     * This may invalidate existing iterators. */
+    bool set(key_const_reference key, const mapped_type &value) {
+	size_type old_size = size();
+	insert(key, value, true);
+	return size() != old_size;
+    }
+
+    /** @brief Remove the element indicated by @a it.
+     * @return An iterator for the next element.
+     *
+     * Erasing an element does not move other elements, so @a it may come
+     * from an ongoing iteration. */
+    inline iterator erase(const iterator &it);
+
+    /** @brief Remove any element with @a key.
+     * @return The number of elements removed, which is always 0 or 1. */
+    size_type erase(key_const_reference key) {
+	uint32_t h = hash(key);
+	uint16_t tag = tag_of(h);
+	table *t;
+	uint32_t slot;
+	if (locate(_t, key, h, tag, slot))
+	    t = &_t;
+	else if (_old.mem && locate(_old, key, h, tag, slot))
+	    t = &_old;
+	else
+	    return 0;
+	remove_slot(*t, slot);
+	return 1;
+    }
+
+    /** @brief Remove all elements. */
+    void clear() {
+	destroy_table(_old);
+	clear_table(_t);
+    }
+
+    /** @brief Swap the contents of this hash table and @a x. */
+    void swap(BucketHashTable<K, V> &x) {
+	table t = _t; _t = x._t; x._t = t;
+	t = _old; _old = x._old; x._old = t;
+	uint32_t d = _drain; _drain = x._drain; x._drain = d;
+	d = _kick; _kick = x._kick; x._kick = d;
+	click_swap(_default_value, x._default_value);
+    }
+
+    /** @brief Rebuild the table with room for at least @a n elements. */
+    void rehash(size_type n) {
+	if (n < size())
+	    n = size();
+	rebuild(buckets_for(n), 0);
+    }
+
+    /** @brief Assign this hash table's contents to a copy of @a x. */
+    BucketHashTable<K, V> &operator=(const BucketHashTable<K, V> &x) {
+	if (&x != this) {
+	    clear();
+	    _default_value = x._default_value;
+	    copy_elements(x);
+	}
+	return *this;
+    }
+
+  private:
+
+    // Each bucket holds its tag word followed by its eight slots, so a hit
+    // usually touches a single cache line.
+    static const size_t slot_offset = sizeof(bucket) > __alignof__(value_type)
+	? sizeof(bucket) : __alignof__(value_type);
+    static const size_t bucket_bytes = (slot_offset + bucket_ways * sizeof(value_type)
+					+ __alignof__(value_type) - 1)
+	& ~(__alignof__(value_type) - 1);
+
+    struct table {
+	char *mem;
+	uint32_t mask;		// number of buckets - 1
+	size_type size;
+
+	bucket &b(uint32_t i) const {
+	    return *reinterpret_cast<bucket *>(mem + i * bucket_bytes);
+	}
+	value_type &slot(uint32_t s) const {
+	    return reinterpret_cast<value_type *>(mem + (s / bucket_ways) * bucket_bytes + slot_offset)[s % bucket_ways];
+	}
+	uint16_t &tag(uint32_t s) const {
+	    return b(s / bucket_ways).tag[s % bucket_ways];
+	}
+    };
+
+    table _t;			// current table
+    table _old;			// table being drained into _t, if any
+    uint32_t _drain;		// next _old bucket to drain
+    uint32_t _kick;		// rotates displacement victims
+    V _default_value;
+
+    static inline uint32_t hash(key_const_reference key) {
+	// Finalize Click's hashcode, which is often weak in the low bits.
+	hashcode_t hc = hashcode(key);
+	uint32_t x = (uint32_t) hc ^ (uint32_t) ((uint64_t) hc >> 32);
+	x ^= x >> 16;
+	x *= 0x85EBCA6BU;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35U;
+	x ^= x >> 16;
+	return x;
+    }
+    static inline uint16_t tag_of(uint32_t h) {
+	uint16_t tag = h >> 16;
+	return tag ? tag : 1;	// tag 0 marks an empty slot
+    }
+    static inline uint32_t alt_bucket(uint32_t b, uint16_t tag, uint32_t mask) {
+	return (b ^ (tag * 0x5BD1E995U)) & mask;
+    }
+    static uint32_t buckets_for(size_type n) {
+	uint32_t nb = 2;
+	while ((size_type) nb * bucket_ways * 7 / 8 < n)
+	    nb *= 2;
+	return nb;
+    }
+
+    // Return a bitmask with bit 2*i set iff tag[i] == tag.
+    static inline unsigned match(const bucket &bk, uint16_t tag) {
+#if CLICK_BUCKETHASHTABLE_SSE2
+	__m128i tags = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bk.tag));
+	__m128i eq = _mm_cmpeq_epi16(tags, _mm_set1_epi16(tag));
+	return _mm_movemask_epi8(eq) & 0x5555;
+#else
+	unsigned bits = 0;
+	for (int i = 0; i < bucket_ways; ++i)
+	    if (bk.tag[i] == tag)
+		bits |= 1U << (2 * i);
+	return bits;
+#endif
+    }
+
+    static bool locate_in_bucket(const table &t, key_const_reference key,
+				 uint32_t b, uint16_t tag, uint32_t &slot) {
+	for (unsigned bits = match(t.b(b), tag); bits; bits &= bits - 1) {
+	    uint32_t s = b * bucket_ways + (ffs_lsb(bits) - 1) / 2;
+	    if (t.slot(s).first == key) {
+		slot = s;
+		return true;
+	    }
+	}
+	return false;
+    }
+    static inline bool locate(const table &t, key_const_reference key,
+			      uint32_t h, uint16_t tag, uint32_t &slot) {
+	uint32_t b1 = h & t.mask, b2 = alt_bucket(b1, tag, t.mask);
+	return locate_in_bucket(t, key, b1, tag, slot)
+	    || (b2 != b1 && locate_in_bucket(t, key, b2, tag, slot));
+    }
+
+    const value_type *lookup(key_const_reference key) const {
+	uint32_t h = hash(key);
+	uint16_t tag = tag_of(h);
+	uint32_t slot;
+	if (locate(_t, key, h, tag, slot))
+	    return &_t.slot(slot);
+	if (unlikely(_old.mem != 0) && locate(_old, key, h, tag, slot))
+	    return &_old.slot(slot);
+	return 0;
+    }
+    value_type *lookup(key_const_reference key) {
+	return const_cast<value_type *>(static_cast<const BucketHashTable<K, V> *>(this)->lookup(key));
+    }
+
+    static inline int free_way(const bucket &bk) {
+	unsigned bits = match(bk, 0);
+	return bits ? (ffs_lsb(bits) - 1) / 2 : -1;
+    }
+
+    // Add 'v' to 't' without checking for duplicates.  Returns false if a
+    // displacement chain ran too long; then 'v' holds the element left
+    // without a slot, which may differ from the one passed in.  Sets
+    // '*placed' to the slot that first received 'v'.
+    bool place(table &t, value_type &v, uint32_t h, uint32_t *placed = 0) {
+	uint16_t tag = tag_of(h);
+	uint32_t b = h & t.mask;
+	uint32_t b2 = alt_bucket(b, tag, t.mask);
+	int way = free_way(t.b(b));
+	if (way < 0 && (way = free_way(t.b(b2))) >= 0)
+	    b = b2;
+	else if (way < 0 && (++_kick & 1))
+	    b = b2;
+	if (placed)
+	    *placed = b * bucket_ways + (way < 0 ? (_kick >> 1) & (bucket_ways - 1) : way);
+
+	// If both buckets are full, evict a victim from one and carry it to
+	// its alternate bucket, repeating until some bucket has room.
+	for (int kicks = 0; way < 0; ++kicks) {
+	    if (kicks == max_kicks)
+		return false;
+	    way = (_kick++ >> 1) & (bucket_ways - 1);
+	    value_type &victim = t.slot(b * bucket_ways + way);
+	    value_type tmp(victim);
+	    victim = v;
+	    v = tmp;
+	    uint16_t vtag = t.b(b).tag[way];
+	    t.b(b).tag[way] = tag;
+	    tag = vtag;
+	    b = alt_bucket(b, tag, t.mask);
+	    way = free_way(t.b(b));
+	}
+
+	new((void *) &t.slot(b * bucket_ways + way)) value_type(v);
+	t.b(b).tag[way] = tag;
+	++t.size;
+	return true;
+    }
+
+    void remove_slot(table &t, uint32_t slot) {
+	t.slot(slot).~value_type();
+	t.tag(slot) = 0;
+	--t.size;
+    }
+
+    value_type *insert(key_const_reference key, const mapped_type &value,
+		       bool replace) {
+	uint32_t h = hash(key);
+	uint16_t tag = tag_of(h);
+	uint32_t slot;
+	if (locate(_t, key, h, tag, slot)) {
+	    if (replace)
+		_t.slot(slot).second = value;
+	    return &_t.slot(slot);
+	}
+	if (unlikely(_old.mem != 0)) {
+	    if (locate(_old, key, h, tag, slot)) {
+		if (replace)
+		    _old.slot(slot).second = value;
+		return &_old.slot(slot);
+	    }
+	    drain();
+	}
+	if (unlikely((size() + 1) * 8 > bucket_count() * 7) && !_old.mem)
+	    grow();
+
+	value_type v(key, value);
+	if (unlikely(!place(_t, v, h, &slot))) {
+	    rebuild((_t.mask + 1) * 2, &v);
+	    locate(_t, key, h, tag, slot);
+	} else if (unlikely(!(_t.slot(slot).first == key)))
+	    locate(_t, key, h, tag, slot);
+	return &_t.slot(slot);
+    }
+
+    void grow() {
+	_old = _t;
+	allocate_table(_t, (_old.mask + 1) * 2);
+	_drain = 0;
+    }
+
+    // Move a few buckets from _old into _t.
+    void drain() {
+	for (int n = 0; n < drain_per_insert && _old.mem; ++n) {
+	    uint32_t b = _drain;
+	    for (int way = 0; way < bucket_ways; ++way)
+		if (_old.b(b).tag[way]) {
+		    uint32_t slot = b * bucket_ways + way;
+		    value_type v(_old.slot(slot));
+		    remove_slot(_old, slot);
+		    if (!place(_t, v, hash(v.first))) {
+			rebuild((_t.mask + 1) * 2, &v);
+			return;
+		    }
+		}
+	    if (++_drain > _old.mask)
+		destroy_table(_old);
+	}
+    }
+
+    // Synchronously rebuild everything, plus '*extra', into a table with
+    // at least 'nb' buckets.
+    void rebuild(uint32_t nb, value_type *extra) {
+	while (1) {
+	    table n;
+	    allocate_table(n, nb);
+	    if (copy_table(n, _t) && copy_table(n, _old)) {
+		if (extra) {
+		    value_type v(*extra);
+		    if (!place(n, v, hash(v.first))) {
+			destroy_table(n);
+			nb *= 2;
+			continue;
+		    }
+		}
+		destroy_table(_old);
+		destroy_table(_t);
+		_t = n;
+		return;
+	    }
+	    destroy_table(n);
+	    nb *= 2;
+	}
+    }
+
+    bool copy_table(table &dst, const table &src) {
+	for (uint32_t s = 0; src.mem && s < (src.mask + 1) * bucket_ways; ++s)
+	    if (src.tag(s)) {
+		value_type v(src.slot(s));
+		if (!place(dst, v, hash(v.first)))
+		    return false;
+	    }
+	return true;
+    }
+
+    void copy_elements(const BucketHashTable<K, V> &x) {
+	for (const_iterator it = x.begin(); it.live(); ++it)
+	    set(it.key(), it.value());
+    }
+
+    void initialize(uint32_t nb) {
+	allocate_table(_t, nb);
+	_old.mem = 0;
+	_old.mask = 0;
+	_old.size = 0;
+	_drain = _kick = 0;
+    }
+
+    static void allocate_table(table &t, uint32_t nb) {
+	t.mem = new char[bucket_bytes * nb];
+	for (uint32_t i = 0; i < nb; ++i)
+	    memset(&t.b(i), 0, sizeof(bucket));
+	t.mask = nb - 1;
+	t.size = 0;
+    }
+
+    static void clear_table(table &t) {
+	for (uint32_t s = 0; t.size && s < (t.mask + 1) * bucket_ways; ++s)
+	    if (t.tag(s)) {
+		t.slot(s).~value_type();
+		t.tag(s) = 0;
+		--t.size;
+	    }
+    }
+
+    static void destroy_table(table &t) {
+	if (t.mem) {
+	    clear_table(t);
+	    delete[] t.mem;
+	    t.mem = 0;
+	}
+    }
+
+    friend class BucketHashTable_const_iterator<K, V>;
+    friend class BucketHashTable_iterator<K, V>;
+
+};
+
+template <typename K, typename V>
+class BucketHashTable_const_iterator { public:
+
+    typedef typename BucketHashTable<K, V>::value_type value_type;
+
+    /** @brief Return a pointer to the element, null if *this == end(). */
+    const value_type *get() const {
+	return _hash ? &table()->slot(_slot) : 0;
+    }
+
+    /** @brief Return a pointer to the element.
+     * @pre *this != end() */
+    const value_type *operator->() const {
+	return get();
+    }
+
+    /** @brief Return a reference to the element.
+     * @pre *this != end() */
+    const value_type &operator*() const {
+	return *get();
+    }
+
+    /** @brief Return a reference to the element's key.
+     * @pre *this != end() */
+    const K &key() const {
+	return get()->first;
+    }
+
+    /** @brief Return a reference to the element's value.
+     * @pre *this != end() */
+    const V &value() const {
+	return get()->second;
+    }
+
+    /** @brief Return true iff *this != end(). */
+    bool live() const {
+	return _hash != 0;
+    }
+
+    typedef bool (BucketHashTable_const_iterator::*unspecified_bool_type)() const;
+    /** @brief Return true iff *this != end(). */
+    inline operator unspecified_bool_type() const {
+	return _hash ? &BucketHashTable_const_iterator::live : 0;
+    }
+
+    /** @brief Advance this iterator to the next element. */
+    void operator++(int) {
+	advance(_slot + 1);
+    }
+    /** @brief Advance this iterator to the next element. */
+    void operator++() {
+	advance(_slot + 1);
+    }
+
+  private:
+
+    const BucketHashTable<K, V> *_hash;
+    bool _old;
+    uint32_t _slot;
+
+    typedef typename BucketHashTable<K, V>::table table_type;
+
+    BucketHashTable_const_iterator(const BucketHashTable<K, V> *hash,
+				   bool old, uint32_t slot)
+	: _hash(hash), _old(old), _slot(slot) {
+    }
+    BucketHashTable_const_iterator(const BucketHashTable<K, V> *hash)
+	: _hash(hash), _old(true), _slot(0) {
+	if (hash)
+	    advance(0);
+    }
+
+    const table_type *table() const {
+	return _old ? &_hash->_old : &_hash->_t;
+    }
+
+    void advance(uint32_t slot) {
+	enum { ways = BucketHashTable<K, V>::bucket_ways };
+	while (1) {
+	    const table_type *t = table();
+	    for (; t->mem && slot < (t->mask + 1) * ways; ++slot)
+		if (t->tag(slot)) {
+		    _slot = slot;
+		    return;
+		}
+	    if (!_old) {
+		_hash = 0;
+		return;
+	    }
+	    _old = false;
+	    slot = 0;
+	}
+    }
+
+    friend class BucketHashTable<K, V>;
+    friend class BucketHashTable_iterator<K, V>;
+
+};
+
+template <typename K, typename V>
+class BucketHashTable_iterator : public BucketHashTable_const_iterator<K, V> { public:
+
+    typedef BucketHashTable_const_iterator<K, V> inherited;
+    typedef typename inherited::value_type value_type;
+
+    /** @brief Return a pointer to the element, null if *this == end(). */
+    value_type *get() const {
+	return const_cast<value_type *>(inherited::get());
+    }
+
+    /** @brief Return a pointer to the element.
+     * @pre *this != end() */
+    inline value_type *operator->() const {
+	return get();
+    }
+
+    /** @brief Return a reference to the element.
+     * @pre *this != end() */
+    inline value_type &operator*() const {
+	return *get();
+    }
+
+    /** @brief Return a mutable reference to the element's value.
+     * @pre *this != end() */
+    V &value() const {
+	return get()->second;
+    }
+
+  private:
+
+    BucketHashTable_iterator(BucketHashTable<K, V> *hash, bool old, uint32_t slot)
+	: inherited(hash, old, slot) {
+    }
+    BucketHashTable_iterator(BucketHashTable<K, V> *hash)
+	: inherited(hash) {
+    }
+
+    friend class BucketHashTable<K, V>;
+
+};
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::iterator
+BucketHashTable<K, V>::begin()
+{
+    return iterator(this);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::const_iterator
+BucketHashTable<K, V>::begin() const
+{
+    return const_iterator(this);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::iterator
+BucketHashTable<K, V>::end()
+{
+    return iterator(0);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::const_iterator
+BucketHashTable<K, V>::end() const
+{
+    return const_iterator(0);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::iterator
+BucketHashTable<K, V>::find(key_const_reference key)
+{
+    uint32_t h = hash(key);
+    uint16_t tag = tag_of(h);
+    uint32_t slot;
+    if (locate(_t, key, h, tag, slot))
+	return iterator(this, false, slot);
+    else if (_old.mem && locate(_old, key, h, tag, slot))
+	return iterator(this, true, slot);
+    else
+	return end();
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::const_iterator
+BucketHashTable<K, V>::find(key_const_reference key) const
+{
+    return const_cast<BucketHashTable<K, V> *>(this)->find(key);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::iterator
+BucketHashTable<K, V>::find_insert(key_const_reference key)
+{
+    insert(key, _default_value, false);
+    return find(key);
+}
+
+template <typename K, typename V>
+inline typename BucketHashTable<K, V>::iterator
+BucketHashTable<K, V>::erase(const iterator &it)
+{
+    if (!it._hash)
+	return it;
+    table &t = it._old ? _old : _t;
+    remove_slot(t, it._slot);
+    iterator next(it);
+    next.advance(it._slot + 1);
+    return next;
+}
+
+template <typename K, typename V>
+inline void
+click_swap(BucketHashTable<K, V> &a, BucketHashTable<K, V> &b)
+{
+    a.swap(b);
+}
+
+CLICK_ENDDECLS
+#endif
@@ -6,6 +6,7 @@
 #include <click/string.hh>
 #include <click/packet.hh>
 #include <click/handler.hh>
+#include <click/profiler.hh>
 CLICK_DECLS
 class Router;
 class Master;
@@ -240,7 +241,7 @@ class Element { public:
 #if CLICK_STATS >= 1
         mutable unsigned _packets;      // How many packets have we moved?
 #endif
-#if CLICK_STATS >= 2
+#if CLICK_STATS >= 2 || HAVE_ELEMENT_PROFILER
         Element* _owner;                // Whose input or output are we?
 #endif
 
@@ -517,8 +518,12 @@ Element::input_is_push(int port) const
 
 #if CLICK_STATS >= 2
 # define PORT_ASSIGN(o) _packets = 0; _owner = (o)
+#elif CLICK_STATS >= 1 && HAVE_ELEMENT_PROFILER
+# define PORT_ASSIGN(o) _packets = 0; _owner = (o)
 #elif CLICK_STATS >= 1
 # define PORT_ASSIGN(o) _packets = 0; (void) (o)
+#elif HAVE_ELEMENT_PROFILER
+# define PORT_ASSIGN(o) _owner = (o)
 #else
 # define PORT_ASSIGN(o) (void) (o)
 #endif
@@ -627,6 +632,12 @@ Element::Port::push(Packet* p) const
     _e->_xfer_own_cycles += own_delta;
     _owner->_child_cycles += all_delta;
 #else
+# if HAVE_ELEMENT_PROFILER
+    if (unlikely(ElementProfiler::enabled()) && ElementProfiler::sample()) {
+        ElementProfiler::push(_owner, _e, _port, p);
+        return;
+    }
+# endif
 # if HAVE_BOUND_PORT_TRANSFER
     _bound.push(_e, _port, p);
 # else
@@ -671,10 +682,16 @@ Element::Port::pull() const
     _e->_xfer_own_cycles += own_delta;
     _owner->_child_cycles += all_delta;
 #else
+    Packet *p;
+# if HAVE_ELEMENT_PROFILER
+    if (unlikely(ElementProfiler::enabled()) && ElementProfiler::sample())
+        p = ElementProfiler::pull(_owner, _e, _port);
+    else
+# endif
 # if HAVE_BOUND_PORT_TRANSFER
-    Packet *p = _bound.pull(_e, _port);
+    p = _bound.pull(_e, _port);
 # else
-    Packet *p = _e->pull(_port);
+    p = _e->pull(_port);
 # endif
 #endif
 #if CLICK_STATS >= 1
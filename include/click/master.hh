@@ -64,6 +64,10 @@ class Master { public:
 
 #if CLICK_USERLEVEL
     static volatile sig_atomic_t signals_pending;
+    // Number of routers whose source tasks are throttled by a hard CPU
+    // quota.  While nonzero, idle threads wake once per statistics window
+    // so quotas are enforced and the routers released on time.
+    static atomic_uint32_t quota_throttled;
 #endif
 
   private:
@@ -131,12 +135,33 @@ class Master { public:
 
 private:
     int _msg_id;
+    click_cycles_t _cycles_epoch;
+    Timestamp _cycles_epoch_time;
     // -1 failed 0 processing 1 successful
     std::unordered_map<int, int> _msg_status;
 
 public:
     pthread_rwlock_t _rw_lock;
     HashMap<String, Router*> _router_map;
+    unsigned _router_map_version;       // incremented on every change
+
+    // Cycle-budget scheduling: when on, a task's pass advances with the
+    // cycles each run takes instead of once per run.
+    bool _budget_sched;
+    unsigned _budget_quantum;           // cycles in a default time slice
+    enum { DEFAULT_BUDGET_QUANTUM = 10000 };
+
+    // CPU quotas: once any router has had a quota, the first run thread to
+    // start a statistics window enforces quotas for the window before it.
+    bool _quotas;
+    atomic_uint32_t _quota_window;
+
+    // The newest statistics window any thread has started.  Elements that
+    // publish per-window statistics compare against it on their fast paths
+    // instead of reading the clock.
+    volatile unsigned _stats_tick;
+
+    inline double cycles_hz() const;
     Vector<Router*> _unused_tasks;
 
     inline void lock_read() {
@@ -183,6 +208,11 @@ public:
         return _router_map.find(rname, 0);
     }
 
+    void router_names(Vector<String>& names) const {
+        for (HashMap<String, Router*>::const_iterator it = _router_map.begin(); it.live(); it++)
+            names.push_back(it.key());
+    }
+
     int add_thread();
 
     int run_nthreads() const;
@@ -258,13 +288,19 @@ TimerSet::next_timer_delay(bool more_tasks, Timestamp &t) const
     if (more_tasks || Master::signals_pending)
         return 0;
     t = timer_expiry_steady_adjusted();
-    if (!t)
-        return -1;              // block forever
-    else if (unlikely(Timestamp::warp_jumping())) {
+    if (!t) {
+        if (!Master::quota_throttled)
+            return -1;          // block forever
+        t = Timestamp::make_msec(Task::STATS_WINDOW_MSEC);
+        return 1;
+    } else if (unlikely(Timestamp::warp_jumping())) {
         Timestamp::warp_jump_steady(t);
         return 0;
     } else if ((t -= Timestamp::now_steady(), !t.is_negative())) {
         t = t.warp_real_delay();
+        if (Master::quota_throttled
+            && t > Timestamp::make_msec(Task::STATS_WINDOW_MSEC))
+            t = Timestamp::make_msec(Task::STATS_WINDOW_MSEC);
         return 1;
     } else
         return 0;
@@ -322,5 +358,15 @@ Element::master() const
     return _router->master();
 }
 
+/** @brief Return the cycle counter's rate in cycles per second.
+ *
+ * The rate is measured from the Master's creation until now. */
+inline double
+Master::cycles_hz() const
+{
+    double sec = (Timestamp::now() - _cycles_epoch_time).doubleval();
+    return sec > 0 ? (click_get_cycles() - _cycles_epoch) / sec : 0;
+}
+
 CLICK_ENDDECLS
 #endif
@@ -679,7 +679,8 @@ inline NotifierSignal Notifier::downstream_full_signal(Element* e, int port, int
  * @param schedule if true, wake up listener tasks
  *
  * If @a active and @a schedule are both true, and the signal was previously
- * inactive, then any listener Tasks are scheduled with Task::reschedule().
+ * inactive, then any listener Tasks are scheduled with Task::wake(), which
+ * takes no locks when the listener lives on another thread.
  *
  * @sa wake, sleep, add_listener
  */
@@ -692,10 +693,10 @@ inline void ActiveNotifier::set_active(bool active, bool schedule) {
 	// reschedule might run BEFORE we set the notifier; after which it
 	// would go to sleep forever.
 	if (_listener1)
-	    _listener1->reschedule();
+	    _listener1->wake();
 	else if (task_or_signal_t *tos = _listeners) {
 	    for (; tos->p > 1; tos++)
-		tos->t->reschedule();
+		tos->t->wake();
 	    if (tos->p == 1)
 		for (tos++; tos->p; tos += 2)
 		    tos->f(tos[1].v, this);
@@ -707,7 +708,7 @@ inline void ActiveNotifier::set_active(bool active, bool schedule) {
  * tasks.
  *
  * If the signal was previously inactive, then any listener Tasks are
- * scheduled with Task::reschedule().
+ * scheduled with Task::wake().
  *
  * @sa set_active, add_listener
  */
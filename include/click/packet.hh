@@ -70,6 +70,18 @@ class Packet { public:
 
     static void static_cleanup();
 
+#if HAVE_CLICK_PACKET_POOL
+    /** @brief Free packets and data buffers held by the packet pools. */
+    struct PoolStats {
+	unsigned thread_pools;		///< number of thread pools
+	unsigned packets;		///< free packets in thread pools
+	unsigned buffers;		///< free data buffers in thread pools
+	unsigned global_packets;	///< free packets in the global pool
+	unsigned global_buffers;	///< free data buffers in the global pool
+    };
+    static void pool_stats(PoolStats &stats);
+#endif
+
     inline void kill();
 
     inline bool shared() const;
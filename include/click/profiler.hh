@@ -0,0 +1,97 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/profiler.cc" -*-
+#ifndef CLICK_PROFILER_HH
+#define CLICK_PROFILER_HH
+#include <click/glue.hh>
+#include <click/string.hh>
+CLICK_DECLS
+class Element;
+class Packet;
+class Router;
+
+/** @file <click/profiler.hh>
+ * @brief Sampling profiler for packet transfers between elements.
+ */
+
+#if CLICK_USERLEVEL
+# define HAVE_ELEMENT_PROFILER 1
+#endif
+
+#if HAVE_ELEMENT_PROFILER
+# if HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+#  define CLICK_PROFILER_TLS __thread
+# else
+#  define CLICK_PROFILER_TLS
+# endif
+
+/** @class ElementProfiler
+ * @brief Runtime-toggled sampling profiler for push and pull calls.
+ *
+ * When the sampling period N is nonzero, one in every N packet transfers on
+ * each thread starts a traced call tree.  That transfer and every transfer
+ * nested inside it are timed with the cycle counter and accumulated into a
+ * per-thread tree of call paths, which only that thread updates.  Readers
+ * combine the threads' trees into per-element and per-edge totals or into
+ * folded stacks for flame graphs.
+ *
+ * While the period is zero, Element::Port::push() and pull() test a single
+ * global and otherwise behave as before.  The profiler is independent of
+ * CLICK_STATS; builds with CLICK_STATS >= 2 do not consult it.
+ *
+ * The profile is reached through global handlers: C<profile_period>,
+ * C<profile_folded>, C<profile_elements.csv>, C<profile_edges.csv>, and
+ * C<profile_reset>.  Reports name elements as ROUTER.ELEMENT when the
+ * element's router has a name, since several routers may run at once. */
+class ElementProfiler { public:
+
+    /** @brief Return true iff sampling is on. */
+    static inline bool enabled() {
+	return _period != 0;
+    }
+
+    /** @brief Return true iff the current transfer should be traced.
+     * @pre enabled()
+     *
+     * True inside a traced call tree, and for one transfer in every period
+     * otherwise. */
+    static inline bool sample() {
+	return _depth || --_countdown <= 0;
+    }
+
+    static void push(Element *owner, Element *e, int port, Packet *p);
+    static Packet *pull(Element *owner, Element *e, int port);
+
+    static int period()			{ return _period; }
+    static void set_period(int period);
+    static void reset();
+    static void forget(Router *router);
+
+    static String folded();
+    static String element_csv()		{ return report(false); }
+    static String edge_csv()		{ return report(true); }
+
+    static void static_initialize();
+    static void static_cleanup();
+
+  private:
+
+    struct Node;
+    struct Tree;
+
+    // Written by handlers, read by every thread.
+    static volatile int _period;
+    static volatile unsigned _generation;
+    static Tree *_all_trees;
+    static CLICK_PROFILER_TLS int _depth;
+    static CLICK_PROFILER_TLS int _countdown;
+    static CLICK_PROFILER_TLS Tree *_tree;
+
+    static Node *enter(Element *owner, Element *e, int port, bool pull);
+    static void leave(Node *n, click_cycles_t cycles);
+    static String report(bool edges);
+
+};
+
+#endif
+
+CLICK_ENDDECLS
+#endif
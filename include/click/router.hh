@@ -357,6 +357,31 @@ private:
 public:
     Vector<Task*> _tasks;
 
+    // Share of threads [_cpu_share_first, _cpu_share_last] reserved for
+    // this router's tasks in cycle-budget scheduling, in permille; 0 means
+    // none.
+    unsigned _cpu_share;
+    int _cpu_share_first;
+    int _cpu_share_last;
+
+    // CPU quotas, in permille of one thread; 0 means none.  Above the soft
+    // quota the router's tasks lose tickets, and above the hard quota its
+    // source tasks are throttled.  The other fields are enforcement state
+    // kept by RouterThread::enforce_quotas().
+    unsigned _soft_quota;
+    unsigned _hard_quota;
+    int _quota_scale;               // ticket scale, permille, applied by
+                                    // each task's home thread
+    double _quota_credit;           // hard-quota cycles in hand
+    bool _quota_throttled;
+    Vector<Task*> _quota_throttled_tasks;   // source tasks throttling
+                                            // unscheduled
+    enum { MIN_QUOTA_SCALE = 16 };
+
+#if HAVE_MULTITHREAD
+    double cpu_usage(unsigned window, Vector<double> *per_thread = 0) const;
+#endif
+
     void set_router_info(RouterInfo* ri) {
         _router_info = ri;
     }
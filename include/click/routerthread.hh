@@ -54,6 +54,9 @@ class RouterThread { public:
     inline void unblock_tasks();
 
     inline bool stop_flag() const;
+    inline unsigned stats_window() const;
+    inline uint32_t quiescent_epoch() const;
+    inline bool quiescent_since(uint32_t epoch) const;
 
     inline void mark_driver_entry();
     void driver();
@@ -123,6 +126,8 @@ class RouterThread { public:
 #endif
 
     TimerSet _timers;
+    unsigned _stats_window;
+    volatile uint32_t _quiescent_epoch;
 #if CLICK_USERLEVEL
     SelectSet _selects;
 #endif
@@ -152,6 +157,11 @@ class RouterThread { public:
     Task::Pending _pending_head;
     Task::Pending *_pending_tail;
     SpinlockIRQ _pending_lock;
+#if HAVE_MULTITHREAD
+    // tasks woken by other threads (Task::wake()), pushed without locks
+    Task * volatile _wake_head;
+    atomic_uint32_t _sleeping;          // set while blocked in run_os()
+#endif
 
     // SHARED STATE GROUP
     Master *_master CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
@@ -227,6 +237,10 @@ class RouterThread { public:
 
     inline void run_tasks(int ntasks);
     inline void process_pending();
+#if HAVE_MULTITHREAD
+    inline void push_wake(Task *t);
+    void process_wakes();
+#endif
     inline void run_os();
 #if HAVE_ADAPTIVE_SCHEDULER
     void client_set_tickets(int client, int tickets);
@@ -246,7 +260,7 @@ class RouterThread { public:
 #endif
     
 private:
-    int add_nf(String config_file);
+    int add_nf(String sth);
 
     int delete_nf(String router_name);
 
@@ -262,6 +276,8 @@ private:
 
     int dividebalance(String sth);
 
+    int replicate(String sth);
+
     void subbalance(const Vector<Task*>& tasks, const Vector<double>& rates, const Vector<int>& cycles, int start, int end);
 
     int randombalance(String sth);
@@ -282,6 +298,22 @@ private:
 
     int check_congestion(String sth);
 
+    int budget(String sth);
+
+    int share(String sth);
+
+    int quota(String sth);
+
+#if HAVE_STRIDE_SCHED && HAVE_MULTITHREAD && CLICK_USERLEVEL
+    void update_budgets();
+    void apply_quota_scales();
+#endif
+#if HAVE_MULTITHREAD && CLICK_USERLEVEL
+    void enforce_quotas(unsigned window);
+#endif
+    static void throttle_router(Router *r, bool throttle);
+    inline void check_stats_window();
+
 public:
     void cmd_driver();
     atomic_uint32_t _task_num;
@@ -317,6 +349,10 @@ inline bool
 RouterThread::active() const
 {
     click_compiler_fence();
+#if HAVE_MULTITHREAD
+    if (_wake_head)
+        return true;
+#endif
 #if HAVE_TASK_HEAP
     return _task_heap.size() != 0 || _pending_head.x;
 #else
@@ -514,12 +550,71 @@ RouterThread::add_pending()
     wake();
 }
 
+#if HAVE_MULTITHREAD
+/* Push t onto the wake list, and signal the thread if it is blocked.  The
+ * first push after the thread blocks clears _sleeping and signals; later
+ * pushes find it clear.  The thread sets _sleeping before checking for
+ * work, so either it sees t or we see _sleeping. */
+inline void
+RouterThread::push_wake(Task *t)
+{
+    Task *head;
+    do {
+        head = _wake_head;
+        t->_wake_next = head;
+    } while (!__sync_bool_compare_and_swap(&_wake_head, head, t));
+#if CLICK_USERLEVEL
+    if (_sleeping && _sleeping.swap(0))
+#endif
+        wake();
+}
+#endif
+
 inline bool
 RouterThread::stop_flag() const
 {
     return _stop_flag;
 }
 
+/** @brief Return this thread's idea of the current statistics window.
+ *
+ * The driver refreshes this value each time it checks timers.
+ * @sa Task::stats_window() */
+inline unsigned
+RouterThread::stats_window() const
+{
+    return _stats_window;
+}
+
+/** @brief Return a counter this thread bumps once per driver loop.
+ *
+ * No task, timer or select runs across a bump, so a pointer the thread read
+ * from a lock-free structure before the bump is no longer in use after it.
+ * @sa quiescent_since() */
+inline uint32_t
+RouterThread::quiescent_epoch() const
+{
+    return _quiescent_epoch;
+}
+
+/** @brief Return true iff this thread has passed a quiescent point since
+ * quiescent_epoch() returned @a epoch.
+ *
+ * A thread that is not running its driver, or is blocked waiting for work,
+ * is quiescent.  Memory retired before @a epoch was read may be freed once
+ * every thread is quiescent since. */
+inline bool
+RouterThread::quiescent_since(uint32_t epoch) const
+{
+    if (_quiescent_epoch != epoch || !_driver_entered)
+        return true;
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    return _sleeping.value() != 0;
+#else
+    return false;
+#endif
+}
+
 inline void
 RouterThread::set_thread_state(int state)
 {
@@ -545,6 +640,16 @@ RouterThread::set_thread_state_for_blocking(int delay_type)
         set_thread_state(S_BLOCKED);
     else
         set_thread_state(delay_type ? S_TIMERWAIT : S_PAUSED);
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    // Let push_wake() know we may block, then catch any wakeup it pushed
+    // before it could see that.
+    if (delay_type != 0) {
+        _sleeping = 1;
+        click_fence();
+        if (_wake_head && _sleeping.swap(0))
+            _selects.wake_immediate();
+    }
+#endif
 }
 
 #if CLICK_DEBUG_SCHEDULING > 1
@@ -563,6 +563,68 @@ ReadWriteLock::release_write()
 #endif
 }
 
+/** @class SeqlockValue
+ * @brief A value published by one writer and read consistently by others.
+ *
+ * A SeqlockValue holds a small copyable value, such as a block of
+ * statistics, that a single thread updates with publish() and that any
+ * thread can read with read().  Readers never write to the object, so
+ * monitoring does not pull the writer's cache lines away from it; a reader
+ * that races with publish() simply retries.  Writers are not synchronized
+ * with each other: there must be at most one.
+ *
+ * @sa SimpleSpinlock
+ */
+template <typename T>
+class SeqlockValue { public:
+
+    SeqlockValue()
+	: _seq(0), _value() {
+    }
+
+    inline void publish(const T &x);
+    inline T read() const;
+
+  private:
+
+    volatile uint32_t _seq;
+    T _value;
+
+};
+
+/** @brief Publish a new value.
+ *
+ * Only one thread may call publish() on a given SeqlockValue. */
+template <typename T>
+inline void
+SeqlockValue<T>::publish(const T &x)
+{
+    _seq = _seq + 1;
+    click_write_fence();
+    _value = x;
+    click_write_fence();
+    _seq = _seq + 1;
+}
+
+/** @brief Return the most recently published value.
+ *
+ * The result is never a mixture of two published values. */
+template <typename T>
+inline T
+SeqlockValue<T>::read() const
+{
+    T x;
+    uint32_t seq;
+    do {
+	while ((seq = _seq) & 1)
+	    click_relax_fence();
+	click_read_fence();
+	x = _value;
+	click_read_fence();
+    } while (seq != _seq);
+    return x;
+}
+
 CLICK_ENDDECLS
 #undef SPINLOCK_ASSERTLEVEL
 #endif
@@ -22,6 +22,10 @@ CLICK_CXX_UNPROTECT
 
 #define PASS_GT(a, b)   ((int)(a - b) > 0)
 
+#if HAVE_MULTITHREAD && CLICK_USERLEVEL && HAVE___THREAD_STORAGE_CLASS
+# define HAVE_TASK_PROFILE 1
+#endif
+
 typedef bool (*TaskCallback)(Task *, void *);
 typedef TaskCallback TaskHook CLICK_DEPRECATED;
 class RouterThread;
@@ -51,6 +55,7 @@ class Task : private TaskLink { public:
 #if HAVE_STRIDE_SCHED
     enum { STRIDE1 = 1U<<16, MAX_STRIDE = 1U<<31 };
     enum { MAX_TICKETS = 1<<15, DEFAULT_TICKETS = 1<<10 };
+    enum { BUDGET_SHIFT = 8, MAX_BUDGET_QUANTA = 64 };
 #endif
 #if HAVE_ADAPTIVE_SCHEDULER
     enum { MAX_UTILIZATION = 1000 };
@@ -131,6 +136,14 @@ class Task : private TaskLink { public:
      * to the new thread. */
     inline RouterThread *thread() const;
 
+    /** @brief Return true iff the caller runs on this task's thread, and
+     * that thread is also the task's home thread.
+     *
+     * A task's thread() changes only on that thread, so while this holds the
+     * task neither runs concurrently with the caller nor moves before the
+     * caller returns to the driver. */
+    inline bool home_thread_is_current() const;
+
     /** @brief Return the router to which this task belongs. */
     inline Router *router() const {
         return _owner->router();
@@ -205,6 +218,19 @@ class Task : private TaskLink { public:
             complete_schedule(0);
     }
 
+    /** @brief Reschedule the task from any thread without taking locks.
+     *
+     * Has the same effect as reschedule(), but is cheaper from threads
+     * other than the task's home thread, which is how notifiers usually
+     * call it.  The first wake() since the home thread last checked puts
+     * the task on that thread's lock-free wake list; until the thread
+     * takes the list, further calls just find the task's wake flag set.
+     * The home thread is signalled only if it is blocked, so a busy thread
+     * picks up a batch of wakeups on its next pass without a system call.
+     *
+     * @sa reschedule */
+    inline void wake();
+
     /** @brief Reschedule a task from the task's callback function.
      *
      * @warning Only call @a task.fast_reschedule() while @a task is being
@@ -281,6 +307,8 @@ class Task : private TaskLink { public:
     inline int tickets() const;
     inline void set_tickets(int n);
     inline void adjust_tickets(int delta);
+    inline unsigned budget_charge(click_cycles_t cycles, unsigned quantum) const;
+    inline int effective_tickets() const;
 #endif
 
     inline bool fire();
@@ -298,6 +326,59 @@ class Task : private TaskLink { public:
     inline void update_cycles(unsigned c);
 #endif
 
+    enum { STATS_WINDOW_MSEC = 100 };
+    static inline unsigned stats_window();
+#if HAVE_MULTITHREAD
+    /** @brief Task statistics published by the home thread. */
+    struct Stats {
+        unsigned window;        ///< statistics window of publication
+        int cycles;             ///< average cycles per run
+        int rate;               ///< runs per second
+        unsigned runs;          ///< runs since the previous publication
+    };
+    inline bool stats(unsigned window, Stats &s) const;
+    inline void publish_stats(unsigned window);
+#endif
+
+#if HAVE_TASK_PROFILE
+    /** @brief Summary of profiled task runs.
+     *
+     * The run's cycles are split into time spent pulling from and pushing
+     * to queues, and the remainder, the task's service time.  Runs that
+     * handle no packets are idle and counted separately. */
+    struct ProfileSummary {
+        uint64_t runs;          ///< profiled runs
+        uint64_t idle_runs;     ///< profiled runs that handled no packets
+        uint64_t packets;       ///< packets handled by busy runs
+        double idle_cycles;     ///< cycles spent in idle runs
+        double pull_cycles;     ///< cycles spent pulling from queues
+        double push_cycles;     ///< cycles spent pushing to queues
+        double service_cycles;  ///< remaining cycles spent in busy runs
+        double mean;            ///< service cycles per packet
+        double m2;              ///< weighted squared deviations from mean
+
+        uint64_t busy_runs() const {
+            return runs - idle_runs;
+        }
+        double stddev() const;
+        double ci95() const;
+        void merge(const ProfileSummary &x);
+    };
+
+    /** @brief Task profile published by the home thread. */
+    struct Profile {
+        ProfileSummary period;  ///< latest complete profile period
+        ProfileSummary baseline; ///< periods since the last drift
+        unsigned periods;       ///< number of complete periods
+        unsigned drifts;        ///< number of drifts detected
+        bool drifted;           ///< true iff the latest period drifted
+    };
+
+    enum { PROFILE_PERIOD_WINDOWS = 10 };
+    inline Profile profile() const;
+    void profile_run(click_cycles_t cycles, bool work_done);
+#endif
+
     /** @cond never */
     inline TaskCallback hook() const CLICK_DEPRECATED;
     inline void *thunk() const CLICK_DEPRECATED;
@@ -312,6 +393,7 @@ class Task : private TaskLink { public:
 #if HAVE_STRIDE_SCHED
     unsigned _stride;
     int _tickets;
+    unsigned _budget_stride;    // pass per budget quantum << BUDGET_SHIFT
 #endif
 
     union Status {
@@ -337,6 +419,22 @@ class Task : private TaskLink { public:
     DirectEWMA _cycles;
     unsigned _cycle_runs;
     unsigned _total_runs;
+    unsigned _stats_published;
+    unsigned _stats_runs;       // _total_runs at last publication
+
+    // wake(): _wake_flag is set while the task is on _wake_thread's wake
+    // list, linked through _wake_next
+    atomic_uint32_t _wake_flag;
+    Task *_wake_next;
+    RouterThread *_wake_thread;
+#endif
+#if HAVE_TASK_PROFILE
+    ProfileSummary _profile_period;
+    ProfileSummary _profile_baseline;
+    unsigned _profile_start;
+    unsigned _profile_periods;
+    unsigned _profile_drifts;
+    void roll_profile(unsigned window);
 #endif
 
     RouterThread *_thread;
@@ -385,12 +483,68 @@ public:
 #endif
     rate_t _rate;
 
-    inline int rates();
+    inline int rates() const;
 
     double _task_load;
+
+#if HAVE_MULTITHREAD
+  private:
+    // Written only by the home thread, once per statistics window, into
+    // slot window & 1; on its own cache line so readers never contend
+    // with the datapath.
+    SeqlockValue<Stats> _stats[2] CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+# if HAVE_TASK_PROFILE
+    SeqlockValue<Profile> _profile;
+# endif
+
+    inline void initialize_stats();
+#endif
 };
 
 
+#if HAVE_TASK_PROFILE
+/** @class TaskProfile
+ * @brief Per-thread accounting for the task run being profiled.
+ *
+ * The driver profiles one in every few task runs.  During a profiled run,
+ * queues report the cycles they spend in push and pull, and the packets
+ * they pass, so that Task::profile_run() can separate queue overhead from
+ * the task's own service time. */
+class TaskProfile { public:
+
+    static inline bool active() {
+        return _active;
+    }
+    static inline void add_pull(click_cycles_t cycles, bool packet) {
+        _pull_cycles += cycles;
+        _pulls += packet;
+    }
+    static inline void add_push(click_cycles_t cycles) {
+        _push_cycles += cycles;
+        ++_pushes;
+    }
+
+  private:
+
+    static __thread bool _active;
+    static __thread click_cycles_t _pull_cycles;
+    static __thread click_cycles_t _push_cycles;
+    static __thread unsigned _pulls;
+    static __thread unsigned _pushes;
+
+    static inline void begin() {
+        _pull_cycles = _push_cycles = 0;
+        _pulls = _pushes = 0;
+        _active = true;
+    }
+
+    friend class Task;
+    friend class RouterThread;
+
+};
+#endif
+
+
 // need RouterThread's definition for inline functions
 CLICK_ENDDECLS
 #include <click/routerthread.hh>
@@ -404,7 +558,7 @@ Task::Task(TaskCallback f, void *user_data)
       _schedpos(-1),
 #endif
 #if HAVE_STRIDE_SCHED
-      _stride(0), _tickets(-1),
+      _stride(0), _tickets(-1), _budget_stride(0),
 #endif
       _hook(f), _thunk(user_data),
 #if HAVE_ADAPTIVE_SCHEDULER
@@ -420,6 +574,12 @@ Task::Task(TaskCallback f, void *user_data)
     _status.is_scheduled = _status.is_strong_unscheduled = false;
     _pending_nextptr.x = 0;
     _is_killed = false;
+#if HAVE_MULTITHREAD
+    initialize_stats();
+    _wake_flag = 0;
+    _wake_next = 0;
+    _wake_thread = 0;
+#endif
 }
 
 inline
@@ -429,7 +589,7 @@ Task::Task(Element* e)
       _schedpos(-1),
 #endif
 #if HAVE_STRIDE_SCHED
-      _stride(0), _tickets(-1),
+      _stride(0), _tickets(-1), _budget_stride(0),
 #endif
       _hook(0), _thunk(e),
 #if HAVE_ADAPTIVE_SCHEDULER
@@ -445,6 +605,31 @@ Task::Task(Element* e)
     _status.is_scheduled = _status.is_strong_unscheduled = false;
     _pending_nextptr.x = 0;
     _is_killed = false;
+#if HAVE_MULTITHREAD
+    initialize_stats();
+    _wake_flag = 0;
+    _wake_next = 0;
+    _wake_thread = 0;
+#endif
+}
+
+inline void
+Task::wake()
+{
+#if HAVE_MULTITHREAD
+    RouterThread *thread = _thread;
+    if (thread && _status.home_thread_id >= 0 && thread->thread_id() >= 0
+        && !thread->current_thread_is_running()) {
+        _status.is_scheduled = true;
+        click_fence();
+        if (_wake_flag.compare_swap(0, 1) == 0) {
+            _wake_thread = thread;
+            thread->push_wake(this);
+        }
+        return;
+    }
+#endif
+    reschedule();
 }
 
 inline bool
@@ -517,6 +702,14 @@ Task::thread() const
     return _thread;
 }
 
+inline bool
+Task::home_thread_is_current() const
+{
+    RouterThread *thread = _thread;
+    return thread && _status.home_thread_id == thread->thread_id()
+        && thread->current_thread_is_running();
+}
+
 inline void
 Task::remove_from_scheduled_list()
 {
@@ -569,9 +762,47 @@ Task::set_tickets(int n)
         n = 1;
     _tickets = n;
     _stride = STRIDE1 / n;
+    _budget_stride = _stride << BUDGET_SHIFT;
     assert(_stride < MAX_STRIDE);
 }
 
+/** @brief Return the pass charged for a run that took @a cycles cycles.
+ * @param cycles cycles the run took
+ * @param quantum cycles in a DEFAULT_TICKETS task's time slice
+ *
+ * Used in cycle-budget scheduling mode.  A task's time slice is @a quantum
+ * cycles scaled by its effective tickets, and a run that uses its whole
+ * slice is charged STRIDE1 / DEFAULT_TICKETS.  Shorter runs are charged
+ * less and overruns more, up to MAX_BUDGET_QUANTA quanta.
+ *
+ * Effective tickets equal tickets() unless the home thread has rescaled
+ * them to honor router CPU shares. */
+inline unsigned
+Task::budget_charge(click_cycles_t cycles, unsigned quantum) const
+{
+    uint64_t charge = ((uint64_t) cycles * _budget_stride / quantum)
+        >> BUDGET_SHIFT;
+    uint64_t max_charge = (uint64_t) MAX_BUDGET_QUANTA * _budget_stride
+        >> BUDGET_SHIFT;
+    if (charge > max_charge)
+        charge = max_charge;
+    return charge ? (unsigned) charge : 1;
+}
+
+/** @brief Return the Task's effective tickets in cycle-budget mode.
+ *
+ * These equal tickets() unless the home thread has rescaled them to honor
+ * router CPU shares or quotas.
+ *
+ * @sa budget_charge */
+inline int
+Task::effective_tickets() const
+{
+    if (!_budget_stride)
+        return _tickets;
+    return (int) (((uint64_t) STRIDE1 << BUDGET_SHIFT) / _budget_stride);
+}
+
 /** @brief Add @a delta to the Task's ticket count.
  * @param delta adjustment to the ticket count
  *
@@ -656,11 +887,17 @@ Task::cycles() const
     return _cycles.unscaled_average();
 }
 
+/** @brief Return the task's runs per second over the last complete
+ * statistics window.
+ *
+ * The result is the value published by the home thread, so calling rates()
+ * from another thread does not disturb the task.  Returns 0 if the task did
+ * not run during that window. */
 inline int
-Task::rates()
+Task::rates() const
 {
-    _rate.update(0);
-    return _rate.rate();
+    Stats s;
+    return stats(stats_window() - 1, s) ? s.rate : 0;
 }
 
 inline unsigned
@@ -681,7 +918,91 @@ Task::update_cycles(unsigned c)
     _cycles.update(c);
     _cycle_runs = 0;
 }
+
+/** @brief Read the statistics published in statistics window @a window.
+ * @param window statistics window
+ * @param[out] s statistics
+ * @return true iff the task published statistics in @a window
+ *
+ * Statistics for the current and previous windows are available.  Any
+ * thread may call this function: it does not modify the task, and the
+ * result is never a mixture of two publications.  Reading every task's
+ * statistics for the same complete window, such as stats_window() - 1,
+ * gives a consistent view across tasks and threads. */
+inline bool
+Task::stats(unsigned window, Stats &s) const
+{
+    s = _stats[window & 1].read();
+    return s.window == window;
+}
+
+/** @brief Publish statistics for statistics window @a window.
+ *
+ * Called by the home thread's driver. */
+inline void
+Task::publish_stats(unsigned window)
+{
+    _rate.update(0);
+    Stats s;
+    s.window = window;
+    s.cycles = _cycles.unscaled_average();
+    s.rate = _rate.rate();
+    s.runs = _total_runs - _stats_runs;
+    _stats_runs = _total_runs;
+    _stats[window & 1].publish(s);
+    _stats_published = window;
+#if HAVE_TASK_PROFILE
+    if (window - _profile_start >= (unsigned) PROFILE_PERIOD_WINDOWS)
+        roll_profile(window);
+#endif
+}
+
+inline void
+Task::initialize_stats()
+{
+    Stats s;
+    s.window = ~0U;
+    s.cycles = s.rate = 0;
+    s.runs = 0;
+    _stats_runs = _total_runs;
+    _stats[0].publish(s);
+    _stats[1].publish(s);
+    _stats_published = ~0U;
+#if HAVE_TASK_PROFILE
+    memset(&_profile_period, 0, sizeof(_profile_period));
+    memset(&_profile_baseline, 0, sizeof(_profile_baseline));
+    _profile_start = ~0U - PROFILE_PERIOD_WINDOWS;
+    _profile_periods = _profile_drifts = 0;
+    Profile p;
+    memset(&p, 0, sizeof(p));
+    _profile.publish(p);
 #endif
+}
+
+#if HAVE_TASK_PROFILE
+/** @brief Return the task's profile.
+ *
+ * Any thread may call this function; it reads the profile the home thread
+ * published at the end of the latest profile period, which lasts
+ * PROFILE_PERIOD_WINDOWS statistics windows. */
+inline Task::Profile
+Task::profile() const
+{
+    return _profile.read();
+}
+#endif
+#endif
+
+/** @brief Return the current statistics window number.
+ *
+ * Windows are STATS_WINDOW_MSEC milliseconds long.  Threads publish
+ * statistics, such as those of their tasks, once per window.
+ * @sa RouterThread::stats_window() */
+inline unsigned
+Task::stats_window()
+{
+    return click_jiffies() / ((CLICK_HZ * STATS_WINDOW_MSEC + 999) / 1000);
+}
 
 inline void
 Task::kill(int kill_thread) {
@@ -2117,6 +2117,13 @@ read_task_tickets(Element *e, void *thunk)
   return String(task->tickets());
 }
 
+static String
+read_task_effective_tickets(Element *e, void *thunk)
+{
+  Task *task = (Task *)((uint8_t *)e + (intptr_t)thunk);
+  return String(task->effective_tickets());
+}
+
 static int
 write_task_tickets(const String &s, Element *e, void *thunk, ErrorHandler *errh)
 {
@@ -2250,6 +2257,7 @@ Element::add_task_handlers(Task *task, NotifierSignal *signal, int flags, const
     add_read_handler(prefix + "tickets", read_task_tickets, thunk);
     if (flags & TASKHANDLER_WRITE_TICKETS)
 	add_write_handler(prefix + "tickets", write_task_tickets, thunk);
+    add_read_handler(prefix + "effective_tickets", read_task_effective_tickets, thunk);
 #endif
 #if HAVE_MULTITHREAD
     add_read_handler(prefix + "home_thread", read_task_home_thread, thunk);
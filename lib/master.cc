@@ -33,6 +33,7 @@ CLICK_DECLS
 
 #if CLICK_USERLEVEL
 volatile sig_atomic_t Master::signals_pending;
+atomic_uint32_t Master::quota_throttled;
 static volatile sig_atomic_t signal_pending[NSIG];
 static RouterThread *signal_thread;
 extern "C" { static void sighandler(int signo); }
@@ -69,6 +70,14 @@ Master::Master(int nthreads)
     _simnode = 0;
 #endif
     pthread_rwlock_init(&_rw_lock, 0);
+    _router_map_version = 0;
+    _budget_sched = false;
+    _budget_quantum = DEFAULT_BUDGET_QUANTUM;
+    _quotas = false;
+    _quota_window = 0;
+    _stats_tick = 0;
+    _cycles_epoch = click_get_cycles();
+    _cycles_epoch_time = Timestamp::now();
 }
 
 // nthreads: run threads, not including -1 and 0
@@ -112,6 +121,14 @@ Master::Master(int capacity, int nthreads, int cmdthreads)
     _simnode = 0;
 #endif
     pthread_rwlock_init(&_rw_lock, 0);
+    _router_map_version = 0;
+    _budget_sched = false;
+    _budget_quantum = DEFAULT_BUDGET_QUANTUM;
+    _quotas = false;
+    _quota_window = 0;
+    _stats_tick = 0;
+    _cycles_epoch = click_get_cycles();
+    _cycles_epoch_time = Timestamp::now();
 }
 
 Master::~Master()
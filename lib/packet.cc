@@ -953,6 +953,39 @@ cleanup_pool(PacketPool *pp, int global)
 }
 #endif
 
+#if HAVE_CLICK_PACKET_POOL
+/** @brief Report how many free packets and buffers the pools hold.
+ *
+ * Thread pools' counts are read without synchronizing with their threads,
+ * so they may be slightly out of date. */
+void
+Packet::pool_stats(PoolStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+# if HAVE_MULTITHREAD
+    while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+	/* do nothing */;
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp;
+	 pp = pp->thread_pool_next) {
+	++stats.thread_pools;
+	stats.packets += pp->pcount;
+	stats.buffers += pp->pdcount;
+    }
+    for (WritablePacket *p = global_packet_pool.pbatch; p;
+	 p = static_cast<WritablePacket *>(p->prev()))
+	stats.global_packets += p->anno_u32(0);
+    for (PacketData *pd = global_packet_pool.pdbatch; pd; pd = pd->batch_next)
+	stats.global_buffers += pd->batch_pdcount;
+    click_compiler_fence();
+    global_packet_pool.lock = 0;
+# else
+    stats.thread_pools = 1;
+    stats.packets = global_packet_pool.pcount;
+    stats.buffers = global_packet_pool.pdcount;
+# endif
+}
+#endif
+
 void
 Packet::static_cleanup()
 {
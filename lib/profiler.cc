@@ -0,0 +1,420 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/profiler.hh" -*-
+/*
+ * profiler.{cc,hh} -- sampling profiler for element push and pull calls
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/profiler.hh>
+#include <click/element.hh>
+#include <click/router.hh>
+#include <click/routerinfo.hh>
+#include <click/straccum.hh>
+#include <click/hashtable.hh>
+#include <click/pair.hh>
+#include <click/sync.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+#if HAVE_ELEMENT_PROFILER
+
+enum { MAXDEPTH = 64, CHUNK = 256 };
+
+// One call path.  Only the owning thread updates calls and cycles, and only
+// the owning thread links in new nodes; readers may walk the lists at any
+// time, holding the tree's lock so that the nodes are not freed under them.
+struct ElementProfiler::Node {
+    Element *e;			// callee, or task element for a root;
+				// null once its router is gone
+    int port;			// callee's port, or -1 for a root
+    bool pull;
+    Node *parent;		// null for a root
+    Node *child;
+    Node *sibling;
+    uint64_t calls;
+    click_cycles_t cycles;	// including children
+};
+
+struct ElementProfiler::Tree {
+    SimpleSpinlock lock;
+    unsigned generation;
+    int thread_id;
+    Node *roots;
+    Node *stack[MAXDEPTH];
+    Vector<Node *> chunks;
+    int chunk_used;
+    Tree *next;
+
+    Node *find_child(Node *parent, Element *e, int port, bool pull);
+    void clear();
+};
+
+volatile int ElementProfiler::_period;
+volatile unsigned ElementProfiler::_generation;
+CLICK_PROFILER_TLS int ElementProfiler::_depth;
+CLICK_PROFILER_TLS int ElementProfiler::_countdown;
+CLICK_PROFILER_TLS ElementProfiler::Tree *ElementProfiler::_tree;
+
+ElementProfiler::Tree *ElementProfiler::_all_trees;
+static SimpleSpinlock all_trees_lock;
+
+ElementProfiler::Node *
+ElementProfiler::Tree::find_child(Node *parent, Element *e, int port, bool pull)
+{
+    Node **head = parent ? &parent->child : &roots;
+    for (Node *n = *head; n; n = n->sibling)
+	if (n->e == e && n->port == port && n->pull == pull)
+	    return n;
+
+    lock.acquire();
+    if (chunks.empty() || chunk_used == CHUNK) {
+	chunks.push_back(new Node[CHUNK]);
+	chunk_used = 0;
+    }
+    Node *n = &chunks.back()[chunk_used++];
+    n->e = e;
+    n->port = port;
+    n->pull = pull;
+    n->parent = parent;
+    n->child = 0;
+    n->sibling = *head;
+    n->calls = 0;
+    n->cycles = 0;
+    click_write_fence();
+    *head = n;
+    lock.release();
+    return n;
+}
+
+void
+ElementProfiler::Tree::clear()
+{
+    for (int i = 0; i < chunks.size(); i++)
+	delete[] chunks[i];
+    chunks.clear();
+    chunk_used = 0;
+    roots = 0;
+}
+
+ElementProfiler::Node *
+ElementProfiler::enter(Element *owner, Element *e, int port, bool pull)
+{
+    Tree *t = _tree;
+    if (!t) {
+	t = _tree = new Tree;
+	t->generation = _generation;
+	t->thread_id = click_current_cpu_id();
+	t->roots = 0;
+	t->chunk_used = 0;
+	all_trees_lock.acquire();
+	t->next = _all_trees;
+	_all_trees = t;
+	all_trees_lock.release();
+    }
+
+    Node *parent;
+    if (_depth == 0) {
+	_countdown = _period;
+	// No traced call is in progress, so no node is in use: safe to clear.
+	if (t->generation != _generation) {
+	    t->lock.acquire();
+	    t->clear();
+	    t->generation = _generation;
+	    t->lock.release();
+	}
+	parent = t->find_child(0, owner, -1, false);
+    } else if (_depth < MAXDEPTH)
+	parent = t->stack[_depth - 1];
+    else
+	parent = 0;
+
+    Node *n = parent ? t->find_child(parent, e, port, pull) : 0;
+    if (_depth < MAXDEPTH)
+	t->stack[_depth] = n;
+    ++_depth;
+    return n;
+}
+
+inline void
+ElementProfiler::leave(Node *n, click_cycles_t cycles)
+{
+    --_depth;
+    if (n) {
+	++n->calls;
+	n->cycles += cycles;
+    }
+}
+
+void
+ElementProfiler::push(Element *owner, Element *e, int port, Packet *p)
+{
+    Node *n = enter(owner, e, port, false);
+    click_cycles_t start = click_get_cycles();
+    e->push(port, p);
+    leave(n, click_get_cycles() - start);
+}
+
+Packet *
+ElementProfiler::pull(Element *owner, Element *e, int port)
+{
+    Node *n = enter(owner, e, port, true);
+    click_cycles_t start = click_get_cycles();
+    Packet *p = e->pull(port);
+    leave(n, click_get_cycles() - start);
+    return p;
+}
+
+void
+ElementProfiler::set_period(int period)
+{
+    _countdown = period;
+    _period = period;
+}
+
+void
+ElementProfiler::reset()
+{
+    // each thread clears its own tree the next time it starts a trace
+    ++_generation;
+}
+
+void
+ElementProfiler::forget(Router *router)
+{
+    all_trees_lock.acquire();
+    for (Tree *t = _all_trees; t; t = t->next) {
+	t->lock.acquire();
+	for (int i = 0; i < t->chunks.size(); i++) {
+	    int n = (i == t->chunks.size() - 1 ? t->chunk_used : CHUNK);
+	    for (Node *x = t->chunks[i]; x != t->chunks[i] + n; ++x)
+		if (x->e && x->e->router() == router)
+		    x->e = 0;
+	}
+	t->lock.release();
+    }
+    all_trees_lock.release();
+}
+
+
+// REPORTS
+
+namespace {
+
+struct ProfileStats {
+    Element *from;
+    Element *to;
+    int port;
+    bool pull;
+    uint64_t calls;
+    click_cycles_t cycles;
+};
+
+}
+
+static int
+profile_stats_compar(const void *a, const void *b, void *)
+{
+    const ProfileStats *sa = (const ProfileStats *) a, *sb = (const ProfileStats *) b;
+    if (sa->cycles != sb->cycles)
+	return sa->cycles > sb->cycles ? -1 : 1;
+    return 0;
+}
+
+static String
+profile_element_name(Element *e)
+{
+    if (RouterInfo *ri = e->router()->router_info())
+	return ri->router_name() + "." + e->name();
+    return e->name();
+}
+
+String
+ElementProfiler::folded()
+{
+    StringAccum sa;
+    all_trees_lock.acquire();
+    for (Tree *t = _all_trees; t; t = t->next) {
+	t->lock.acquire();
+	if (t->generation == _generation) {
+	    // depth-first walk; prefix[i] is the length of stack[i]'s parent path
+	    Vector<Node *> stack;
+	    Vector<int> prefix;
+	    StringAccum path;
+	    path << "thread" << t->thread_id;
+	    for (Node *r = t->roots; r; r = r->sibling)
+		if (r->e) {
+		    stack.push_back(r);
+		    prefix.push_back(path.length());
+		}
+	    while (stack.size()) {
+		Node *n = stack.back();
+		path.adjust_length(prefix.back() - path.length());
+		stack.pop_back();
+		prefix.pop_back();
+		path << ';' << profile_element_name(n->e);
+		if (n->pull)
+		    path << "[pull]";
+
+		click_cycles_t kids = 0;
+		for (Node *c = n->child; c; c = c->sibling) {
+		    kids += c->cycles;
+		    if (c->e) {
+			stack.push_back(c);
+			prefix.push_back(path.length());
+		    }
+		}
+		if (n->parent && n->cycles > kids)
+		    sa << path << ' ' << (n->cycles - kids) << '\n';
+	    }
+	}
+	t->lock.release();
+    }
+    all_trees_lock.release();
+    return sa.take_string();
+}
+
+String
+ElementProfiler::report(bool edges)
+{
+    // Per element: time spent in the element itself, excluding the
+    // transfers it makes.  Per edge: time spent in the callee, including
+    // the transfers it makes.
+    typedef Pair<Pair<Element *, Element *>, int> Key;
+    HashTable<Key, int> index(-1);
+    Vector<ProfileStats> stats;
+
+    all_trees_lock.acquire();
+    for (Tree *t = _all_trees; t; t = t->next) {
+	t->lock.acquire();
+	if (t->generation == _generation)
+	    for (int i = 0; i < t->chunks.size(); i++) {
+		int nn = (i == t->chunks.size() - 1 ? t->chunk_used : CHUNK);
+		for (Node *n = t->chunks[i]; n != t->chunks[i] + nn; ++n) {
+		    if (!n->e || !n->parent || !n->parent->e)
+			continue;
+		    ProfileStats s;
+		    s.from = edges ? n->parent->e : 0;
+		    s.to = n->e;
+		    s.port = edges ? n->port : -1;
+		    s.pull = edges && n->pull;
+		    s.calls = n->calls;
+		    s.cycles = n->cycles;
+		    if (!edges) {
+			for (Node *c = n->child; c; c = c->sibling)
+			    s.cycles -= c->cycles;
+			if ((int64_t) s.cycles < 0)
+			    s.cycles = 0;
+		    }
+		    int &x = index[Key(Pair<Element *, Element *>(s.from, s.to), s.port * 2 + s.pull)];
+		    if (x < 0) {
+			x = stats.size();
+			stats.push_back(s);
+		    } else {
+			stats[x].calls += s.calls;
+			stats[x].cycles += s.cycles;
+		    }
+		}
+	    }
+	t->lock.release();
+    }
+    all_trees_lock.release();
+
+    if (stats.size())
+	click_qsort(stats.begin(), stats.size(), sizeof(ProfileStats), profile_stats_compar);
+    StringAccum sa;
+    if (edges)
+	sa << "from,to,port,direction,calls,cycles,cycles_per_call\n";
+    else
+	sa << "name,class,calls,cycles,cycles_per_call\n";
+    for (ProfileStats *s = stats.begin(); s != stats.end(); ++s) {
+	if (edges)
+	    sa << profile_element_name(s->from) << ','
+	       << profile_element_name(s->to) << ',' << s->port << ','
+	       << (s->pull ? "pull" : "push") << ',';
+	else
+	    sa << profile_element_name(s->to) << ',' << s->to->class_name() << ',';
+	sa << s->calls << ',' << s->cycles << ','
+	   << (s->calls ? s->cycles / s->calls : 0) << '\n';
+    }
+    return sa.take_string();
+}
+
+
+// HANDLERS
+
+enum { H_PERIOD, H_FOLDED, H_ELEMENTS, H_EDGES, H_RESET };
+
+static String
+profile_read_handler(Element *, void *thunk)
+{
+    switch ((intptr_t) thunk) {
+    case H_PERIOD:
+	return String(ElementProfiler::period());
+    case H_FOLDED:
+	return ElementProfiler::folded();
+    case H_ELEMENTS:
+	return ElementProfiler::element_csv();
+    case H_EDGES:
+	return ElementProfiler::edge_csv();
+    default:
+	return String();
+    }
+}
+
+static int
+profile_write_handler(const String &str, Element *, void *thunk, ErrorHandler *errh)
+{
+    switch ((intptr_t) thunk) {
+    case H_PERIOD: {
+	int period;
+	if (!IntArg().parse(str, period) || period < 0)
+	    return errh->error("expected nonnegative integer");
+	ElementProfiler::set_period(period);
+	return 0;
+    }
+    case H_RESET:
+	ElementProfiler::reset();
+	return 0;
+    default:
+	return 0;
+    }
+}
+
+void
+ElementProfiler::static_initialize()
+{
+    Router::add_read_handler(0, "profile_period", profile_read_handler, (void *) H_PERIOD);
+    Router::add_write_handler(0, "profile_period", profile_write_handler, (void *) H_PERIOD);
+    Router::add_read_handler(0, "profile_folded", profile_read_handler, (void *) H_FOLDED);
+    Router::add_read_handler(0, "profile_elements.csv", profile_read_handler, (void *) H_ELEMENTS);
+    Router::add_read_handler(0, "profile_edges.csv", profile_read_handler, (void *) H_EDGES);
+    Router::add_write_handler(0, "profile_reset", profile_write_handler, (void *) H_RESET);
+}
+
+void
+ElementProfiler::static_cleanup()
+{
+    _period = 0;
+    all_trees_lock.acquire();
+    while (Tree *t = _all_trees) {
+	_all_trees = t->next;
+	t->clear();
+	delete t;
+    }
+    all_trees_lock.release();
+    _tree = 0;
+}
+
+#endif
+
+CLICK_ENDDECLS
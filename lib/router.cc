@@ -83,7 +83,10 @@ Router::Router(const String &configuration, Master *master)
       _configuration(configuration),
       _notifier_signals(0),
       _arena_factory(new HashMap_ArenaFactory),
-      _hotswap_router(0), _thread_sched(0), _name_info(0), _next_router(0)
+      _hotswap_router(0), _thread_sched(0), _name_info(0), _next_router(0),
+      _cpu_share(0), _cpu_share_first(0), _cpu_share_last(-1),
+      _soft_quota(0), _hard_quota(0), _quota_scale(1000), _quota_credit(0),
+      _quota_throttled(false)
 {
     _refcount = 0;
     _runcount = 0;
@@ -122,6 +125,10 @@ Router::~Router()
             _elements[i]->cleanup(Element::CLEANUP_NO_ROUTER);
     }
 
+#if HAVE_ELEMENT_PROFILER
+    ElementProfiler::forget(this);
+#endif
+
     // Delete elements in reverse configuration order
     if (_element_configure_order.size())
         for (int ord = _elements.size() - 1; ord >= 0; ord--)
@@ -846,6 +853,35 @@ Router::adjust_runcount(int32_t delta)
         _master->request_stop();
 }
 
+#if HAVE_MULTITHREAD
+/** @brief  Return the CPU usage of the router's tasks in cycles per second.
+ *  @param  window  statistics window
+ *  @param  per_thread  if nonnull, each thread's part is added to the
+ *  element indexed by its thread ID
+ *
+ *  Usage is estimated from the statistics the tasks' home threads published
+ *  in @a window: the runs since the previous publication times the average
+ *  cycles per run, over one window's time.  Each run is counted in exactly
+ *  one window, so summing usage over windows gives total usage even for
+ *  tasks that do not run every window. */
+double
+Router::cpu_usage(unsigned window, Vector<double> *per_thread) const
+{
+    double usage = 0;
+    for (int i = 0; i < _tasks.size(); ++i) {
+        Task::Stats s;
+        if (!_tasks[i]->stats(window, s))
+            continue;
+        double u = (double) s.cycles * s.runs * 1000 / Task::STATS_WINDOW_MSEC;
+        usage += u;
+        int t = _tasks[i]->home_thread_id();
+        if (per_thread && t >= 0 && t < per_thread->size())
+            (*per_thread)[t] += u;
+    }
+    return usage;
+}
+#endif
+
 
 // FLOWS
 
@@ -1256,6 +1292,16 @@ Router::activate(bool foreground, ErrorHandler *errh)
         }
     }
     if (_hotswap_router) {
+        // Take over the old router's name, so readers of the router map,
+        // such as MetricsExporter's series cache, see the swap.
+        Master *m = master();
+        m->lock_write();
+        for (HashMap<String, Router *>::iterator it = m->_router_map.begin();
+             it.live(); it++)
+            if (it.value() == _hotswap_router)
+                it.value() = this;
+        m->_router_map_version++;
+        m->unlock_rw();
         _hotswap_router->unuse();
         _hotswap_router = 0;
     }
@@ -2436,6 +2482,9 @@ Router::static_initialize()
         add_read_handler(0, "element_cycles.csv", router_read_handler, (void *)GH_ELEMENT_CYCLES);
         add_read_handler(0, "class_cycles.csv", router_read_handler, (void *)GH_CLASS_CYCLES);
         add_write_handler(0, "reset_cycles", router_write_handler, (void *)GH_RESET_CYCLES);
+#endif
+#if HAVE_ELEMENT_PROFILER
+        ElementProfiler::static_initialize();
 #endif
     }
 }
@@ -2447,6 +2496,9 @@ Router::static_cleanup()
     globalh = 0;
     nglobalh = globalh_cap = 0;
     delete Handler::the_blank_handler;
+#if HAVE_ELEMENT_PROFILER
+    ElementProfiler::static_cleanup();
+#endif
 }
 
 
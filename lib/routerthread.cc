@@ -78,10 +78,15 @@ static unsigned long greedy_schedule_jiffies;
  */
 
 RouterThread::RouterThread(Master *master, int id)
-    : _stop_flag(false), _master(master), _id(id), _driver_entered(false)
+    : _stop_flag(false), _quiescent_epoch(0), _master(master), _id(id),
+      _driver_entered(false)
 {
     _pending_head.x = 0;
     _pending_tail = &_pending_head;
+#if HAVE_MULTITHREAD
+    _wake_head = 0;
+    _sleeping = 0;
+#endif
 
 #if !HAVE_TASK_HEAP
     _task_link._prev = _task_link._next = &_task_link;
@@ -113,6 +118,7 @@ RouterThread::RouterThread(Master *master, int id)
 
     _iters_per_os = 2;          // userlevel: iterations per select()
                                 // kernel: iterations per OS schedule()
+    _stats_window = 0;
 
 #if CLICK_LINUXMODULE || CLICK_BSDMODULE
     _greedy = false;
@@ -369,6 +375,11 @@ RouterThread::run_tasks(int ntasks)
 #if HAVE_MULTITHREAD
     // cycle counter for adaptive scheduling among processors
     click_cycles_t cycles = 0;
+# if HAVE_STRIDE_SCHED
+    // in cycle-budget mode, every run is measured and charged by its cycles
+    bool budget = _master->_budget_sched;
+    unsigned quantum = _master->_budget_quantum;
+# endif
 #endif
 
     Task::Status want_status;
@@ -397,24 +408,44 @@ RouterThread::run_tasks(int ntasks)
 
 #if HAVE_MULTITHREAD
         runs = t->cycle_runs();
-        if (runs > PROFILE_ELEMENT)
+        if (runs > PROFILE_ELEMENT) {
+# if HAVE_TASK_PROFILE
+            TaskProfile::begin();
+# endif
+            cycles = click_get_cycles();
+        }
+# if HAVE_STRIDE_SCHED
+        else if (budget)
             cycles = click_get_cycles();
+# endif
 #endif
 
         t->_status.is_scheduled = false;
         work_done = t->fire();
 
 #if HAVE_MULTITHREAD
+        unsigned delta = 0;
         if (runs > PROFILE_ELEMENT) {
-            unsigned delta = click_get_cycles() - cycles;
+            delta = click_get_cycles() - cycles;
             t->update_cycles(delta/32 + (t->cycles()*31)/32);
+# if HAVE_TASK_PROFILE
+            t->profile_run(delta, work_done);
+# endif
         }
+# if HAVE_STRIDE_SCHED
+        else if (budget)
+            delta = click_get_cycles() - cycles;
+# endif
+        if (unlikely(t->_stats_published != _stats_window))
+            t->publish_stats(_stats_window);
 #endif
 
         // fix task list
         if (t->scheduled()) {
             // adjust position in scheduled list
-#if HAVE_STRIDE_SCHED
+#if HAVE_STRIDE_SCHED && HAVE_MULTITHREAD
+            t->_pass += (budget ? t->budget_charge(delta, quantum) : t->_stride);
+#elif HAVE_STRIDE_SCHED
             t->_pass += t->_stride;
 #endif
 
@@ -487,6 +518,9 @@ RouterThread::run_os()
 
 #if CLICK_USERLEVEL
     select_set().run_selects(this);
+# if HAVE_MULTITHREAD
+    _sleeping = 0;
+# endif
 #elif CLICK_MINIOS
     /*
      * MiniOS uses a cooperative scheduler. By schedule() we'll give a chance
@@ -562,6 +596,253 @@ RouterThread::process_pending()
     }
 }
 
+#if HAVE_MULTITHREAD
+/* Reschedule the tasks other threads have woken since we last looked.
+ * Taking the whole list with one atomic operation batches the wakeups.
+ * Any thread may call this: Task::cleanup() does, to get a task off the
+ * list of a thread that is not running. */
+void
+RouterThread::process_wakes()
+{
+    Task *t;
+    do {
+        t = _wake_head;
+    } while (!__sync_bool_compare_and_swap(&_wake_head, t, (Task *) 0));
+    while (t) {
+        Task *next = t->_wake_next;
+        if (t->_status.home_thread_id >= 0)
+            t->reschedule();
+        // the task may be freed once its flag is clear
+        click_fence();
+        t->_wake_flag = 0;
+        t = next;
+    }
+}
+#endif
+
+#if HAVE_STRIDE_SCHED && HAVE_MULTITHREAD && CLICK_USERLEVEL
+static inline bool
+router_has_share(Router *r, int thread_id)
+{
+    return r->_cpu_share && thread_id >= r->_cpu_share_first
+        && (r->_cpu_share_last < 0 || thread_id <= r->_cpu_share_last);
+}
+
+static inline bool
+task_active(Task *t, int thread_id, unsigned window)
+{
+    Task::Stats s;
+    return t->home_thread_id() == thread_id && t->stats(window, s)
+        && s.rate > 0;
+}
+
+static double
+router_active_tickets(Router *r, int thread_id, unsigned window)
+{
+    double tickets = 0;
+    for (int i = 0; i < r->_tasks.size(); ++i)
+        if (task_active(r->_tasks[i], thread_id, window))
+            tickets += r->_tasks[i]->tickets();
+    return tickets;
+}
+
+/* Rescale the effective tickets of this thread's tasks for cycle-budget
+ * scheduling.  Only tasks that ran in the last statistics window count.
+ * Each router with a CPU share on this thread divides that share among its
+ * tasks in proportion to their tickets, and the routers without a share
+ * divide what is left in proportion to their tasks' tickets.  A router's
+ * soft-quota scale then applies on top.  With no shares or quotas,
+ * effective tickets equal tickets. */
+void
+RouterThread::update_budgets()
+{
+    unsigned window = _stats_window - 1;
+    Master *m = _master;
+    m->lock_read();
+
+    unsigned reserved = 0;
+    double total_tickets = 0, unshared_tickets = 0;
+    for (HashMap<String, Router*>::iterator it = m->_router_map.begin(); it.live(); it++) {
+        Router *r = it.value();
+        double tickets = router_active_tickets(r, _id, window);
+        total_tickets += tickets;
+        if (tickets && router_has_share(r, _id))
+            reserved += r->_cpu_share;
+        else
+            unshared_tickets += tickets;
+    }
+
+    // Overcommitted shares are scaled down, and routers without a share
+    // always keep at least 1% between them.
+    double scale = (reserved > 990 ? 990. / reserved : 1);
+    double rest = (reserved < 990 ? (1000 - reserved) / 1000. : 0.01);
+    for (HashMap<String, Router*>::iterator it = m->_router_map.begin(); it.live(); it++) {
+        Router *r = it.value();
+        double tickets = router_active_tickets(r, _id, window);
+        if (!tickets)
+            continue;
+        double share;
+        if (router_has_share(r, _id))
+            share = r->_cpu_share * scale / 1000;
+        else
+            share = rest * tickets / unshared_tickets;
+        for (int i = 0; i < r->_tasks.size(); ++i) {
+            Task *t = r->_tasks[i];
+            if (!task_active(t, _id, window))
+                continue;
+            double eff = share * t->tickets() / tickets * total_tickets
+                * r->_quota_scale / 1000;
+            if (eff < 1)
+                eff = 1;
+            t->_budget_stride = (unsigned) ((Task::STRIDE1 << Task::BUDGET_SHIFT) / eff);
+        }
+    }
+
+    m->unlock_rw();
+}
+
+/* Apply each router's soft-quota scale to the strides of this thread's
+ * tasks.  Strides are only written by a task's home thread, which is also
+ * the only thread that schedules it; tickets() is left alone.  Cycle-budget
+ * mode charges by _budget_stride instead, which update_budgets() scales. */
+void
+RouterThread::apply_quota_scales()
+{
+    Master *m = _master;
+    m->lock_read();
+    for (HashMap<String, Router*>::iterator it = m->_router_map.begin(); it.live(); it++) {
+        Router *r = it.value();
+        int scale = r->_quota_scale;
+        for (int i = 0; i < r->_tasks.size(); ++i) {
+            Task *t = r->_tasks[i];
+            if (t->home_thread_id() != _id)
+                continue;
+            int tickets = (int) ((int64_t) t->tickets() * scale / 1000);
+            t->_stride = Task::STRIDE1 / (tickets > 0 ? tickets : 1);
+        }
+    }
+    m->unlock_rw();
+}
+#endif
+
+// Throttling strong-unschedules the router's source tasks, those of
+// elements without inputs, so no new work enters the router; tasks
+// downstream drain what is already queued.  Releasing reschedules only
+// the tasks that throttling unscheduled, plus any that rescheduled
+// themselves meanwhile, such as one firing when throttling began; idle
+// sources stay idle.
+void
+RouterThread::throttle_router(Router *r, bool throttle)
+{
+    if (throttle)
+        r->_quota_throttled_tasks.clear();
+    for (int i = 0; i < r->_tasks.size(); ++i) {
+        Task *t = r->_tasks[i];
+        Element *e = t->element();
+        if (!e || e->ninputs())
+            continue;
+        if (throttle) {
+            if (t->scheduled())
+                r->_quota_throttled_tasks.push_back(t);
+            t->strong_unschedule();
+        } else if (t->scheduled())
+            t->strong_reschedule();
+        else
+            t->_status.is_strong_unscheduled = false;
+    }
+    if (!throttle) {
+        for (Task **tp = r->_quota_throttled_tasks.begin();
+             tp != r->_quota_throttled_tasks.end(); ++tp)
+            (*tp)->strong_reschedule();
+        r->_quota_throttled_tasks.clear();
+    }
+    r->_quota_throttled = throttle;
+    if (throttle)
+        Master::quota_throttled++;
+    else
+        Master::quota_throttled--;
+}
+
+#if HAVE_MULTITHREAD && CLICK_USERLEVEL
+/* Enforce router CPU quotas given the usage published for statistics
+ * window window.  Usage above a soft quota scales the router's task tickets
+ * down until usage fits, so the router yields to others when its threads
+ * are contended; as usage falls, tickets recover.  This only sets the
+ * router's scale; apply_quota_scales() and update_budgets() apply it on
+ * each task's home thread.  A hard quota is a
+ * budget of cycles that refills at the quota's rate and holds at most one
+ * window's worth; while it is overdrawn, the router's source tasks are
+ * throttled, whether or not the threads are contended. */
+void
+RouterThread::enforce_quotas(unsigned window)
+{
+    Master *m = _master;
+    double hz = m->cycles_hz();
+    if (hz <= 0)
+        return;
+    double window_cycles = hz * Task::STATS_WINDOW_MSEC / 1000;
+
+    m->lock_read();
+    for (HashMap<String, Router*>::iterator it = m->_router_map.begin(); it.live(); it++) {
+        Router *r = it.value();
+        if (!r->_soft_quota && !r->_hard_quota && r->_quota_scale == 1000
+            && !r->_quota_throttled)
+            continue;
+        double usage = r->cpu_usage(window) * 1000 / hz;
+
+#if HAVE_STRIDE_SCHED
+        int scale = r->_quota_scale;
+        if (r->_soft_quota && usage > r->_soft_quota)
+            scale = (int) (scale * r->_soft_quota / usage);
+        else if (!r->_soft_quota || usage < r->_soft_quota * 0.9)
+            scale += scale / 4 + 1;
+        scale = (scale < Router::MIN_QUOTA_SCALE ? Router::MIN_QUOTA_SCALE
+                 : (scale > 1000 ? 1000 : scale));
+        r->_quota_scale = scale;
+#endif
+
+        if (r->_hard_quota) {
+            double allowance = r->_hard_quota * window_cycles / 1000;
+            r->_quota_credit += allowance - usage * window_cycles / 1000;
+            if (r->_quota_credit > allowance)
+                r->_quota_credit = allowance;
+        } else
+            r->_quota_credit = 0;
+        bool throttle = r->_quota_credit < 0;
+        if (throttle != r->_quota_throttled)
+            throttle_router(r, throttle);
+    }
+    m->unlock_rw();
+}
+#endif
+
+// Parse quota keywords "SOFT PERCENT" and "HARD PERCENT" from words[i...];
+// percentages are of one thread.
+static bool
+parse_quotas(const Vector<String> &words, int i, Router *r)
+{
+    unsigned soft = r->_soft_quota, hard = r->_hard_quota;
+    for (; i < words.size(); i += 2) {
+        double percent;
+        if (i + 1 == words.size()
+            || !DoubleArg().parse(words[i + 1], percent)
+            || percent < 0 || percent > 100000)
+            return false;
+        unsigned permille = (unsigned) (percent * 10 + 0.5);
+        if (words[i].equals("SOFT", 4))
+            soft = permille;
+        else if (words[i].equals("HARD", 4))
+            hard = permille;
+        else
+            return false;
+    }
+    r->_soft_quota = soft;
+    r->_hard_quota = hard;
+    if (soft || hard)
+        r->master()->_quotas = true;
+    return true;
+}
+
 void
 RouterThread::cmd_driver() {
 
@@ -606,6 +887,8 @@ RouterThread::cmd_driver() {
             ret = randombalance(msg.arg);
         } else if(msg.cmd == "dividebalance") {
         	ret = dividebalance(msg.arg);
+        } else if(msg.cmd == "replicate") {
+            ret = replicate(msg.arg);
 		} else if(msg.cmd == "addthread") {
             ret = add_thread(msg.arg);
         } else if (msg.cmd == "global") {
@@ -620,11 +903,45 @@ RouterThread::cmd_driver() {
             ret = check_congestion(msg.arg);
         } else if (msg.cmd == "coco_reset") {    //add coco_reset
             ret = coco_reset(msg.arg);
+        } else if (msg.cmd == "budget") {
+            ret = budget(msg.arg);
+        } else if (msg.cmd == "share") {
+            ret = share(msg.arg);
+        } else if (msg.cmd == "quota") {
+            ret = quota(msg.arg);
         }
         master()->set_msg_status(msg.id, (ret==-1 ? -1 : 1));
     }
 }
 
+/* Start a new statistics window if one is due.  Window changes drive
+ * cycle-budget rescaling and CPU quota enforcement. */
+inline void
+RouterThread::check_stats_window()
+{
+    unsigned window = Task::stats_window();
+    if (window == _stats_window)
+        return;
+    _stats_window = window;
+    _master->_stats_tick = window;
+#if HAVE_STRIDE_SCHED && HAVE_MULTITHREAD && CLICK_USERLEVEL
+    if (_master->_budget_sched)
+        update_budgets();
+#endif
+#if HAVE_MULTITHREAD && CLICK_USERLEVEL
+    if (_master->_quotas) {
+        uint32_t last = _master->_quota_window;
+        if (last != window
+            && _master->_quota_window.compare_swap(last, window) == last)
+            enforce_quotas(window - 1);
+# if HAVE_STRIDE_SCHED
+        if (!_master->_budget_sched)
+            apply_quota_scales();
+# endif
+    }
+#endif
+}
+
 void
 RouterThread::driver()
 {
@@ -665,6 +982,7 @@ RouterThread::driver()
 #if CLICK_DEBUG_SCHEDULING
         _driver_epoch++;
 #endif
+        _quiescent_epoch = _quiescent_epoch + 1;
 
 #if !BSD_NETISRSCHED
         // check to see if driver is stopped
@@ -679,6 +997,10 @@ RouterThread::driver()
         click_compiler_fence();
         if (_pending_head.x)
             process_pending();
+#if HAVE_MULTITHREAD
+        if (_wake_head)
+            process_wakes();
+#endif
 
         // run tasks
         do {
@@ -704,6 +1026,7 @@ RouterThread::driver()
                 break;
             _oticks = ticks;
 #endif
+            check_stats_window();
             timer_set().run_timers(this, _master);
         } while (0);
 
@@ -719,6 +1042,12 @@ RouterThread::driver()
             break;
 #endif
             run_os();
+#if HAVE_MULTITHREAD && CLICK_USERLEVEL
+            // an idle thread wakes each window while routers are throttled,
+            // which may be less often than the timer stride allows for
+            if (Master::quota_throttled)
+                check_stats_window();
+#endif
         } while (0);
 
 #if CLICK_NS || BSD_NETISRSCHED
@@ -839,14 +1168,22 @@ RouterThread::thread_state_name(int ts)
 #endif
 
 int
-RouterThread::add_nf(String config_file) {
-    config_file.trim_space();
+RouterThread::add_nf(String sth) {
+    // addnf FILE [SOFT PERCENT] [HARD PERCENT]
+    Vector<String> words;
+    cp_spacevec(sth, words);
+    if (!words.size())
+        return -1;
+    String config_file = words[0];
     Router* router = click_read_router(config_file, false, NULL, false, master());
-    router->initialize(ErrorHandler::silent_handler());
+    if (!parse_quotas(words, 1, router))
+        click_chatter("addnf %s: bad quota, ignored", config_file.c_str());
+    router->initialize(ErrorHandler::default_handler());
     String router_name = router->router_info()->router_name();    
     router->activate(ErrorHandler::default_handler());
     master()->lock_write();
     master()->_router_map.insert(router_name, router);
+    master()->_router_map_version++;
     master()->unlock_rw();
     printf("router %s activated\n", router->router_info()->router_name().mutable_c_str());
     printf("number of tasks: %d\n", router->_tasks.size());
@@ -860,6 +1197,13 @@ RouterThread::delete_nf(String router_name) {
         return -1;
     }
 
+    // stop quota enforcement, which could leave source tasks throttled
+    master()->lock_write();
+    router->_soft_quota = router->_hard_quota = 0;
+    if (router->_quota_throttled)
+        throttle_router(router, false);
+    master()->unlock_rw();
+
     driver_lock_tasks();
 
     // move tasks
@@ -903,6 +1247,7 @@ RouterThread::delete_nf(String router_name) {
 
     m->lock_write();
     m->_router_map.remove(router_name);
+    m->_router_map_version++;
     m->unlock_rw();
     printf("delete router %s\n", router_name.mutable_data());
 
@@ -1021,16 +1366,21 @@ RouterThread::balance(String nullstr) {
     Vector<int> rates;
     Vector<double> oldTaskLoads;
     Vector<double> oldCpuLoads(cpuNum+1, 0);
+    // use every task's statistics from the same complete window
+    unsigned window = Task::stats_window() - 1;
     for(HashMap<String, Router*>::iterator it = master()->_router_map.begin(); it.live(); it++) {
         Vector<Task*>& ts = it.value()->_tasks;
         for(int i=0; i<ts.size(); i++) {
+            Task::Stats s;
+            if (!ts[i]->stats(window, s))
+                s.cycles = s.rate = 0;
             tasks.push_back(ts[i]);
-            cycles.push_back(ts[i]->cycles());
-            rates.push_back(ts[i]->rates());
-            oldTaskLoads.push_back((double)cycles[i] * (double)rates[i]);
+            cycles.push_back(s.cycles);
+            rates.push_back(s.rate);
+            oldTaskLoads.push_back((double)cycles.back() * (double)rates.back());
             int tid = ts[i]->home_thread_id();
-            oldCpuLoads[tid] += oldTaskLoads[i];
-            ts[i]->_task_load = oldTaskLoads[i];
+            oldCpuLoads[tid] += oldTaskLoads.back();
+            ts[i]->_task_load = oldTaskLoads.back();
         }
     }
     for(int i=0; i<tasks.size(); ++i) {
@@ -1417,6 +1767,76 @@ RouterThread::newbalance(String sth) {
    return 0;
 }
 
+int
+RouterThread::replicate(String sth) {
+    int startThread = 1;
+    IntArg().parse(sth, startThread);
+
+    // Instead of moving tasks, activate another replica of each FlowDispatch
+    // stage whose heaviest replica exceeds the average thread load, placing
+    // the new replica on the least-loaded thread.
+    int cpuNum = master()->run_nthreads();
+    int validCpuNum = cpuNum - startThread + 1;
+    Vector<double> cpuLoads(cpuNum+1, 0);
+    Vector<Element*> dispatchers;
+    double totalCpuLoad = 0;
+    String sysRouter("sys");
+    std::cout << "======================== replicate ========================" << std::endl;
+    unsigned window = Task::stats_window() - 1;
+    for(HashMap<String, Router*>::iterator it = master()->_router_map.begin(); it.live(); it++) {
+        if(it.key().equals(sysRouter)) continue;
+        Router* r = it.value();
+        for(int i=0; i<r->_tasks.size(); i++) {
+            Task* t = r->_tasks[i];
+            int tid = t->home_thread_id();
+            Task::Stats s;
+            double load = t->stats(window, s) ? (double) s.cycles * s.rate : 0;
+            if(tid >= startThread && tid <= cpuNum)
+                cpuLoads[tid] += load;
+            totalCpuLoad += load;
+        }
+        for(int i=0; i<r->nelements(); i++) {
+            if(r->element(i)->cast("FlowDispatch"))
+                dispatchers.push_back(r->element(i));
+        }
+    }
+    if(validCpuNum <= 0)
+        return -1;
+    double avgCpuLoad = totalCpuLoad / validCpuNum;
+
+    int ret = 0;
+    ErrorHandler* errh = ErrorHandler::default_handler();
+    for(int i=0; i<dispatchers.size(); i++) {
+        Element* e = dispatchers[i];
+        double load = 0;
+        const Handler* lh = Router::handler(e, "replica_load");
+        const Handler* rh = Router::handler(e, "replicate");
+        if(!lh || !rh || !DoubleArg().parse(lh->call_read(e), load))
+            continue;
+        int active = 0;
+        IntArg().parse(Router::handler(e, "active")->call_read(e), active);
+        if(load <= avgCpuLoad || active >= e->noutputs())
+            continue;
+        int id = startThread;
+        for(int j=startThread; j<=cpuNum; j++) {
+            if(cpuLoads[j] < cpuLoads[id]) {
+                id = j;
+            }
+        }
+        std::cout << e->router()->router_name().c_str() << " "
+                  << e->name().c_str() << ": replica " << active << " (load "
+                  << load << ", average " << avgCpuLoad << ") to thread " << id << std::endl;
+        if(rh->call_write(String(id), e, errh) < 0) {
+            ret = -1;
+            continue;
+        }
+        // The new replica takes over part of the stage's flows.
+        cpuLoads[id] += load / (active + 1);
+    }
+
+    return ret;
+}
+
 void
 RouterThread::subbalance(const Vector<Task*>& tasks, const Vector<double>& rates, const Vector<int>& cycles, int start, int end) {
     int cpuNum = end;
@@ -1619,6 +2039,79 @@ RouterThread::dividebalance(String sth) {
 	return 0;
 }
 
+int
+RouterThread::budget(String sth) {
+    // budget on [QUANTUM] | off
+    Vector<String> words;
+    cp_spacevec(sth, words);
+    unsigned quantum = Master::DEFAULT_BUDGET_QUANTUM;
+    if (words.size() < 1 || words.size() > 2
+        || (words[0] != "on" && words[0] != "off")
+        || (words.size() == 2 && (!IntArg().parse(words[1], quantum) || !quantum)))
+        return -1;
+    bool on = (words[0] == "on");
+
+    master()->_budget_quantum = quantum;
+    click_fence();
+    master()->_budget_sched = on;
+    std::cout << "budget scheduling " << (on ? "on" : "off")
+              << ", quantum " << quantum << " cycles" << std::endl;
+    return 0;
+}
+
+int
+RouterThread::share(String sth) {
+    // share ROUTER PERCENT [FIRST[-LAST]]
+    Vector<String> words;
+    cp_spacevec(sth, words);
+    double percent = 0;
+    int first = 0, last = -1;
+    Router* r = (words.size() ? master()->get_router(words[0]) : 0);
+    if (!r || words.size() < 2 || words.size() > 3
+        || !DoubleArg().parse(words[1], percent)
+        || percent < 0 || percent > 100)
+        return -1;
+    if (words.size() == 3) {
+        const String& range = words[2];
+        const char *dash = find(range, '-');
+        if (!IntArg().parse(range.substring(range.begin(), dash), first))
+            return -1;
+        if (dash == range.end())
+            last = first;
+        else if (!IntArg().parse(range.substring(dash + 1, range.end()), last)
+                 || last < first)
+            return -1;
+    }
+
+    r->_cpu_share_first = first;
+    r->_cpu_share_last = last;
+    r->_cpu_share = (unsigned) (percent * 10 + 0.5);
+    std::cout << "share " << words[0].c_str() << ": " << percent << "% of ";
+    if (words.size() == 3)
+        std::cout << "threads " << first << "-" << last << std::endl;
+    else
+        std::cout << "all threads" << std::endl;
+    return 0;
+}
+
+int
+RouterThread::quota(String sth) {
+    // quota ROUTER [SOFT PERCENT] [HARD PERCENT] | quota ROUTER off
+    Vector<String> words;
+    cp_spacevec(sth, words);
+    Router* r = (words.size() ? master()->get_router(words[0]) : 0);
+    if (!r || words.size() < 2)
+        return -1;
+    if (words.size() == 2 && words[1] == "off")
+        r->_soft_quota = r->_hard_quota = 0;
+    else if (!parse_quotas(words, 1, r))
+        return -1;
+    printf("quota %s: soft %u.%u%%, hard %u.%u%%\n", words[0].c_str(),
+           r->_soft_quota / 10, r->_soft_quota % 10,
+           r->_hard_quota / 10, r->_hard_quota % 10);
+    return 0;
+}
+
 int
 RouterThread::add_thread(String nstr) {
     int num = 0;
@@ -25,6 +25,9 @@
 #include <click/router.hh>
 #include <click/routerthread.hh>
 #include <click/master.hh>
+#if HAVE_TASK_PROFILE
+# include <math.h>
+#endif
 CLICK_DECLS
 
 /** @file task.hh
@@ -323,7 +326,20 @@ Task::cleanup()
         // for that thread to notice. If on this thread, we must remove it
         // ourselves.
 
-        while (needs_cleanup()) {
+        while (needs_cleanup()
+#if HAVE_MULTITHREAD
+               || _wake_flag
+#endif
+               ) {
+#if HAVE_MULTITHREAD
+            // Task must not be on a wake list.  Taking the list ourselves
+            // is safe even if its thread is running.
+            if (_wake_flag) {
+                _wake_thread->process_wakes();
+                click_relax_fence();
+                continue;
+            }
+#endif
             RouterThread* thread = _thread;
             if (!thread->current_thread_is_running_cleanup()) {
                 click_relax_fence();
@@ -411,4 +427,127 @@ Task::process_pending(RouterThread* thread)
         _pending_nextptr.x = 0;
 }
 
+#if HAVE_TASK_PROFILE
+__thread bool TaskProfile::_active;
+__thread click_cycles_t TaskProfile::_pull_cycles;
+__thread click_cycles_t TaskProfile::_push_cycles;
+__thread unsigned TaskProfile::_pulls;
+__thread unsigned TaskProfile::_pushes;
+
+/** @brief Return the standard deviation of per-packet service cycles. */
+double
+Task::ProfileSummary::stddev() const
+{
+    return packets ? sqrt(m2 / packets) : 0;
+}
+
+/** @brief Return the half-width of a 95% confidence interval for the mean
+ * per-packet service cycles.
+ *
+ * Each busy run contributes one sample, so the interval narrows with the
+ * number of busy runs rather than the number of packets. */
+double
+Task::ProfileSummary::ci95() const
+{
+    uint64_t n = busy_runs();
+    return n > 1 ? 1.96 * stddev() / sqrt((double) n) : 0;
+}
+
+/** @brief Add the runs summarized in @a x to this summary. */
+void
+Task::ProfileSummary::merge(const ProfileSummary &x)
+{
+    if (x.packets) {
+        double n = packets + x.packets;
+        double delta = x.mean - mean;
+        m2 += x.m2 + delta * delta * packets * x.packets / n;
+        mean += delta * x.packets / n;
+    }
+    runs += x.runs;
+    idle_runs += x.idle_runs;
+    packets += x.packets;
+    idle_cycles += x.idle_cycles;
+    pull_cycles += x.pull_cycles;
+    push_cycles += x.push_cycles;
+    service_cycles += x.service_cycles;
+}
+
+/** @brief Account a profiled run of this task.
+ * @param cycles cycles spent in the run
+ * @param work_done the task's return value
+ *
+ * Called by the home thread after a run started with TaskProfile::begin().
+ * The run handled as many packets as it pulled from queues, or if it pulled
+ * none, as many as it pushed to queues; a task that touches no queues but
+ * reports work handled one.  The run's service time is its cycles less the
+ * cycles its queues reported. */
+void
+Task::profile_run(click_cycles_t cycles, bool work_done)
+{
+    TaskProfile::_active = false;
+    ProfileSummary &p = _profile_period;
+    unsigned packets = TaskProfile::_pulls;
+    if (!packets)
+        packets = TaskProfile::_pushes;
+    if (!packets && work_done)
+        packets = 1;
+
+    ++p.runs;
+    if (!packets) {
+        ++p.idle_runs;
+        p.idle_cycles += cycles;
+        return;
+    }
+
+    click_cycles_t queue = TaskProfile::_pull_cycles + TaskProfile::_push_cycles;
+    double service = cycles > queue ? cycles - queue : 0;
+    p.pull_cycles += TaskProfile::_pull_cycles;
+    p.push_cycles += TaskProfile::_push_cycles;
+    p.service_cycles += service;
+
+    // weighted Welford update; each packet of the run gets the run's mean
+    double x = service / packets;
+    double delta = x - p.mean;
+    p.packets += packets;
+    p.mean += delta * packets / p.packets;
+    p.m2 += packets * delta * (x - p.mean);
+}
+
+void
+Task::roll_profile(unsigned window)
+{
+    enum { MIN_RUNS = 10 };
+    _profile_start = window;
+    ProfileSummary &p = _profile_period, &b = _profile_baseline;
+    if (!p.runs)
+        return;
+
+    // The period drifted if its mean service time differs from the
+    // baseline's by more than four standard errors and by more than 5%.
+    bool drifted = false;
+    uint64_t pn = p.busy_runs(), bn = b.busy_runs();
+    if (pn >= MIN_RUNS && bn >= MIN_RUNS) {
+        double ps = p.stddev(), bs = b.stddev();
+        double se = sqrt(ps * ps / pn + bs * bs / bn);
+        double delta = fabs(p.mean - b.mean);
+        drifted = delta > 4 * se && delta > b.mean / 20;
+    }
+    if (drifted) {
+        b = p;
+        ++_profile_drifts;
+    } else
+        b.merge(p);
+    ++_profile_periods;
+
+    Profile x;
+    x.period = p;
+    x.baseline = b;
+    x.periods = _profile_periods;
+    x.drifts = _profile_drifts;
+    x.drifted = drifted;
+    _profile.publish(x);
+    memset(&p, 0, sizeof(p));
+}
+#endif
+
 CLICK_ENDDECLS
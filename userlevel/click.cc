@@ -59,6 +59,7 @@
 #include <click/handlercall.hh>
 #include "elements/standard/quitwatcher.hh"
 #include "elements/userlevel/controlsocket.hh"
+#include "elements/userlevel/metricsexporter.hh"
 #include "elements/local/routerbox.hh"
 #include "elements/threads/staticthreadsched.hh"
 CLICK_USING_DECLS
@@ -83,6 +84,7 @@ CLICK_USING_DECLS
 #define SOCKET_OPT              318
 #define THREADS_AFF_OPT         319
 #define DPDK_OPT                320
+#define METRICS_PORT_OPT        321
 
 static const Clp_Option options[] = {
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
@@ -92,6 +94,7 @@ static const Clp_Option options[] = {
     { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
     { "handler", 'h', HANDLER_OPT, Clp_ValString, 0 },
     { "help", 0, HELP_OPT, 0, 0 },
+    { "metrics-port", 0, METRICS_PORT_OPT, Clp_ValString, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
     { "socket", 0, SOCKET_OPT, Clp_ValInt, 0 },
     { "port", 'p', PORT_OPT, Clp_ValString, 0 },
@@ -145,6 +148,7 @@ Options:\n\
   -p, --port PORT               Listen for control connections on TCP port.\n\
   -u, --unix-socket FILE        Listen for control connections on Unix socket.\n\
       --socket FD               Add a file descriptor control connection.\n\
+      --metrics-port PORT       Serve OpenMetrics statistics on TCP port.\n\
   -R, --allow-reconfigure       Provide a writable 'hotconfig' handler.\n\
   -h, --handler ELEMENT.H       Call ELEMENT's read handler H after running\n\
                                 driver and print result to standard output.\n\
@@ -297,6 +301,7 @@ hotswap_hook(Task*, void*)
 static Vector<String> cs_unix_sockets;
 static Vector<String> cs_ports;
 static Vector<String> cs_sockets;
+static String metrics_port;
 static bool warnings = true;
 int click_nthreads = 1;
 bool dpdk_enabled = false;
@@ -325,7 +330,13 @@ create_control_router(ErrorHandler* errh) {
     for (String *it = cs_ports.begin(); it != cs_ports.end(); ++it, ++ncs)
         router->add_element(new ControlSocket, "cs", "TCP, " + *it, "click", 0);
 
-    router->add_element(new StaticThreadSched(), "sts", "rb 0, cs 0", "click", 0);
+    String sched = "rb 0, cs 0";
+    if (metrics_port) {
+        router->add_element(new MetricsExporter, "metrics", metrics_port, "click", 0);
+        sched += ", metrics 0";
+    }
+
+    router->add_element(new StaticThreadSched(), "sts", sched, "click", 0);
 
     // catch control-C and SIGTERM
     click_signal(SIGINT, stop_signal_handler, true);
@@ -334,6 +345,7 @@ create_control_router(ErrorHandler* errh) {
     click_signal(SIGPIPE, SIG_IGN, false);
 
     click_master->_router_map.insert("sys", router);
+    click_master->_router_map_version++;
 
   if (errh->nerrors() == before_errors
       && router->initialize(errh) >= 0)
@@ -425,6 +437,16 @@ main(int argc, char **argv)
       break;
   }
 
+  case METRICS_PORT_OPT: {
+      uint16_t portno;
+      if (!IPPortArg(IP_PROTO_TCP).parse(clp->vstr, portno)) {
+          Clp_OptionError(clp, "%<%O%> expects a TCP port number, not %<%s%>", clp->vstr);
+          goto bad_option;
+      }
+      metrics_port = String(portno);
+      break;
+  }
+
      case UNIX_SOCKET_OPT:
       cs_unix_sockets.push_back(clp->vstr);
       break;